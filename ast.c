@@ -1,8 +1,11 @@
 #include "ast.h"
+#include "automaton.h"
 #include "common.h"
+#include "utf8.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 void add_child(ast_t *ast, ast_t child) {
   ast_child_list_t *list = malloc(sizeof(ast_child_list_t));
@@ -30,11 +33,13 @@ void print_ast_indented(ast_t *ast, int indent, FILE *fout) {
     fprintf(fout, "AND\n");
     print_ast_children(ast, indent, fout);
     break;
-  case CHAR:
+  case CHAR: {
+    char buffer[CHAR_BUFFER_SIZE];
     fprintf(fout, "CHAR\n");
     fprint_indent(indent + 1, fout);
-    fprintf(fout, "%s\n", print_char(ast->terminal));
+    fprintf(fout, "%s\n", sprint_char(ast->terminal, buffer));
     break;
+  }
   case INV_CLASS:
     fprintf(fout, "INV_");
   case CLASS:
@@ -42,7 +47,21 @@ void print_ast_indented(ast_t *ast, int indent, FILE *fout) {
     fprint_indent(indent + 1, fout);
     for (int i = 0; i < 256; i++) {
       if (ast->terminals[i]) {
-        fprintf(fout, "%s ", print_char(i));
+        char buffer[CHAR_BUFFER_SIZE];
+        fprintf(fout, "%s ", sprint_char(i, buffer));
+      }
+    }
+    fprintf(fout, "\n");
+    break;
+  case UTF8_CLASS:
+    fprintf(fout, "UTF8_CLASS\n");
+    fprint_indent(indent + 1, fout);
+    for (int i = 0; i < ast->codepoints->range_count; i++) {
+      codepoint_range_t *range = &ast->codepoints->ranges[i];
+      if (range->first == range->last) {
+        fprintf(fout, "U+%04X ", range->first);
+      } else {
+        fprintf(fout, "U+%04X-U+%04X ", range->first, range->last);
       }
     }
     fprintf(fout, "\n");
@@ -59,6 +78,26 @@ void print_ast_indented(ast_t *ast, int indent, FILE *fout) {
     fprintf(fout, "OPT\n");
     print_ast_children(ast, indent, fout);
     break;
+  case REPEAT_MODIFIER:
+    if (ast->repeat_max == -1) {
+      fprintf(fout, "REPEAT {%d,}\n", ast->repeat_min);
+    } else {
+      fprintf(fout, "REPEAT {%d,%d}\n", ast->repeat_min, ast->repeat_max);
+    }
+    print_ast_children(ast, indent, fout);
+    break;
+  case INTERSECTION_EXPR:
+    fprintf(fout, "INTERSECTION\n");
+    print_ast_children(ast, indent, fout);
+    break;
+  case COMPLEMENT_EXPR:
+    fprintf(fout, "COMPLEMENT\n");
+    print_ast_children(ast, indent, fout);
+    break;
+  case CAPTURE_GROUP:
+    fprintf(fout, "CAPTURE %s\n", ast->capture_name);
+    print_ast_children(ast, indent, fout);
+    break;
   case WILDCARD:
     fprintf(fout, "WILDCARD\n");
     break;
@@ -76,6 +115,340 @@ void print_ast_indented(ast_t *ast, int indent, FILE *fout) {
 
 void print_ast(ast_t *ast, FILE *fout) { print_ast_indented(ast, 0, fout); }
 
+void print_regex_char(int c, FILE *fout) {
+  switch (c) {
+  case '[':
+  case ']':
+  case '(':
+  case ')':
+  case '{':
+  case '}':
+  case '.':
+  case '-':
+  case '^':
+  case '|':
+  case '*':
+  case '+':
+  case '?':
+  case '&':
+  case '~':
+  case '\\':
+    fprintf(fout, "\\%c", c);
+    return;
+  case 0:
+  case 9:
+  case 10:
+  case 13:
+  case 32: {
+    // These have the same escape codes in regex syntax
+    char buffer[CHAR_BUFFER_SIZE];
+    fprintf(fout, "%s", sprint_char(c, buffer));
+    return;
+  }
+  }
+  if (c >= 0x21 && c <= 0x7e) {
+    fprintf(fout, "%c", c);
+  } else {
+    fprintf(fout, "\\x%02x", c);
+  }
+}
+
+void print_regex_class(ast_t *ast, FILE *fout) {
+  fprintf(fout, ast->type == INV_CLASS ? "[^" : "[");
+  for (int c = 0; c < 256; c++) {
+    if (!ast->terminals[c]) {
+      continue;
+    }
+    int first = c;
+    while (c + 1 < 256 && ast->terminals[c + 1]) {
+      c++;
+    }
+    print_regex_char(first, fout);
+    if (c > first) {
+      fprintf(fout, "-");
+      print_regex_char(c, fout);
+    }
+  }
+  fprintf(fout, "]");
+}
+
+/**
+ * Prints the given {@code codepoint} of a UTF-8 class. ASCII chars are
+ * printed like in byte classes, unless {@code escape_ascii} is set.
+ */
+void print_regex_codepoint(int codepoint, bool_t escape_ascii, FILE *fout) {
+  if (codepoint < 0x80 && !escape_ascii) {
+    print_regex_char(codepoint, fout);
+  } else {
+    fprintf(fout, "\\u{%x}", codepoint);
+  }
+}
+
+void print_regex_utf8_class(ast_t *ast, FILE *fout) {
+  codepoint_set_t *set = ast->codepoints;
+  if (set->range_count == 0) {
+    fprintf(fout, "[^\\u{0}-\\u{%x}]", MAX_CODEPOINT);
+    return;
+  }
+  // A class of only ASCII chars needs an escape, which keeps it a UTF-8 class
+  bool_t escape_ascii = set->ranges[set->range_count - 1].last < 0x80;
+  fprintf(fout, "[");
+  for (int i = 0; i < set->range_count; i++) {
+    print_regex_codepoint(set->ranges[i].first, escape_ascii, fout);
+    if (set->ranges[i].last > set->ranges[i].first) {
+      fprintf(fout, "-");
+      print_regex_codepoint(set->ranges[i].last, escape_ascii, fout);
+    }
+  }
+  fprintf(fout, "]");
+}
+
+ast_t **get_children_in_order(ast_t *ast, int *count) {
+  *count = 0;
+  for (ast_child_list_t *list = ast->children; list != NULL;
+       list = list->next) {
+    (*count)++;
+  }
+  ast_t **children = malloc(*count * sizeof(ast_t *));
+  int i = *count;
+  for (ast_child_list_t *list = ast->children; list != NULL;
+       list = list->next) {
+    children[--i] = &list->child;
+  }
+  return children;
+}
+
+int get_repeat_copies(ast_t *ast) {
+  if (ast->repeat_max != -1) {
+    return ast->repeat_max;
+  }
+  return ast->repeat_min > 0 ? ast->repeat_min : 1;
+}
+
+size_t get_expanded_terminal_count(ast_t *ast) {
+  ast = resolve_references(ast);
+  switch (ast->type) {
+  case CHAR:
+  case CLASS:
+  case INV_CLASS:
+  case WILDCARD:
+  case UTF8_CLASS:
+    return 1;
+  case REPEAT_MODIFIER: {
+    size_t count = get_expanded_terminal_count(&ast->children->child);
+    return multiply_sizes(get_repeat_copies(ast), count > 0 ? count : 1);
+  }
+  default: {
+    size_t count = 0;
+    for (ast_child_list_t *list = ast->children; list != NULL;
+         list = list->next) {
+      count = add_sizes(count, get_expanded_terminal_count(&list->child));
+    }
+    return count;
+  }
+  }
+}
+
+bool_t ast_has_captures(ast_t *ast) {
+  ast = resolve_references(ast);
+  switch (ast->type) {
+  case CAPTURE_GROUP:
+    return 1;
+  case OR_EXPR:
+  case AND_EXPR:
+  case STAR_MODIFIER:
+  case PLUS_MODIFIER:
+  case OPT_MODIFIER:
+  case REPEAT_MODIFIER:
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
+    for (ast_child_list_t *list = ast->children; list != NULL;
+         list = list->next) {
+      if (ast_has_captures(&list->child)) {
+        return 1;
+      }
+    }
+    return 0;
+  default:
+    return 0;
+  }
+}
+
+ast_t *resolve_references(ast_t *ast) {
+  while (ast->type == REFERENCE) {
+    ast = ast->reference;
+  }
+  return ast;
+}
+
+unsigned long hash_ast(ast_t *ast, unsigned long seed) {
+  ast = resolve_references(ast);
+  unsigned long hash = hash_bytes(&ast->type, sizeof(ast_type_t), seed);
+  switch (ast->type) {
+  case CHAR:
+    return hash_bytes(&ast->terminal, 1, hash);
+  case CLASS:
+  case INV_CLASS:
+    return hash_bytes(ast->terminals, 256, hash);
+  case UTF8_CLASS:
+    return hash_bytes(ast->codepoints->ranges,
+                      ast->codepoints->range_count * sizeof(codepoint_range_t),
+                      hash);
+  case CAPTURE_GROUP:
+    hash = hash_bytes(ast->capture_name, strlen(ast->capture_name), hash);
+    return hash_ast(&ast->children->child, hash);
+  case REPEAT_MODIFIER:
+    hash = hash_bytes(&ast->repeat_min, sizeof(int), hash);
+    hash = hash_bytes(&ast->repeat_max, sizeof(int), hash);
+  case OR_EXPR:
+  case AND_EXPR:
+  case STAR_MODIFIER:
+  case PLUS_MODIFIER:
+  case OPT_MODIFIER:
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
+    for (ast_child_list_t *list = ast->children; list != NULL;
+         list = list->next) {
+      hash = hash_ast(&list->child, hash);
+    }
+    // Mark the end of the children, so nested expressions hash differently
+    return hash_bytes(&ast->type, sizeof(ast_type_t), hash);
+  case WILDCARD:
+  case REFERENCE:
+    break;
+  }
+  return hash;
+}
+
+/**
+ * Returns how strongly expressions of the given {@code type} bind in regex
+ * syntax, from or-expressions (lowest) to singles (highest).
+ */
+int regex_precedence(ast_type_t type) {
+  switch (type) {
+  case OR_EXPR:
+    return 0;
+  case INTERSECTION_EXPR:
+    return 1;
+  case COMPLEMENT_EXPR:
+    return 2;
+  case AND_EXPR:
+    return 3;
+  case STAR_MODIFIER:
+  case PLUS_MODIFIER:
+  case OPT_MODIFIER:
+  case REPEAT_MODIFIER:
+    return 4;
+  default:
+    return 5;
+  }
+}
+
+/**
+ * Returns whether a child of the given {@code type} must be put into
+ * parentheses, when it is a child of an expression of the type {@code
+ * parent}.
+ */
+bool_t regex_child_needs_parentheses(ast_type_t parent, ast_type_t type) {
+  switch (parent) {
+  case OR_EXPR:
+    return 0;
+  case STAR_MODIFIER:
+  case PLUS_MODIFIER:
+  case OPT_MODIFIER:
+  case REPEAT_MODIFIER:
+    // Modifiers only apply to singles
+    return regex_precedence(type) <= regex_precedence(parent);
+  default:
+    return regex_precedence(type) < regex_precedence(parent);
+  }
+}
+
+/**
+ * Prints the children of the given {@code ast} in source order (they are
+ * stored in reverse), separated by {@code separator}.
+ */
+void print_regex_children(ast_t *ast, char *separator, FILE *fout) {
+  int count;
+  ast_t **children = get_children_in_order(ast, &count);
+  for (int i = 0; i < count; i++) {
+    ast_t *child = resolve_references(children[i]);
+    if (i > 0) {
+      fprintf(fout, "%s", separator);
+    }
+    if (regex_child_needs_parentheses(ast->type, child->type)) {
+      fprintf(fout, "(");
+      print_ast_regex(child, fout);
+      fprintf(fout, ")");
+    } else {
+      print_ast_regex(child, fout);
+    }
+  }
+  free(children);
+}
+
+void print_ast_regex(ast_t *ast, FILE *fout) {
+  ast = resolve_references(ast);
+  switch (ast->type) {
+  case OR_EXPR:
+    print_regex_children(ast, "|", fout);
+    break;
+  case AND_EXPR:
+    print_regex_children(ast, "", fout);
+    break;
+  case INTERSECTION_EXPR:
+    print_regex_children(ast, "&", fout);
+    break;
+  case COMPLEMENT_EXPR:
+    fprintf(fout, "~");
+    print_regex_children(ast, "", fout);
+    break;
+  case CHAR:
+    print_regex_char(ast->terminal, fout);
+    break;
+  case CLASS:
+  case INV_CLASS:
+    print_regex_class(ast, fout);
+    break;
+  case UTF8_CLASS:
+    print_regex_utf8_class(ast, fout);
+    break;
+  case STAR_MODIFIER:
+    print_regex_children(ast, "", fout);
+    fprintf(fout, "*");
+    break;
+  case PLUS_MODIFIER:
+    print_regex_children(ast, "", fout);
+    fprintf(fout, "+");
+    break;
+  case OPT_MODIFIER:
+    print_regex_children(ast, "", fout);
+    fprintf(fout, "?");
+    break;
+  case REPEAT_MODIFIER:
+    print_regex_children(ast, "", fout);
+    if (ast->repeat_max == -1) {
+      fprintf(fout, "{%d,}", ast->repeat_min);
+    } else if (ast->repeat_min == ast->repeat_max) {
+      fprintf(fout, "{%d}", ast->repeat_min);
+    } else {
+      fprintf(fout, "{%d,%d}", ast->repeat_min, ast->repeat_max);
+    }
+    break;
+  case WILDCARD:
+    fprintf(fout, ".");
+    break;
+  case CAPTURE_GROUP:
+    fprintf(fout, "(?<%s>", ast->capture_name);
+    print_ast_regex(&ast->children->child, fout);
+    fprintf(fout, ")");
+    break;
+  case REFERENCE:
+    // References have been resolved above
+    break;
+  }
+}
+
 void delete_ast_children(ast_t ast) {
   ast_child_list_t *children = ast.children;
   while (children != NULL) {
@@ -97,7 +470,28 @@ void delete_ast(ast_t ast) {
   case STAR_MODIFIER:
   case PLUS_MODIFIER:
   case OPT_MODIFIER:
+  case REPEAT_MODIFIER:
+    delete_ast_children(ast);
+    break;
+  case CAPTURE_GROUP:
+    delete_ast_children(ast);
+    free(ast.capture_name);
+    break;
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
     delete_ast_children(ast);
+    if (ast.automaton != NULL) {
+      delete_automaton(*ast.automaton);
+      free(ast.automaton);
+    }
+    break;
+  case UTF8_CLASS:
+    delete_codepoint_set(ast.codepoints);
+    free(ast.codepoints);
+    if (ast.automaton != NULL) {
+      delete_automaton(*ast.automaton);
+      free(ast.automaton);
+    }
     break;
   case CHAR:
   case WILDCARD:
@@ -2,6 +2,8 @@
 
 #include <stdio.h>
 
+#include "common.h"
+
 typedef enum ast_type {
   OR_EXPR,       // a|b
   AND_EXPR,      // abc
@@ -13,6 +15,11 @@ typedef enum ast_type {
   OPT_MODIFIER,  // a?
   WILDCARD,      // .
   REFERENCE,     // {DIGIT}
+  REPEAT_MODIFIER, // a{2,5}
+  INTERSECTION_EXPR, // a&b
+  COMPLEMENT_EXPR,   // ~a
+  UTF8_CLASS,        // [Ѐ-ӿ], \u{e9} or \p{L}
+  CAPTURE_GROUP,     // (?<name>a)
 } ast_type_t;
 
 typedef struct ast {
@@ -22,7 +29,14 @@ typedef struct ast {
     unsigned char *terminals;
     unsigned char terminal;
     struct ast *reference;
+    struct codepoint_set *codepoints; // normalized, for UTF8_CLASS
   };
+  int repeat_min; // for REPEAT_MODIFIER
+  int repeat_max; // for REPEAT_MODIFIER, -1 if unbounded
+  char *capture_name; // for CAPTURE_GROUP, a c identifier
+  // For INTERSECTION_EXPR, COMPLEMENT_EXPR and UTF8_CLASS, the minimal DFA of
+  // the expression, once it has been built (see get_embedded_automaton)
+  struct automaton *automaton;
 } ast_t;
 
 typedef struct ast_child_list {
@@ -34,4 +48,54 @@ void add_child(ast_t *ast, ast_t child);
 void print_ast_indented(ast_t *ast, int indent, FILE *fout);
 void print_ast_children(ast_t *ast, int indent, FILE *fout);
 void print_ast(ast_t *ast, FILE *fout);
+
+/**
+ * Prints the given {@code ast} in regex syntax (see {@code
+ * consume_regex_expr}), such that parsing the printed string results in an
+ * equivalent AST. References are printed as the referenced expression.
+ */
+void print_ast_regex(ast_t *ast, FILE *fout);
 void delete_ast(ast_t ast);
+
+/**
+ * Follows references, starting at the given {@code ast}, until a
+ * non-reference AST is reached, and returns that AST.
+ */
+ast_t *resolve_references(ast_t *ast);
+
+/**
+ * Returns a newly allocated array of pointers to the children of the given
+ * {@code ast} in source order (they are stored in reverse), and stores their
+ * number into {@code count}.
+ */
+ast_t **get_children_in_order(ast_t *ast, int *count);
+
+/**
+ * Returns a hash of the structure of the given {@code ast}, continuing from
+ * {@code seed} (see {@code hash_bytes}). References are hashed as the
+ * referenced expression, so equal expressions have equal hashes.
+ */
+unsigned long hash_ast(ast_t *ast, unsigned long seed);
+
+/**
+ * Returns how often the child of the given repetition {@code ast} is copied,
+ * when the repetition is expanded: once per possible repetition, or for
+ * unbounded repetitions once per required repetition (at least once), with the
+ * last copy repeating itself.
+ */
+int get_repeat_copies(ast_t *ast);
+
+/**
+ * Returns the number of terminals of the given {@code ast}, with references
+ * followed and repetitions expanded into their copies (see {@code
+ * get_repeat_copies}), or {@code SIZE_MAX} if the number does not fit into a
+ * {@code size_t}. Each copy counts at least once, even if it has no
+ * terminals.
+ */
+size_t get_expanded_terminal_count(ast_t *ast);
+
+/**
+ * Returns whether the given {@code ast} contains a capture group (following
+ * references).
+ */
+bool_t ast_has_captures(ast_t *ast);
@@ -1,31 +1,57 @@
 #include "ast2automaton.h"
 #include "ast.h"
 #include "automaton.h"
+#include "common.h"
+#include "positions.h"
+#include "utf8.h"
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-int get_automaton_nodes_from_ast(ast_t *ast);
+size_t get_automaton_nodes_from_ast(ast_t *ast);
 
-int get_automaton_nodes_from_ast_children(ast_t *ast) {
-  int c = 0;
+/**
+ * Returns whether the given {@code ast} matches exactly one char.
+ */
+bool_t is_single_terminal_ast(ast_t *ast) {
+  switch (resolve_references(ast)->type) {
+  case CHAR:
+  case CLASS:
+  case INV_CLASS:
+  case WILDCARD:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+size_t get_automaton_nodes_from_ast_children(ast_t *ast) {
+  size_t c = 0;
   ast_child_list_t *list = ast->children;
   while (list != NULL) {
-    c += get_automaton_nodes_from_ast(&list->child);
+    c = add_sizes(c, get_automaton_nodes_from_ast(&list->child));
     list = list->next;
   }
   return c;
 }
 
-int get_automaton_nodes_from_ast(ast_t *ast) {
+/**
+ * Returns the number of nodes, which the given {@code ast} converts to. The
+ * number saturates at {@code SIZE_MAX} (see {@code add_sizes}).
+ */
+size_t get_automaton_nodes_from_ast(ast_t *ast) {
   switch (ast->type) {
   case OR_EXPR:
   case STAR_MODIFIER:
   case PLUS_MODIFIER:
     // These need to add an extra 2 nodes surrounding the inner automaton, for
     // epsilon-transitions
-    return 2 + get_automaton_nodes_from_ast_children(ast);
+    return add_sizes(2, get_automaton_nodes_from_ast_children(ast));
   case AND_EXPR:
   case OPT_MODIFIER:
+  case CAPTURE_GROUP:
     // These do not need extra nodes
     return get_automaton_nodes_from_ast_children(ast);
   case CHAR:
@@ -36,14 +62,28 @@ int get_automaton_nodes_from_ast(ast_t *ast) {
     return 2;
   case REFERENCE:
     return get_automaton_nodes_from_ast(ast->reference);
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
+  case UTF8_CLASS: {
+    // The nodes of the DFA and a new start and end node
+    automaton_t *dfa = get_embedded_automaton(ast);
+    return dfa == NULL ? SIZE_MAX : add_sizes(2, dfa->max_node_count);
+  }
+  case REPEAT_MODIFIER:
+    if (is_single_terminal_ast(&ast->children->child)) {
+      // A chain of nodes, see convert_ast_repeat_single_to_automaton_nodes
+      return 1 + (ast->repeat_max == -1 ? ast->repeat_min : ast->repeat_max);
+    }
+    size_t copy = get_automaton_nodes_from_ast_children(ast);
+    return add_sizes(2, multiply_sizes(get_repeat_copies(ast), copy));
   }
   return 0;
 }
 
-int get_automaton_nodes_from_ast_list(ast_list_t *ast_list) {
-  int count = 0;
+size_t get_automaton_nodes_from_ast_list(ast_list_t *ast_list) {
+  size_t count = 0;
   while (ast_list != NULL) {
-    count += get_automaton_nodes_from_ast(ast_list->ast);
+    count = add_sizes(count, get_automaton_nodes_from_ast(ast_list->ast));
     ast_list = ast_list->next;
   }
   return count;
@@ -123,6 +163,94 @@ void convert_ast_opt_to_automaton_nodes(automaton_t *automaton, ast_t *ast,
   connect_nodes(automaton, *start, *end, 0, 1);
 }
 
+/**
+ * Connects {@code node0} and {@code node1} with all terminals of the given
+ * single terminal {@code ast}.
+ */
+void connect_nodes_with_terminal_ast(automaton_t *automaton, int node0,
+                                     int node1, ast_t *ast) {
+  ast = resolve_references(ast);
+  for (int i = 0; i < 256; i++) {
+    bool_t matches;
+    switch (ast->type) {
+    case CHAR:
+      matches = i == ast->terminal;
+      break;
+    case CLASS:
+      matches = ast->terminals[i] != 0;
+      break;
+    case INV_CLASS:
+      matches = ast->terminals[i] == 0;
+      break;
+    default:
+      matches = 1;
+    }
+    if (matches) {
+      connect_nodes(automaton, node0, node1, i, 0);
+    }
+  }
+}
+
+/**
+ * Converts a repetition of a single terminal into a chain of nodes, which
+ * share the terminal edges: node i is reached after i chars. All nodes from
+ * the minimum on are connected to the last node, unbounded repetitions loop at
+ * the last node instead.
+ */
+void convert_ast_repeat_single_to_automaton_nodes(automaton_t *automaton,
+                                                  ast_t *ast, int *start,
+                                                  int *end) {
+  ast_t *child = &ast->children->child;
+  int copies = ast->repeat_max == -1 ? ast->repeat_min : ast->repeat_max;
+  *start = create_node(automaton);
+  int node = *start;
+  for (int i = 0; i < copies; i++) {
+    int next = create_node(automaton);
+    connect_nodes_with_terminal_ast(automaton, node, next, child);
+    node = next;
+  }
+  *end = node;
+  if (ast->repeat_max == -1) {
+    connect_nodes_with_terminal_ast(automaton, *end, *end, child);
+    return;
+  }
+  for (int i = ast->repeat_min; i < copies; i++) {
+    connect_nodes(automaton, *start + i, *end, 0, 1);
+  }
+}
+
+/**
+ * Converts a repetition into copies of the child automaton. The copies after
+ * the minimum are optional, but each one can only follow the copy before it
+ * (x{1,3} is converted like x(x(x)?)?), so epsilon-closures stay small.
+ */
+void convert_ast_repeat_to_automaton_nodes(automaton_t *automaton, ast_t *ast,
+                                           int *start, int *end) {
+  ast_t *child = &ast->children->child;
+  if (is_single_terminal_ast(child)) {
+    convert_ast_repeat_single_to_automaton_nodes(automaton, ast, start, end);
+    return;
+  }
+  *start = create_node(automaton);
+  *end = create_node(automaton);
+  int copies = get_repeat_copies(ast);
+  int previous_end = *start;
+  for (int i = 0; i < copies; i++) {
+    int inner_start, inner_end;
+    convert_ast_to_automaton_nodes(automaton, child, &inner_start, &inner_end);
+    connect_nodes(automaton, previous_end, inner_start, 0, 1);
+    if (i >= ast->repeat_min) {
+      // The remaining copies are optional
+      connect_nodes(automaton, previous_end, *end, 0, 1);
+    }
+    if (ast->repeat_max == -1 && i == copies - 1) {
+      connect_nodes(automaton, inner_end, inner_start, 0, 1);
+    }
+    previous_end = inner_end;
+  }
+  connect_nodes(automaton, previous_end, *end, 0, 1);
+}
+
 void convert_ast_wildcard_to_automaton_nodes(automaton_t *automaton, ast_t *ast,
                                              int *start, int *end) {
   *start = create_node(automaton);
@@ -132,6 +260,106 @@ void convert_ast_wildcard_to_automaton_nodes(automaton_t *automaton, ast_t *ast,
   }
 }
 
+/**
+ * Returns the minimal DFA of the given {@code ast}.
+ */
+automaton_t convert_ast_to_minimal_dfa(ast_t *ast) {
+  automaton_t automaton = convert_ast_to_dfa(ast);
+  automaton_t m_automaton = minimize(&automaton);
+  delete_automaton(automaton);
+  return m_automaton;
+}
+
+automaton_t *get_embedded_automaton(ast_t *ast) {
+  if (ast->automaton != NULL) {
+    return ast->automaton->nodes != NULL ? ast->automaton : NULL;
+  }
+  automaton_t result;
+  if (ast->type == UTF8_CLASS) {
+    result = convert_codepoint_set_to_automaton(ast->codepoints);
+  } else if (ast->type == COMPLEMENT_EXPR) {
+    automaton_t child = convert_ast_to_minimal_dfa(&ast->children->child);
+    automaton_t complement = complement_automaton(&child, 0);
+    result = minimize(&complement);
+    delete_automaton(child);
+    delete_automaton(complement);
+  } else {
+    result = convert_ast_to_minimal_dfa(&ast->children->child);
+    for (ast_child_list_t *list = ast->children->next; list != NULL;
+         list = list->next) {
+      automaton_t child = convert_ast_to_minimal_dfa(&list->child);
+      automaton_t product = intersect_automata(&result, &child);
+      delete_automaton(result);
+      delete_automaton(child);
+      if (product.nodes == NULL) {
+        // The failure is kept, so it is not computed again
+        result = product;
+        break;
+      }
+      result = minimize(&product);
+      delete_automaton(product);
+    }
+  }
+  ast->automaton = malloc(sizeof(automaton_t));
+  *ast->automaton = result;
+  return result.nodes != NULL ? ast->automaton : NULL;
+}
+
+bool_t build_embedded_automata(ast_t *ast) {
+  ast = resolve_references(ast);
+  switch (ast->type) {
+  case CHAR:
+  case CLASS:
+  case INV_CLASS:
+  case WILDCARD:
+    return 1;
+  case UTF8_CLASS:
+    return get_embedded_automaton(ast) != NULL;
+  default:
+    // The children first, so the DFA of an expression is only built from the
+    // DFAs of its children, once they all exist
+    for (ast_child_list_t *list = ast->children; list != NULL;
+         list = list->next) {
+      if (!build_embedded_automata(&list->child)) {
+        return 0;
+      }
+    }
+    if (ast->type == INTERSECTION_EXPR || ast->type == COMPLEMENT_EXPR) {
+      return get_embedded_automaton(ast) != NULL;
+    }
+    return 1;
+  }
+}
+
+/**
+ * Copies the DFA of the intersection, complement or UTF-8 class {@code ast}
+ * into the given {@code automaton}. The copy is entered from a new start node
+ * and left to a new end node by epsilon transitions, because the start node of
+ * the DFA may have incoming transitions and its end nodes outgoing ones.
+ */
+void convert_ast_embedded_to_automaton_nodes(automaton_t *automaton,
+                                            ast_t *ast, int *start, int *end) {
+  automaton_t *dfa = get_embedded_automaton(ast);
+  *start = create_node(automaton);
+  *end = create_node(automaton);
+  int offset = automaton->next_node_index;
+  automaton->next_node_index += dfa->max_node_count;
+  for (int node = 0; node < dfa->max_node_count; node++) {
+    for (int e = 0; e < dfa->nodes[node].edge_count; e++) {
+      edge_t *edge = &dfa->nodes[node].edges[e];
+      for (int t = 0; t < 256; t++) {
+        if (edge->transitions[t]) {
+          connect_nodes(automaton, offset + node, offset + edge->target, t, 0);
+        }
+      }
+    }
+    if (dfa->nodes[node].end_tag != -1) {
+      connect_nodes(automaton, offset + node, *end, 0, 1);
+    }
+  }
+  connect_nodes(automaton, *start, offset + dfa->start_index, 0, 1);
+}
+
 void convert_ast_to_automaton_nodes(automaton_t *automaton, ast_t *ast,
                                     int *start, int *end) {
   switch (ast->type) {
@@ -165,11 +393,27 @@ void convert_ast_to_automaton_nodes(automaton_t *automaton, ast_t *ast,
   case REFERENCE:
     convert_ast_to_automaton_nodes(automaton, ast->reference, start, end);
     return;
+  case CAPTURE_GROUP:
+    // Only tagged DFAs record captures, see tagged_dfa.h
+    convert_ast_to_automaton_nodes(automaton, &ast->children->child, start,
+                                   end);
+    return;
+  case REPEAT_MODIFIER:
+    convert_ast_repeat_to_automaton_nodes(automaton, ast, start, end);
+    return;
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
+  case UTF8_CLASS:
+    convert_ast_embedded_to_automaton_nodes(automaton, ast, start, end);
+    return;
   }
 }
 
 automaton_t convert_ast_to_automaton(ast_t *ast) {
   automaton_t automaton = create_automaton(get_automaton_nodes_from_ast(ast));
+  if (automaton.nodes == NULL) {
+    return automaton;
+  }
   int start, end;
   convert_ast_to_automaton_nodes(&automaton, ast, &start, &end);
   automaton.start_index = start;
@@ -178,8 +422,11 @@ automaton_t convert_ast_to_automaton(ast_t *ast) {
 }
 
 automaton_t convert_ast_list_to_automaton(ast_list_t *ast_list) {
-  automaton_t automaton =
-      create_automaton(get_automaton_nodes_from_ast_list(ast_list) + 1);
+  automaton_t automaton = create_automaton(
+      add_sizes(get_automaton_nodes_from_ast_list(ast_list), 1));
+  if (automaton.nodes == NULL) {
+    return automaton;
+  }
   automaton.start_index = create_node(&automaton);
   int tag = 0;
   while (ast_list != NULL) {
@@ -191,3 +438,414 @@ automaton_t convert_ast_list_to_automaton(ast_list_t *ast_list) {
   }
   return automaton;
 }
+
+/**
+ * Connects {@code node} to the nodes of all char positions in the given {@code
+ * set} and sets the end tag of {@code node} to the lowest end tag of the end
+ * markers in the set.
+ */
+void connect_glushkov_node(automaton_t *automaton, positions_t *positions,
+                           int *position_nodes, int node, bool_t *set) {
+  for (int q = 0; q < positions->count; q++) {
+    if (!set[q] || position_nodes[q] == -1) {
+      continue;
+    }
+    for (int t = 0; t < 256; t++) {
+      if (positions->positions[q].terminals[t]) {
+        connect_nodes(automaton, node, position_nodes[q], t, 0);
+      }
+    }
+  }
+  automaton->nodes[node].end_tag = lowest_end_tag(positions, set);
+}
+
+automaton_t convert_positions_to_automaton(positions_t *positions) {
+  // End markers get no node, they only tag the nodes they follow
+  int *position_nodes = malloc(positions->count * sizeof(int));
+  int node_count = 1;
+  for (int p = 0; p < positions->count; p++) {
+    position_nodes[p] =
+        positions->positions[p].end_tag == -1 ? node_count++ : -1;
+  }
+  automaton_t automaton = create_automaton(node_count);
+  if (automaton.nodes == NULL) {
+    free(position_nodes);
+    return automaton;
+  }
+  automaton.next_node_index = node_count;
+  automaton.start_index = 0;
+  connect_glushkov_node(&automaton, positions, position_nodes, 0,
+                        positions->first);
+  for (int p = 0; p < positions->count; p++) {
+    if (position_nodes[p] != -1) {
+      connect_glushkov_node(&automaton, positions, position_nodes,
+                            position_nodes[p],
+                            get_follow_set(positions, p));
+    }
+  }
+  free(position_nodes);
+  return automaton;
+}
+
+automaton_t convert_ast_to_glushkov_automaton(ast_t *ast) {
+  positions_t positions = create_positions_from_ast(ast);
+  automaton_t automaton = convert_positions_to_automaton(&positions);
+  delete_positions(positions);
+  return automaton;
+}
+
+automaton_t convert_ast_list_to_glushkov_automaton(ast_list_t *ast_list) {
+  positions_t positions = create_positions_from_ast_list(ast_list);
+  automaton_t automaton = convert_positions_to_automaton(&positions);
+  delete_positions(positions);
+  return automaton;
+}
+
+/**
+ * Groups all terminals into classes, whose terminals are matched by exactly
+ * the same positions (see {@code refine_terminal_classes}). Stores one
+ * terminal of each class into {@code representatives}. Returns the number of
+ * classes.
+ */
+int compute_position_terminal_classes(positions_t *positions, int *class_of,
+                                      int *representatives) {
+  memset(class_of, 0, 256 * sizeof(int));
+  int class_count = 1;
+  for (int p = 0; p < positions->count; p++) {
+    class_count =
+        refine_terminal_classes(class_of, positions->positions[p].terminals);
+  }
+  for (int t = 255; t >= 0; t--) {
+    representatives[class_of[t]] = t;
+  }
+  return class_count;
+}
+
+/**
+ * The states of a DFA under construction. Each state is a sorted set of
+ * positions, which are looked up via an open addressing hash table.
+ */
+typedef struct position_dfa {
+  positions_t *positions;
+  int **follow;      // the follow set of each position as a sorted list
+  int *follow_sizes; // the size of each follow set
+  int class_count;
+  int **sets;
+  int *set_sizes;
+  int *end_tags;
+  int *targets; // state_count * class_count entries, -1 for no transition
+  int state_count;
+  int capacity;
+  int *buckets; // bucket_count entries, -1 for empty
+  int bucket_count;
+  size_t set_memory; // bytes of all position sets
+} position_dfa_t;
+
+void insert_position_set_bucket(position_dfa_t *dfa, int state) {
+  int mask = dfa->bucket_count - 1;
+  int bucket = hash_bytes(dfa->sets[state], dfa->set_sizes[state] * sizeof(int),
+                          HASH_SEED) &
+               mask;
+  while (dfa->buckets[bucket] != -1) {
+    bucket = (bucket + 1) & mask;
+  }
+  dfa->buckets[bucket] = state;
+}
+
+void grow_position_dfa(position_dfa_t *dfa) {
+  dfa->capacity *= 2;
+  dfa->sets = realloc(dfa->sets, dfa->capacity * sizeof(int *));
+  dfa->set_sizes = realloc(dfa->set_sizes, dfa->capacity * sizeof(int));
+  dfa->end_tags = realloc(dfa->end_tags, dfa->capacity * sizeof(int));
+  dfa->targets = realloc(dfa->targets, (size_t)dfa->capacity *
+                                           dfa->class_count * sizeof(int));
+  // Keep the load factor of the hash table at most one half
+  free(dfa->buckets);
+  dfa->bucket_count = dfa->capacity * 2;
+  dfa->buckets = malloc(dfa->bucket_count * sizeof(int));
+  memset(dfa->buckets, 0xff, dfa->bucket_count * sizeof(int));
+  for (int state = 0; state < dfa->state_count; state++) {
+    insert_position_set_bucket(dfa, state);
+  }
+}
+
+/**
+ * Returns the state with the given sorted position {@code set}. The state is
+ * created, if it does not exist yet.
+ */
+int find_or_add_position_set(position_dfa_t *dfa, int *set, int size) {
+  int mask = dfa->bucket_count - 1;
+  int bucket = hash_bytes(set, size * sizeof(int), HASH_SEED) & mask;
+  while (dfa->buckets[bucket] != -1) {
+    int state = dfa->buckets[bucket];
+    if (dfa->set_sizes[state] == size &&
+        memcmp(dfa->sets[state], set, size * sizeof(int)) == 0) {
+      return state;
+    }
+    bucket = (bucket + 1) & mask;
+  }
+  if (dfa->state_count == dfa->capacity) {
+    grow_position_dfa(dfa);
+  }
+  int state = dfa->state_count++;
+  dfa->sets[state] = malloc(size * sizeof(int));
+  memcpy(dfa->sets[state], set, size * sizeof(int));
+  dfa->set_sizes[state] = size;
+  dfa->set_memory += size * sizeof(int);
+  int end_tag = -1;
+  for (int i = 0; i < size; i++) {
+    int tag = dfa->positions->positions[set[i]].end_tag;
+    if (tag != -1 && (end_tag == -1 || tag < end_tag)) {
+      end_tag = tag;
+    }
+  }
+  dfa->end_tags[state] = end_tag;
+  insert_position_set_bucket(dfa, state);
+  return state;
+}
+
+bool_t position_dfa_exceeds_budget(position_dfa_t *dfa, dfa_budget_t *budget) {
+  if (budget == NULL) {
+    return 0;
+  }
+  if (budget->max_states > 0 && dfa->state_count > budget->max_states) {
+    return 1;
+  }
+  size_t state_size =
+      sizeof(int *) + 2 * sizeof(int) + dfa->class_count * sizeof(int);
+  size_t memory = dfa->set_memory + dfa->capacity * state_size +
+                  dfa->bucket_count * sizeof(int) +
+                  dfa->state_count * sizeof(node_t);
+  return budget->max_memory > 0 && memory > budget->max_memory;
+}
+
+position_dfa_t create_position_dfa(positions_t *positions) {
+  position_dfa_t dfa = {.positions = positions, .capacity = 8};
+  int count = positions->count;
+  dfa.follow = malloc(count * sizeof(int *));
+  dfa.follow_sizes = calloc(count, sizeof(int));
+  for (int p = 0; p < count; p++) {
+    dfa.follow[p] = malloc(count * sizeof(int));
+    for (int q = 0; q < count; q++) {
+      if (get_follow_set(positions, p)[q]) {
+        dfa.follow[p][dfa.follow_sizes[p]++] = q;
+      }
+    }
+  }
+  dfa.sets = malloc(dfa.capacity * sizeof(int *));
+  dfa.set_sizes = malloc(dfa.capacity * sizeof(int));
+  dfa.end_tags = malloc(dfa.capacity * sizeof(int));
+  dfa.bucket_count = dfa.capacity * 2;
+  dfa.buckets = malloc(dfa.bucket_count * sizeof(int));
+  memset(dfa.buckets, 0xff, dfa.bucket_count * sizeof(int));
+  return dfa;
+}
+
+void delete_position_dfa(position_dfa_t *dfa) {
+  for (int p = 0; p < dfa->positions->count; p++) {
+    free(dfa->follow[p]);
+  }
+  for (int state = 0; state < dfa->state_count; state++) {
+    free(dfa->sets[state]);
+  }
+  free(dfa->follow);
+  free(dfa->follow_sizes);
+  free(dfa->sets);
+  free(dfa->set_sizes);
+  free(dfa->end_tags);
+  free(dfa->targets);
+  free(dfa->buckets);
+}
+
+int compare_positions(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+bool_t convert_positions_to_dfa(positions_t *positions, dfa_budget_t *budget,
+                                automaton_t *result) {
+  int class_of[256];
+  int representatives[256];
+  position_dfa_t dfa = create_position_dfa(positions);
+  dfa.class_count =
+      compute_position_terminal_classes(positions, class_of, representatives);
+  dfa.targets = malloc(dfa.capacity * dfa.class_count * sizeof(int));
+
+  int count = positions->count;
+  int *next = malloc(count * sizeof(int));
+  int *mark = malloc(count * sizeof(int));
+  memset(mark, 0xff, count * sizeof(int));
+  int stamp = 0;
+
+  // The start state is the set of first positions, the next state is the
+  // union of the follow sets of all positions matching the terminal
+  int size = 0;
+  for (int p = 0; p < count; p++) {
+    if (positions->first[p]) {
+      next[size++] = p;
+    }
+  }
+  find_or_add_position_set(&dfa, next, size);
+  for (int state = 0; state < dfa.state_count; state++) {
+    for (int k = 0; k < dfa.class_count; k++) {
+      int t = representatives[k];
+      size = 0;
+      for (int i = 0; i < dfa.set_sizes[state]; i++) {
+        int p = dfa.sets[state][i];
+        if (!positions->positions[p].terminals[t]) {
+          continue;
+        }
+        for (int j = 0; j < dfa.follow_sizes[p]; j++) {
+          int q = dfa.follow[p][j];
+          if (mark[q] != stamp) {
+            mark[q] = stamp;
+            next[size++] = q;
+          }
+        }
+      }
+      stamp++;
+      int target = -1;
+      if (size > 0) {
+        qsort(next, size, sizeof(int), compare_positions);
+        target = find_or_add_position_set(&dfa, next, size);
+      }
+      dfa.targets[(size_t)state * dfa.class_count + k] = target;
+    }
+    if (position_dfa_exceeds_budget(&dfa, budget)) {
+      free(next);
+      free(mark);
+      delete_position_dfa(&dfa);
+      return 0;
+    }
+  }
+  free(next);
+  free(mark);
+
+  *result = create_automaton(dfa.state_count);
+  result->next_node_index = dfa.state_count;
+  for (int state = 0; state < dfa.state_count; state++) {
+    for (int t = 0; t < 256; t++) {
+      int target = dfa.targets[(size_t)state * dfa.class_count + class_of[t]];
+      if (target != -1) {
+        connect_nodes(result, state, target, t, 0);
+      }
+    }
+    result->nodes[state].end_tag = dfa.end_tags[state];
+  }
+  delete_position_dfa(&dfa);
+  return 1;
+}
+
+automaton_t convert_ast_to_dfa(ast_t *ast) {
+  automaton_t automaton;
+  convert_ast_to_dfa_bounded(ast, NULL, &automaton);
+  return automaton;
+}
+
+bool_t convert_ast_to_dfa_bounded(ast_t *ast, dfa_budget_t *budget,
+                                  automaton_t *result) {
+  positions_t positions = create_positions_from_ast(ast);
+  bool_t converted = convert_positions_to_dfa(&positions, budget, result);
+  delete_positions(positions);
+  return converted;
+}
+
+automaton_t convert_ast_list_to_dfa(ast_list_t *ast_list) {
+  positions_t positions = create_positions_from_ast_list(ast_list);
+  automaton_t automaton;
+  convert_positions_to_dfa(&positions, NULL, &automaton);
+  delete_positions(positions);
+  return automaton;
+}
+
+bool_t subexpression_exceeds_budget(ast_t *ast, dfa_budget_t *budget) {
+  automaton_t automaton = convert_ast_to_automaton(ast);
+  automaton_t d_automaton;
+  bool_t exceeded = !determinize_bounded(&automaton, budget, &d_automaton);
+  delete_automaton(automaton);
+  if (!exceeded) {
+    delete_automaton(d_automaton);
+  }
+  return exceeded;
+}
+
+ast_t *find_blowup_subexpression(ast_t *ast, dfa_budget_t *budget) {
+  ast = resolve_references(ast);
+  switch (ast->type) {
+  case OR_EXPR:
+  case AND_EXPR:
+  case STAR_MODIFIER:
+  case PLUS_MODIFIER:
+  case OPT_MODIFIER:
+  case REPEAT_MODIFIER:
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
+  case CAPTURE_GROUP:
+    for (ast_child_list_t *list = ast->children; list != NULL;
+         list = list->next) {
+      if (subexpression_exceeds_budget(&list->child, budget)) {
+        return find_blowup_subexpression(&list->child, budget);
+      }
+    }
+    return ast;
+  default:
+    return ast;
+  }
+}
+
+/**
+ * Creates an and-expression of references to the children {@code first} to
+ * {@code last} (inclusive) of {@code children}. The children are shared, so
+ * only the child list of the result must be freed.
+ */
+ast_t create_and_window(ast_t **children, int first, int last) {
+  ast_t window = {.type = AND_EXPR, .children = NULL};
+  for (int i = first; i <= last; i++) {
+    // add_child prepends, so the children end up in reverse (as in the parser)
+    ast_t reference = {.type = REFERENCE, .reference = children[i]};
+    add_child(&window, reference);
+  }
+  return window;
+}
+
+void free_and_window(ast_t window) {
+  ast_child_list_t *list = window.children;
+  while (list != NULL) {
+    ast_child_list_t *next = list->next;
+    free(list);
+    list = next;
+  }
+}
+
+bool_t and_window_exceeds_budget(ast_t **children, int first, int last,
+                                 dfa_budget_t *budget) {
+  ast_t window = create_and_window(children, first, last);
+  bool_t exceeded = subexpression_exceeds_budget(&window, budget);
+  free_and_window(window);
+  return exceeded;
+}
+
+void print_blowup_subexpression(ast_t *ast, dfa_budget_t *budget, FILE *fout) {
+  ast_t *culprit = find_blowup_subexpression(ast, budget);
+  if (culprit->type != AND_EXPR) {
+    print_ast_regex(culprit, fout);
+    return;
+  }
+
+  int count;
+  ast_t **children = get_children_in_order(culprit, &count);
+
+  // Shrink the run of children from both sides, while it exceeds the budget
+  int first = 0, last = count - 1;
+  while (last > first &&
+         and_window_exceeds_budget(children, first, last - 1, budget)) {
+    last--;
+  }
+  while (first < last &&
+         and_window_exceeds_budget(children, first + 1, last, budget)) {
+    first++;
+  }
+  ast_t window = create_and_window(children, first, last);
+  print_ast_regex(&window, fout);
+  free_and_window(window);
+  free(children);
+}
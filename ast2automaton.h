@@ -10,7 +10,9 @@ typedef struct ast_list {
 
 /**
  * Converts the given {@code ast} to an automaton. The end node is tagged with
- * {@code 0}.
+ * {@code 0}. The automaton has no nodes (see {@code create_automaton}), if it
+ * would have too many nodes or an embedded DFA cannot be built (see {@code
+ * get_embedded_automaton}); the same holds for the other conversions to NFAs.
  */
 automaton_t convert_ast_to_automaton(ast_t *ast);
 
@@ -21,3 +23,77 @@ automaton_t convert_ast_to_automaton(ast_t *ast);
  * incrementing.
  */
 automaton_t convert_ast_list_to_automaton(ast_list_t *ast_list);
+
+/**
+ * Converts the given {@code ast} to an automaton without epsilon transitions
+ * (Glushkov / position automaton). It has one node per char, class and
+ * wildcard of the ast and an additional start node. All transitions into a
+ * node have the terminals of its position. Nodes, after which the ast can end,
+ * are tagged with {@code 0}.
+ */
+automaton_t convert_ast_to_glushkov_automaton(ast_t *ast);
+
+/**
+ * Same as {@code convert_ast_to_glushkov_automaton}, but for the or-construct
+ * of all asts of the given {@code ast_list}. End tags are assigned as in {@code
+ * convert_ast_list_to_automaton}.
+ */
+automaton_t convert_ast_list_to_glushkov_automaton(ast_list_t *ast_list);
+
+/**
+ * Converts the given {@code ast} directly to a deterministic automaton, without
+ * an intermediate NFA (followpos construction). Each state is a set of
+ * positions of the ast. The states, after which the ast can end, are tagged
+ * with {@code 0}.
+ */
+automaton_t convert_ast_to_dfa(ast_t *ast);
+
+/**
+ * Same as {@code convert_ast_to_dfa}, but stops as soon as the {@code budget}
+ * is exceeded (see {@code determinize_bounded}). Returns 1 and stores the
+ * automaton into {@code result} on success, 0 otherwise.
+ */
+bool_t convert_ast_to_dfa_bounded(ast_t *ast, dfa_budget_t *budget,
+                                  automaton_t *result);
+
+/**
+ * Same as {@code convert_ast_to_dfa}, but for the or-construct of all asts of
+ * the given {@code ast_list}. End tags are assigned as in {@code
+ * convert_ast_list_to_automaton}; a state which ends several asts gets the
+ * lowest end tag.
+ */
+automaton_t convert_ast_list_to_dfa(ast_list_t *ast_list);
+
+/**
+ * Returns the minimal DFA of the given intersection, complement or UTF-8 class
+ * {@code ast} (tagged with {@code 0}), which is embedded into the automata and
+ * positions of enclosing expressions. It is built on first use (from the DFAs
+ * of the children by the product construction, or from the codepoints, see
+ * {@code convert_codepoint_set_to_automaton}), and is kept in the ast, until
+ * the ast is deleted. Returns {@code NULL} if a product of the DFAs has too
+ * many states (see {@code combine_automata}).
+ */
+automaton_t *get_embedded_automaton(ast_t *ast);
+
+/**
+ * Builds the DFAs of all intersections, complements and UTF-8 classes in the
+ * given {@code ast} (see {@code get_embedded_automaton}), innermost first.
+ * Returns 0 if one of them cannot be built; the others may not be built then.
+ * Once it returned 1, the DFAs of the ast are never {@code NULL}.
+ */
+bool_t build_embedded_automata(ast_t *ast);
+
+/**
+ * Searches the subexpression of the given {@code ast}, which is responsible
+ * for exceeding the {@code budget} during determinization. The given {@code
+ * ast} itself must exceed the budget. Returns the innermost subexpression,
+ * which exceeds the budget on its own (which may be {@code ast} itself).
+ */
+ast_t *find_blowup_subexpression(ast_t *ast, dfa_budget_t *budget);
+
+/**
+ * Prints the subexpression found by {@code find_blowup_subexpression} in regex
+ * syntax. If it is an and-expression, only the shortest run of its children,
+ * which still exceeds the {@code budget}, is printed.
+ */
+void print_blowup_subexpression(ast_t *ast, dfa_budget_t *budget, FILE *fout);
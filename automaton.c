@@ -1,17 +1,13 @@
 #include "automaton.h"
 #include "common.h"
 
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-__attribute__((always_inline)) inline int edge_idx(automaton_t *automaton,
-                                                   int node0, int node1) {
-  return node1 * automaton->max_node_count + node0;
-}
-
 void print_automaton(automaton_t *automaton, FILE *fout) {
   fprintf(fout, "Automaton (max nodes = %d, node count = %d)\n",
           automaton->max_node_count, automaton->next_node_index);
@@ -26,16 +22,17 @@ void print_automaton(automaton_t *automaton, FILE *fout) {
               automaton->nodes[node0].end_tag, node0);
     }
 
-    for (int node1 = 0; node1 < automaton->max_node_count; node1++) {
-      int edge = edge_idx(automaton, node0, node1);
+    for (int e = 0; e < automaton->nodes[node0].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[node0].edges[e];
+      int node1 = edge->target;
 
-      if (automaton->adjacency_matrix[edge].transitions[EPSILON_EDGE]) {
+      if (edge->transitions[EPSILON_EDGE]) {
         fprintf(fout, " ε->%d", node1);
       }
 
       int is_wildcard = 1;
       for (int t = 0; t < 256; t++) {
-        if (!automaton->adjacency_matrix[edge].transitions[t]) {
+        if (!edge->transitions[t]) {
           is_wildcard = 0;
           break;
         }
@@ -45,8 +42,9 @@ void print_automaton(automaton_t *automaton, FILE *fout) {
         fprintf(fout, " any->%d", node1);
       } else {
         for (int t = 0; t < 256; t++) {
-          if (automaton->adjacency_matrix[edge].transitions[t]) {
-            fprintf(fout, " %s->%d", print_char(t), node1);
+          if (edge->transitions[t]) {
+            char buffer[CHAR_BUFFER_SIZE];
+            fprintf(fout, " %s->%d", sprint_char(t, buffer), node1);
           }
         }
       }
@@ -55,87 +53,128 @@ void print_automaton(automaton_t *automaton, FILE *fout) {
   }
 }
 
-automaton_t create_automaton(int node_count) {
-  automaton_t result = {.adjacency_matrix =
-                            calloc(node_count * node_count, sizeof(edge_t)),
-                        .nodes = malloc(node_count * sizeof(node_t)),
-                        .max_node_count = node_count,
+automaton_t create_automaton(size_t node_count) {
+  automaton_t result = {.nodes = NULL,
+                        .max_node_count = 0,
                         .next_node_index = 0,
                         .start_index = 0};
-  memset(result.nodes, 0xff, node_count * sizeof(node_t));
+  // Node counts are computed, so reject the ones, which have saturated or do
+  // not fit into the int node indices, instead of passing them to calloc
+  if (node_count > INT_MAX) {
+    return result;
+  }
+  // At least one node is allocated, so only failures leave the nodes NULL
+  result.nodes = calloc(node_count > 0 ? node_count : 1, sizeof(node_t));
+  if (result.nodes == NULL) {
+    return result;
+  }
+  result.max_node_count = node_count;
+  for (int node = 0; node < node_count; node++) {
+    result.nodes[node].end_tag = -1;
+  }
   return result;
 }
 
 int create_node(automaton_t *automaton) { return automaton->next_node_index++; }
 
+/**
+ * Returns the index, at which the edge to {@code target} is (or would have to
+ * be inserted) in the sorted edges of the given {@code node}.
+ */
+int find_edge_index(node_t *node, int target) {
+  int low = 0;
+  int high = node->edge_count;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (node->edges[mid].target < target) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+edge_t *get_edge(automaton_t *automaton, int node0, int node1) {
+  node_t *node = &automaton->nodes[node0];
+  int e = find_edge_index(node, node1);
+  if (e < node->edge_count && node->edges[e].target == node1) {
+    return &node->edges[e];
+  }
+  return NULL;
+}
+
+/**
+ * Returns the edge from {@code node0} to {@code node1}. The edge is created
+ * (without any transitions), if it does not exist yet.
+ */
+edge_t *get_or_create_edge(automaton_t *automaton, int node0, int node1) {
+  node_t *node = &automaton->nodes[node0];
+  int e = find_edge_index(node, node1);
+  if (e < node->edge_count && node->edges[e].target == node1) {
+    return &node->edges[e];
+  }
+  if (node->edge_count == node->edge_capacity) {
+    node->edge_capacity =
+        node->edge_capacity == 0 ? 2 : node->edge_capacity * 2;
+    node->edges = realloc(node->edges, node->edge_capacity * sizeof(edge_t));
+  }
+  memmove(&node->edges[e + 1], &node->edges[e],
+          (node->edge_count - e) * sizeof(edge_t));
+  node->edge_count++;
+  memset(&node->edges[e], 0, sizeof(edge_t));
+  node->edges[e].target = node1;
+  return &node->edges[e];
+}
+
 void connect_nodes(automaton_t *automaton, int node0, int node1,
                    unsigned char terminal, bool_t is_epsilon) {
   int transition = terminal;
   if (is_epsilon) {
     transition = EPSILON_EDGE;
   }
-  automaton->adjacency_matrix[edge_idx(automaton, node0, node1)]
-      .transitions[transition] = 1;
-}
-
-typedef struct dfa_edge {
-  int target;
-  bool_t transitions[256];
-} dfa_edge_t;
-
-typedef struct dfa_edge_list {
-  struct dfa_edge_list *next;
-  dfa_edge_t edge;
-} dfa_edge_list_t;
-
-typedef struct dfa_state {
-  bool_t *nodes;
-  dfa_edge_list_t *outgoing;
-  int index;
-  int end_tag;
-} dfa_state_t;
-
-typedef struct dfa_state_list {
-  struct dfa_state_list *next;
-  dfa_state_t state;
-} dfa_state_list_t;
-
-dfa_state_t create_dfa_state(automaton_t *automaton, int index) {
-  dfa_state_t state;
-  state.nodes = calloc(automaton->max_node_count, sizeof(bool_t));
-  state.index = index;
-  state.outgoing = NULL;
-  state.end_tag = -1;
-  return state;
+  get_or_create_edge(automaton, node0, node1)->transitions[transition] = 1;
 }
 
-void delete_dfa_state(dfa_state_t state) {
-  free(state.nodes);
-  dfa_edge_list_t *list = state.outgoing;
-  while (list != NULL) {
-    dfa_edge_list_t *next = list->next;
-    free(list);
-    list = next;
+int refine_terminal_classes(int *class_of, const bool_t *transitions) {
+  // A new class for each pair of old class and transition bit
+  int new_class[2 * 256];
+  memset(new_class, 0xff, sizeof(new_class));
+  int class_count = 0;
+  for (int t = 0; t < 256; t++) {
+    int key = class_of[t] * 2 + (transitions[t] != 0);
+    if (new_class[key] == -1) {
+      new_class[key] = class_count++;
+    }
+    class_of[t] = new_class[key];
   }
+  return class_count;
 }
 
-void delete_dfa_state_list(dfa_state_list_t *list) {
-  while (list != NULL) {
-    dfa_state_list_t *next = list->next;
-    delete_dfa_state(list->state);
-    free(list);
-    list = next;
+int compute_terminal_classes(automaton_t *automaton, int *class_of) {
+  memset(class_of, 0, 256 * sizeof(int));
+  int class_count = 1;
+  for (int node = 0; node < automaton->max_node_count; node++) {
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      class_count = refine_terminal_classes(
+          class_of, automaton->nodes[node].edges[e].transitions);
+    }
   }
+  return class_count;
 }
 
-__attribute__((always_inline)) inline void
-set_dfa_state_node(dfa_state_t *state, int node) {
-  state->nodes[node] = 1;
-}
-
-__attribute__((always_inline)) inline bool_t
-get_dfa_state_node(dfa_state_t *state, int node) {
-  return state->nodes[node];
+/**
+ * Stores one terminal of each of the {@code class_count} classes into {@code
+ * representatives}.
+ */
+void get_class_representatives(int *class_of, int class_count,
+                               int *representatives) {
+  memset(representatives, 0xff, class_count * sizeof(int));
+  for (int t = 0; t < 256; t++) {
+    if (representatives[class_of[t]] == -1) {
+      representatives[class_of[t]] = t;
+    }
+  }
 }
 
 __attribute__((always_inline)) inline int choose_end_tag(int old, int new) {
@@ -147,332 +186,1055 @@ __attribute__((always_inline)) inline int choose_end_tag(int old, int new) {
 }
 
 /**
- * Returns all nodes, which can be reached from any of the given {@code nodes}
- * via a transition of {@code terminal}.
+ * The states of a DFA under construction. Each state is a sorted set of nodes
+ * of the NFA, which are looked up via an open addressing hash table.
  */
-dfa_state_t move(automaton_t *automaton, dfa_state_t *state, int terminal,
-                 int next_idx) {
-  dfa_state_t move = create_dfa_state(automaton, next_idx);
-  for (int node0 = 0; node0 < automaton->max_node_count; node0++) {
-    if (get_dfa_state_node(state, node0)) {
-      for (int node1 = 0; node1 < automaton->max_node_count; node1++) {
-        int edge = edge_idx(automaton, node0, node1);
-        if (automaton->adjacency_matrix[edge].transitions[terminal]) {
-          set_dfa_state_node(&move, node1);
-          move.end_tag =
-              choose_end_tag(move.end_tag, automaton->nodes[node1].end_tag);
-        }
+typedef struct dfa_states {
+  int **node_sets;
+  int *set_sizes;
+  int *end_tags;
+  int *targets; // count * class_count entries, -1 for no transition
+  int class_count;
+  int count;
+  int capacity;
+  int *buckets; // bucket_count entries, -1 for empty
+  int bucket_count;
+  size_t set_memory; // bytes of all node sets
+  size_t edge_count; // number of distinct pairs of state and target
+  tag_sets_t *tag_sets; // end tags are indices of sets of all tags, if set
+} dfa_states_t;
+
+dfa_states_t create_dfa_states(int class_count) {
+  dfa_states_t states = {.class_count = class_count, .capacity = 8};
+  states.node_sets = malloc(states.capacity * sizeof(int *));
+  states.set_sizes = malloc(states.capacity * sizeof(int));
+  states.end_tags = malloc(states.capacity * sizeof(int));
+  states.targets = malloc(states.capacity * class_count * sizeof(int));
+  states.bucket_count = states.capacity * 2;
+  states.buckets = malloc(states.bucket_count * sizeof(int));
+  memset(states.buckets, 0xff, states.bucket_count * sizeof(int));
+  return states;
+}
+
+void delete_dfa_states(dfa_states_t *states) {
+  for (int state = 0; state < states->count; state++) {
+    free(states->node_sets[state]);
+  }
+  free(states->node_sets);
+  free(states->set_sizes);
+  free(states->end_tags);
+  free(states->targets);
+  free(states->buckets);
+}
+
+unsigned long hash_node_set(int *nodes, int size) {
+  return hash_bytes(nodes, size * sizeof(int), HASH_SEED);
+}
+
+void insert_dfa_state_bucket(dfa_states_t *states, int state) {
+  int mask = states->bucket_count - 1;
+  int bucket = hash_node_set(states->node_sets[state],
+                             states->set_sizes[state]) &
+               mask;
+  while (states->buckets[bucket] != -1) {
+    bucket = (bucket + 1) & mask;
+  }
+  states->buckets[bucket] = state;
+}
+
+void grow_dfa_states(dfa_states_t *states) {
+  states->capacity *= 2;
+  states->node_sets =
+      realloc(states->node_sets, states->capacity * sizeof(int *));
+  states->set_sizes =
+      realloc(states->set_sizes, states->capacity * sizeof(int));
+  states->end_tags = realloc(states->end_tags, states->capacity * sizeof(int));
+  states->targets =
+      realloc(states->targets,
+              (size_t)states->capacity * states->class_count * sizeof(int));
+  // Keep the load factor of the hash table at most one half
+  free(states->buckets);
+  states->bucket_count = states->capacity * 2;
+  states->buckets = malloc(states->bucket_count * sizeof(int));
+  memset(states->buckets, 0xff, states->bucket_count * sizeof(int));
+  for (int state = 0; state < states->count; state++) {
+    insert_dfa_state_bucket(states, state);
+  }
+}
+
+int compare_nodes(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * Returns the index of the set of the end tags of the given {@code nodes} in
+ * {@code tag_sets}, or -1 if none of them has an end tag.
+ */
+int intern_node_tags(tag_sets_t *tag_sets, automaton_t *automaton,
+                     int *nodes, int size) {
+  int *tags = malloc(size * sizeof(int));
+  int count = 0;
+  for (int i = 0; i < size; i++) {
+    if (automaton->nodes[nodes[i]].end_tag != -1) {
+      tags[count++] = automaton->nodes[nodes[i]].end_tag;
+    }
+  }
+  qsort(tags, count, sizeof(int), compare_nodes);
+  int distinct = 0;
+  for (int i = 0; i < count; i++) {
+    if (distinct == 0 || tags[distinct - 1] != tags[i]) {
+      tags[distinct++] = tags[i];
+    }
+  }
+  int index = distinct > 0 ? intern_tag_set(tag_sets, tags, distinct) : -1;
+  free(tags);
+  return index;
+}
+
+/**
+ * Returns the state with the given sorted set of {@code nodes}. The state is
+ * created, if it does not exist yet.
+ */
+int find_or_add_dfa_state(dfa_states_t *states, automaton_t *automaton,
+                          int *nodes, int size) {
+  int mask = states->bucket_count - 1;
+  int bucket = hash_node_set(nodes, size) & mask;
+  while (states->buckets[bucket] != -1) {
+    int state = states->buckets[bucket];
+    if (states->set_sizes[state] == size &&
+        memcmp(states->node_sets[state], nodes, size * sizeof(int)) == 0) {
+      return state;
+    }
+    bucket = (bucket + 1) & mask;
+  }
+  if (states->count == states->capacity) {
+    grow_dfa_states(states);
+  }
+  int state = states->count++;
+  states->node_sets[state] = malloc(size * sizeof(int));
+  memcpy(states->node_sets[state], nodes, size * sizeof(int));
+  states->set_sizes[state] = size;
+  states->set_memory += size * sizeof(int);
+  int end_tag = -1;
+  if (states->tag_sets != NULL) {
+    end_tag = intern_node_tags(states->tag_sets, automaton, nodes, size);
+  } else {
+    for (int i = 0; i < size; i++) {
+      end_tag = choose_end_tag(end_tag, automaton->nodes[nodes[i]].end_tag);
+    }
+  }
+  states->end_tags[state] = end_tag;
+  insert_dfa_state_bucket(states, state);
+  return state;
+}
+
+int make_epsclosure(automaton_t *automaton, int *nodes, int size, int *mark,
+                    int stamp) {
+  for (int i = 0; i < size; i++) {
+    node_t *node = &automaton->nodes[nodes[i]];
+    for (int e = 0; e < node->edge_count; e++) {
+      int target = node->edges[e].target;
+      if (node->edges[e].transitions[EPSILON_EDGE] && mark[target] != stamp) {
+        mark[target] = stamp;
+        nodes[size++] = target;
       }
     }
   }
-  return move;
+  return size;
 }
 
 /**
- * Returns all nodes, which can be reached from any of the given {@code nodes}
- * via an epsilon-transition. It also includes all nodes in {@code nodes}. This
- * is the epsilon-close of {@code nodes}.
+ * Stores all nodes, which can be reached from the nodes of the given {@code
+ * state} via a transition of {@code terminal}, into {@code nodes}. Nodes in
+ * the set are marked with {@code stamp} in {@code mark}. Returns the number of
+ * nodes.
  */
-dfa_state_t make_epsclosure(automaton_t *automaton, dfa_state_t closure) {
-  bool_t closure_changed;
-  do {
-    closure_changed = 0;
-    for (int node0 = 0; node0 < automaton->max_node_count; node0++) {
-      if (get_dfa_state_node(&closure, node0)) {
-        for (int node1 = 0; node1 < automaton->max_node_count; node1++) {
-          int edge = edge_idx(automaton, node0, node1);
-          if (!get_dfa_state_node(&closure, node1) &&
-              automaton->adjacency_matrix[edge].transitions[EPSILON_EDGE]) {
-            set_dfa_state_node(&closure, node1);
-            closure.end_tag = choose_end_tag(closure.end_tag,
-                                             automaton->nodes[node1].end_tag);
-            closure_changed = 1;
-          }
-        }
+int move(automaton_t *automaton, dfa_states_t *states, int state, int terminal,
+         int *nodes, int *mark, int stamp) {
+  int size = 0;
+  for (int i = 0; i < states->set_sizes[state]; i++) {
+    node_t *node = &automaton->nodes[states->node_sets[state][i]];
+    for (int e = 0; e < node->edge_count; e++) {
+      int target = node->edges[e].target;
+      if (node->edges[e].transitions[terminal] && mark[target] != stamp) {
+        mark[target] = stamp;
+        nodes[size++] = target;
       }
     }
-  } while (closure_changed);
-  return closure;
+  }
+  return size;
 }
 
 /**
- * Returns all nodes, which are start nodes.
+ * Estimates the memory (in bytes) needed by the determinization so far. This
+ * includes the resulting automaton.
  */
-dfa_state_t initial_state(automaton_t *automaton) {
-  dfa_state_t start = create_dfa_state(automaton, 0);
-  set_dfa_state_node(&start, automaton->start_index);
-  return start;
+size_t estimate_determinize_memory(dfa_states_t *states) {
+  size_t state_size =
+      sizeof(int *) + 2 * sizeof(int) + states->class_count * sizeof(int);
+  return states->set_memory + states->capacity * state_size +
+         states->bucket_count * sizeof(int) +
+         states->count * sizeof(node_t) + states->edge_count * sizeof(edge_t);
 }
 
-bool_t dfa_state_empty(automaton_t *automaton, dfa_state_t *state) {
-  for (int node = 0; node < automaton->max_node_count; node++) {
-    if (get_dfa_state_node(state, node)) {
-      return 0;
+bool_t budget_exceeded(dfa_states_t *states, dfa_budget_t *budget) {
+  if (budget == NULL) {
+    return 0;
+  }
+  if (budget->max_states > 0 && states->count > budget->max_states) {
+    return 1;
+  }
+  return budget->max_memory > 0 &&
+         estimate_determinize_memory(states) > budget->max_memory;
+}
+
+/**
+ * Returns the number of distinct targets of the given {@code state}.
+ */
+int count_dfa_state_targets(dfa_states_t *states, int state) {
+  int *targets = &states->targets[(size_t)state * states->class_count];
+  int count = 0;
+  for (int k = 0; k < states->class_count; k++) {
+    bool_t seen = targets[k] == -1;
+    for (int j = 0; j < k && !seen; j++) {
+      seen = targets[j] == targets[k];
     }
+    count += !seen;
   }
-  return 1;
+  return count;
 }
 
-bool_t dfa_states_equal(automaton_t *automaton, dfa_state_t *s0,
-                        dfa_state_t *s1) {
-  for (int node = 0; node < automaton->max_node_count; node++) {
-    if (get_dfa_state_node(s0, node) != get_dfa_state_node(s1, node)) {
+automaton_t dfa_states_to_automaton(dfa_states_t *states, int *class_of) {
+  automaton_t automaton = create_automaton(states->count);
+  automaton.next_node_index = states->count;
+  automaton.start_index = 0;
+  for (int state = 0; state < states->count; state++) {
+    for (int t = 0; t < 256; t++) {
+      int target =
+          states->targets[(size_t)state * states->class_count + class_of[t]];
+      if (target != -1) {
+        connect_nodes(&automaton, state, target, t, 0);
+      }
+    }
+    automaton.nodes[state].end_tag = states->end_tags[state];
+  }
+  return automaton;
+}
+
+/**
+ * Determinizes the given {@code automaton} (see {@code determinize_bounded}),
+ * with end tags of tag sets, if {@code tag_sets} is not {@code NULL}.
+ */
+static bool_t determinize_states(automaton_t *automaton, dfa_budget_t *budget,
+                                 tag_sets_t *tag_sets, automaton_t *result) {
+  int N = automaton->max_node_count;
+  // Terminals, which no transition can tell apart, lead to the same states
+  int class_of[256];
+  int representatives[256];
+  int class_count = compute_terminal_classes(automaton, class_of);
+  get_class_representatives(class_of, class_count, representatives);
+
+  // Automata without epsilon transitions (e.g. Glushkov automata) need no
+  // closures
+  bool_t needs_closure = count_epsilon_edges(automaton) > 0;
+  int *nodes = malloc(N * sizeof(int));
+  int *mark = malloc(N * sizeof(int));
+  memset(mark, 0xff, N * sizeof(int));
+  int stamp = 0;
+
+  dfa_states_t states = create_dfa_states(class_count);
+  states.tag_sets = tag_sets;
+  nodes[0] = automaton->start_index;
+  mark[nodes[0]] = stamp;
+  int size = make_epsclosure(automaton, nodes, 1, mark, stamp++);
+  qsort(nodes, size, sizeof(int), compare_nodes);
+  find_or_add_dfa_state(&states, automaton, nodes, size);
+
+  for (int state = 0; state < states.count; state++) {
+    for (int k = 0; k < class_count; k++) {
+      size = move(automaton, &states, state, representatives[k], nodes, mark,
+                  stamp);
+      if (needs_closure) {
+        size = make_epsclosure(automaton, nodes, size, mark, stamp);
+      }
+      stamp++;
+      int target = -1;
+      if (size > 0) {
+        qsort(nodes, size, sizeof(int), compare_nodes);
+        target = find_or_add_dfa_state(&states, automaton, nodes, size);
+      }
+      states.targets[(size_t)state * class_count + k] = target;
+    }
+    states.edge_count += count_dfa_state_targets(&states, state);
+    if (budget_exceeded(&states, budget)) {
+      free(nodes);
+      free(mark);
+      delete_dfa_states(&states);
       return 0;
     }
   }
+  free(nodes);
+  free(mark);
+  *result = dfa_states_to_automaton(&states, class_of);
+  delete_dfa_states(&states);
   return 1;
 }
 
-dfa_state_list_t *create_dfa_state_list(dfa_state_t state,
-                                        dfa_state_list_t *next) {
-  dfa_state_list_t *list = malloc(sizeof(dfa_state_list_t));
-  list->state = state;
-  list->next = next;
-  return list;
+automaton_t determinize(automaton_t *automaton) {
+  automaton_t result;
+  determinize_states(automaton, NULL, NULL, &result);
+  return result;
+}
+
+bool_t determinize_bounded(automaton_t *automaton, dfa_budget_t *budget,
+                           automaton_t *result) {
+  return determinize_states(automaton, budget, NULL, result);
+}
+
+automaton_t determinize_tag_sets(automaton_t *automaton,
+                                 tag_sets_t *tag_sets) {
+  automaton_t result;
+  determinize_states(automaton, NULL, tag_sets, &result);
+  return result;
+}
+
+int *create_state_transition_matrix(automaton_t *automaton) {
+  int N = automaton->max_node_count;
+  size_t stm_size = (size_t)N * 256 * sizeof(int);
+  int *stm = malloc(stm_size);
+  memset(stm, 0xff, stm_size);
+  for (int start = 0; start < N; start++) {
+    for (int e = 0; e < automaton->nodes[start].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[start].edges[e];
+      for (int t = 0; t < 256; t++) {
+        if (edge->transitions[t]) {
+          stm[start * 256 + t] = edge->target;
+        }
+      }
+    }
+  }
+  return stm;
+}
+
+automaton_t create_automaton_from_partition(automaton_t *automaton,
+                                            int *partition, int node_count) {
+  automaton_t result = create_automaton(node_count);
+  result.next_node_index = node_count;
+  bool_t *created = calloc(node_count, sizeof(bool_t));
+  for (int i = 0; i < automaton->max_node_count; i++) {
+    // All nodes of a partition have the same transitions and end tag
+    if (created[partition[i]]) {
+      continue;
+    }
+    created[partition[i]] = 1;
+    for (int e = 0; e < automaton->nodes[i].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[i].edges[e];
+      edge_t *new_edge =
+          get_or_create_edge(&result, partition[i], partition[edge->target]);
+      for (int t = 0; t < 256; t++) {
+        new_edge->transitions[t] |= edge->transitions[t];
+      }
+    }
+    result.nodes[partition[i]].end_tag = automaton->nodes[i].end_tag;
+  }
+  free(created);
+  return result;
 }
 
 /**
- * If the given {@code list} contains an equal state as {@code state}, then a
- * pointer to that equal state is returned. {@code NULL} otherwise.
+ * A partition of the nodes for Hopcroft's algorithm. The nodes of each block
+ * are stored contiguously in {@code nodes}. Marked nodes are moved to the
+ * front of their block.
  */
-dfa_state_t *dfa_state_list_contains_state(automaton_t *automaton,
-                                           dfa_state_list_t *list,
-                                           dfa_state_t *state) {
-  while (list != NULL) {
-    if (dfa_states_equal(automaton, &list->state, state)) {
-      return &list->state;
-    }
-    list = list->next;
+typedef struct partition {
+  int *nodes;
+  int *location; // index of each node in nodes
+  int *block_of;
+  int *block_start;
+  int *block_end;
+  int *marked_end;
+  int block_count;
+} partition_t;
+
+int compare_node_keys(const void *a, const void *b, void *arg) {
+  int *keys = arg;
+  int key0 = keys[*(const int *)a];
+  int key1 = keys[*(const int *)b];
+  if (key0 != key1) {
+    return key0 < key1 ? -1 : 1;
   }
-  return NULL;
+  return *(const int *)a - *(const int *)b;
 }
 
-void connect_dfa_states(dfa_state_t *start, dfa_state_t *end,
-                        unsigned char terminal) {
-  dfa_edge_list_t *list = start->outgoing;
-  while (list != NULL) {
-    if (list->edge.target == end->index) {
-      list->edge.transitions[terminal] = 1;
-      return;
+/**
+ * Creates the initial partition of the {@code N} nodes, where nodes with equal
+ * {@code keys} are in the same block.
+ */
+partition_t create_partition(int *keys, int N) {
+  partition_t partition = {.nodes = malloc(N * sizeof(int)),
+                           .location = malloc(N * sizeof(int)),
+                           .block_of = malloc(N * sizeof(int)),
+                           .block_start = malloc(N * sizeof(int)),
+                           .block_end = malloc(N * sizeof(int)),
+                           .marked_end = malloc(N * sizeof(int)),
+                           .block_count = 0};
+  for (int i = 0; i < N; i++) {
+    partition.nodes[i] = i;
+  }
+  qsort_r(partition.nodes, N, sizeof(int), compare_node_keys, keys);
+  for (int i = 0; i < N; i++) {
+    int node = partition.nodes[i];
+    if (i == 0 || keys[node] != keys[partition.nodes[i - 1]]) {
+      int block = partition.block_count++;
+      partition.block_start[block] = i;
+      partition.marked_end[block] = i;
     }
-    list = list->next;
+    partition.block_end[partition.block_count - 1] = i + 1;
+    partition.block_of[node] = partition.block_count - 1;
+    partition.location[node] = i;
   }
-  list = malloc(sizeof(dfa_edge_list_t));
+  return partition;
+}
 
-  // Fuck this line (cost me my sanity and 2 days)
-  memset(list, 0, sizeof(dfa_edge_list_t));
-  /*                   (
-      __________       )\
-     /         /\______{,}
-     \_________\/
-  */
+void delete_partition(partition_t *partition) {
+  free(partition->nodes);
+  free(partition->location);
+  free(partition->block_of);
+  free(partition->block_start);
+  free(partition->block_end);
+  free(partition->marked_end);
+}
 
-  list->next = start->outgoing;
-  list->edge.target = end->index;
-  list->edge.transitions[terminal] = 1;
-  start->outgoing = list;
+/**
+ * Marks the given {@code node}. Returns whether it is the first marked node of
+ * its block.
+ */
+bool_t mark_partition_node(partition_t *partition, int node) {
+  int block = partition->block_of[node];
+  int location = partition->location[node];
+  if (location < partition->marked_end[block]) {
+    return 0;
+  }
+  // Swap the node with the first unmarked node of its block
+  int target = partition->marked_end[block]++;
+  int other = partition->nodes[target];
+  partition->nodes[target] = node;
+  partition->nodes[location] = other;
+  partition->location[node] = target;
+  partition->location[other] = location;
+  return target == partition->block_start[block];
 }
 
-automaton_t dfa_state_list_to_automaton(dfa_state_list_t *states) {
-  dfa_state_list_t *list = states;
-  int node_count = 0;
-  while (list != NULL) {
-    node_count++;
-    list = list->next;
+/**
+ * Splits the marked nodes of the given {@code block} into a new block, unless
+ * all of its nodes are marked. Unmarks all nodes. Returns the new block, or
+ * {@code -1} if the block has not been split.
+ */
+int split_partition_block(partition_t *partition, int block) {
+  int start = partition->block_start[block];
+  int marked_end = partition->marked_end[block];
+  partition->marked_end[block] = start;
+  if (marked_end == partition->block_end[block]) {
+    return -1;
   }
-  automaton_t automaton = create_automaton(node_count);
-  automaton.start_index = 0;
-  list = states;
-  while (list != NULL) {
-    dfa_edge_list_t *edge_list = list->state.outgoing;
-    while (edge_list != NULL) {
-      for (int t = 0; t < 256; t++) {
-        if (edge_list->edge.transitions[t]) {
-          connect_nodes(&automaton, list->state.index, edge_list->edge.target,
-                        t, 0);
+  int new_block = partition->block_count++;
+  partition->block_start[new_block] = start;
+  partition->block_end[new_block] = marked_end;
+  partition->marked_end[new_block] = start;
+  partition->block_start[block] = marked_end;
+  partition->marked_end[block] = marked_end;
+  for (int i = start; i < marked_end; i++) {
+    partition->block_of[partition->nodes[i]] = new_block;
+  }
+  return new_block;
+}
+
+automaton_t minimize(automaton_t *automaton) {
+  return minimize_counting_rounds(automaton, NULL);
+}
+
+automaton_t minimize_counting_rounds(automaton_t *automaton, int *rounds) {
+  // Hopcroft's algorithm. Missing transitions lead into an additional dead
+  // node D (with index N), which is never merged with any other node. So
+  // nodes with and without a transition stay distinguishable.
+  int N = automaton->max_node_count;
+  int D = N;
+  int *stm = create_state_transition_matrix(automaton);
+  int class_of[256];
+  int representatives[256];
+  int K = compute_terminal_classes(automaton, class_of);
+  get_class_representatives(class_of, K, representatives);
+
+  // Predecessors of each node per class of terminals
+  size_t slots = (size_t)K * (N + 1);
+  int *predecessor_start = calloc(slots + 1, sizeof(int));
+  int *predecessors = malloc(slots * sizeof(int));
+  for (int k = 0; k < K; k++) {
+    for (int node = 0; node <= N; node++) {
+      int target = node == D ? D : stm[node * 256 + representatives[k]];
+      target = target == -1 ? D : target;
+      predecessor_start[k * (N + 1) + target + 1]++;
+    }
+  }
+  for (size_t slot = 0; slot < slots; slot++) {
+    predecessor_start[slot + 1] += predecessor_start[slot];
+  }
+  int *filled = calloc(slots, sizeof(int));
+  for (int k = 0; k < K; k++) {
+    for (int node = 0; node <= N; node++) {
+      int target = node == D ? D : stm[node * 256 + representatives[k]];
+      size_t slot = k * (N + 1) + (target == -1 ? D : target);
+      predecessors[predecessor_start[slot] + filled[slot]++] = node;
+    }
+  }
+  free(filled);
+  free(stm);
+
+  // initial node partition (by end tag, the dead node on its own)
+  int *keys = malloc((N + 1) * sizeof(int));
+  for (int node = 0; node < N; node++) {
+    keys[node] = automaton->nodes[node].end_tag;
+  }
+  keys[D] = -2;
+  partition_t partition = create_partition(keys, N + 1);
+  free(keys);
+
+  // The worklist of splitters (block, class)
+  bool_t *waiting = calloc((size_t)(N + 1) * K, sizeof(bool_t));
+  int *worklist = malloc((size_t)(N + 1) * K * 2 * sizeof(int));
+  size_t worklist_size = 0;
+  for (int block = 0; block < partition.block_count; block++) {
+    for (int k = 0; k < K; k++) {
+      waiting[block * K + k] = 1;
+      worklist[2 * worklist_size] = block;
+      worklist[2 * worklist_size++ + 1] = k;
+    }
+  }
+  int *touched = malloc((N + 1) * sizeof(int));
+  int *splitter = malloc((N + 1) * sizeof(int));
+  int steps = 0;
+  while (worklist_size > 0) {
+    worklist_size--;
+    int block = worklist[2 * worklist_size];
+    int k = worklist[2 * worklist_size + 1];
+    waiting[block * K + k] = 0;
+    steps++;
+
+    // Copy the splitter, its block may be split below
+    int splitter_size = 0;
+    for (int i = partition.block_start[block]; i < partition.block_end[block];
+         i++) {
+      splitter[splitter_size++] = partition.nodes[i];
+    }
+    int touched_count = 0;
+    for (int i = 0; i < splitter_size; i++) {
+      size_t slot = k * (N + 1) + splitter[i];
+      for (int p = predecessor_start[slot]; p < predecessor_start[slot + 1];
+           p++) {
+        int node = predecessors[p];
+        if (mark_partition_node(&partition, node)) {
+          touched[touched_count++] = partition.block_of[node];
+        }
+      }
+    }
+    for (int i = 0; i < touched_count; i++) {
+      int old_block = touched[i];
+      int new_block = split_partition_block(&partition, old_block);
+      if (new_block == -1) {
+        continue;
+      }
+      int old_size =
+          partition.block_end[old_block] - partition.block_start[old_block];
+      int new_size =
+          partition.block_end[new_block] - partition.block_start[new_block];
+      for (int c = 0; c < K; c++) {
+        // Waiting splitters must be split too, otherwise the smaller half
+        // suffices
+        int added = waiting[old_block * K + c] || new_size <= old_size
+                        ? new_block
+                        : old_block;
+        if (!waiting[added * K + c]) {
+          waiting[added * K + c] = 1;
+          worklist[2 * worklist_size] = added;
+          worklist[2 * worklist_size++ + 1] = c;
         }
       }
-      edge_list = edge_list->next;
     }
-    automaton.nodes[list->state.index].end_tag = list->state.end_tag;
-    list = list->next;
   }
-  delete_dfa_state_list(states);
-  return automaton;
+  free(predecessor_start);
+  free(predecessors);
+  free(waiting);
+  free(worklist);
+  free(touched);
+  free(splitter);
+
+  // Number the partitions in the order of their lowest node
+  int *block_index = malloc(partition.block_count * sizeof(int));
+  memset(block_index, 0xff, partition.block_count * sizeof(int));
+  int *node_partition = malloc(N * sizeof(int));
+  int partition_count = 0;
+  for (int node = 0; node < N; node++) {
+    int block = partition.block_of[node];
+    if (block_index[block] == -1) {
+      block_index[block] = partition_count++;
+    }
+    node_partition[node] = block_index[block];
+  }
+  automaton_t result = create_automaton_from_partition(
+      automaton, node_partition, partition_count);
+  result.start_index = node_partition[automaton->start_index];
+  free(block_index);
+  free(node_partition);
+  delete_partition(&partition);
+
+  if (rounds != NULL) {
+    *rounds = steps;
+  }
+  return result;
 }
 
-automaton_t determinize(automaton_t *automaton) {
-  dfa_state_list_t *d_states = create_dfa_state_list(
-      make_epsclosure(automaton, initial_state(automaton)), NULL);
-  bool_t state_changed;
-  int next_idx = 1;
-  do {
-    state_changed = 0;
-    dfa_state_list_t *d_states_iter = d_states;
-    while (d_states_iter != NULL) {
-      for (int t = 0; t < 256; t++) {
-        dfa_state_t new_state = make_epsclosure(
-            automaton, move(automaton, &d_states_iter->state, t, next_idx));
-        if (!dfa_state_empty(automaton, &new_state)) {
-          dfa_state_t *existing_state =
-              dfa_state_list_contains_state(automaton, d_states, &new_state);
-          if (!existing_state) {
-            d_states = create_dfa_state_list(new_state, d_states);
-            existing_state = &d_states->state;
-            state_changed = 1;
-            next_idx++;
-          } else {
-            delete_dfa_state(new_state);
-          }
-          connect_dfa_states(&d_states_iter->state, existing_state, t);
-        } else {
-          delete_dfa_state(new_state);
-        }
+unsigned long automaton_fingerprint(automaton_t *automaton) {
+  int N = automaton->max_node_count;
+  int *stm = create_state_transition_matrix(automaton);
+  unsigned long hash =
+      hash_bytes(&automaton->start_index, sizeof(int), HASH_SEED);
+  hash = hash_bytes(stm, N * 256 * sizeof(int), hash);
+  for (int i = 0; i < N; i++) {
+    hash = hash_bytes(&automaton->nodes[i].end_tag, sizeof(int), hash);
+  }
+  free(stm);
+  return hash;
+}
+
+automaton_t renumber_automaton(automaton_t *automaton, int *new_index) {
+  int N = automaton->max_node_count;
+  automaton_t result = create_automaton(N);
+  result.next_node_index = automaton->next_node_index;
+  result.start_index = new_index[automaton->start_index];
+  for (int i = 0; i < N; i++) {
+    for (int e = 0; e < automaton->nodes[i].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[i].edges[e];
+      edge_t *new_edge =
+          get_or_create_edge(&result, new_index[i], new_index[edge->target]);
+      memcpy(new_edge->transitions, edge->transitions,
+             sizeof(edge->transitions));
+    }
+    result.nodes[new_index[i]].end_tag = automaton->nodes[i].end_tag;
+  }
+  return result;
+}
+
+bool_t automata_equivalent(automaton_t *a0, automaton_t *a1) {
+  // Explore all reachable pairs of states, the missing transitions lead into
+  // a dead state (with index N)
+  int N0 = a0->max_node_count;
+  int N1 = a1->max_node_count;
+  int *stm0 = create_state_transition_matrix(a0);
+  int *stm1 = create_state_transition_matrix(a1);
+  bool_t *visited = calloc((size_t)(N0 + 1) * (N1 + 1), sizeof(bool_t));
+  int *queue = malloc(2 * sizeof(int));
+  size_t queue_capacity = 1;
+  size_t queue_size = 1;
+  queue[0] = a0->start_index;
+  queue[1] = a1->start_index;
+  visited[(size_t)queue[0] * (N1 + 1) + queue[1]] = 1;
+  bool_t equivalent = 1;
+  for (size_t i = 0; i < queue_size && equivalent; i++) {
+    int s0 = queue[2 * i];
+    int s1 = queue[2 * i + 1];
+    int end_tag0 = s0 == N0 ? -1 : a0->nodes[s0].end_tag;
+    int end_tag1 = s1 == N1 ? -1 : a1->nodes[s1].end_tag;
+    if (end_tag0 != end_tag1) {
+      equivalent = 0;
+      break;
+    }
+    for (int t = 0; t < 256; t++) {
+      int d0 = s0 == N0 ? -1 : stm0[s0 * 256 + t];
+      int d1 = s1 == N1 ? -1 : stm1[s1 * 256 + t];
+      d0 = d0 == -1 ? N0 : d0;
+      d1 = d1 == -1 ? N1 : d1;
+      bool_t *seen = &visited[(size_t)d0 * (N1 + 1) + d1];
+      if (*seen) {
+        continue;
+      }
+      *seen = 1;
+      if (queue_size == queue_capacity) {
+        queue_capacity *= 2;
+        queue = realloc(queue, 2 * queue_capacity * sizeof(int));
       }
-      d_states_iter = d_states_iter->next;
+      queue[2 * queue_size] = d0;
+      queue[2 * queue_size + 1] = d1;
+      queue_size++;
     }
-  } while (state_changed);
-  return dfa_state_list_to_automaton(d_states);
+  }
+  free(stm0);
+  free(stm1);
+  free(visited);
+  free(queue);
+  return equivalent;
 }
 
 /**
- * Returns whether or not the transitions from the given {@code node0} and
- * {@code node1} result in the same partition for every terminal.
- * (See Moore's Algorithm)
+ * The pairs of states of a product automaton under construction, which are
+ * looked up via an open addressing hash table.
  */
-bool_t nodes_equivalent(bool_t *stm, int node0, int node1, int *partition) {
-  for (int t = 0; t < 256; t++) {
-    int dest0 = stm[node0 * 256 + t];
-    int dest1 = stm[node1 * 256 + t];
-    if (dest0 == dest1) {
-      continue;
+typedef struct state_pairs {
+  int *pairs;   // 2 entries per state
+  int *targets; // 256 entries per state, -1 for no transition
+  int count;
+  int capacity;
+  int *buckets; // bucket_count entries, -1 for empty
+  int bucket_count;
+} state_pairs_t;
+
+void insert_state_pair_bucket(state_pairs_t *states, int state) {
+  int mask = states->bucket_count - 1;
+  int bucket =
+      hash_bytes(&states->pairs[2 * state], 2 * sizeof(int), HASH_SEED) & mask;
+  while (states->buckets[bucket] != -1) {
+    bucket = (bucket + 1) & mask;
+  }
+  states->buckets[bucket] = state;
+}
+
+/**
+ * Returns the state of the pair ({@code s0}, {@code s1}). The state is
+ * created, if it does not exist yet. Returns -1 if there are too many states.
+ */
+int find_or_add_state_pair(state_pairs_t *states, int s0, int s1) {
+  int pair[2] = {s0, s1};
+  int mask = states->bucket_count - 1;
+  int bucket = hash_bytes(pair, sizeof(pair), HASH_SEED) & mask;
+  while (states->buckets[bucket] != -1) {
+    int state = states->buckets[bucket];
+    if (states->pairs[2 * state] == s0 && states->pairs[2 * state + 1] == s1) {
+      return state;
     }
-    if (dest0 == -1 || dest1 == -1) {
-      return 0;
+    bucket = (bucket + 1) & mask;
+  }
+  if (states->count == states->capacity) {
+    // The states are numbered by ints, and so are the buckets
+    if (states->capacity > INT_MAX / 4) {
+      return -1;
     }
-    if (partition[dest0] != partition[dest1]) {
-      return 0;
+    states->capacity *= 2;
+    states->pairs =
+        realloc(states->pairs, (size_t)states->capacity * 2 * sizeof(int));
+    states->targets =
+        realloc(states->targets, (size_t)states->capacity * 256 * sizeof(int));
+    // Keep the load factor of the hash table at most one half
+    free(states->buckets);
+    states->bucket_count = states->capacity * 2;
+    states->buckets = malloc((size_t)states->bucket_count * sizeof(int));
+    memset(states->buckets, 0xff, (size_t)states->bucket_count * sizeof(int));
+    for (int state = 0; state < states->count; state++) {
+      insert_state_pair_bucket(states, state);
     }
   }
-  return 1;
+  int state = states->count++;
+  states->pairs[2 * state] = s0;
+  states->pairs[2 * state + 1] = s1;
+  insert_state_pair_bucket(states, state);
+  return state;
 }
 
-bool_t *create_state_transition_matrix(automaton_t *automaton) {
-  int N = automaton->max_node_count;
-  size_t stm_size = N * 256 * sizeof(bool_t);
-  bool_t *stm = malloc(stm_size);
-  memset(stm, 0xff, stm_size);
-  for (int start = 0; start < N; start++) {
-    for (int end = 0; end < N; end++) {
-      for (int t = 0; t < 256; t++) {
-        if (automaton->adjacency_matrix[edge_idx(automaton, start, end)]
-                .transitions[t]) {
-          stm[start * 256 + t] = end;
-        }
-      }
+/**
+ * Returns the end tag of a product state, whose states in the two automata
+ * have the end tags {@code end_tag0} and {@code end_tag1} ({@code -1} for not
+ * accepting).
+ */
+int combine_end_tags(int end_tag0, int end_tag1,
+                     automaton_operation_t operation) {
+  switch (operation) {
+  case UNION_OPERATION:
+    break;
+  case INTERSECTION_OPERATION:
+    if (end_tag0 == -1 || end_tag1 == -1) {
+      return -1;
     }
+    break;
+  case DIFFERENCE_OPERATION:
+    return end_tag1 == -1 ? end_tag0 : -1;
   }
-  return stm;
+  return end_tag0 != -1 && (end_tag1 == -1 || end_tag0 < end_tag1) ? end_tag0
+                                                                   : end_tag1;
 }
 
-bool_t partitions_equivalent(int *p0, int *p1, int N) {
-  for (int i = 0; i < N; i++) {
-    if (p0[i] != p1[i]) {
-      return 0;
+automaton_t combine_automata(automaton_t *a0, automaton_t *a1,
+                             automaton_operation_t operation, int tag_offset) {
+  int *stm0 = create_state_transition_matrix(a0);
+  int *stm1 = create_state_transition_matrix(a1);
+  state_pairs_t states = {.capacity = 8, .bucket_count = 16};
+  states.pairs = malloc((size_t)states.capacity * 2 * sizeof(int));
+  states.targets = malloc((size_t)states.capacity * 256 * sizeof(int));
+  states.buckets = malloc(states.bucket_count * sizeof(int));
+  memset(states.buckets, 0xff, states.bucket_count * sizeof(int));
+
+  // A state of -1 means that the automaton does not match anymore. Pairs,
+  // which cannot be accepted anymore by the operation, are not created.
+  find_or_add_state_pair(&states, a0->start_index, a1->start_index);
+  bool_t complete = 1;
+  for (int state = 0; complete && state < states.count; state++) {
+    for (int t = 0; t < 256; t++) {
+      int s0 = states.pairs[2 * state];
+      int s1 = states.pairs[2 * state + 1];
+      int d0 = s0 == -1 ? -1 : stm0[s0 * 256 + t];
+      int d1 = s1 == -1 ? -1 : stm1[s1 * 256 + t];
+      bool_t alive = operation == UNION_OPERATION
+                         ? d0 != -1 || d1 != -1
+                         : d0 != -1 && (d1 != -1 || operation ==
+                                                       DIFFERENCE_OPERATION);
+      int target = -1;
+      if (alive) {
+        target = find_or_add_state_pair(&states, d0, d1);
+        complete &= target != -1;
+      }
+      states.targets[(size_t)state * 256 + t] = target;
     }
   }
-  return 1;
+
+  // Without all states, the result fails like an automaton with too many nodes
+  automaton_t result = create_automaton(complete ? states.count : SIZE_MAX);
+  result.next_node_index = result.max_node_count;
+  for (int state = 0; state < result.max_node_count; state++) {
+    for (int t = 0; t < 256; t++) {
+      int target = states.targets[(size_t)state * 256 + t];
+      if (target != -1) {
+        connect_nodes(&result, state, target, t, 0);
+      }
+    }
+    int s0 = states.pairs[2 * state];
+    int s1 = states.pairs[2 * state + 1];
+    int end_tag0 = s0 == -1 ? -1 : a0->nodes[s0].end_tag;
+    int end_tag1 = s1 == -1 ? -1 : a1->nodes[s1].end_tag;
+    if (end_tag1 != -1) {
+      end_tag1 += tag_offset;
+    }
+    result.nodes[state].end_tag =
+        combine_end_tags(end_tag0, end_tag1, operation);
+  }
+  free(stm0);
+  free(stm1);
+  free(states.pairs);
+  free(states.targets);
+  free(states.buckets);
+  if (result.nodes == NULL) {
+    return result;
+  }
+
+  automaton_t trimmed = trim_automaton(&result);
+  delete_automaton(result);
+  return trimmed;
 }
 
-void print_partition(int *p, int N) {
-  for (int i = 0; i < N; i++) {
-    printf(" %d", p[i]);
+automaton_t union_automata(automaton_t *a0, automaton_t *a1, int tag_offset) {
+  return combine_automata(a0, a1, UNION_OPERATION, tag_offset);
+}
+
+automaton_t intersect_automata(automaton_t *a0, automaton_t *a1) {
+  return combine_automata(a0, a1, INTERSECTION_OPERATION, 0);
+}
+
+automaton_t subtract_automata(automaton_t *a0, automaton_t *a1) {
+  return combine_automata(a0, a1, DIFFERENCE_OPERATION, 0);
+}
+
+automaton_t complement_automaton(automaton_t *automaton, int end_tag) {
+  // Complete the automaton with a sink node N, and swap accepting and not
+  // accepting nodes
+  int N = automaton->max_node_count;
+  int *stm = create_state_transition_matrix(automaton);
+  automaton_t result = create_automaton(N + 1);
+  result.next_node_index = N + 1;
+  result.start_index = automaton->start_index;
+  for (int node = 0; node <= N; node++) {
+    for (int t = 0; t < 256; t++) {
+      int target = node == N ? -1 : stm[node * 256 + t];
+      connect_nodes(&result, node, target == -1 ? N : target, t, 0);
+    }
+    bool_t accepting = node < N && automaton->nodes[node].end_tag != -1;
+    result.nodes[node].end_tag = accepting ? -1 : end_tag;
   }
-  printf("\n");
+  free(stm);
+
+  automaton_t trimmed = trim_automaton(&result);
+  delete_automaton(result);
+  return trimmed;
 }
 
-automaton_t create_automaton_from_partition(automaton_t *automaton,
-                                            int *partition, int node_count) {
-  automaton_t result = create_automaton(node_count);
-  int old_N = automaton->max_node_count;
-  for (int i = 0; i < old_N; i++) {
-    for (int j = 0; j < old_N; j++) {
-      for (int t = 0; t < 256; t++) {
-        if (automaton->adjacency_matrix[edge_idx(automaton, i, j)]
-                .transitions[t]) {
-          connect_nodes(&result, partition[i], partition[j], t, 0);
-        }
+automaton_t reverse_automaton(automaton_t *automaton) {
+  // The nodes keep their indices, a new start node N leads to the old end
+  // nodes
+  int N = automaton->max_node_count;
+  automaton_t result = create_automaton(N + 1);
+  result.next_node_index = N + 1;
+  result.start_index = N;
+  for (int node = 0; node < N; node++) {
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[node].edges[e];
+      edge_t *new_edge = get_or_create_edge(&result, edge->target, node);
+      for (int t = 0; t < MAX_EDGES; t++) {
+        new_edge->transitions[t] |= edge->transitions[t];
       }
     }
-    int end_tag = automaton->nodes[i].end_tag;
-    if (end_tag != -1) {
-      result.nodes[partition[i]].end_tag = end_tag;
+    if (automaton->nodes[node].end_tag != -1) {
+      connect_nodes(&result, N, node, 0, 1);
     }
   }
+  result.nodes[automaton->start_index].end_tag = 0;
   return result;
 }
 
-automaton_t minimize(automaton_t *automaton) {
+automaton_t unanchor_automaton(automaton_t *automaton) {
+  // A new start node N loops on every byte before entering the old start node
   int N = automaton->max_node_count;
-  size_t partition_size = N * sizeof(int);
-  int *partition0 = malloc(partition_size);
-  int *partition1 = malloc(partition_size);
-  // set all values to -1
-  memset(partition0, 0xff, partition_size);
-  memset(partition1, 0xff, partition_size);
-  bool_t *stm = create_state_transition_matrix(automaton);
-
-  // initial node partition (end states vs normal state)
-  for (int i = 0; i < N; i++) {
-    partition0[i] = automaton->nodes[i].end_tag;
+  automaton_t result = create_automaton(N + 1);
+  result.next_node_index = N + 1;
+  result.start_index = N;
+  for (int node = 0; node < N; node++) {
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[node].edges[e];
+      memcpy(get_or_create_edge(&result, node, edge->target)->transitions,
+             edge->transitions, sizeof(edge->transitions));
+    }
+    result.nodes[node].end_tag = automaton->nodes[node].end_tag;
+  }
+  for (int t = 0; t < 256; t++) {
+    connect_nodes(&result, N, N, t, 0);
+  }
+  connect_nodes(&result, N, automaton->start_index, 0, 1);
+  return result;
+}
+
+automaton_t trim_automaton(automaton_t *automaton) {
+  int N = automaton->max_node_count;
+  // Collect the predecessors of each node (compressed by target)
+  int *predecessor_start = calloc(N + 1, sizeof(int));
+  for (int node = 0; node < N; node++) {
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      predecessor_start[automaton->nodes[node].edges[e].target + 1]++;
+    }
+  }
+  for (int node = 0; node < N; node++) {
+    predecessor_start[node + 1] += predecessor_start[node];
+  }
+  int *predecessors = malloc(predecessor_start[N] * sizeof(int));
+  int *fill = malloc(N * sizeof(int));
+  memcpy(fill, predecessor_start, N * sizeof(int));
+  for (int node = 0; node < N; node++) {
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      predecessors[fill[automaton->nodes[node].edges[e].target]++] = node;
+    }
   }
 
-  while (1) {
-    int next_partition_idx = 0;
+  // Search backwards from the accepting nodes, the start node is always kept
+  int *new_index = fill;
+  memset(new_index, 0xff, N * sizeof(int));
+  int *queue = malloc(N * sizeof(int));
+  int count = 0;
+  for (int node = 0; node < N; node++) {
+    if (automaton->nodes[node].end_tag != -1) {
+      new_index[node] = count;
+      queue[count++] = node;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    for (int p = predecessor_start[queue[i]];
+         p < predecessor_start[queue[i] + 1]; p++) {
+      if (new_index[predecessors[p]] == -1) {
+        new_index[predecessors[p]] = count;
+        queue[count++] = predecessors[p];
+      }
+    }
+  }
+  if (new_index[automaton->start_index] == -1) {
+    new_index[automaton->start_index] = count++;
+  }
 
-    int i = 0;
-    while (i < N) {
-      partition1[i] = next_partition_idx;
-      int i_next = N;
-      for (int j = i + 1; j < N; j++) {
-        if (partition1[j] >= 0) {
-          // that node is already partitioned
-          continue;
-        }
-        if (partition0[i] == partition0[j] &&
-            nodes_equivalent(stm, i, j, partition0)) {
-          // nodes are equivalent -> put into same partition
-          partition1[j] = next_partition_idx;
-        } else if (i_next == N) {
-          // nodes are not equivalent -> create new partition and
-          // start at this node
-          i_next = j;
-        }
+  // Keep the order of the remaining nodes
+  for (int node = 0, next = 0; node < N; node++) {
+    if (new_index[node] != -1) {
+      new_index[node] = next++;
+    }
+  }
+  automaton_t result = create_automaton(count);
+  result.next_node_index = count;
+  result.start_index = new_index[automaton->start_index];
+  for (int node = 0; node < N; node++) {
+    if (new_index[node] == -1) {
+      continue;
+    }
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[node].edges[e];
+      if (new_index[edge->target] == -1) {
+        continue;
       }
-      i = i_next;
-      next_partition_idx++;
+      edge_t *new_edge =
+          get_or_create_edge(&result, new_index[node], new_index[edge->target]);
+      memcpy(new_edge->transitions, edge->transitions,
+             sizeof(edge->transitions));
     }
+    result.nodes[new_index[node]].end_tag = automaton->nodes[node].end_tag;
+  }
+  free(predecessor_start);
+  free(predecessors);
+  free(new_index);
+  free(queue);
+  return result;
+}
 
-    if (partitions_equivalent(partition0, partition1, N)) {
-      automaton_t result = create_automaton_from_partition(
-          automaton, partition1, next_partition_idx);
+automaton_t canonicalize_automaton(automaton_t *automaton) {
+  int N = automaton->max_node_count;
+  int *stm = create_state_transition_matrix(automaton);
+  int *new_index = malloc(N * sizeof(int));
+  int *queue = malloc(N * sizeof(int));
+  memset(new_index, 0xff, N * sizeof(int));
+  int count = 0;
+  new_index[automaton->start_index] = count;
+  queue[count++] = automaton->start_index;
+  for (int i = 0; i < count; i++) {
+    for (int t = 0; t < 256; t++) {
+      int target = stm[queue[i] * 256 + t];
+      if (target != -1 && new_index[target] == -1) {
+        new_index[target] = count;
+        queue[count++] = target;
+      }
+    }
+  }
+  // Unreachable nodes keep their order behind all reachable ones
+  for (int node = 0; node < N; node++) {
+    if (new_index[node] == -1) {
+      new_index[node] = count++;
+    }
+  }
+  automaton_t result = renumber_automaton(automaton, new_index);
+  free(stm);
+  free(new_index);
+  free(queue);
+  return result;
+}
 
-      free(partition0);
-      free(partition1);
-      free(stm);
+int count_edges(automaton_t *automaton) {
+  int count = 0;
+  for (int node = 0; node < automaton->max_node_count; node++) {
+    count += automaton->nodes[node].edge_count;
+  }
+  return count;
+}
 
-      return result;
+int count_epsilon_edges(automaton_t *automaton) {
+  int count = 0;
+  for (int node = 0; node < automaton->max_node_count; node++) {
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      count += automaton->nodes[node].edges[e].transitions[EPSILON_EDGE] != 0;
     }
-
-    // swap partitions and reset one
-    int *tmp = partition0;
-    partition0 = partition1;
-    partition1 = tmp;
-    memset(partition1, 0xff, partition_size);
   }
+  return count;
 }
 
 void delete_automaton(automaton_t automaton) {
-  free(automaton.adjacency_matrix);
+  for (int node = 0; node < automaton.max_node_count; node++) {
+    free(automaton.nodes[node].edges);
+  }
   free(automaton.nodes);
 }
@@ -3,20 +3,35 @@
 #include <stdio.h>
 
 #include "common.h"
+#include "tag_sets.h"
 
 #define EPSILON_EDGE 256
 #define MAX_EDGES 257
 
 typedef struct edge {
+  int target;
   bool_t transitions[MAX_EDGES];
 } edge_t;
 
 typedef struct node {
   int end_tag;
+  edge_t *edges; // outgoing edges, at most one per target, sorted by target
+  int edge_count;
+  int edge_capacity;
 } node_t;
 
+typedef struct dfa_budget {
+  int max_states;    // 0 for no limit
+  size_t max_memory; // in bytes, 0 for no limit
+} dfa_budget_t;
+
+typedef enum automaton_operation {
+  UNION_OPERATION,
+  INTERSECTION_OPERATION,
+  DIFFERENCE_OPERATION,
+} automaton_operation_t;
+
 typedef struct automaton {
-  edge_t *adjacency_matrix;
   node_t *nodes;
   int max_node_count;
   int next_node_index;
@@ -29,9 +44,12 @@ typedef struct automaton {
 void print_automaton(automaton_t *automaton, FILE *fout);
 
 /**
- * Creates an automaton which can hold up to {@code node_count} nodes.
+ * Creates an automaton which can hold up to {@code node_count} nodes. Node
+ * counts are computed as {@code size_t} (see {@code add_sizes}). If the count
+ * is larger than {@code INT_MAX} or the nodes cannot be allocated, the
+ * automaton has no nodes ({@code nodes == NULL}); it can still be deleted.
  */
-automaton_t create_automaton(int node_count);
+automaton_t create_automaton(size_t node_count);
 
 /**
  * Creates a new node in the given {@code automaton}.
@@ -46,24 +64,195 @@ int create_node(automaton_t *automaton);
 void connect_nodes(automaton_t *automaton, int node0, int node1,
                    unsigned char terminal, bool_t is_epsilon);
 
+/**
+ * Returns the edge from {@code node0} to {@code node1}, or {@code NULL} if the
+ * nodes are not connected.
+ */
+edge_t *get_edge(automaton_t *automaton, int node0, int node1);
+
+/**
+ * Splits the classes of terminals, such that terminals {@code t} with {@code
+ * transitions[t] != 0} and those without end up in different classes. {@code
+ * class_of} holds the class of each of the 256 terminals, and is updated in
+ * place. Classes are numbered in the order of their lowest terminal. Returns
+ * the new number of classes.
+ */
+int refine_terminal_classes(int *class_of, const bool_t *transitions);
+
+/**
+ * Computes the classes of terminals, which cannot be distinguished by any
+ * transition of the given {@code automaton}, into {@code class_of} (see {@code
+ * refine_terminal_classes}). Returns the number of classes.
+ */
+int compute_terminal_classes(automaton_t *automaton, int *class_of);
+
+/**
+ * Stores one terminal of each of the {@code class_count} classes into {@code
+ * representatives}.
+ */
+void get_class_representatives(int *class_of, int class_count,
+                               int *representatives);
+
+/**
+ * Adds all nodes, which can be reached from the {@code size} given {@code
+ * nodes} via epsilon-transitions, to {@code nodes}. This is the
+ * epsilon-closure of {@code nodes}. Nodes in the set are marked with {@code
+ * stamp} in {@code mark}. Returns the new number of nodes.
+ */
+int make_epsclosure(automaton_t *automaton, int *nodes, int size, int *mark,
+                    int stamp);
+
 /**
  * Creates a new automaton, which is equivalent to the given {@code automaton},
  * but is deterministic.
  */
 automaton_t determinize(automaton_t *automaton);
 
+/**
+ * Same as {@code determinize}, but stops as soon as the deterministic
+ * automaton would get more states than {@code budget->max_states}, or the
+ * determinization (including the result) would need more memory than {@code
+ * budget->max_memory}. Returns 1 and stores the deterministic automaton into
+ * {@code result} on success. Returns 0 if the budget has been exceeded; all
+ * intermediate memory is freed in that case. A {@code budget} of {@code NULL}
+ * means no limit.
+ */
+bool_t determinize_bounded(automaton_t *automaton, dfa_budget_t *budget,
+                           automaton_t *result);
+
+/**
+ * Same as {@code determinize}, but the end tag of every state is the index of
+ * the set of the end tags of all its NFA nodes in {@code tag_sets} (see {@code
+ * intern_tag_set}), or -1 if none of them has an end tag, instead of the
+ * lowest of those end tags. Minimizing the result keeps states with different
+ * sets apart, since their end tags differ.
+ */
+automaton_t determinize_tag_sets(automaton_t *automaton, tag_sets_t *tag_sets);
+
 /**
  * Creates a new automaton, which is equivalent to the given {@code automaton},
  * but is minimal. The given {@code automaton} must be deterministic.
  */
 automaton_t minimize(automaton_t *automaton);
 
+/**
+ * Same as {@code minimize}, but additionally stores the number of partition
+ * refinement rounds into {@code rounds} (if it is not {@code NULL}). The
+ * minimization uses Hopcroft's algorithm, a round is the split of all blocks
+ * by one (block, terminal class) splitter.
+ */
+automaton_t minimize_counting_rounds(automaton_t *automaton, int *rounds);
+
 /**
  * Deletes a given {@code automaton} and frees all its related memory.
  */
 void delete_automaton(automaton_t automaton);
 
 /**
- * Creates a state transition matrix for the given {@code automaton}.
+ * Creates a state transition matrix for the given {@code automaton}. The
+ * matrix has 256 entries per node, which hold the target node of the
+ * transition with that terminal, or {@code -1} if there is none.
+ */
+int *create_state_transition_matrix(automaton_t *automaton);
+
+/**
+ * Returns a hash of the structure of the given deterministic {@code automaton}
+ * (transitions, end tags and start node). Automata with equal numbering and
+ * transitions have equal fingerprints.
+ */
+unsigned long automaton_fingerprint(automaton_t *automaton);
+
+/**
+ * Creates a new automaton, which is equal to the given {@code automaton}, but
+ * node {@code i} is moved to index {@code new_index[i]}. {@code new_index}
+ * must be a permutation of all node indices.
+ */
+automaton_t renumber_automaton(automaton_t *automaton, int *new_index);
+
+/**
+ * Returns whether the two given deterministic automata accept the same strings
+ * with the same end tags.
+ */
+bool_t automata_equivalent(automaton_t *a0, automaton_t *a1);
+
+/**
+ * Creates the product of the two given deterministic automata, which accepts
+ * the strings of the {@code operation}:
+ *
+ * UNION_OPERATION        strings accepted by {@code a0} or {@code a1}
+ * INTERSECTION_OPERATION strings accepted by {@code a0} and {@code a1}
+ * DIFFERENCE_OPERATION   strings accepted by {@code a0}, but not {@code a1}
+ *
+ * End tags of {@code a1} are shifted by {@code tag_offset}. A state, which
+ * accepts in both automata, gets the lower end tag; with a difference, the
+ * states keep the end tags of {@code a0}. The result is deterministic and
+ * trimmed (see {@code trim_automaton}), but not minimal. If the product has
+ * more states than can be numbered by ints, the result has no nodes (see
+ * {@code create_automaton}).
+ */
+automaton_t combine_automata(automaton_t *a0, automaton_t *a1,
+                             automaton_operation_t operation, int tag_offset);
+
+/**
+ * Same as {@code combine_automata} with {@code UNION_OPERATION}.
+ */
+automaton_t union_automata(automaton_t *a0, automaton_t *a1, int tag_offset);
+
+/**
+ * Same as {@code combine_automata} with {@code INTERSECTION_OPERATION}.
+ */
+automaton_t intersect_automata(automaton_t *a0, automaton_t *a1);
+
+/**
+ * Same as {@code combine_automata} with {@code DIFFERENCE_OPERATION}.
+ */
+automaton_t subtract_automata(automaton_t *a0, automaton_t *a1);
+
+/**
+ * Creates a deterministic automaton, which accepts exactly the strings of
+ * bytes, which the given deterministic {@code automaton} does not accept.
+ * Accepting states are tagged with {@code end_tag}. The result is trimmed, but
+ * not minimal.
+ */
+automaton_t complement_automaton(automaton_t *automaton, int end_tag);
+
+/**
+ * Creates a nondeterministic automaton, which accepts exactly the reversed
+ * strings accepted by the given {@code automaton}, with end tag 0.
+ */
+automaton_t reverse_automaton(automaton_t *automaton);
+
+/**
+ * Creates a nondeterministic automaton, which accepts every string ending with
+ * a string accepted by the given {@code automaton} (with its end tag). Its DFA
+ * finds the ends of all matches of the automaton in a single pass.
+ */
+automaton_t unanchor_automaton(automaton_t *automaton);
+
+/**
+ * Creates a new automaton, which is equal to the given deterministic {@code
+ * automaton}, but without the nodes, from which no end node can be reached
+ * (except for the start node). The parser of a trimmed automaton rejects as
+ * soon as the input cannot be accepted anymore.
+ */
+automaton_t trim_automaton(automaton_t *automaton);
+
+/**
+ * Creates a new automaton, which is equal to the given deterministic {@code
+ * automaton}, but numbered in breadth-first order from the start node
+ * (following the transitions in the order of their terminals). Equal minimal
+ * automata are therefore numbered equally, no matter how they were built.
+ */
+automaton_t canonicalize_automaton(automaton_t *automaton);
+
+/**
+ * Returns the number of node pairs of the given {@code automaton}, which are
+ * connected by at least one transition (epsilon or not).
+ */
+int count_edges(automaton_t *automaton);
+
+/**
+ * Returns the number of node pairs of the given {@code automaton}, which are
+ * connected by an epsilon transition.
  */
-bool_t *create_state_transition_matrix(automaton_t *automaton);
+int count_epsilon_edges(automaton_t *automaton);
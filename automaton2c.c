@@ -1,74 +1,823 @@
 #include "automaton2c.h"
 #include "common.h"
+#include "profile.h"
 
 #include <err.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Profile-guided if-chains test at most this many arms before the switch
+#define MAX_HOT_CASE_ARMS 4
+// ... and stop once the tested arms cover this percentage of all hits
+#define HOT_CASE_ARMS_COVERAGE 90
+// Arms with at least this percentage of all hits are hinted as likely
+#define DOMINANT_CASE_ARM_SHARE 75
+// Chains of at least this many equal states are emitted as one counted state
+#define MIN_COUNTED_CHAIN 16
+// Estimated conditional branches per byte of a bitmap test (bounds and bit)
+#define BITMAP_DISPATCH_COST 2
+// ... and of a table lookup (bounds, load and the reject test), which is only
+// worth its 256 table entries if the arms would need more branches
+#define TABLE_DISPATCH_COST 4
+
+static void print_profile_counters(automaton_t *automaton, char *parser_name,
+                                   FILE *fout) {
+  fprintf(fout, "#include <stdio.h>\n");
+  fprintf(fout, "static unsigned long %s_state_visits[%d];\n", parser_name,
+          automaton->max_node_count);
+  fprintf(fout, "static unsigned long %s_transition_hits[%d][256];\n",
+          parser_name, automaton->max_node_count);
+}
+
+static void print_profile_dump(automaton_t *automaton, char *parser_name,
+                               int flags, FILE *fout) {
+  int N = automaton->max_node_count;
+  fprintf(fout, "%sint %s_dump_profile(const char *path) {\n",
+          get_parser_storage(flags), parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "FILE *fout = fopen(path, \"w\");\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "if (fout == NULL) { return -1; }\n");
+  fprint_indent(2, fout);
+  fprintf(fout,
+          "fprintf(fout, \"regex2c-profile %d\\nfingerprint %016lx\\n"
+          "states %d\\n\");\n",
+          REGEX2C_PROFILE_VERSION, automaton_fingerprint(automaton), N);
+  fprint_indent(2, fout);
+  fprintf(fout, "for (int s = 0; s < %d; s++) {\n", N);
+  fprint_indent(4, fout);
+  fprintf(fout,
+          "unsigned long visits = __atomic_load_n(&%s_state_visits[s], "
+          "__ATOMIC_RELAXED);\n",
+          parser_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "if (visits) { fprintf(fout, \"state %%d %%lu\\n\", s, "
+                "visits); }\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "for (int c = 0; c < 256; c++) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout,
+          "unsigned long hits = __atomic_load_n(&%s_transition_hits[s][c], "
+          "__ATOMIC_RELAXED);\n",
+          parser_name);
+  fprint_indent(6, fout);
+  fprintf(fout, "if (hits) { fprintf(fout, \"transition %%d %%d %%lu\\n\", "
+                "s, c, hits); }\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return fclose(fout) == 0 ? 0 : -1;\n");
+  fprintf(fout, "}\n");
+}
+
+/**
+ * Returns whether {@code state} continues the chain starting at {@code first}:
+ * it has the same end tag and the same targets as {@code first}, except that
+ * all terminals, which lead from {@code first} to {@code second}, lead to the
+ * same state (which is stored into {@code next}).
+ */
+static bool_t continues_chain(automaton_t *automaton, int *stm, int first,
+                              int second, int state, int *next) {
+  if (automaton->nodes[state].end_tag != automaton->nodes[first].end_tag) {
+    return 0;
+  }
+  *next = -1;
+  for (int t = 0; t < 256; t++) {
+    int target = stm[state * 256 + t];
+    if (stm[first * 256 + t] != second) {
+      if (target != stm[first * 256 + t]) {
+        return 0;
+      }
+    } else if (*next == -1) {
+      *next = target;
+    } else if (target != *next) {
+      return 0;
+    }
+  }
+  return *next != -1;
+}
+
+/**
+ * Finds chains of states, which only differ in the state they advance to (as
+ * created by bounded repetitions like {@code [a-z]{1,64}}): each state of the
+ * chain {@code s_0, ..., s_n-1} continues the chain from {@code s_0} to {@code
+ * s_1} (see {@code continues_chain}), and all states but {@code s_0} can only
+ * be reached from their predecessor in the chain. Such a chain can be emitted
+ * as the single state {@code s_0} with a counter.
+ *
+ * Stores the length {@code n} of the chain starting at each state into {@code
+ * chain_length} (0 if no chain starts there, -1 for the other states of a
+ * chain) and the state after the chain into {@code chain_exit}.
+ */
+static void find_counted_chains(automaton_t *automaton, int *stm,
+                                int *chain_length, int *chain_exit) {
+  int N = automaton->max_node_count;
+  int *predecessors = calloc(N, sizeof(int));
+  int *last_source = malloc(N * sizeof(int));
+  int *members = malloc(N * sizeof(int));
+  memset(last_source, 0xff, N * sizeof(int));
+  memset(chain_length, 0, N * sizeof(int));
+  // The start state is also entered from outside
+  predecessors[automaton->start_index]++;
+  for (int state = 0; state < N; state++) {
+    for (int t = 0; t < 256; t++) {
+      int target = stm[state * 256 + t];
+      if (target != -1 && last_source[target] != state) {
+        last_source[target] = state;
+        predecessors[target]++;
+      }
+    }
+  }
+
+  // last_source is reused to try each target of a state only once
+  memset(last_source, 0xff, N * sizeof(int));
+  for (int first = 0; first < N; first++) {
+    if (chain_length[first] != 0) {
+      continue;
+    }
+    for (int t = 0; t < 256; t++) {
+      int second = stm[first * 256 + t];
+      if (second == -1 || second == first || last_source[second] == first) {
+        continue;
+      }
+      last_source[second] = first;
+      int length = 0;
+      members[length++] = first;
+      int state = second;
+      int next;
+      // Chain states have a single predecessor, so the chain can only run
+      // back into its first state
+      while (state != first && predecessors[state] == 1 &&
+             chain_length[state] == 0 &&
+             continues_chain(automaton, stm, first, second, state, &next)) {
+        members[length++] = state;
+        state = next;
+      }
+      if (length < MIN_COUNTED_CHAIN) {
+        continue;
+      }
+      chain_length[first] = length;
+      chain_exit[first] = state;
+      for (int i = 1; i < length; i++) {
+        chain_length[members[i]] = -1;
+      }
+      break;
+    }
+  }
+  free(predecessors);
+  free(last_source);
+  free(members);
+}
+
+typedef struct case_arm {
+  int first;
+  int last;
+  int target;
+  unsigned long hits;
+} case_arm_t;
+
+/**
+ * Collects all maximal byte ranges of the given {@code state}, which lead to
+ * the same target, into {@code arms}. Returns the number of arms.
+ */
+static int collect_case_arms(int *stm, int state, profile_t *profile,
+                             case_arm_t *arms) {
+  int count = 0;
+  for (int t = 0; t < 256; t++) {
+    int target = stm[state * 256 + t];
+    if (target < 0) {
+      continue;
+    }
+    case_arm_t arm = {.first = t, .target = target, .hits = 0};
+    while (t + 1 < 256 && stm[state * 256 + (t + 1)] == target) {
+      t++;
+    }
+    arm.last = t;
+    if (profile != NULL) {
+      for (int c = arm.first; c <= arm.last; c++) {
+        arm.hits += profile->transition_hits[state * 256 + c];
+      }
+    }
+    arms[count++] = arm;
+  }
+  return count;
+}
+
+static int compare_case_arm_hits(const void *a, const void *b) {
+  const case_arm_t *arm0 = a;
+  const case_arm_t *arm1 = b;
+  if (arm0->hits != arm1->hits) {
+    return arm0->hits > arm1->hits ? -1 : 1;
+  }
+  // Keep byte order for equally hot arms
+  return arm0->first - arm1->first;
+}
+
+static void print_case_arm_body(case_arm_t *arm, int state, char *parser_name,
+                                bool_t profile, bool_t reset_count, int indent,
+                                FILE *fout) {
+  if (profile) {
+    fprint_indent(indent, fout);
+    fprintf(fout,
+            "__atomic_fetch_add(&%s_transition_hits[%d][c], 1, "
+            "__ATOMIC_RELAXED);\n",
+            parser_name, state);
+  }
+  if (reset_count) {
+    // The target is the first state of a counted chain
+    fprint_indent(indent, fout);
+    fprintf(fout, "count = 0;\n");
+  }
+  fprint_indent(indent, fout);
+  fprintf(fout, "state = %d;\n", arm->target);
+  fprint_indent(indent, fout);
+  fprintf(fout, "continue;\n");
+}
+
+/**
+ * Prints the hottest arms as an if-chain in front of the switch, so they are
+ * tested first. Returns the number of printed arms.
+ */
+static int print_hot_case_arms(case_arm_t *arms, int arm_count, int state,
+                               char *parser_name, bool_t profile, FILE *fout) {
+  unsigned long total = 0;
+  for (int i = 0; i < arm_count; i++) {
+    total += arms[i].hits;
+  }
+  unsigned long covered = 0;
+  int printed = 0;
+  while (printed < arm_count && printed < MAX_HOT_CASE_ARMS &&
+         arms[printed].hits > 0 &&
+         covered * 100 < total * HOT_CASE_ARMS_COVERAGE) {
+    case_arm_t *arm = &arms[printed];
+    // The dominant transition of a state is hinted as likely
+    bool_t dominant = arm->hits * 100 >= total * DOMINANT_CASE_ARM_SHARE;
+    fprint_indent(6, fout);
+    if (arm->first == arm->last) {
+      fprintf(fout, "if (%sc == %d%s) {\n",
+              dominant ? "__builtin_expect(" : "", arm->first,
+              dominant ? ", 1)" : "");
+    } else {
+      fprintf(fout, "if (%sc >= %d && c <= %d%s) {\n",
+              dominant ? "__builtin_expect(" : "", arm->first, arm->last,
+              dominant ? ", 1)" : "");
+    }
+    print_case_arm_body(arm, state, parser_name, profile, 0, 8, fout);
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+    covered += arm->hits;
+    printed++;
+  }
+  return printed;
+}
+
+/**
+ * Prints the body of an arm, which advances in the counted chain of the given
+ * {@code length}, starting at {@code state}.
+ */
+static void print_chain_arm_body(int length, int exit, bool_t reset_count,
+                                 FILE *fout) {
+  fprint_indent(8, fout);
+  fprintf(fout, "if (++count < %d) {\n", length);
+  fprint_indent(10, fout);
+  fprintf(fout, "continue;\n");
+  fprint_indent(8, fout);
+  fprintf(fout, "}\n");
+  if (reset_count) {
+    fprint_indent(8, fout);
+    fprintf(fout, "count = 0;\n");
+  }
+  fprint_indent(8, fout);
+  fprintf(fout, "state = %d;\n", exit);
+  fprint_indent(8, fout);
+  fprintf(fout, "continue;\n");
+}
+
+/**
+ * The ways of dispatching on the next byte in a state, see {@code
+ * choose_dispatch}.
+ */
+typedef enum dispatch {
+  COMPARE_DISPATCH, // an if-chain of range compares
+  BITMAP_DISPATCH,  // a 256-bit membership test, for states with one target
+  SWITCH_DISPATCH,  // a switch with a case per arm
+  TABLE_DISPATCH,   // a 256-entry table lookup
+} dispatch_t;
+
+typedef struct dispatch_plan {
+  dispatch_t *dispatch;  // per state
+  int *table;            // per state, the bitmap or table used, or -1
+  bool_t *indexed_table; // per state, whether the table holds target indices
+  // The distinct bitmaps and tables of all states. Tables hold the target
+  // state + 1 (or the target index + 1, if indexed) per byte, 0 for rejects.
+  unsigned long (*bitmaps)[4];
+  int bitmap_count;
+  int (*tables)[256];
+  int table_count;
+  int max_table_entry;
+} dispatch_plan_t;
+
+static int count_arm_targets(case_arm_t *arms, int arm_count) {
+  int count = 0;
+  for (int i = 0; i < arm_count; i++) {
+    bool_t seen = 0;
+    for (int j = 0; j < i && !seen; j++) {
+      seen = arms[j].target == arms[i].target;
+    }
+    count += !seen;
+  }
+  return count;
+}
+
+/**
+ * Chooses how the given {@code arms} of a state are dispatched, by estimating
+ * the conditional branches per byte of each way: an if-chain needs one
+ * compare per single byte arm and two per range, a switch about a binary
+ * search over its arms (or an indirect jump), a bitmap test (only possible
+ * with a single target) and a table lookup need a constant number. The table
+ * lookup is penalized for its data, so it is only chosen for fragmented states,
+ * for which the switch would degenerate into a deep search.
+ */
+static dispatch_t choose_dispatch(case_arm_t *arms, int arm_count) {
+  int compare_cost = 0;
+  for (int i = 0; i < arm_count; i++) {
+    compare_cost += arms[i].first == arms[i].last ? 1 : 2;
+  }
+  int search_depth = 0;
+  while ((1 << search_depth) < arm_count + 1) {
+    search_depth++;
+  }
+  int switch_cost = 1 + search_depth;
+
+  dispatch_t dispatch = COMPARE_DISPATCH;
+  int cost = compare_cost;
+  if (count_arm_targets(arms, arm_count) == 1 && BITMAP_DISPATCH_COST < cost) {
+    dispatch = BITMAP_DISPATCH;
+    cost = BITMAP_DISPATCH_COST;
+  }
+  if (switch_cost < cost) {
+    dispatch = SWITCH_DISPATCH;
+    cost = switch_cost;
+  }
+  if (TABLE_DISPATCH_COST < cost) {
+    dispatch = TABLE_DISPATCH;
+  }
+  return dispatch;
+}
+
+/**
+ * Returns whether the arm to {@code target} needs more than {@code state =
+ * target;} (see {@code print_arm_body}).
+ */
+static bool_t has_special_arm_body(int target, int *chain_length,
+                                   bool_t instrument) {
+  return instrument || chain_length[target] != 0;
+}
+
+/**
+ * Returns the index of the bitmap or table in {@code items} (of {@code size}
+ * bytes each), which equals {@code item}, or appends the item.
+ */
+static int add_dispatch_data(void **items, int *count, void *item,
+                             size_t size) {
+  for (int i = 0; i < *count; i++) {
+    if (memcmp((char *)*items + i * size, item, size) == 0) {
+      return i;
+    }
+  }
+  *items = realloc(*items, (*count + 1) * size);
+  memcpy((char *)*items + *count * size, item, size);
+  return (*count)++;
+}
+
+/**
+ * Chooses the dispatch of every state (except those of counted chains), and
+ * collects the bitmaps and tables they need. Profiled states keep their
+ * switch, which follows the hot arms.
+ */
+static dispatch_plan_t plan_dispatch(automaton_t *automaton, int *stm,
+                                     int *chain_length, bool_t instrument,
+                                     bool_t profiled) {
+  int N = automaton->max_node_count;
+  dispatch_plan_t plan = {.dispatch = malloc(N * sizeof(dispatch_t)),
+                          .table = malloc(N * sizeof(int)),
+                          .indexed_table = calloc(N, sizeof(bool_t)),
+                          .bitmaps = NULL,
+                          .bitmap_count = 0,
+                          .tables = NULL,
+                          .table_count = 0,
+                          .max_table_entry = 0};
+  case_arm_t arms[256];
+  for (int state = 0; state < N; state++) {
+    plan.table[state] = -1;
+    int arm_count = collect_case_arms(stm, state, NULL, arms);
+    plan.dispatch[state] =
+        profiled ? SWITCH_DISPATCH : choose_dispatch(arms, arm_count);
+    if (chain_length[state] == -1) {
+      continue;
+    }
+    if (plan.dispatch[state] == BITMAP_DISPATCH) {
+      unsigned long bitmap[4] = {0, 0, 0, 0};
+      for (int i = 0; i < arm_count; i++) {
+        for (int c = arms[i].first; c <= arms[i].last; c++) {
+          bitmap[c >> 6] |= 1UL << (c & 63);
+        }
+      }
+      plan.table[state] = add_dispatch_data(
+          (void **)&plan.bitmaps, &plan.bitmap_count, bitmap, sizeof(bitmap));
+    } else if (plan.dispatch[state] == TABLE_DISPATCH) {
+      int targets[256];
+      int target_count = 0;
+      bool_t indexed = 0;
+      for (int i = 0; i < arm_count; i++) {
+        indexed |= has_special_arm_body(arms[i].target, chain_length,
+                                        instrument);
+      }
+      int table[256];
+      memset(table, 0, sizeof(table));
+      for (int i = 0; i < arm_count; i++) {
+        int entry = arms[i].target + 1;
+        if (indexed) {
+          int index = 0;
+          while (index < target_count && targets[index] != arms[i].target) {
+            index++;
+          }
+          if (index == target_count) {
+            targets[target_count++] = arms[i].target;
+          }
+          entry = index + 1;
+        }
+        for (int c = arms[i].first; c <= arms[i].last; c++) {
+          table[c] = entry;
+        }
+        if (entry > plan.max_table_entry) {
+          plan.max_table_entry = entry;
+        }
+      }
+      plan.indexed_table[state] = indexed;
+      plan.table[state] = add_dispatch_data(
+          (void **)&plan.tables, &plan.table_count, table, sizeof(table));
+    }
+  }
+  return plan;
+}
+
+static void delete_dispatch_plan(dispatch_plan_t plan) {
+  free(plan.dispatch);
+  free(plan.table);
+  free(plan.indexed_table);
+  free(plan.bitmaps);
+  free(plan.tables);
+}
+
+/**
+ * Prints the bitmaps and tables of the given {@code plan} as static arrays.
+ */
+static void print_dispatch_data(dispatch_plan_t *plan, char *parser_name,
+                                FILE *fout) {
+  if (plan->bitmap_count == 0 && plan->table_count == 0) {
+    return;
+  }
+  fprintf(fout, "#include <stdint.h>\n");
+  for (int i = 0; i < plan->bitmap_count; i++) {
+    fprintf(fout, "static const uint64_t %s_bitmap_%d[4] = {", parser_name, i);
+    for (int w = 0; w < 4; w++) {
+      fprintf(fout, "%s0x%016lxULL", w > 0 ? ", " : "", plan->bitmaps[i][w]);
+    }
+    fprintf(fout, "};\n");
+  }
+  char *type = plan->max_table_entry <= UINT8_MAX    ? "uint8_t"
+               : plan->max_table_entry <= UINT16_MAX ? "uint16_t"
+                                                     : "int32_t";
+  for (int i = 0; i < plan->table_count; i++) {
+    fprintf(fout, "static const %s %s_table_%d[256] = {", type, parser_name,
+            i);
+    for (int c = 0; c < 256; c++) {
+      if (c % 16 == 0) {
+        fprintf(fout, "\n");
+        fprint_indent(2, fout);
+      }
+      fprintf(fout, "%d,", plan->tables[i][c]);
+    }
+    fprintf(fout, "\n};\n");
+  }
+}
+
+typedef struct arm_context {
+  int state;
+  char *parser_name;
+  bool_t instrument;
+  int *chain_length;
+  int *chain_exit;
+} arm_context_t;
+
+/**
+ * Prints the body of the given {@code arm} of a state at indent 8: advancing
+ * in a counted chain, or entering the target.
+ */
+static void print_arm_body(case_arm_t *arm, arm_context_t *context,
+                           FILE *fout) {
+  int *chain_length = context->chain_length;
+  int *chain_exit = context->chain_exit;
+  if (chain_length[arm->target] == -1) {
+    // Only the second state of this state's chain is hidden
+    int length = chain_length[context->state];
+    int exit = chain_exit[context->state];
+    print_chain_arm_body(length, exit, chain_length[exit] > 0, fout);
+  } else {
+    print_case_arm_body(arm, context->state, context->parser_name,
+                        context->instrument, chain_length[arm->target] > 0, 8,
+                        fout);
+  }
+}
+
+static void print_reject(char *rej_name, int indent, FILE *fout) {
+  fprint_indent(indent, fout);
+  fprintf(fout, "%s();\n", rej_name);
+  fprint_indent(indent, fout);
+  fprintf(fout, "return;\n");
+}
+
+static void print_compare_dispatch(case_arm_t *arms, int arm_count,
+                                   arm_context_t *context, FILE *fout) {
+  for (int i = 0; i < arm_count; i++) {
+    fprint_indent(6, fout);
+    if (arms[i].first == arms[i].last) {
+      fprintf(fout, "if (c == %d) {\n", arms[i].first);
+    } else {
+      fprintf(fout, "if (c >= %d && c <= %d) {\n", arms[i].first,
+              arms[i].last);
+    }
+    print_arm_body(&arms[i], context, fout);
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+  }
+}
+
+static void print_bitmap_dispatch(case_arm_t *arms, int bitmap,
+                                  arm_context_t *context, FILE *fout) {
+  fprint_indent(6, fout);
+  fprintf(fout,
+          "if ((unsigned)c < 256 && (%s_bitmap_%d[c >> 6] >> (c & 63) & 1)) "
+          "{\n",
+          context->parser_name, bitmap);
+  print_arm_body(&arms[0], context, fout);
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+}
+
+static void print_table_dispatch(case_arm_t *arms, int arm_count, int table,
+                                 bool_t indexed, arm_context_t *context,
+                                 char *rej_name, FILE *fout) {
+  char *parser_name = context->parser_name;
+  if (!indexed) {
+    fprint_indent(6, fout);
+    fprintf(fout, "if ((unsigned)c < 256 && %s_table_%d[c]) {\n", parser_name,
+            table);
+    fprint_indent(8, fout);
+    fprintf(fout, "state = %s_table_%d[c] - 1;\n", parser_name, table);
+    fprint_indent(8, fout);
+    fprintf(fout, "continue;\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+    return;
+  }
+  // The table selects the case of the target, in the order of first arms
+  fprint_indent(6, fout);
+  fprintf(fout, "switch ((unsigned)c < 256 ? %s_table_%d[c] : 0) {\n",
+          parser_name, table);
+  int index = 0;
+  for (int i = 0; i < arm_count; i++) {
+    bool_t printed = 0;
+    for (int j = 0; j < i && !printed; j++) {
+      printed = arms[j].target == arms[i].target;
+    }
+    if (printed) {
+      continue;
+    }
+    fprint_indent(6, fout);
+    fprintf(fout, "case %d:\n", ++index);
+    print_arm_body(&arms[i], context, fout);
+  }
+  fprint_indent(6, fout);
+  fprintf(fout, "default:\n");
+  print_reject(rej_name, 8, fout);
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+}
 
 void print_automaton_to_c_code(automaton_t automaton, char *parser_name,
                                char *next_name, char *acc_name, char *rej_name,
                                int flags, FILE *fout) {
-  fprintf(fout, "%sint %s();\n", flags & 1 ? "static " : "", next_name);
-  fprintf(fout, "%sint %s(int tag);\n", flags & 2 ? "static " : "", acc_name);
-  fprintf(fout, "%svoid %s();\n", flags & 4 ? "static " : "", rej_name);
-  fprintf(fout, "%svoid %s() {\n", flags & 8 ? "static " : "", parser_name);
+  print_profiled_automaton_to_c_code(automaton, NULL, parser_name, next_name,
+                                     acc_name, rej_name, flags, fout);
+}
+
+char *get_parser_storage(int flags) {
+  if (flags & REGEX2C_PARSER_DECL_INLINE) {
+    return "static inline ";
+  }
+  return flags & REGEX2C_PARSER_DECL_STATIC ? "static " : "";
+}
+
+void print_helper_declarations(char *next_name, char *acc_name,
+                               char *rej_name, int flags, FILE *fout) {
+  if (flags & REGEX2C_OMIT_HELPER_DECLS) {
+    return;
+  }
+  if (flags & REGEX2C_SEARCH) {
+    // Searches only report matches, see print_search_automata_to_c_code
+    fprintf(fout, "%sint %s(long start, long end%s);\n",
+            flags & REGEX2C_ACCEPT_DECL_STATIC ? "static " : "", acc_name,
+            flags & REGEX2C_SEARCH_TAGS ? ", int tag" : "");
+    return;
+  }
+  fprintf(fout, "%sint %s();\n",
+          flags & REGEX2C_NEXT_DECL_STATIC ? "static " : "", next_name);
+  fprintf(fout, "%sint %s(int tag);\n",
+          flags & REGEX2C_ACCEPT_DECL_STATIC ? "static " : "", acc_name);
+  fprintf(fout, "%svoid %s();\n",
+          flags & REGEX2C_REJECT_DECL_STATIC ? "static " : "", rej_name);
+}
+
+/**
+ * Prints the array {@code <parser_name>_tag_set_<name>} of {@code count}
+ * {@code values}.
+ */
+static void print_tag_set_array(char *parser_name, char *name, int *values,
+                                int count, FILE *fout) {
+  fprintf(fout, "static const int %s_tag_set_%s[%d] = {", parser_name, name,
+          count > 0 ? count : 1);
+  for (int i = 0; i < count; i++) {
+    if (i % 16 == 0) {
+      fprintf(fout, "\n");
+      fprint_indent(2, fout);
+    }
+    fprintf(fout, "%d,", values[i]);
+  }
+  fprintf(fout, "%s\n};\n", count > 0 ? "" : "0");
+}
+
+void print_tag_sets_to_c_code(tag_sets_t *sets, char *parser_name, int flags,
+                              FILE *fout) {
+  print_tag_set_array(parser_name, "offsets", sets->offsets, sets->count + 1,
+                      fout);
+  print_tag_set_array(parser_name, "members", sets->members,
+                      sets->offsets[sets->count], fout);
+  fprintf(fout, "%sint %s_tags(int set, const int **tags) {\n",
+          get_parser_storage(flags), parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "*tags = &%s_tag_set_members[%s_tag_set_offsets[set]];\n",
+          parser_name, parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout,
+          "return %s_tag_set_offsets[set + 1] - %s_tag_set_offsets[set];\n",
+          parser_name, parser_name);
+  fprintf(fout, "}\n");
+}
+
+void print_profiled_automaton_to_c_code(automaton_t automaton,
+                                        profile_t *profile, char *parser_name,
+                                        char *next_name, char *acc_name,
+                                        char *rej_name, int flags,
+                                        FILE *fout) {
+  bool_t instrument = (flags & REGEX2C_PROFILE) != 0;
+  int *stm = create_state_transition_matrix(&automaton);
+  case_arm_t arms[256];
+
+  // Counted chains would hide the states, which profiles refer to
+  int N = automaton.max_node_count;
+  int *chain_length = calloc(N, sizeof(int));
+  int *chain_exit = malloc(N * sizeof(int));
+  if (!instrument && profile == NULL) {
+    find_counted_chains(&automaton, stm, chain_length, chain_exit);
+  }
+  dispatch_plan_t plan =
+      plan_dispatch(&automaton, stm, chain_length, instrument, profile != NULL);
+
+  if (instrument) {
+    print_profile_counters(&automaton, parser_name, fout);
+  }
+  print_helper_declarations(next_name, acc_name, rej_name, flags, fout);
+  print_dispatch_data(&plan, parser_name, fout);
+  fprintf(fout, "%svoid %s() {\n", get_parser_storage(flags), parser_name);
   fprint_indent(2, fout);
   fprintf(fout, "int state = %d;\n", automaton.start_index);
+  bool_t switch_only = !instrument && profile == NULL;
+  for (int state = 0; state < N; state++) {
+    switch_only &= plan.dispatch[state] == SWITCH_DISPATCH ||
+                   chain_length[state] == -1;
+  }
+  if (!switch_only) {
+    fprint_indent(2, fout);
+    fprintf(fout, "int c;\n");
+  }
+  for (int state = 0; state < N; state++) {
+    if (chain_length[state] > 0) {
+      fprint_indent(2, fout);
+      fprintf(fout, "int count = 0;\n");
+      break;
+    }
+  }
+
   fprint_indent(2, fout);
   fprintf(fout, "while (1) {\n");
 
-  bool_t *stm = create_state_transition_matrix(&automaton);
-
   fprint_indent(4, fout);
   fprintf(fout, "switch (state) {\n");
 
-  for (int state = 0; state < automaton.max_node_count; state++) {
+  for (int state = 0; state < N; state++) {
+    if (chain_length[state] == -1) {
+      // Emitted as part of the first state of its chain
+      continue;
+    }
     fprint_indent(4, fout);
     fprintf(fout, "case %d:\n", state);
+    if (instrument) {
+      fprint_indent(6, fout);
+      fprintf(fout,
+              "__atomic_fetch_add(&%s_state_visits[%d], 1, "
+              "__ATOMIC_RELAXED);\n",
+              parser_name, state);
+    }
     int end_tag = automaton.nodes[state].end_tag;
     if (end_tag != -1) {
       // If the parsing could stop here, call accept with end tag
       fprint_indent(6, fout);
       fprintf(fout, "if (%s(%d)) { return; }\n", acc_name, end_tag);
     }
-    fprint_indent(6, fout);
-    fprintf(fout, "switch (%s()) {\n", next_name);
 
-    for (int t = 0; t < 256; t++) {
-      int range_start = t;
-      int target = stm[state * 256 + t];
+    int arm_count = collect_case_arms(stm, state, profile, arms);
+    arm_context_t context = {.state = state,
+                             .parser_name = parser_name,
+                             .instrument = instrument,
+                             .chain_length = chain_length,
+                             .chain_exit = chain_exit};
+    dispatch_t dispatch = plan.dispatch[state];
+    if (dispatch != SWITCH_DISPATCH) {
+      fprint_indent(6, fout);
+      fprintf(fout, "c = %s();\n", next_name);
+    }
+    if (dispatch == COMPARE_DISPATCH) {
+      print_compare_dispatch(arms, arm_count, &context, fout);
+    } else if (dispatch == BITMAP_DISPATCH) {
+      print_bitmap_dispatch(arms, plan.table[state], &context, fout);
+    } else if (dispatch == TABLE_DISPATCH) {
+      print_table_dispatch(arms, arm_count, plan.table[state],
+                           plan.indexed_table[state], &context, rej_name,
+                           fout);
+    }
+    if (dispatch == TABLE_DISPATCH && plan.indexed_table[state]) {
+      continue;
+    }
+    if (dispatch != SWITCH_DISPATCH) {
+      print_reject(rej_name, 6, fout);
+      continue;
+    }
 
-      if (target >= 0) {
-        while (t + 1 < 256 && stm[state * 256 + (t + 1)] == target) {
-          t++;
-        }
+    int hot_arm_count = 0;
+    fprint_indent(6, fout);
+    if (profile != NULL) {
+      // Test the most frequent byte ranges first
+      qsort(arms, arm_count, sizeof(case_arm_t), compare_case_arm_hits);
+      fprintf(fout, "c = %s();\n", next_name);
+      hot_arm_count = print_hot_case_arms(arms, arm_count, state, parser_name,
+                                          instrument, fout);
+      fprint_indent(6, fout);
+      fprintf(fout, "switch (c) {\n");
+    } else if (!switch_only) {
+      fprintf(fout, "switch (c = %s()) {\n", next_name);
+    } else {
+      fprintf(fout, "switch (%s()) {\n", next_name);
+    }
 
-        // Add transitions for all defined edges
-        fprint_indent(6, fout);
-        if (range_start == t) {
-          fprintf(fout, "case %d:\n", t);
-        } else {
-          fprintf(fout, "case %d ... %d:\n", range_start, t);
-        }
-        fprint_indent(8, fout);
-        fprintf(fout, "state = %d;\n", target);
-        fprint_indent(8, fout);
-        fprintf(fout, "continue;\n");
+    // Add transitions for all defined edges
+    for (int i = hot_arm_count; i < arm_count; i++) {
+      fprint_indent(6, fout);
+      if (arms[i].first == arms[i].last) {
+        fprintf(fout, "case %d:\n", arms[i].first);
+      } else {
+        fprintf(fout, "case %d ... %d:\n", arms[i].first, arms[i].last);
       }
+      print_arm_body(&arms[i], &context, fout);
     }
 
     // Reject if there is no transition for that terminal-state combo
     fprint_indent(6, fout);
     fprintf(fout, "default:\n");
-    fprint_indent(8, fout);
-    fprintf(fout, "%s();\n", rej_name);
-    fprint_indent(8, fout);
-    fprintf(fout, "return;\n");
+    print_reject(rej_name, 8, fout);
 
     fprint_indent(6, fout);
     fprintf(fout, "}\n");
   }
 
   free(stm);
+  free(chain_length);
+  free(chain_exit);
+  delete_dispatch_plan(plan);
 
   fprint_indent(4, fout);
   fprintf(fout, "}\n");
@@ -76,4 +825,8 @@ void print_automaton_to_c_code(automaton_t automaton, char *parser_name,
   fprint_indent(2, fout);
   fprintf(fout, "}\n");
   fprintf(fout, "}\n");
+
+  if (instrument) {
+    print_profile_dump(&automaton, parser_name, flags, fout);
+  }
 }
@@ -4,6 +4,8 @@
 
 #include "automaton.h"
 #include "common.h"
+#include "profile.h"
+#include "tag_sets.h"
 
 #define REGEX2C_NEXT_DECL_STATIC 1
 #define REGEX2C_ACCEPT_DECL_STATIC 2
@@ -12,6 +14,19 @@
 
 #define REGEX2C_ALL_DECL_STATIC 15
 
+#define REGEX2C_PROFILE 16
+
+#define REGEX2C_OMIT_HELPER_DECLS 32
+
+#define REGEX2C_SEARCH 64
+#define REGEX2C_SEARCH_TAGS 128
+
+#define REGEX2C_PARSER_DECL_INLINE 256
+
+#define REGEX2C_SEARCH_EARLIEST 512
+
+#define REGEX2C_PROFILE_VERSION 1
+
 /*
  * Generates c code from the given {@code automaton}.
  *
@@ -37,10 +52,97 @@
  * REGEX2C_REJECT_DECL_STATIC = 4  // declare the {@code reject} function static
  * REGEX2C_PARSER_DECL_STATIC = 8  // declare the {@code parser} function static
  * REGEX2C_ALL_DECL_STATIC =    15 // declare all functions static
+ * REGEX2C_PROFILE =            16 // instrument the parser with counters
+ * REGEX2C_OMIT_HELPER_DECLS =  32 // do not declare next, accept and reject
+ * REGEX2C_SEARCH =             64 // search a buffer for matches instead
+ * REGEX2C_SEARCH_TAGS =        128 // pass the matching rule to the search
+ * REGEX2C_PARSER_DECL_INLINE = 256 // declare the {@code parser} static inline
+ * REGEX2C_SEARCH_EARLIEST =    512 // end search matches as early as possible
+ *
+ * The static flags are useful when the generated code is not linked, but
+ * included into other code. In a header, which is included into several files,
+ * REGEX2C_PARSER_DECL_INLINE keeps the parsers, which a file does not call,
+ * from being reported as unused functions. REGEX2C_OMIT_HELPER_DECLS is useful
+ * when several parsers are generated into the same file, which declares the
+ * functions once (see {@code print_helper_declarations}). REGEX2C_SEARCH is
+ * not handled by this function, but selects {@code
+ * print_search_automata_to_c_code} in {@code regex2c_compile} and the command
+ * line tool, which add REGEX2C_SEARCH_TAGS for rule sets.
+ *
+ * Long chains of states, which all consume the same byte ranges and only lead
+ * to the next state of the chain (as produced by bounded repetitions like
+ * {@code [a-z]{1,1000}}), are emitted as a single state with a counter, unless
+ * the parser is instrumented or profiled.
+ *
+ * Each state dispatches on the consumed byte with the strategy, which needs
+ * the fewest estimated branches per byte: a chain of comparisons for a few
+ * byte ranges, a test against a 256-bit bitmap if all ranges lead to the same
+ * state, a switch, or a lookup in a 256-entry table of successor states.
+ * Equal bitmaps and tables are shared by all states. Profiled parsers keep the
+ * switch of every state, which is laid out according to the profile.
+ *
+ * With REGEX2C_PROFILE, the parser counts how often each state is visited and
+ * how often each byte leads out of each state (using relaxed atomic
+ * increments, so the parser may run on several threads at once). An
+ * additional function {@code int <parser_name>_dump_profile(const char *path)}
+ * is generated, which writes the counts into the file at {@code path} and
+ * returns 0 on success or -1 if the file cannot be written. The profile is a
+ * text file of the following lines:
  *
- * These flags are useful when the generated code is not linked, but included
- * into other code.
+ * regex2c-profile <version>
+ * fingerprint <hex hash of the automaton>
+ * states <state count>
+ * state <state> <visits>
+ * transition <state> <byte> <hits>
+ *
+ * Only non-zero counts are written. Profiles of several runs can be
+ * concatenated, the counts are summed up when the profile is read.
  */
 void print_automaton_to_c_code(automaton_t automaton, char *parser_name,
                                char *next_name, char *acc_name, char *rej_name,
                                int flags, FILE *fout);
+
+/**
+ * Same as {@code print_automaton_to_c_code}, but uses the state and
+ * transition counts of the given {@code profile} (if it is not {@code NULL})
+ * to lay out the code: in each state, the most frequent byte ranges are tested
+ * first, and a transition taking most of the hits of its state is hinted as
+ * likely with {@code __builtin_expect}. The profile must match the given
+ * {@code automaton} (see {@code profile_matches_automaton}).
+ *
+ * States are emitted in index order, so renumbering the automaton by hotness
+ * before (see {@code order_states_by_hotness}) keeps hot states together.
+ */
+void print_profiled_automaton_to_c_code(automaton_t automaton,
+                                        profile_t *profile, char *parser_name,
+                                        char *next_name, char *acc_name,
+                                        char *rej_name, int flags, FILE *fout);
+
+/**
+ * Returns the storage class specifiers of the parser function (and of the
+ * other functions of the generated api) according to {@code flags}: "static
+ * inline " with REGEX2C_PARSER_DECL_INLINE, "static " with
+ * REGEX2C_PARSER_DECL_STATIC, or "".
+ */
+char *get_parser_storage(int flags);
+
+/**
+ * Prints the declarations of the {@code next}, {@code accept} and {@code
+ * reject} functions, which the generated parsers call (static according to
+ * {@code flags}). Prints nothing if {@code flags} contains
+ * REGEX2C_OMIT_HELPER_DECLS, and only the accept function of searches with
+ * REGEX2C_SEARCH (with a tag parameter with REGEX2C_SEARCH_TAGS).
+ */
+void print_helper_declarations(char *next_name, char *acc_name,
+                               char *rej_name, int flags, FILE *fout);
+
+/**
+ * Prints the given tag {@code sets} and {@code int <parser_name>_tags(int set,
+ * const int **tags)}, which returns the number of tags of the set with index
+ * {@code set} and stores a pointer to them into {@code tags}. Parsers of
+ * automata, whose end tags are indices of these sets (see {@code
+ * determinize_tag_sets}), pass such an index to accept. The function is
+ * static with REGEX2C_PARSER_DECL_STATIC.
+ */
+void print_tag_sets_to_c_code(tag_sets_t *sets, char *parser_name, int flags,
+                              FILE *fout);
@@ -0,0 +1,183 @@
+#include "automaton2cpp.h"
+#include "automaton2c.h"
+#include "common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static char *get_unsigned_type(long max_entry) {
+  return max_entry <= UINT8_MAX    ? "std::uint8_t"
+         : max_entry <= UINT16_MAX ? "std::uint16_t"
+                                   : "std::uint32_t";
+}
+
+static char *get_signed_type(long max_entry) {
+  return max_entry <= INT8_MAX    ? "std::int8_t"
+         : max_entry <= INT16_MAX ? "std::int16_t"
+                                  : "std::int32_t";
+}
+
+/**
+ * Prints the {@code count} {@code values} as the body of an array initializer
+ * at the given {@code indent}, 16 values per line.
+ */
+static void print_values(int *values, int count, int indent, FILE *fout) {
+  for (int i = 0; i < count; i++) {
+    if (i % 16 == 0) {
+      fprintf(fout, "%s", i > 0 ? "\n" : "");
+      fprint_indent(indent, fout);
+    }
+    fprintf(fout, "%d,", values[i]);
+  }
+  fprintf(fout, "\n");
+}
+
+void print_cpp_header_prologue(FILE *fout) {
+  fprintf(fout, "#pragma once\n");
+  fprintf(fout, "#include <cstddef>\n");
+  fprintf(fout, "#include <cstdint>\n");
+  fprintf(fout, "#include <string_view>\n");
+}
+
+static void print_tables(automaton_t *automaton, FILE *fout) {
+  int N = automaton->max_node_count;
+  int class_of[256];
+  int class_count = compute_terminal_classes(automaton, class_of);
+  int *stm = create_state_transition_matrix(automaton);
+
+  fprintf(fout, "inline constexpr std::uint8_t byte_class[256] = {\n");
+  print_values(class_of, 256, 2, fout);
+  fprintf(fout, "};\n");
+
+  // The target + 1 of every state and byte class, 0 to reject
+  int *row = malloc(class_count * sizeof(int));
+  fprintf(fout, "inline constexpr %s next[%d][%d] = {\n", get_unsigned_type(N),
+          N, class_count);
+  for (int state = 0; state < N; state++) {
+    for (int c = 0; c < 256; c++) {
+      row[class_of[c]] = stm[state * 256 + c] + 1;
+    }
+    fprint_indent(2, fout);
+    if (class_count <= 16) {
+      fprintf(fout, "{");
+      for (int c = 0; c < class_count; c++) {
+        fprintf(fout, "%d,", row[c]);
+      }
+      fprintf(fout, "},\n");
+      continue;
+    }
+    fprintf(fout, "{\n");
+    print_values(row, class_count, 4, fout);
+    fprint_indent(2, fout);
+    fprintf(fout, "},\n");
+  }
+  fprintf(fout, "};\n");
+  free(row);
+  free(stm);
+
+  int *end_tags = malloc(N * sizeof(int));
+  int max_tag = 0;
+  for (int state = 0; state < N; state++) {
+    end_tags[state] = automaton->nodes[state].end_tag;
+    if (end_tags[state] > max_tag) {
+      max_tag = end_tags[state];
+    }
+  }
+  fprintf(fout, "inline constexpr %s end_tag[%d] = {\n",
+          get_signed_type(max_tag), N);
+  print_values(end_tags, N, 2, fout);
+  fprintf(fout, "};\n");
+  free(end_tags);
+  fprintf(fout, "inline constexpr int start = %d;\n", automaton->start_index);
+}
+
+/**
+ * Prints the statement, which advances {@code state} by the char at {@code
+ * first}, at the given {@code indent}.
+ */
+static void print_step(int indent, FILE *fout) {
+  fprint_indent(indent, fout);
+  fprintf(fout, "state = next[state][byte_class[static_cast<unsigned char>("
+                "*first)]] - 1;\n");
+}
+
+static void print_longest_prefix(FILE *fout) {
+  fprintf(fout, "template <typename Iterator>\n");
+  fprintf(fout, "constexpr match_result longest_prefix(Iterator first, "
+                "Iterator last) {\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "match_result result = {0, end_tag[start]};\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "int state = start;\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "for (std::size_t length = 1; first != last; ++first, "
+                "++length) {\n");
+  print_step(4, fout);
+  fprint_indent(4, fout);
+  fprintf(fout, "if (state < 0) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "break;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "if (end_tag[state] != -1) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "result = {length, end_tag[state]};\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return result;\n");
+  fprintf(fout, "}\n");
+
+  fprintf(fout, "constexpr match_result longest_prefix(std::string_view "
+                "input) {\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return longest_prefix(input.begin(), input.end());\n");
+  fprintf(fout, "}\n");
+}
+
+static void print_match(FILE *fout) {
+  fprintf(fout, "template <typename Iterator>\n");
+  fprintf(fout, "constexpr int match(Iterator first, Iterator last) {\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "int state = start;\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "for (; first != last; ++first) {\n");
+  print_step(4, fout);
+  fprint_indent(4, fout);
+  fprintf(fout, "if (state < 0) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "return -1;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return end_tag[state];\n");
+  fprintf(fout, "}\n");
+
+  fprintf(fout, "constexpr int match(std::string_view input) {\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return match(input.begin(), input.end());\n");
+  fprintf(fout, "}\n");
+}
+
+void print_automaton_to_cpp_header(automaton_t automaton, char *namespace_name,
+                                   int flags, FILE *fout) {
+  if (!(flags & REGEX2C_OMIT_HELPER_DECLS)) {
+    print_cpp_header_prologue(fout);
+  }
+  fprintf(fout, "namespace %s {\n", namespace_name);
+  fprintf(fout, "struct match_result {\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "std::size_t length; // of the longest accepted prefix\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "int tag;            // its end tag, -1 if there is none\n");
+  fprintf(fout, "};\n");
+  print_tables(&automaton, fout);
+  print_longest_prefix(fout);
+  print_match(fout);
+  fprintf(fout, "} // namespace %s\n", namespace_name);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "automaton.h"
+
+/*
+ * Generates a header-only C++17 matcher from the given deterministic {@code
+ * automaton} into the namespace {@code namespace_name}. The automaton is
+ * stored in {@code constexpr} tables (the byte classes of the automaton, the
+ * next state per state and byte class, and the end tag per state), so the
+ * header needs no initialization at runtime and no object file. The matcher
+ * consists of {@code constexpr} functions, which can be evaluated at compile
+ * time (e.g. in a {@code static_assert}) as well as inlined into callers:
+ *
+ * struct match_result { std::size_t length; int tag; };
+ * template <typename Iterator>
+ * constexpr match_result longest_prefix(Iterator first, Iterator last);
+ * constexpr match_result longest_prefix(std::string_view input);
+ * template <typename Iterator>
+ * constexpr int match(Iterator first, Iterator last);
+ * constexpr int match(std::string_view input);
+ *
+ * {@code longest_prefix} returns the length and end tag of the longest prefix
+ * of the input, which the automaton accepts (a tag of -1 if there is none),
+ * {@code match} the end tag of the whole input, or -1 if it is not accepted.
+ * Iterators must dereference to chars or bytes.
+ *
+ * The header starts with the includes it needs (see {@code
+ * print_cpp_header_prologue}), unless {@code flags} contains
+ * REGEX2C_OMIT_HELPER_DECLS (see {@code print_automaton_to_c_code}); all other
+ * flags are ignored.
+ */
+void print_automaton_to_cpp_header(automaton_t automaton, char *namespace_name,
+                                   int flags, FILE *fout);
+
+/**
+ * Prints the includes needed by the matchers of {@code
+ * print_automaton_to_cpp_header}.
+ */
+void print_cpp_header_prologue(FILE *fout);
@@ -0,0 +1,381 @@
+#include "batch.h"
+#include "automaton2c.h"
+#include "automaton2cpp.h"
+#include "common.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct batch_queue {
+  batch_t *batch;
+  regex2c_options_t options;
+  atomic_int next_entry;
+} batch_queue_t;
+
+static bool_t is_space(int c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool_t is_identifier(char *name) {
+  for (char *c = name; *c != '\0'; c++) {
+    bool_t alpha = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+                   *c == '_';
+    if (!alpha && (c == name || *c < '0' || *c > '9')) {
+      return 0;
+    }
+  }
+  return name[0] != '\0';
+}
+
+/**
+ * Reads the whole file at {@code path} into {@code data} without its trailing
+ * whitespace. Returns 1 on success, 0 otherwise.
+ */
+static bool_t read_pattern_file(char *path, char **data, size_t *length) {
+  FILE *fin = fopen(path, "r");
+  if (fin == NULL) {
+    return 0;
+  }
+  FILE *fout = open_memstream(data, length);
+  if (fout == NULL) {
+    fclose(fin);
+    return 0;
+  }
+  int c;
+  while ((c = getc(fin)) != EOF) {
+    putc(c, fout);
+  }
+  bool_t success = !ferror(fin);
+  fclose(fin);
+  success &= fclose(fout) == 0;
+  if (!success) {
+    free(*data);
+    return 0;
+  }
+  while (*length > 0 && is_space((*data)[*length - 1])) {
+    (*length)--;
+  }
+  return 1;
+}
+
+/**
+ * Parses the given manifest {@code line} into {@code entry}. Returns 1 on
+ * success, or 0 and stores an error into {@code error}.
+ */
+static bool_t parse_manifest_line(char *line, char *directory,
+                                  batch_entry_t *entry, char **error) {
+  char *name = line;
+  char *end = name;
+  while (*end != '\0' && !is_space(*end)) {
+    end++;
+  }
+  char *pattern = end;
+  while (is_space(*pattern)) {
+    pattern++;
+  }
+  *end = '\0';
+  size_t length = strlen(pattern);
+  while (length > 0 && is_space(pattern[length - 1])) {
+    length--;
+  }
+  pattern[length] = '\0';
+  if (!is_identifier(name)) {
+    asprintf(error, "line %d: \"%s\" is not a valid parser name", entry->line,
+             name);
+    return 0;
+  }
+  if (length == 0) {
+    asprintf(error, "line %d: missing pattern of \"%s\"", entry->line, name);
+    return 0;
+  }
+
+  entry->name = create_string(name).data;
+  if (pattern[0] != '@') {
+    entry->pattern = create_string(pattern).data;
+    entry->length = length;
+    return 1;
+  }
+  char *path;
+  if (pattern[1] == '/' || directory == NULL) {
+    path = create_string(pattern + 1).data;
+  } else {
+    asprintf(&path, "%s/%s", directory, pattern + 1);
+  }
+  bool_t success = read_pattern_file(path, &entry->pattern, &entry->length);
+  if (!success) {
+    asprintf(error, "line %d: cannot read pattern file \"%s\"", entry->line,
+             path);
+  }
+  free(path);
+  return success;
+}
+
+/**
+ * Marks every entry of {@code batch}, whose name or pattern equals that of an
+ * earlier entry. Returns 1 on success, or 0 and stores an error into {@code
+ * error} if a name is used twice.
+ */
+static bool_t find_duplicates(batch_t *batch, char **error) {
+  unsigned long *hashes = malloc(batch->entry_count * sizeof(unsigned long));
+  for (int i = 0; i < batch->entry_count; i++) {
+    batch_entry_t *entry = &batch->entries[i];
+    hashes[i] = hash_bytes(entry->pattern, entry->length, HASH_SEED);
+    entry->duplicate_of = -1;
+    for (int j = 0; j < i; j++) {
+      batch_entry_t *other = &batch->entries[j];
+      if (strcmp(entry->name, other->name) == 0) {
+        asprintf(error, "line %d: parser \"%s\" is already defined in line %d",
+                 entry->line, entry->name, other->line);
+        free(hashes);
+        return 0;
+      }
+      if (entry->duplicate_of == -1 && other->duplicate_of == -1 &&
+          hashes[i] == hashes[j] && entry->length == other->length &&
+          memcmp(entry->pattern, other->pattern, entry->length) == 0) {
+        entry->duplicate_of = j;
+      }
+    }
+  }
+  free(hashes);
+  return 1;
+}
+
+/**
+ * Stores the names of the functions called by the parsers (next, accept and
+ * reject) of the given {@code options} (which may be {@code NULL}) into {@code
+ * names}.
+ */
+static void get_helper_names(const regex2c_options_t *options,
+                             char *names[3]) {
+  names[0] = options != NULL && options->next_name != NULL ? options->next_name
+                                                           : "consume_next";
+  names[1] = options != NULL && options->acc_name != NULL ? options->acc_name
+                                                          : "accept";
+  names[2] = options != NULL && options->rej_name != NULL ? options->rej_name
+                                                          : "reject";
+}
+
+/**
+ * Returns whether {@code symbol} is one of the symbols of the parser named
+ * {@code name}, which are the parser itself and its tables and functions
+ * named {@code <name>_...}.
+ */
+static bool_t is_parser_symbol(char *symbol, char *name) {
+  size_t length = strlen(name);
+  return strncmp(symbol, name, length) == 0 &&
+         (symbol[length] == '\0' || symbol[length] == '_');
+}
+
+/**
+ * Checks that the symbols of the parsers of {@code batch} collide neither
+ * with the functions called by the parsers (named according to {@code
+ * options}), nor with the symbols of the other parsers. C++ headers are not
+ * checked, since every parser has its own namespace there. Returns 1 on
+ * success, or 0 and stores an error into {@code error}.
+ */
+static bool_t check_parser_names(batch_t *batch,
+                                 const regex2c_options_t *options,
+                                 char **error) {
+  if (options != NULL && options->backend == CPP_HEADER_BACKEND) {
+    return 1;
+  }
+  char *helper_names[3];
+  get_helper_names(options, helper_names);
+  for (int i = 0; i < batch->entry_count; i++) {
+    batch_entry_t *entry = &batch->entries[i];
+    for (int h = 0; h < 3; h++) {
+      if (is_parser_symbol(helper_names[h], entry->name)) {
+        asprintf(error,
+                 "line %d: parser \"%s\" collides with the function \"%s\" "
+                 "called by the parsers",
+                 entry->line, entry->name, helper_names[h]);
+        return 0;
+      }
+    }
+    for (int j = 0; j < batch->entry_count; j++) {
+      batch_entry_t *other = &batch->entries[j];
+      if (j != i && is_parser_symbol(entry->name, other->name)) {
+        asprintf(error,
+                 "line %d: parser \"%s\" collides with the symbols of "
+                 "parser \"%s\" in line %d",
+                 entry->line, entry->name, other->name, other->line);
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+bool_t read_batch_manifest(char *path, const regex2c_options_t *options,
+                           batch_t *batch, char **error) {
+  memset(batch, 0, sizeof(batch_t));
+  *error = NULL;
+  FILE *fin = fopen(path, "r");
+  if (fin == NULL) {
+    asprintf(error, "cannot open manifest \"%s\"", path);
+    return 0;
+  }
+  char *directory = NULL;
+  char *slash = strrchr(path, '/');
+  if (slash != NULL) {
+    directory = create_string(path).data;
+    directory[slash - path] = '\0';
+  }
+
+  int capacity = 16;
+  batch->entries = malloc(capacity * sizeof(batch_entry_t));
+  char *line = NULL;
+  size_t line_capacity = 0;
+  int line_number = 0;
+  bool_t success = 1;
+  while (success && getline(&line, &line_capacity, fin) != -1) {
+    line_number++;
+    char *start = line;
+    while (is_space(*start)) {
+      start++;
+    }
+    if (*start == '\0' || *start == '#') {
+      continue;
+    }
+    if (batch->entry_count == capacity) {
+      capacity *= 2;
+      batch->entries =
+          realloc(batch->entries, capacity * sizeof(batch_entry_t));
+    }
+    batch_entry_t *entry = &batch->entries[batch->entry_count];
+    memset(entry, 0, sizeof(batch_entry_t));
+    entry->line = line_number;
+    success = parse_manifest_line(start, directory, entry, error);
+    if (success) {
+      batch->entry_count++;
+    } else {
+      free(entry->name);
+    }
+  }
+  free(line);
+  free(directory);
+  fclose(fin);
+
+  if (success && batch->entry_count == 0) {
+    asprintf(error, "manifest \"%s\" has no entries", path);
+    success = 0;
+  }
+  if (success) {
+    success = find_duplicates(batch, error) &&
+              check_parser_names(batch, options, error);
+  }
+  if (!success) {
+    delete_batch(batch);
+  }
+  return success;
+}
+
+static void *run_batch_worker(void *data) {
+  batch_queue_t *queue = data;
+  batch_t *batch = queue->batch;
+  int i;
+  while ((i = atomic_fetch_add(&queue->next_entry, 1)) < batch->entry_count) {
+    batch_entry_t *entry = &batch->entries[i];
+    if (entry->duplicate_of != -1) {
+      continue;
+    }
+    regex2c_options_t options = queue->options;
+    options.parser_name = entry->name;
+    regex2c_compile(entry->pattern, entry->length, &options, &entry->result);
+  }
+  return NULL;
+}
+
+int compile_batch(batch_t *batch, const regex2c_options_t *options, int jobs) {
+  batch_queue_t queue = {.batch = batch};
+  if (options != NULL) {
+    queue.options = *options;
+  }
+  queue.options.flags |= REGEX2C_OMIT_HELPER_DECLS;
+  atomic_init(&queue.next_entry, 0);
+
+  if (jobs > batch->entry_count) {
+    jobs = batch->entry_count;
+  }
+  pthread_t *threads = malloc(jobs * sizeof(pthread_t));
+  int started = 0;
+  // The calling thread works as well, so one job needs no thread
+  while (started < jobs - 1 &&
+         pthread_create(&threads[started], NULL, run_batch_worker, &queue) ==
+             0) {
+    started++;
+  }
+  run_batch_worker(&queue);
+  for (int t = 0; t < started; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  free(threads);
+
+  for (int i = 0; i < batch->entry_count; i++) {
+    if (batch->entries[i].result.error != NULL) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void print_batch(batch_t *batch, const regex2c_options_t *options,
+                 FILE *fout) {
+  int flags = options != NULL ? options->flags : 0;
+  bool_t cpp = options != NULL && options->backend == CPP_HEADER_BACKEND;
+  bool_t simd = options != NULL && options->backend == SIMD_BACKEND;
+  if (cpp) {
+    print_cpp_header_prologue(fout);
+  } else {
+    char *helper_names[3];
+    get_helper_names(options, helper_names);
+    print_helper_declarations(helper_names[0], helper_names[1],
+                              helper_names[2],
+                              flags & ~REGEX2C_OMIT_HELPER_DECLS, fout);
+  }
+  for (int i = 0; i < batch->entry_count; i++) {
+    batch_entry_t *entry = &batch->entries[i];
+    fprintf(fout, "\n");
+    if (entry->duplicate_of == -1) {
+      fwrite(entry->result.code, 1, entry->result.code_length, fout);
+      continue;
+    }
+    if (cpp) {
+      fprintf(fout, "namespace %s = %s;\n", entry->name,
+              batch->entries[entry->duplicate_of].name);
+      continue;
+    }
+    if (simd) {
+      fprintf(fout,
+              "%svoid %s(const unsigned char *const *inputs, const long "
+              "*lengths, long count, int *tags) { %s(inputs, lengths, count, "
+              "tags); }\n",
+              get_parser_storage(flags), entry->name,
+              batch->entries[entry->duplicate_of].name);
+      continue;
+    }
+    if (flags & REGEX2C_SEARCH) {
+      fprintf(fout,
+              "%svoid %s(const unsigned char *input, long length) { "
+              "%s(input, length); }\n",
+              get_parser_storage(flags), entry->name,
+              batch->entries[entry->duplicate_of].name);
+      continue;
+    }
+    fprintf(fout, "%svoid %s() { %s(); }\n",
+            get_parser_storage(flags), entry->name,
+            batch->entries[entry->duplicate_of].name);
+  }
+}
+
+void delete_batch(batch_t *batch) {
+  for (int i = 0; i < batch->entry_count; i++) {
+    free(batch->entries[i].name);
+    free(batch->entries[i].pattern);
+    delete_regex2c_result(&batch->entries[i].result);
+  }
+  free(batch->entries);
+  memset(batch, 0, sizeof(batch_t));
+}
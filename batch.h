@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "compiler.h"
+
+typedef struct batch_entry {
+  char *name;    // the name of the generated parser, a c identifier
+  char *pattern; // the regular expression, not null-terminated
+  size_t length;
+  int line; // the line of the entry in the manifest
+  // The index of the first entry with the same pattern, which is compiled
+  // instead of this one, or -1
+  int duplicate_of;
+  regex2c_result_t result;
+} batch_entry_t;
+
+typedef struct batch {
+  batch_entry_t *entries;
+  int entry_count;
+} batch_t;
+
+/**
+ * Reads the manifest at {@code path} into {@code batch}. Every non-empty line
+ * of the manifest, which does not start with '#', is an entry of a parser
+ * name and a pattern separated by whitespace:
+ *
+ * name pattern
+ * name @file
+ *
+ * The pattern extends to the end of the line (only trailing whitespace is
+ * removed). A pattern starting with '@' names a file (relative to the
+ * directory of the manifest) containing the pattern instead, without its
+ * trailing whitespace; a literal '@' at the start of a pattern can be written
+ * as {@code \x40}. Entries with the same pattern are marked as duplicates of
+ * the first one.
+ *
+ * Every parser defines its name and symbols named {@code <name>_...}, so
+ * unless the {@code options} (which may be {@code NULL}) select the cpp
+ * backend, a name must not start with the name of another entry followed by
+ * '_', and must not be, or be a prefix followed by '_' of, the name of a
+ * function called by the parsers (see {@code print_batch}).
+ *
+ * Returns 1 on success. Otherwise stores a description of the error into
+ * {@code error} (to be freed by the caller) and returns 0.
+ */
+bool_t read_batch_manifest(char *path, const regex2c_options_t *options,
+                           batch_t *batch, char **error);
+
+/**
+ * Compiles the pattern of every entry of {@code batch}, which is not a
+ * duplicate, with the given {@code options} on {@code jobs} threads. The
+ * parser of each entry is named after the entry; the flag
+ * REGEX2C_OMIT_HELPER_DECLS is added to the flags of the options.
+ *
+ * Returns the index of the first entry, which failed to compile (see its
+ * {@code result.error}), or -1 if all entries were compiled.
+ */
+int compile_batch(batch_t *batch, const regex2c_options_t *options, int jobs);
+
+/**
+ * Prints the compiled {@code batch} as one translation unit: the declarations
+ * of the functions called by the parsers (named and made static according to
+ * {@code options}), followed by the parser of every entry in manifest order.
+ * Duplicates call the parser of the entry they duplicate. C++ headers start
+ * with their includes instead, and duplicates alias the namespace of the
+ * entry they duplicate.
+ */
+void print_batch(batch_t *batch, const regex2c_options_t *options,
+                 FILE *fout);
+
+/**
+ * Frees all memory of the given {@code batch}.
+ */
+void delete_batch(batch_t *batch);
@@ -0,0 +1,419 @@
+#include <math.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "compiler.h"
+#include "jit.h"
+
+/*
+ * Matches every line of an input file against every pattern of a corpus (see
+ * corpus.txt) with glibc's regexec and with the parsers generated by regex2c,
+ * checks that they agree on which lines match as a whole, and prints the
+ * compile times and the throughput of every engine. The geometric mean of the
+ * speedups over regexec of every regex2c engine is compared against a
+ * baseline file.
+ */
+
+// The parsers generated from the corpus by each backend, named
+// <backend>_<entry name> (see the Makefile)
+#define BENCH_PATTERN(name)                                                    \
+  void dfa_##name();                                                           \
+  void table_##name();                                                         \
+  void comb_##name();
+#include "corpus.def"
+#undef BENCH_PATTERN
+
+#define GENERATED_BACKEND_COUNT 3
+
+typedef struct bench_parsers {
+  char *name;
+  void (*parsers[GENERATED_BACKEND_COUNT])();
+} bench_parsers_t;
+
+static bench_parsers_t bench_parsers[] = {
+#define BENCH_PATTERN(name) {#name, {dfa_##name, table_##name, comb_##name}},
+#include "corpus.def"
+#undef BENCH_PATTERN
+};
+
+#define BENCH_PARSER_COUNT                                                     \
+  (int)(sizeof(bench_parsers) / sizeof(bench_parsers_t))
+
+typedef enum engine {
+  REGEXEC_ENGINE,
+  DFA_ENGINE,
+  TABLE_ENGINE,
+  COMB_ENGINE,
+  JIT_ENGINE,
+  ENGINE_COUNT
+} engine_t;
+
+static char *engine_names[ENGINE_COUNT] = {"regexec", "dfa", "table", "comb",
+                                           "jit"};
+
+typedef struct line {
+  char *chars; // null-terminated for regexec
+  size_t length;
+} line_t;
+
+typedef struct input {
+  char *data;
+  line_t *lines;
+  int line_count;
+  size_t byte_count; // of all lines, without the newlines
+} input_t;
+
+// The state of the callbacks of the generated parsers
+static const line_t *current_line;
+static size_t position;
+static bool_t matched;
+
+int consume_next() {
+  return position < current_line->length
+             ? (unsigned char)current_line->chars[position++]
+             : EOF;
+}
+
+int accept(int tag) {
+  if (position == current_line->length) {
+    matched = 1;
+    return 1;
+  }
+  return 0;
+}
+
+void reject() {}
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void read_input(char *path, input_t *input) {
+  FILE *fin = fopen(path, "rb");
+  if (fin == NULL) {
+    fprintf(stderr, "regcomp_bench: cannot open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fseek(fin, 0, SEEK_END);
+  long size = ftell(fin);
+  rewind(fin);
+  input->data = malloc(size + 1);
+  size = fread(input->data, 1, size, fin);
+  fclose(fin);
+  input->data[size] = '\n';
+  input->lines = malloc((size + 1) * sizeof(line_t));
+  input->line_count = 0;
+  input->byte_count = 0;
+  char *start = input->data;
+  for (char *c = input->data; c < input->data + size; c++) {
+    if (*c != '\n') {
+      continue;
+    }
+    *c = '\0';
+    input->lines[input->line_count++] =
+        (line_t){.chars = start, .length = c - start};
+    input->byte_count += c - start;
+    start = c + 1;
+  }
+  if (start < input->data + size) {
+    input->data[size] = '\0';
+    input->lines[input->line_count++] =
+        (line_t){.chars = start, .length = input->data + size - start};
+    input->byte_count += input->data + size - start;
+  }
+}
+
+typedef struct bench_pattern {
+  batch_entry_t *entry;
+  void (*const *parsers)();
+  regex_t regex;
+  jit_matcher_t matcher;
+  bool_t has_jit;
+  double compile_seconds[ENGINE_COUNT];
+} bench_pattern_t;
+
+static bool_t match_line(bench_pattern_t *pattern, engine_t engine,
+                         const line_t *line) {
+  switch (engine) {
+  case REGEXEC_ENGINE:
+    return regexec(&pattern->regex, line->chars, 0, NULL, 0) == 0;
+  case JIT_ENGINE: {
+    int tag;
+    const unsigned char *chars = (const unsigned char *)line->chars;
+    return pattern->matcher.match(chars, chars + line->length, &tag) ==
+           (long)line->length;
+  }
+  default:
+    current_line = line;
+    position = 0;
+    matched = 0;
+    pattern->parsers[engine - DFA_ENGINE]();
+    return matched;
+  }
+}
+
+static void compile_pattern(bench_pattern_t *pattern) {
+  batch_entry_t *entry = pattern->entry;
+  // regexec finds a match anywhere, the parsers match the whole line
+  size_t size = entry->length + 5;
+  char *anchored = malloc(size);
+  snprintf(anchored, size, "^(%.*s)$", (int)entry->length, entry->pattern);
+  double start = now();
+  int error = regcomp(&pattern->regex, anchored, REG_EXTENDED | REG_NOSUB);
+  pattern->compile_seconds[REGEXEC_ENGINE] = now() - start;
+  if (error != 0) {
+    fprintf(stderr, "regcomp_bench: regcomp rejects %s\n", anchored);
+    exit(EXIT_FAILURE);
+  }
+  free(anchored);
+
+  // The c code is the same for all generated backends up to the printing
+  regex2c_result_t result;
+  start = now();
+  if (regex2c_compile(entry->pattern, entry->length, NULL, &result) != 0) {
+    fprintf(stderr, "regcomp_bench: %s: %s\n", entry->name, result.error);
+    exit(EXIT_FAILURE);
+  }
+  double seconds = now() - start;
+  delete_regex2c_result(&result);
+  for (int engine = DFA_ENGINE; engine <= COMB_ENGINE; engine++) {
+    pattern->compile_seconds[engine] = seconds;
+  }
+
+  start = now();
+  pattern->has_jit = regex2c_compile_jit(entry->pattern, entry->length, NULL,
+                                         &pattern->matcher, &result) == 0;
+  pattern->compile_seconds[JIT_ENGINE] = now() - start;
+  delete_regex2c_result(&result);
+}
+
+/**
+ * Returns the first line, on which an engine disagrees with regexec, or -1.
+ * Stores the engine into {@code engine}.
+ */
+static int find_disagreement(bench_pattern_t *pattern, input_t *input,
+                             engine_t *engine) {
+  for (int i = 0; i < input->line_count; i++) {
+    bool_t expected = match_line(pattern, REGEXEC_ENGINE, &input->lines[i]);
+    for (*engine = DFA_ENGINE; *engine < ENGINE_COUNT; (*engine)++) {
+      if (*engine == JIT_ENGINE && !pattern->has_jit) {
+        continue;
+      }
+      if (match_line(pattern, *engine, &input->lines[i]) != expected) {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
+/**
+ * Returns the throughput of the {@code engine} in MB/s over {@code
+ * repetitions} passes over the {@code input}.
+ */
+static double measure_throughput(bench_pattern_t *pattern, engine_t engine,
+                                 input_t *input, int repetitions) {
+  long match_count = 0;
+  double start = now();
+  for (int r = 0; r < repetitions; r++) {
+    for (int i = 0; i < input->line_count; i++) {
+      match_count += match_line(pattern, engine, &input->lines[i]);
+    }
+  }
+  double seconds = now() - start;
+  if (match_count < 0) {
+    // Keeps the matches from being optimized away
+    printf("%ld\n", match_count);
+  }
+  return (double)input->byte_count * repetitions / seconds / 1e6;
+}
+
+/**
+ * Reads the minimal speedups of the regex2c engines over regexec from {@code
+ * path} (one "engine speedup" pair per line) into {@code baseline}; engines
+ * without a line get 0. Returns 0 if the file cannot be read.
+ */
+static bool_t read_baseline(char *path, double *baseline) {
+  for (int engine = 0; engine < ENGINE_COUNT; engine++) {
+    baseline[engine] = 0;
+  }
+  FILE *fin = fopen(path, "r");
+  if (fin == NULL) {
+    return 0;
+  }
+  char name[64];
+  double speedup;
+  while (fscanf(fin, "%63s %lf", name, &speedup) == 2) {
+    for (int engine = DFA_ENGINE; engine < ENGINE_COUNT; engine++) {
+      if (strcmp(name, engine_names[engine]) == 0) {
+        baseline[engine] = speedup;
+      }
+    }
+  }
+  fclose(fin);
+  return 1;
+}
+
+static void write_baseline(char *path, double *speedups) {
+  FILE *fout = fopen(path, "w");
+  if (fout == NULL) {
+    fprintf(stderr, "regcomp_bench: cannot write %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  for (int engine = DFA_ENGINE; engine < ENGINE_COUNT; engine++) {
+    if (speedups[engine] > 0) {
+      fprintf(fout, "%s %.2f\n", engine_names[engine], speedups[engine]);
+    }
+  }
+  fclose(fout);
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: regcomp_bench [-r repetitions] [-b baseline] [-t tolerance] "
+          "[-w] corpus input\n"
+          "  -r  passes over the input per pattern and engine (default 1000)\n"
+          "  -b  fail if a geometric mean speedup over regexec falls below\n"
+          "      the one in this file by more than the tolerance\n"
+          "  -t  the tolerated fraction (default 0.2)\n"
+          "  -w  write the measured speedups into the baseline instead\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  int repetitions = 1000;
+  char *baseline_path = NULL;
+  double tolerance = 0.2;
+  bool_t write = 0;
+  int option;
+  while ((option = getopt(argc, argv, "r:b:t:w")) != -1) {
+    switch (option) {
+    case 'r':
+      repetitions = atoi(optarg);
+      break;
+    case 'b':
+      baseline_path = optarg;
+      break;
+    case 't':
+      tolerance = atof(optarg);
+      break;
+    case 'w':
+      write = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (argc - optind != 2 || repetitions <= 0 || (write && !baseline_path)) {
+    usage();
+  }
+
+  batch_t batch;
+  char *error;
+  if (!read_batch_manifest(argv[optind], NULL, &batch, &error)) {
+    fprintf(stderr, "regcomp_bench: %s\n", error);
+    return EXIT_FAILURE;
+  }
+  bool_t matches_parsers = batch.entry_count == BENCH_PARSER_COUNT;
+  for (int p = 0; p < batch.entry_count && matches_parsers; p++) {
+    matches_parsers = strcmp(batch.entries[p].name, bench_parsers[p].name) == 0;
+  }
+  if (!matches_parsers) {
+    fprintf(stderr, "regcomp_bench: %s does not match the generated parsers\n",
+            argv[optind]);
+    return EXIT_FAILURE;
+  }
+  input_t input;
+  read_input(argv[optind + 1], &input);
+
+  printf("%-8s %9s %9s %9s |", "pattern", "regcomp", "regex2c", "jit");
+  for (int engine = 0; engine < ENGINE_COUNT; engine++) {
+    printf(" %8s", engine_names[engine]);
+  }
+  printf("\n%-8s %9s %9s %9s |", "", "(us)", "(us)", "(us)");
+  for (int engine = 0; engine < ENGINE_COUNT; engine++) {
+    printf(" %8s", "(MB/s)");
+  }
+  printf("\n");
+
+  double log_speedups[ENGINE_COUNT] = {0};
+  int speedup_counts[ENGINE_COUNT] = {0};
+  bool_t failed = 0;
+  for (int p = 0; p < batch.entry_count; p++) {
+    bench_pattern_t pattern = {.entry = &batch.entries[p],
+                               .parsers = bench_parsers[p].parsers};
+    compile_pattern(&pattern);
+    engine_t engine;
+    int line = find_disagreement(&pattern, &input, &engine);
+    if (line != -1) {
+      fflush(stdout);
+      fprintf(stderr, "regcomp_bench: %s: %s and regexec disagree on \"%s\"\n",
+              pattern.entry->name, engine_names[engine],
+              input.lines[line].chars);
+      failed = 1;
+    }
+
+    printf("%-8s %9.1f %9.1f %9.1f |", pattern.entry->name,
+           pattern.compile_seconds[REGEXEC_ENGINE] * 1e6,
+           pattern.compile_seconds[DFA_ENGINE] * 1e6,
+           pattern.compile_seconds[JIT_ENGINE] * 1e6);
+    double regexec_throughput = 0;
+    for (engine = 0; engine < ENGINE_COUNT; engine++) {
+      if (engine == JIT_ENGINE && !pattern.has_jit) {
+        printf(" %8s", "-");
+        continue;
+      }
+      double throughput =
+          measure_throughput(&pattern, engine, &input, repetitions);
+      printf(" %8.1f", throughput);
+      fflush(stdout);
+      if (engine == REGEXEC_ENGINE) {
+        regexec_throughput = throughput;
+        continue;
+      }
+      log_speedups[engine] += log(throughput / regexec_throughput);
+      speedup_counts[engine]++;
+    }
+    printf("\n");
+    regfree(&pattern.regex);
+    delete_jit_matcher(&pattern.matcher);
+  }
+
+  double speedups[ENGINE_COUNT] = {0};
+  double baseline[ENGINE_COUNT] = {0};
+  if (baseline_path != NULL && !write &&
+      !read_baseline(baseline_path, baseline)) {
+    fprintf(stderr, "regcomp_bench: cannot read %s\n", baseline_path);
+    failed = 1;
+  }
+  printf("\ngeometric mean speedup over regexec:\n");
+  for (int engine = DFA_ENGINE; engine < ENGINE_COUNT; engine++) {
+    if (speedup_counts[engine] == 0) {
+      continue;
+    }
+    speedups[engine] = exp(log_speedups[engine] / speedup_counts[engine]);
+    printf("%-8s %6.2fx", engine_names[engine], speedups[engine]);
+    if (baseline[engine] > 0) {
+      bool_t regressed = speedups[engine] < baseline[engine] * (1 - tolerance);
+      printf(" (baseline %.2fx%s)", baseline[engine],
+             regressed ? ", REGRESSED" : "");
+      failed |= regressed;
+    }
+    printf("\n");
+  }
+  if (write) {
+    write_baseline(baseline_path, speedups);
+  }
+
+  delete_batch(&batch);
+  free(input.lines);
+  free(input.data);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,384 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "compiler.h"
+#include "stats.h"
+
+/*
+ * Compiles families of generated patterns of increasing size and measures the
+ * time of every compile phase (see compile_stats_t). The growth of every phase
+ * is fitted by a power law t = a * n^b (or by t = a * g^n for families with
+ * exponential automata), so asymptotic regressions show up as a larger
+ * exponent b (or growth factor g) instead of as noise in the wall time.
+ */
+
+// The shortest phase time, which is included in a fit, in milliseconds
+#define MIN_FIT_MS 0.05
+
+typedef struct pattern_family {
+  char *name;
+  // Appends the pattern of the given size to the pattern
+  void (*generate)(int size, string_t *pattern);
+  int first_size;
+  int last_size;
+  bool_t exponential; // sizes grow by one instead of doubling
+} pattern_family_t;
+
+static char *phase_names[PHASE_COUNT] = {"parse", "ast2nfa", "determinize",
+                                         "minimize", "codegen"};
+
+/**
+ * Appends a literal of {@code size} chars.
+ */
+static void generate_literal(int size, string_t *pattern) {
+  for (int i = 0; i < size; i++) {
+    append_char_to_str(pattern, 'a' + i % 26);
+  }
+}
+
+/**
+ * Appends an alternation of {@code size} distinct words of five letters, which
+ * share prefixes like the keywords of a lexer.
+ */
+static void generate_alternation(int size, string_t *pattern) {
+  for (int i = 0; i < size; i++) {
+    if (i > 0) {
+      append_char_to_str(pattern, '|');
+    }
+    for (int k = 0, digits = i * 7919; k < 5; k++, digits /= 26) {
+      append_char_to_str(pattern, 'a' + digits % 26);
+    }
+  }
+}
+
+/**
+ * Appends {@code size} nested stars: ((((a*b)*c)*d)*...).
+ */
+static void generate_nested_stars(int size, string_t *pattern) {
+  for (int i = 0; i < size; i++) {
+    append_char_to_str(pattern, '(');
+  }
+  append_str_to_str(pattern, "a");
+  for (int i = 0; i < size; i++) {
+    append_str_to_str(pattern, "*");
+    append_char_to_str(pattern, 'b' + i % 25);
+    append_char_to_str(pattern, ')');
+  }
+  append_char_to_str(pattern, '*');
+}
+
+/**
+ * Appends (a|b)*a(a|b)...(a|b) with {@code size} trailing (a|b), whose minimal
+ * DFA has 2^(size + 1) states.
+ */
+static void generate_blowup(int size, string_t *pattern) {
+  append_str_to_str(pattern, "(a|b)*a");
+  for (int i = 0; i < size; i++) {
+    append_str_to_str(pattern, "(a|b)");
+  }
+}
+
+/**
+ * Appends an alternation of {@code size} overlapping byte ranges, which split
+ * the bytes into many classes, each followed by three distinct letters.
+ */
+static void generate_classes(int size, string_t *pattern) {
+  char range[32];
+  for (int i = 0; i < size; i++) {
+    int first = i * 37 % 240;
+    snprintf(range, sizeof(range), "%s[\\x%02x-\\x%02x]%c%c%c",
+             i > 0 ? "|" : "", first, first + 1 + i % 15, 'a' + i % 26,
+             'a' + i / 26 % 26, 'a' + i / 676 % 26);
+    append_str_to_str(pattern, range);
+  }
+}
+
+static pattern_family_t families[] = {
+    {"literal", generate_literal, 256, 16384, 0},
+    {"alternation", generate_alternation, 64, 8192, 0},
+    {"nested_stars", generate_nested_stars, 16, 512, 0},
+    {"blowup", generate_blowup, 4, 14, 1},
+    {"classes", generate_classes, 16, 1024, 0},
+};
+
+#define FAMILY_COUNT (int)(sizeof(families) / sizeof(pattern_family_t))
+
+typedef struct scaling_point {
+  double x; // the size, or the log of the size for power laws
+  double log_ms[PHASE_COUNT];
+  bool_t measured[PHASE_COUNT];
+} scaling_point_t;
+
+/**
+ * Compiles the given {@code pattern} {@code repetitions} times and stores the
+ * shortest time of every phase into {@code ms}, and the statistics of the last
+ * compile into {@code stats}.
+ */
+static void measure_pattern(string_t *pattern, regex2c_options_t *options,
+                            int repetitions, double *ms,
+                            compile_stats_t *stats) {
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    ms[phase] = INFINITY;
+  }
+  for (int r = 0; r < repetitions; r++) {
+    regex2c_result_t result;
+    if (regex2c_compile(pattern->data, pattern->length, options, &result) !=
+        0) {
+      fprintf(stderr, "scaling_bench: %s\n", result.error);
+      exit(EXIT_FAILURE);
+    }
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+      if (result.stats.phases[phase].wall_ms < ms[phase]) {
+        ms[phase] = result.stats.phases[phase].wall_ms;
+      }
+    }
+    *stats = result.stats;
+    delete_regex2c_result(&result);
+  }
+}
+
+/**
+ * Returns the slope of the least squares line through the points of the
+ * given {@code phase}, or NAN if less than three points were measured.
+ */
+static double fit_slope(scaling_point_t *points, int point_count, int phase) {
+  double n = 0, sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+  for (int i = 0; i < point_count; i++) {
+    if (!points[i].measured[phase]) {
+      continue;
+    }
+    n++;
+    sum_x += points[i].x;
+    sum_y += points[i].log_ms[phase];
+    sum_xx += points[i].x * points[i].x;
+    sum_xy += points[i].x * points[i].log_ms[phase];
+  }
+  if (n < 3) {
+    return NAN;
+  }
+  return (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+}
+
+/**
+ * Reads the largest allowed exponent (or growth factor) of every family and
+ * phase from {@code path} (one "family phase value" triple per line) into
+ * {@code limits}. Returns 0 if the file cannot be read.
+ */
+static bool_t read_limits(char *path, double limits[][PHASE_COUNT]) {
+  FILE *fin = fopen(path, "r");
+  if (fin == NULL) {
+    return 0;
+  }
+  char family[64], phase[64];
+  double value;
+  while (fscanf(fin, "%63s %63s %lf", family, phase, &value) == 3) {
+    for (int f = 0; f < FAMILY_COUNT; f++) {
+      for (int p = 0; p < PHASE_COUNT; p++) {
+        if (strcmp(family, families[f].name) == 0 &&
+            strcmp(phase, phase_names[p]) == 0) {
+          limits[f][p] = value;
+        }
+      }
+    }
+  }
+  fclose(fin);
+  return 1;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: scaling_bench [-c construction] [-r repetitions] "
+          "[-l seconds] [-o csv] [-b baseline] [-t tolerance] [-w] "
+          "[family...]\n"
+          "  -c  thompson (default), glushkov or direct\n"
+          "  -r  compiles per size, the fastest counts (default 3)\n"
+          "  -l  stop growing a family after a compile of this many seconds\n"
+          "      (default 2)\n"
+          "  -o  write every measurement into this csv file for plotting\n"
+          "  -b  fail if a fitted exponent (or growth factor) exceeds the one\n"
+          "      in this file by more than the tolerance\n"
+          "  -t  the tolerated difference (default 0.3)\n"
+          "  -w  write the fitted exponents into the baseline instead\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  regex2c_options_t options = {.construction = THOMPSON_CONSTRUCTION};
+  int repetitions = 3;
+  double limit_seconds = 2;
+  char *csv_path = NULL;
+  char *baseline_path = NULL;
+  double tolerance = 0.3;
+  bool_t write = 0;
+  int option;
+  while ((option = getopt(argc, argv, "c:r:l:o:b:t:w")) != -1) {
+    switch (option) {
+    case 'c':
+      if (strcmp(optarg, "thompson") == 0) {
+        options.construction = THOMPSON_CONSTRUCTION;
+      } else if (strcmp(optarg, "glushkov") == 0) {
+        options.construction = GLUSHKOV_CONSTRUCTION;
+      } else if (strcmp(optarg, "direct") == 0) {
+        options.construction = DIRECT_CONSTRUCTION;
+      } else {
+        usage();
+      }
+      break;
+    case 'r':
+      repetitions = atoi(optarg);
+      break;
+    case 'l':
+      limit_seconds = atof(optarg);
+      break;
+    case 'o':
+      csv_path = optarg;
+      break;
+    case 'b':
+      baseline_path = optarg;
+      break;
+    case 't':
+      tolerance = atof(optarg);
+      break;
+    case 'w':
+      write = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (repetitions <= 0 || (write && baseline_path == NULL)) {
+    usage();
+  }
+  bool_t selected[FAMILY_COUNT];
+  for (int f = 0; f < FAMILY_COUNT; f++) {
+    selected[f] = optind == argc;
+    for (int i = optind; i < argc; i++) {
+      selected[f] |= strcmp(argv[i], families[f].name) == 0;
+    }
+  }
+
+  double limits[FAMILY_COUNT][PHASE_COUNT];
+  for (int f = 0; f < FAMILY_COUNT; f++) {
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      limits[f][p] = NAN;
+    }
+  }
+  bool_t failed = 0;
+  if (baseline_path != NULL && !write && !read_limits(baseline_path, limits)) {
+    fprintf(stderr, "scaling_bench: cannot read %s\n", baseline_path);
+    failed = 1;
+  }
+  FILE *csv = NULL;
+  if (csv_path != NULL) {
+    csv = fopen(csv_path, "w");
+    if (csv == NULL) {
+      fprintf(stderr, "scaling_bench: cannot write %s\n", csv_path);
+      return EXIT_FAILURE;
+    }
+    fprintf(csv, "family,size,pattern_length,nfa_nodes,dfa_states,"
+                 "minimal_dfa_states");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      fprintf(csv, ",%s_ms", phase_names[p]);
+    }
+    fprintf(csv, "\n");
+  }
+  FILE *baseline = NULL;
+  if (write) {
+    baseline = fopen(baseline_path, "w");
+    if (baseline == NULL) {
+      fprintf(stderr, "scaling_bench: cannot write %s\n", baseline_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (int f = 0; f < FAMILY_COUNT; f++) {
+    pattern_family_t *family = &families[f];
+    if (!selected[f]) {
+      continue;
+    }
+    printf("%s\n%8s %8s %8s %8s %8s", family->name, "size", "length", "nfa",
+           "dfa", "min dfa");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      printf(" %11s", phase_names[p]);
+    }
+    printf("\n");
+
+    scaling_point_t points[64];
+    int point_count = 0;
+    for (int size = family->first_size;
+         size <= family->last_size && point_count < 64;
+         size = family->exponential ? size + 1 : size * 2) {
+      string_t pattern = create_string(NULL);
+      family->generate(size, &pattern);
+      double ms[PHASE_COUNT];
+      compile_stats_t stats;
+      measure_pattern(&pattern, &options, repetitions, ms, &stats);
+
+      scaling_point_t *point = &points[point_count++];
+      point->x = family->exponential ? size : log(size);
+      double total_ms = 0;
+      printf("%8d %8zu %8d %8d %8d", size, pattern.length, stats.nfa_nodes,
+             stats.dfa_states, stats.minimized_dfa_states);
+      for (int p = 0; p < PHASE_COUNT; p++) {
+        printf(" %9.2fms", ms[p]);
+        point->measured[p] = ms[p] >= MIN_FIT_MS;
+        point->log_ms[p] = point->measured[p] ? log(ms[p]) : 0;
+        total_ms += ms[p];
+      }
+      printf("\n");
+      fflush(stdout);
+      if (csv != NULL) {
+        fprintf(csv, "%s,%d,%zu,%d,%d,%d", family->name, size, pattern.length,
+                stats.nfa_nodes, stats.dfa_states, stats.minimized_dfa_states);
+        for (int p = 0; p < PHASE_COUNT; p++) {
+          fprintf(csv, ",%.4f", ms[p]);
+        }
+        fprintf(csv, "\n");
+      }
+      free(pattern.data);
+      if (total_ms > limit_seconds * 1000) {
+        break;
+      }
+    }
+
+    printf("%-44s", family->exponential ? "growth factor per size step:"
+                                        : "exponent of the size:");
+    bool_t regressed[PHASE_COUNT] = {0};
+    double values[PHASE_COUNT];
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      double slope = fit_slope(points, point_count, p);
+      double value = family->exponential ? exp(slope) : slope;
+      values[p] = value;
+      if (isnan(value)) {
+        printf(" %11s", "-");
+        continue;
+      }
+      printf(" %11.2f", value);
+      if (baseline != NULL) {
+        fprintf(baseline, "%s %s %.2f\n", family->name, phase_names[p], value);
+      }
+      regressed[p] = !isnan(limits[f][p]) && value > limits[f][p] + tolerance;
+    }
+    printf("\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      if (regressed[p]) {
+        printf("REGRESSED: %s of %s grows by %.2f, the baseline is %.2f\n",
+               phase_names[p], family->name, values[p], limits[f][p]);
+        failed = 1;
+      }
+    }
+    printf("\n");
+  }
+
+  if (csv != NULL) {
+    fclose(csv);
+  }
+  if (baseline != NULL) {
+    fclose(baseline);
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,244 @@
+#include "bitparallel2c.h"
+#include "automaton2c.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct bit_mask {
+  unsigned long words[2];
+} bit_mask_t;
+
+__attribute__((always_inline)) inline void set_mask_bit(bit_mask_t *mask,
+                                                        int bit) {
+  mask->words[bit / 64] |= 1UL << (bit % 64);
+}
+
+__attribute__((always_inline)) inline void clear_mask_bit(bit_mask_t *mask,
+                                                          int bit) {
+  mask->words[bit / 64] &= ~(1UL << (bit % 64));
+}
+
+__attribute__((always_inline)) inline bool_t mask_has_bit(bit_mask_t *mask,
+                                                          int bit) {
+  return mask->words[bit / 64] >> (bit % 64) & 1;
+}
+
+__attribute__((always_inline)) inline bool_t mask_empty(bit_mask_t *mask) {
+  return mask->words[0] == 0 && mask->words[1] == 0;
+}
+
+__attribute__((always_inline)) inline bool_t masks_equal(bit_mask_t *m0,
+                                                        bit_mask_t *m1) {
+  return m0->words[0] == m1->words[0] && m0->words[1] == m1->words[1];
+}
+
+static void print_mask(bit_mask_t *mask, bool_t wide, FILE *fout) {
+  if (wide) {
+    fprintf(fout, "((unsigned __int128)0x%lxULL << 64 | 0x%lxULL)",
+            mask->words[1], mask->words[0]);
+  } else {
+    fprintf(fout, "0x%lxULL", mask->words[0]);
+  }
+}
+
+/**
+ * Assigns a bit to every char position (end markers get no bit). Bit 0 is
+ * the initial state. Returns the number of used bits.
+ */
+static int assign_position_bits(positions_t *positions, int *bits) {
+  int next_bit = 1;
+  for (int p = 0; p < positions->count; p++) {
+    bits[p] = positions->positions[p].end_tag == -1 ? next_bit++ : -1;
+  }
+  return next_bit;
+}
+
+/**
+ * Computes the follow mask of every bit and the final mask of every end tag.
+ * Returns the highest end tag.
+ */
+static int compute_follow_masks(positions_t *positions, int *bits,
+                                bit_mask_t *follow, bit_mask_t **final) {
+  int N = positions->count;
+  int max_tag = -1;
+  for (int p = 0; p < N; p++) {
+    if (positions->positions[p].end_tag > max_tag) {
+      max_tag = positions->positions[p].end_tag;
+    }
+  }
+  *final = calloc(max_tag + 1, sizeof(bit_mask_t));
+  // Position -1 stands for the initial state (bit 0)
+  for (int p = -1; p < N; p++) {
+    if (p >= 0 && bits[p] == -1) {
+      continue;
+    }
+    int bit = p >= 0 ? bits[p] : 0;
+    for (int q = 0; q < N; q++) {
+      bool_t follows =
+          p >= 0 ? positions->follow[p * N + q] : positions->first[q];
+      if (!follows) {
+        continue;
+      }
+      int end_tag = positions->positions[q].end_tag;
+      if (end_tag == -1) {
+        set_mask_bit(&follow[bit], bits[q]);
+      } else {
+        set_mask_bit(&(*final)[end_tag], bit);
+      }
+    }
+  }
+  return max_tag;
+}
+
+static void print_byte_class_tables(positions_t *positions, int *bits,
+                                    char *parser_name, char *type, bool_t wide,
+                                    FILE *fout) {
+  bit_mask_t masks[256];
+  memset(masks, 0, sizeof(masks));
+  for (int p = 0; p < positions->count; p++) {
+    for (int t = 0; bits[p] != -1 && t < 256; t++) {
+      if (positions->positions[p].terminals[t]) {
+        set_mask_bit(&masks[t], bits[p]);
+      }
+    }
+  }
+
+  // Bytes with equal masks share a byte class
+  int byte_class[256];
+  int class_count = 0;
+  bit_mask_t class_masks[256];
+  for (int t = 0; t < 256; t++) {
+    byte_class[t] = -1;
+    for (int c = 0; c < class_count; c++) {
+      if (masks_equal(&class_masks[c], &masks[t])) {
+        byte_class[t] = c;
+        break;
+      }
+    }
+    if (byte_class[t] == -1) {
+      class_masks[class_count] = masks[t];
+      byte_class[t] = class_count++;
+    }
+  }
+
+  fprintf(fout, "static const unsigned char %s_byte_class[256] = {",
+          parser_name);
+  for (int t = 0; t < 256; t++) {
+    if (t % 16 == 0) {
+      fprintf(fout, "\n ");
+    }
+    fprintf(fout, " %d,", byte_class[t]);
+  }
+  fprintf(fout, "\n};\n");
+  fprintf(fout, "static const %s %s_class_mask[%d] = {\n", type, parser_name,
+          class_count);
+  for (int c = 0; c < class_count; c++) {
+    fprint_indent(2, fout);
+    print_mask(&class_masks[c], wide, fout);
+    fprintf(fout, ",\n");
+  }
+  fprintf(fout, "};\n");
+}
+
+bool_t print_positions_to_bitparallel_c_code(positions_t *positions,
+                                             char *parser_name,
+                                             char *next_name, char *acc_name,
+                                             char *rej_name, int flags,
+                                             FILE *fout) {
+  int *bits = malloc(positions->count * sizeof(int));
+  int bit_count = assign_position_bits(positions, bits);
+  if (bit_count > BITPARALLEL_MAX_BITS) {
+    free(bits);
+    return 0;
+  }
+  bool_t wide = bit_count > 64;
+  char *type = wide ? "unsigned __int128" : "uint64_t";
+
+  bit_mask_t follow[BITPARALLEL_MAX_BITS];
+  memset(follow, 0, sizeof(follow));
+  bit_mask_t *final;
+  int max_tag = compute_follow_masks(positions, bits, follow, &final);
+
+  // Follow edges to the next bit are handled by a single shift
+  bit_mask_t shift = {{0, 0}};
+  for (int bit = 0; bit + 1 < bit_count; bit++) {
+    if (mask_has_bit(&follow[bit], bit + 1)) {
+      set_mask_bit(&shift, bit + 1);
+      clear_mask_bit(&follow[bit], bit + 1);
+    }
+  }
+
+  fprintf(fout, "#include <stdint.h>\n");
+  print_helper_declarations(next_name, acc_name, rej_name, flags, fout);
+  print_byte_class_tables(positions, bits, parser_name, type, wide, fout);
+
+  fprintf(fout, "%svoid %s() {\n",
+          get_parser_storage(flags), parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "%s state = 1;\n", type);
+  fprint_indent(2, fout);
+  fprintf(fout, "while (1) {\n");
+
+  // Accept with the lowest end tag of all active final positions
+  bool_t first_tag = 1;
+  for (int tag = 0; tag <= max_tag; tag++) {
+    if (mask_empty(&final[tag])) {
+      continue;
+    }
+    fprint_indent(4, fout);
+    fprintf(fout, "%sif (state & ", first_tag ? "" : "} else ");
+    print_mask(&final[tag], wide, fout);
+    fprintf(fout, ") {\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "if (%s(%d)) { return; }\n", acc_name, tag);
+    first_tag = 0;
+  }
+  if (!first_tag) {
+    fprint_indent(4, fout);
+    fprintf(fout, "}\n");
+  }
+
+  fprint_indent(4, fout);
+  fprintf(fout, "int c = %s();\n", next_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "if (c < 0 || c >= 256) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "%s();\n", rej_name);
+  fprint_indent(6, fout);
+  fprintf(fout, "return;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "%s following = (state << 1) & ", type);
+  print_mask(&shift, wide, fout);
+  fprintf(fout, ";\n");
+  for (int bit = 0; bit < bit_count; bit++) {
+    if (mask_empty(&follow[bit])) {
+      continue;
+    }
+    fprint_indent(4, fout);
+    fprintf(fout, "following |= ");
+    print_mask(&follow[bit], wide, fout);
+    fprintf(fout, " & -(state >> %d & 1);\n", bit);
+  }
+  fprint_indent(4, fout);
+  fprintf(fout, "state = following & %s_class_mask[%s_byte_class[c]];\n",
+          parser_name, parser_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "if (!state) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "%s();\n", rej_name);
+  fprint_indent(6, fout);
+  fprintf(fout, "return;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "}\n");
+
+  free(final);
+  free(bits);
+  return 1;
+}
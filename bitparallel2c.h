@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "common.h"
+#include "positions.h"
+
+// The initial state needs one bit in addition to the char positions
+#define BITPARALLEL_MAX_BITS 128
+
+/*
+ * Generates bit-parallel c code from the given {@code positions} (Glushkov
+ * automaton), if it has less than {@code BITPARALLEL_MAX_BITS} char
+ * positions. Returns 1 on success and 0 (without printing anything) if there
+ * are too many positions.
+ *
+ * The generated parser has the same interface and behaviour as the parser of
+ * {@code print_automaton_to_c_code} (including the meaning of {@code flags}),
+ * but keeps all active positions as bits of a single {@code uint64_t} (or
+ * {@code unsigned __int128} for more than 63 positions). Each char is handled
+ * with a few ALU operations: the active positions are shifted to their
+ * successors (Shift-And), the remaining follow edges are added with masks, and
+ * the result is masked with the positions matching the char. The char masks
+ * are indexed by byte class, so the tables stay small.
+ */
+bool_t print_positions_to_bitparallel_c_code(positions_t *positions,
+                                             char *parser_name,
+                                             char *next_name, char *acc_name,
+                                             char *rej_name, int flags,
+                                             FILE *fout);
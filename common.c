@@ -1,5 +1,6 @@
 #include "common.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -31,31 +32,52 @@ void append_str_to_str(string_t *string, char *other) {
 }
 
 char *print_char(int c) {
-  char *result = NULL;
+  char buffer[CHAR_BUFFER_SIZE];
+  return create_string(sprint_char(c, buffer)).data;
+}
+
+char *sprint_char(int c, char *buffer) {
   switch (c) {
   case EOF:
-    return "EOF";
+    return strcpy(buffer, "EOF");
   case 0:
-    return "\\0";
+    return strcpy(buffer, "\\0");
   case 9:
-    return "\\t";
+    return strcpy(buffer, "\\t");
   case 10:
-    return "\\n";
+    return strcpy(buffer, "\\n");
   case 13:
-    return "\\r";
+    return strcpy(buffer, "\\r");
   case 32:
-    return "\\s";
+    return strcpy(buffer, "\\s");
   case 33 ... 126:
-    asprintf(&result, "%c", c);
+    snprintf(buffer, CHAR_BUFFER_SIZE, "%c", c);
     break;
   default:
     if (c >= 0 && c < 256) {
-      asprintf(&result, "\\x%hhx", c);
+      snprintf(buffer, CHAR_BUFFER_SIZE, "\\x%hhx", c);
     } else {
-      asprintf(&result, "\\?%x", c);
+      snprintf(buffer, CHAR_BUFFER_SIZE, "\\?%x", c);
     }
   }
-  return result;
+  return buffer;
+}
+
+unsigned long hash_bytes(const void *data, size_t length, unsigned long seed) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < length; i++) {
+    seed ^= bytes[i];
+    seed *= 0x100000001b3UL;
+  }
+  return seed;
+}
+
+size_t add_sizes(size_t a, size_t b) {
+  return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+}
+
+size_t multiply_sizes(size_t a, size_t b) {
+  return b != 0 && a > SIZE_MAX / b ? SIZE_MAX : a * b;
 }
 
 void fprint_indent(int indent, FILE *fout) {
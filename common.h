@@ -29,4 +29,35 @@ void append_str_to_str(string_t *string, char *other);
  * \?________
  */
 char *print_char(int c);
+
+// The size of a buffer, which fits any char printed by sprint_char
+#define CHAR_BUFFER_SIZE 12
+
+/**
+ * Same as {@code print_char}, but prints into the given {@code buffer} of
+ * {@code CHAR_BUFFER_SIZE} chars instead of allocating, and returns it.
+ */
+char *sprint_char(int c, char *buffer);
+
+/**
+ * Hashes {@code length} bytes at {@code data} using 64-bit FNV-1a. The hash
+ * continues from {@code seed}, so several buffers can be hashed in sequence
+ * (the first seed should be {@code HASH_SEED}).
+ */
+unsigned long hash_bytes(const void *data, size_t length, unsigned long seed);
+
+#define HASH_SEED 0xcbf29ce484222325UL
+
+/**
+ * Returns {@code a + b}, or {@code SIZE_MAX} if the sum does not fit into a
+ * {@code size_t}. Sizes of expanded expressions are computed with these, so
+ * they saturate instead of wrapping around.
+ */
+size_t add_sizes(size_t a, size_t b);
+
+/**
+ * Same as {@code add_sizes}, but returns {@code a * b}.
+ */
+size_t multiply_sizes(size_t a, size_t b);
+
 void fprint_indent(int indent, FILE *fout);
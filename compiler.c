@@ -0,0 +1,994 @@
+#include "compiler.h"
+#include "ast2automaton.h"
+#include "automaton2c.h"
+#include "automaton2cpp.h"
+#include "bitparallel2c.h"
+#include "jit.h"
+#include "nfa2c.h"
+#include "positions.h"
+#include "profile.h"
+#include "regex_parser.h"
+#include "rule_cache.h"
+#include "search2c.h"
+#include "simd2c.h"
+#include "table2c.h"
+#include "tagged_dfa.h"
+#include "tagged_dfa2c.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct string_input {
+  const char *pattern;
+  size_t length;
+  size_t position;
+  const regex2c_options_t *options;
+} string_input_t;
+
+static int peek_string_input(void *data) {
+  string_input_t *input = data;
+  if (input->position >= input->length) {
+    return EOF;
+  }
+  return (unsigned char)input->pattern[input->position];
+}
+
+static int consume_string_input(void *data) {
+  string_input_t *input = data;
+  int c = peek_string_input(input);
+  if (input->position < input->length) {
+    input->position++;
+  }
+  return c;
+}
+
+static ast_t *get_string_input_definition(void *data, char *name) {
+  string_input_t *input = data;
+  if (input->options->get_definition == NULL) {
+    return NULL;
+  }
+  return input->options->get_definition(input->options->definition_data, name);
+}
+
+static bool_t is_whitespace(int c) {
+  switch (c) {
+  case '\n':
+  case '\r':
+  case '\t':
+  case '\0':
+  case ' ':
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static bool_t is_whitespace_end(void *data, int c) { return is_whitespace(c); }
+
+static regex_parser_t create_string_parser(string_input_t *input) {
+  bool_t whitespace_ends =
+      input->options->whitespace_ends || input->options->rules;
+  regex_parser_t parser = {.peek_next = peek_string_input,
+                           .consume_next = consume_string_input,
+                           .is_end = whitespace_ends ? is_whitespace_end
+                                                     : NULL,
+                           .get_definition = get_string_input_definition,
+                           .data = input,
+                           .error = NULL,
+                           .position = 0};
+  return parser;
+}
+
+static void set_error(regex2c_result_t *result, char *error) {
+  result->error = create_string(error).data;
+}
+
+/**
+ * Stores the given {@code error}, which is followed by the given {@code
+ * detail}, into {@code result}.
+ */
+static void set_detailed_error(regex2c_result_t *result, char *error,
+                               char *detail) {
+  string_t message = create_string(error);
+  append_str_to_str(&message, detail);
+  result->error = message.data;
+}
+
+/**
+ * Appends the given {@code warning} as a line to the warnings of {@code
+ * result}.
+ */
+static void add_warning(regex2c_result_t *result, char *warning) {
+  string_t warnings = create_string(result->warnings);
+  free(result->warnings);
+  append_str_to_str(&warnings, warning);
+  append_char_to_str(&warnings, '\n');
+  result->warnings = warnings.data;
+}
+
+/**
+ * Adds a warning, that the profiling is not supported by the given {@code
+ * parser}, if the {@code options} ask for it.
+ */
+static void ignore_profiling(const regex2c_options_t *options, char *parser,
+                             regex2c_result_t *result) {
+  if (options->flags & REGEX2C_PROFILE || options->profile_file_name != NULL) {
+    string_t warning = create_string("profiling is not supported ");
+    append_str_to_str(&warning, parser);
+    append_str_to_str(&warning, ", ignoring it");
+    add_warning(result, warning.data);
+    free(warning.data);
+  }
+}
+
+/**
+ * Parses the {@code length} chars at {@code pattern} into {@code ast}. Returns
+ * 1 on success, or stores the error into {@code result} and returns 0.
+ */
+static bool_t parse_pattern(const char *pattern, size_t length,
+                            const regex2c_options_t *options,
+                            regex2c_result_t *result, ast_t *ast) {
+  string_input_t input = {.pattern = pattern,
+                          .length = length,
+                          .position = 0,
+                          .options = options};
+  regex_parser_t parser = create_string_parser(&input);
+  begin_phase(&result->stats, PHASE_PARSE);
+  *ast = consume_regex_expr(&parser);
+  // The embedded DFAs are built along with the ast, so their failure is
+  // reported before any automaton of the ast is built
+  bool_t built = parser.error == NULL && build_embedded_automata(ast);
+  end_phase(&result->stats, PHASE_PARSE);
+  if (parser.error != NULL) {
+    result->error = parser.error;
+    result->syntax_error = 1;
+    result->error_position = parser.position;
+    delete_ast(*ast);
+    return 0;
+  }
+  if (!built) {
+    delete_ast(*ast);
+    set_error(result, "an intersection or complement has too many states");
+    return 0;
+  }
+  if (options->debug_file != NULL) {
+    fprintf(options->debug_file, "--- Abstract syntax tree:\n");
+    print_ast(ast, options->debug_file);
+    fprintf(options->debug_file, "\n");
+  }
+  return 1;
+}
+
+static void delete_rules(ast_list_t *rules) {
+  while (rules != NULL) {
+    ast_list_t *next = rules->next;
+    delete_ast(*rules->ast);
+    free(rules->ast);
+    free(rules);
+    rules = next;
+  }
+}
+
+/**
+ * Parses the whitespace separated rules of the {@code length} chars at {@code
+ * pattern} into {@code rules}. Returns 1 on success, or stores the error into
+ * {@code result} and returns 0.
+ */
+static bool_t parse_rules(const char *pattern, size_t length,
+                          const regex2c_options_t *options,
+                          regex2c_result_t *result, ast_list_t **rules) {
+  string_input_t input = {.pattern = pattern,
+                          .length = length,
+                          .position = 0,
+                          .options = options};
+  regex_parser_t parser = create_string_parser(&input);
+  ast_list_t **tail = rules;
+  *rules = NULL;
+  result->stats.rules = 0;
+  begin_phase(&result->stats, PHASE_PARSE);
+  while (parser.error == NULL && peek_string_input(&input) != EOF) {
+    if (is_whitespace(peek_string_input(&input))) {
+      consume_string_input(&input);
+      parser.position++;
+      continue;
+    }
+    ast_list_t *list = malloc(sizeof(ast_list_t));
+    list->next = NULL;
+    list->ast = malloc(sizeof(ast_t));
+    *list->ast = consume_regex_expr(&parser);
+    *tail = list;
+    tail = &list->next;
+    result->stats.rules++;
+  }
+  bool_t built = 1;
+  for (ast_list_t *list = *rules; parser.error == NULL && built && list != NULL;
+       list = list->next) {
+    built = build_embedded_automata(list->ast);
+  }
+  end_phase(&result->stats, PHASE_PARSE);
+  if (parser.error != NULL) {
+    result->error = parser.error;
+    result->syntax_error = 1;
+    result->error_position = parser.position;
+    delete_rules(*rules);
+    return 0;
+  }
+  if (!built) {
+    delete_rules(*rules);
+    set_error(result, "an intersection or complement has too many states");
+    return 0;
+  }
+  if (*rules == NULL) {
+    set_error(result, "the rule set is empty");
+    return 0;
+  }
+  for (ast_list_t *list = *rules; list != NULL; list = list->next) {
+    if (ast_has_captures(list->ast)) {
+      add_warning(result, "rule sets do not record capture groups, ignoring "
+                          "them");
+      break;
+    }
+  }
+  if (options->debug_file != NULL) {
+    fprintf(options->debug_file, "--- Abstract syntax trees:\n");
+    for (ast_list_t *list = *rules; list != NULL; list = list->next) {
+      print_ast(list->ast, options->debug_file);
+    }
+    fprintf(options->debug_file, "\n");
+  }
+  return 1;
+}
+
+/**
+ * Checks the combination of the given {@code options}. Returns 0 and stores
+ * the error into {@code result} if it is not supported.
+ */
+static bool_t check_options(const regex2c_options_t *options,
+                            regex2c_result_t *result) {
+  bool_t bounded =
+      options->budget.max_states > 0 || options->budget.max_memory > 0;
+  if (options->flags & REGEX2C_SEARCH && options->backend != DFA_BACKEND) {
+    set_error(result, "a search needs the dfa backend");
+    return 0;
+  }
+  if (options->rules && bounded) {
+    set_error(result, "the DFA budget is not supported with rule sets");
+    return 0;
+  }
+  if (!options->rules && (options->cache_dir != NULL || options->all_tags)) {
+    set_error(result, "a rule cache and tag sets need a rule set");
+    return 0;
+  }
+  if (options->all_tags &&
+      (options->construction != THOMPSON_CONSTRUCTION ||
+       options->cache_dir != NULL || options->flags & REGEX2C_SEARCH ||
+       options->backend == CPP_HEADER_BACKEND || options->verify)) {
+    // Glushkov automata share one start node, which has only one end tag
+    set_error(result, "tag sets need the thompson construction and no rule "
+                      "cache, search, verification or cpp backend");
+    return 0;
+  }
+  if (options->rules && options->backend == BITPARALLEL_BACKEND) {
+    add_warning(result, "the bitparallel backend does not support rule sets, "
+                        "generating a DFA instead");
+  }
+  return 1;
+}
+
+/**
+ * Builds the NFA of the given {@code ast} with the construction of the {@code
+ * options}.
+ */
+static automaton_t build_nfa(ast_t *ast, const regex2c_options_t *options,
+                             compile_stats_t *stats) {
+  begin_phase(stats, PHASE_AST_TO_NFA);
+  automaton_t automaton = options->construction == THOMPSON_CONSTRUCTION
+                              ? convert_ast_to_automaton(ast)
+                              : convert_ast_to_glushkov_automaton(ast);
+  end_phase(stats, PHASE_AST_TO_NFA);
+  stats->nfa_nodes = automaton.next_node_index;
+  stats->nfa_edges = count_edges(&automaton);
+  stats->nfa_epsilon_edges = count_epsilon_edges(&automaton);
+  if (options->debug_file != NULL) {
+    fprintf(options->debug_file, "--- NFA:\n");
+    print_automaton(&automaton, options->debug_file);
+    fprintf(options->debug_file, "\n");
+  }
+  return automaton;
+}
+
+/**
+ * Builds the DFA of the given {@code ast} with the construction and budget of
+ * the {@code options} into {@code d_automaton}. If the budget is exceeded,
+ * stores the subexpression causing the blowup into {@code result}, the NFA
+ * into {@code automaton} and returns 0. If the NFA has too many nodes, stores
+ * the error into {@code result}, the NFA without nodes (see {@code
+ * create_automaton}) into {@code automaton} and returns 0.
+ */
+static bool_t build_dfa(ast_t *ast, const regex2c_options_t *options,
+                        regex2c_result_t *result, automaton_t *d_automaton,
+                        automaton_t *automaton) {
+  compile_stats_t *stats = &result->stats;
+  dfa_budget_t budget = options->budget;
+  bool_t bounded = budget.max_states > 0 || budget.max_memory > 0;
+  bool_t determinized;
+  if (options->construction == DIRECT_CONSTRUCTION) {
+    begin_phase(stats, PHASE_DETERMINIZE);
+    determinized = convert_ast_to_dfa_bounded(ast, bounded ? &budget : NULL,
+                                              d_automaton);
+    end_phase(stats, PHASE_DETERMINIZE);
+    if (!determinized) {
+      // The simulation needs an NFA, the followpos construction has none
+      *automaton = convert_ast_to_glushkov_automaton(ast);
+    }
+  } else {
+    *automaton = build_nfa(ast, options, stats);
+    begin_phase(stats, PHASE_DETERMINIZE);
+    determinized = automaton->nodes != NULL &&
+                   determinize_bounded(automaton, bounded ? &budget : NULL,
+                                       d_automaton);
+    end_phase(stats, PHASE_DETERMINIZE);
+    if (determinized) {
+      delete_automaton(*automaton);
+    }
+  }
+
+  if (!determinized && automaton->nodes == NULL) {
+    set_error(result, "the NFA has too many nodes");
+    return 0;
+  }
+  if (!determinized) {
+    size_t length;
+    FILE *blowup = open_memstream(&result->blowup_subexpression, &length);
+    if (blowup != NULL) {
+      print_blowup_subexpression(ast, &budget, blowup);
+      fclose(blowup);
+    }
+    return 0;
+  }
+  stats->dfa_states = d_automaton->max_node_count;
+  if (options->debug_file != NULL) {
+    fprintf(options->debug_file, "--- DFA:\n");
+    print_automaton(d_automaton, options->debug_file);
+    fprintf(options->debug_file, "\n");
+  }
+  return 1;
+}
+
+/**
+ * Minimizes and deletes the given {@code d_automaton}.
+ */
+static automaton_t minimize_dfa(automaton_t d_automaton,
+                                compile_stats_t *stats) {
+  begin_phase(stats, PHASE_MINIMIZE);
+  automaton_t m_automaton =
+      minimize_counting_rounds(&d_automaton, &stats->minimization_rounds);
+  end_phase(stats, PHASE_MINIMIZE);
+  delete_automaton(d_automaton);
+  stats->minimized_dfa_states = m_automaton.max_node_count;
+  return m_automaton;
+}
+
+/**
+ * Checks the given minimal DFA against a DFA of the same {@code ast}, which is
+ * built by the followpos construction (or by the Thompson construction, if the
+ * followpos construction was used to build {@code m_automaton}). Returns 0 and
+ * stores the error into {@code result} if they disagree.
+ */
+static bool_t verify_dfa(ast_t *ast, const regex2c_options_t *options,
+                         automaton_t *m_automaton, regex2c_result_t *result) {
+  automaton_t check;
+  if (options->construction == DIRECT_CONSTRUCTION) {
+    automaton_t automaton = convert_ast_to_automaton(ast);
+    if (automaton.nodes == NULL) {
+      set_error(result, "the NFA of the verification has too many nodes");
+      return 0;
+    }
+    check = determinize(&automaton);
+    delete_automaton(automaton);
+  } else {
+    check = convert_ast_to_dfa(ast);
+  }
+  bool_t equivalent = automata_equivalent(m_automaton, &check);
+  delete_automaton(check);
+  if (!equivalent) {
+    set_error(result, "verification failed: the DFA constructions disagree "
+                      "on this pattern");
+  }
+  return equivalent;
+}
+
+/**
+ * Builds the canonical minimal DFA of the given {@code rules} into {@code
+ * m_automaton}, either from the rule cache of the {@code options}, or by a
+ * full rebuild with their construction. Both result in the same automaton.
+ * Returns 0 and stores the error into {@code result} if the rule cache cannot
+ * be written or the verification fails.
+ */
+static bool_t build_rule_dfa(ast_list_t *rules,
+                             const regex2c_options_t *options,
+                             regex2c_result_t *result,
+                             automaton_t *m_automaton) {
+  compile_stats_t *stats = &result->stats;
+  if (options->cache_dir != NULL) {
+    rule_cache_stats_t cache_stats;
+    begin_phase(stats, PHASE_DETERMINIZE);
+    bool_t cached = compile_rule_set(rules, options->cache_dir, m_automaton,
+                                     &cache_stats);
+    int error = errno;
+    end_phase(stats, PHASE_DETERMINIZE);
+    stats->loaded_rule_dfas = cache_stats.loaded_dfas;
+    stats->built_rule_dfas = cache_stats.built_dfas;
+    if (!cached) {
+      delete_automaton(*m_automaton);
+      if (error == EOVERFLOW) {
+        set_error(result, "the DFA of the rule set has too many states");
+      } else {
+        set_detailed_error(result, "cannot write the rule cache: ",
+                           strerror(error));
+      }
+      return 0;
+    }
+  } else {
+    automaton_t d_automaton;
+    if (options->construction == DIRECT_CONSTRUCTION) {
+      begin_phase(stats, PHASE_DETERMINIZE);
+      d_automaton = convert_ast_list_to_dfa(rules);
+      end_phase(stats, PHASE_DETERMINIZE);
+    } else {
+      begin_phase(stats, PHASE_AST_TO_NFA);
+      automaton_t automaton =
+          options->construction == THOMPSON_CONSTRUCTION
+              ? convert_ast_list_to_automaton(rules)
+              : convert_ast_list_to_glushkov_automaton(rules);
+      end_phase(stats, PHASE_AST_TO_NFA);
+      if (automaton.nodes == NULL) {
+        set_error(result, "the NFA has too many nodes");
+        return 0;
+      }
+      stats->nfa_nodes = automaton.next_node_index;
+      stats->nfa_edges = count_edges(&automaton);
+      stats->nfa_epsilon_edges = count_epsilon_edges(&automaton);
+      begin_phase(stats, PHASE_DETERMINIZE);
+      if (options->all_tags) {
+        result->tag_sets = create_tag_sets();
+        d_automaton = determinize_tag_sets(&automaton, &result->tag_sets);
+      } else {
+        d_automaton = determinize(&automaton);
+      }
+      end_phase(stats, PHASE_DETERMINIZE);
+      delete_automaton(automaton);
+    }
+    stats->dfa_states = d_automaton.max_node_count;
+    begin_phase(stats, PHASE_MINIMIZE);
+    automaton_t automaton =
+        minimize_counting_rounds(&d_automaton, &stats->minimization_rounds);
+    *m_automaton = canonicalize_automaton(&automaton);
+    end_phase(stats, PHASE_MINIMIZE);
+    delete_automaton(automaton);
+    delete_automaton(d_automaton);
+  }
+  stats->minimized_dfa_states = m_automaton->max_node_count;
+
+  if (options->verify) {
+    automaton_t automaton = convert_ast_list_to_automaton(rules);
+    if (automaton.nodes == NULL) {
+      delete_automaton(*m_automaton);
+      set_error(result, "the NFA of the verification has too many nodes");
+      return 0;
+    }
+    automaton_t check = determinize(&automaton);
+    delete_automaton(automaton);
+    bool_t equivalent = automata_equivalent(m_automaton, &check);
+    delete_automaton(check);
+    if (!equivalent) {
+      delete_automaton(*m_automaton);
+      set_error(result, "verification failed: the rule set DFA disagrees "
+                        "with the Thompson construction");
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Generates a search for the pattern of the given minimal DFA into {@code
+ * fout} (see {@code print_search_automata_to_c_code}), and deletes the DFA.
+ * Returns 0 and stores the error into {@code result} if the DFA budget is
+ * exceeded.
+ */
+static bool_t print_search(automaton_t m_automaton,
+                           const regex2c_options_t *options, char **names,
+                           regex2c_result_t *result, FILE *fout) {
+  ignore_profiling(options, "by searches", result);
+  prefilter_t prefilter;
+  build_prefilter(&m_automaton, &prefilter);
+  dfa_budget_t budget = options->budget;
+  bool_t bounded = budget.max_states > 0 || budget.max_memory > 0;
+  automaton_t forward;
+  automaton_t reverse;
+  automaton_t anchored;
+  begin_phase(&result->stats, PHASE_DETERMINIZE);
+  bool_t built = build_search_automata(
+      &m_automaton, bounded ? &budget : NULL, &forward, &reverse, &anchored);
+  end_phase(&result->stats, PHASE_DETERMINIZE);
+  if (!built) {
+    delete_automaton(m_automaton);
+    set_error(result, "the DFA budget is exceeded by the DFAs of the search");
+    return 0;
+  }
+  FILE *debug_file = options->debug_file;
+  if (debug_file != NULL) {
+    fprintf(debug_file, "--- Minimal DFA:\n");
+    print_automaton(&m_automaton, debug_file);
+    fprintf(debug_file, "\n--- Forward DFA:\n");
+    print_automaton(&forward, debug_file);
+    fprintf(debug_file, "\n--- Reverse DFA:\n");
+    print_automaton(&reverse, debug_file);
+    fprintf(debug_file, "\n--- C code:\n");
+  }
+  delete_automaton(m_automaton);
+  int flags = options->flags & ~REGEX2C_PROFILE;
+  if (options->rules) {
+    flags |= REGEX2C_SEARCH_TAGS;
+  }
+  begin_phase(&result->stats, PHASE_CODEGEN);
+  print_search_automata_to_c_code(&forward, &reverse, &anchored, &prefilter,
+                                  names[0], names[2], flags, fout);
+  end_phase(&result->stats, PHASE_CODEGEN);
+  delete_automaton(forward);
+  delete_automaton(reverse);
+  delete_automaton(anchored);
+  return 1;
+}
+
+/**
+ * Renumbers the given minimal DFA by the hotness of the states in the profile
+ * file of the {@code options} (if any), which is read into {@code profile}.
+ * Returns 0 and stores the error into {@code result} if the profile cannot be
+ * read or was not recorded with a parser of the DFA.
+ */
+static bool_t apply_profile(automaton_t *m_automaton,
+                            const regex2c_options_t *options,
+                            regex2c_result_t *result, profile_t *profile) {
+  char *file_name = options->profile_file_name;
+  if (!read_profile(file_name, profile)) {
+    set_detailed_error(result, "cannot read the profile ", file_name);
+    return 0;
+  }
+  if (!profile_matches_automaton(profile, m_automaton)) {
+    delete_profile(*profile);
+    set_detailed_error(result, "the profile was not recorded with a parser "
+                               "of this pattern: ",
+                       file_name);
+    return 0;
+  }
+  // Renumber states by hotness, so hot states are emitted together
+  int *new_index = malloc(m_automaton->max_node_count * sizeof(int));
+  order_states_by_hotness(profile, new_index);
+  automaton_t r_automaton = renumber_automaton(m_automaton, new_index);
+  renumber_profile(profile, new_index);
+  free(new_index);
+  delete_automaton(*m_automaton);
+  *m_automaton = r_automaton;
+  return 1;
+}
+
+/**
+ * Generates the parser of the given minimal DFA with the backend of the
+ * {@code options} into {@code fout}, or a search, and deletes the DFA.
+ * Returns 0 and stores the error into {@code result} on failure.
+ */
+static bool_t print_minimal_dfa(automaton_t m_automaton,
+                                const regex2c_options_t *options,
+                                char **names, regex2c_result_t *result,
+                                FILE *fout) {
+  if (options->flags & REGEX2C_SEARCH) {
+    return print_search(m_automaton, options, names, result, fout);
+  }
+  if (options->debug_file != NULL) {
+    fprintf(options->debug_file, "--- Minimal DFA:\n");
+    print_automaton(&m_automaton, options->debug_file);
+    fprintf(options->debug_file, "\n--- C code:\n");
+  }
+  compile_stats_t *stats = &result->stats;
+  int flags = options->flags & ~REGEX2C_PROFILE;
+  if (options->backend == DENSE_TABLE_BACKEND ||
+      options->backend == COMB_TABLE_BACKEND) {
+    ignore_profiling(options, "by the table backends", result);
+    begin_phase(stats, PHASE_CODEGEN);
+    table_size_t size = print_automaton_to_table_c_code(
+        m_automaton, options->backend == COMB_TABLE_BACKEND, names[0],
+        names[1], names[2], names[3], flags, fout);
+    end_phase(stats, PHASE_CODEGEN);
+    stats->table_bytes = size.bytes;
+    stats->dense_table_bytes = size.dense_bytes;
+  } else if (options->backend == CPP_HEADER_BACKEND) {
+    ignore_profiling(options, "by the cpp backend", result);
+    begin_phase(stats, PHASE_CODEGEN);
+    print_automaton_to_cpp_header(m_automaton, names[0], flags, fout);
+    end_phase(stats, PHASE_CODEGEN);
+  } else if (options->backend == SIMD_BACKEND) {
+    ignore_profiling(options, "by the simd backend", result);
+    begin_phase(stats, PHASE_CODEGEN);
+    print_automaton_to_simd_c_code(m_automaton, names[0], flags, fout);
+    end_phase(stats, PHASE_CODEGEN);
+  } else {
+    profile_t profile;
+    bool_t profiled = options->profile_file_name != NULL;
+    if (profiled && !apply_profile(&m_automaton, options, result, &profile)) {
+      delete_automaton(m_automaton);
+      return 0;
+    }
+    begin_phase(stats, PHASE_CODEGEN);
+    print_profiled_automaton_to_c_code(m_automaton, profiled ? &profile : NULL,
+                                       names[0], names[1], names[2], names[3],
+                                       options->flags, fout);
+    end_phase(stats, PHASE_CODEGEN);
+    if (profiled) {
+      delete_profile(profile);
+    }
+  }
+  delete_automaton(m_automaton);
+  return 1;
+}
+
+/**
+ * Generates the parser of the given {@code ast} with the bitparallel backend
+ * into {@code fout}. Returns whether the pattern was small enough.
+ */
+static bool_t print_bitparallel_parser(ast_t *ast,
+                                       const regex2c_options_t *options,
+                                       char **names, regex2c_result_t *result,
+                                       FILE *fout) {
+  compile_stats_t *stats = &result->stats;
+  begin_phase(stats, PHASE_AST_TO_NFA);
+  positions_t positions = create_positions_from_ast(ast);
+  end_phase(stats, PHASE_AST_TO_NFA);
+  if (options->debug_file != NULL) {
+    fprintf(options->debug_file, "--- Positions:\n");
+    print_positions(&positions, options->debug_file);
+    fprintf(options->debug_file, "\n--- C code:\n");
+  }
+  begin_phase(stats, PHASE_CODEGEN);
+  bool_t printed = print_positions_to_bitparallel_c_code(
+      &positions, names[0], names[1], names[2], names[3],
+      options->flags & ~REGEX2C_PROFILE, fout);
+  end_phase(stats, PHASE_CODEGEN);
+  delete_positions(positions);
+  if (printed) {
+    ignore_profiling(options, "by the bitparallel backend", result);
+  }
+  return printed;
+}
+
+/**
+ * Generates the parser of the given {@code ast}, which has capture groups, as
+ * a tagged DFA into {@code fout}. Returns 0 and stores the error into {@code
+ * result} if the tagged DFA cannot be built.
+ */
+static bool_t print_tagged_dfa_parser(ast_t *ast,
+                                      const regex2c_options_t *options,
+                                      char **names, regex2c_result_t *result,
+                                      FILE *fout) {
+  compile_stats_t *stats = &result->stats;
+  dfa_budget_t budget = options->budget;
+  tagged_dfa_t dfa;
+  begin_phase(stats, PHASE_DETERMINIZE);
+  bool_t built = convert_ast_to_tagged_dfa(ast, &budget, &dfa, &result->error);
+  end_phase(stats, PHASE_DETERMINIZE);
+  if (!built) {
+    return 0;
+  }
+  stats->dfa_states = dfa.state_count;
+  if (options->debug_file != NULL) {
+    fprintf(options->debug_file, "--- Tagged DFA:\n");
+    print_tagged_dfa(&dfa, options->debug_file);
+    fprintf(options->debug_file, "\n--- C code:\n");
+  }
+  ignore_profiling(options, "with capture groups", result);
+  begin_phase(stats, PHASE_CODEGEN);
+  print_tagged_dfa_to_c_code(&dfa, names[0], names[1], names[2], names[3],
+                             options->flags & ~REGEX2C_PROFILE, fout);
+  end_phase(stats, PHASE_CODEGEN);
+  delete_tagged_dfa(dfa);
+  return 1;
+}
+
+/**
+ * Generates the parser of the given {@code ast} without capture groups into
+ * {@code fout}: with the backend of the {@code options}, or by simulating the
+ * NFA if the budget is exceeded. Returns 0 and stores the error into {@code
+ * result} if the backend needs a DFA nevertheless, or on failure.
+ */
+static bool_t print_dfa_parser(ast_t *ast, const regex2c_options_t *options,
+                               char **names, regex2c_result_t *result,
+                               FILE *fout) {
+  compile_stats_t *stats = &result->stats;
+  if (options->backend == BITPARALLEL_BACKEND) {
+    if (print_bitparallel_parser(ast, options, names, result, fout)) {
+      return 1;
+    }
+    add_warning(result, "the pattern has too many positions for the "
+                        "bitparallel backend, generating a DFA instead");
+  }
+  automaton_t automaton;
+  automaton_t d_automaton;
+  if (!build_dfa(ast, options, result, &d_automaton, &automaton)) {
+    if (automaton.nodes == NULL) {
+      return 0;
+    }
+    if (options->flags & REGEX2C_SEARCH) {
+      delete_automaton(automaton);
+      set_error(result, "the DFA budget is exceeded, but a search needs DFAs");
+      return 0;
+    }
+    if (options->backend == CPP_HEADER_BACKEND ||
+        options->backend == SIMD_BACKEND) {
+      delete_automaton(automaton);
+      set_error(result, "the DFA budget is exceeded, but the backend needs a "
+                        "DFA");
+      return 0;
+    }
+    ignore_profiling(options, "with NFA simulation", result);
+    stats->nfa_simulation = 1;
+    begin_phase(stats, PHASE_CODEGEN);
+    print_nfa_simulation_to_c_code(automaton, names[0], names[1], names[2],
+                                   names[3], options->flags & ~REGEX2C_PROFILE,
+                                   fout);
+    end_phase(stats, PHASE_CODEGEN);
+    delete_automaton(automaton);
+    return 1;
+  }
+  automaton_t m_automaton = minimize_dfa(d_automaton, stats);
+  if (options->verify && !verify_dfa(ast, options, &m_automaton, result)) {
+    delete_automaton(m_automaton);
+    return 0;
+  }
+  return print_minimal_dfa(m_automaton, options, names, result, fout);
+}
+
+/**
+ * Generates the parser of the single pattern of {@code length} chars at {@code
+ * pattern} into {@code fout}. Returns 0 and stores the error into {@code
+ * result} on failure.
+ */
+static bool_t print_pattern(const char *pattern, size_t length,
+                            const regex2c_options_t *options, char **names,
+                            regex2c_result_t *result, FILE *fout) {
+  ast_t ast;
+  if (!parse_pattern(pattern, length, options, result, &ast)) {
+    return 0;
+  }
+  bool_t printed;
+  if (ast_has_captures(&ast)) {
+    if (options->backend != DFA_BACKEND || options->flags & REGEX2C_SEARCH) {
+      set_error(result, "capture groups need the dfa backend and no search");
+      printed = 0;
+    } else {
+      printed = print_tagged_dfa_parser(&ast, options, names, result, fout);
+    }
+  } else {
+    printed = print_dfa_parser(&ast, options, names, result, fout);
+  }
+  delete_ast(ast);
+  return printed;
+}
+
+/**
+ * Generates the parser of the rule set of {@code length} chars at {@code
+ * pattern} into {@code fout}, followed by its tag sets with all_tags. Returns
+ * 0 and stores the error into {@code result} on failure.
+ */
+static bool_t print_rule_set(const char *pattern, size_t length,
+                             const regex2c_options_t *options, char **names,
+                             regex2c_result_t *result, FILE *fout) {
+  ast_list_t *rules;
+  if (!parse_rules(pattern, length, options, result, &rules)) {
+    return 0;
+  }
+  automaton_t m_automaton;
+  bool_t built = build_rule_dfa(rules, options, result, &m_automaton);
+  delete_rules(rules);
+  if (!built || !print_minimal_dfa(m_automaton, options, names, result, fout)) {
+    return 0;
+  }
+  if (options->all_tags) {
+    print_tag_sets_to_c_code(&result->tag_sets, names[0], options->flags,
+                             fout);
+  }
+  return 1;
+}
+
+/**
+ * Clears the given {@code result}, and returns the given {@code options}, or
+ * the zero-initialized {@code default_options} if they are {@code NULL}.
+ */
+static const regex2c_options_t *
+begin_compile(const regex2c_options_t *options,
+              regex2c_options_t *default_options, regex2c_result_t *result) {
+  memset(result, 0, sizeof(regex2c_result_t));
+  result->stats = create_compile_stats();
+  if (options == NULL) {
+    memset(default_options, 0, sizeof(regex2c_options_t));
+    return default_options;
+  }
+  return options;
+}
+
+int regex2c_compile(const char *pattern, size_t length,
+                    const regex2c_options_t *options,
+                    regex2c_result_t *result) {
+  regex2c_options_t default_options;
+  options = begin_compile(options, &default_options, result);
+  char *names[] = {options->parser_name != NULL ? options->parser_name
+                                                : "parse",
+                   options->next_name != NULL ? options->next_name
+                                              : "consume_next",
+                   options->acc_name != NULL ? options->acc_name : "accept",
+                   options->rej_name != NULL ? options->rej_name : "reject"};
+  if (!check_options(options, result)) {
+    return -1;
+  }
+
+  FILE *fout = open_memstream(&result->code, &result->code_length);
+  if (fout == NULL) {
+    set_error(result, "cannot allocate the generated code");
+    return -1;
+  }
+  bool_t printed =
+      options->rules
+          ? print_rule_set(pattern, length, options, names, result, fout)
+          : print_pattern(pattern, length, options, names, result, fout);
+  if (!printed) {
+    fclose(fout);
+    free(result->code);
+    result->code = NULL;
+    result->code_length = 0;
+    return -1;
+  }
+  if (fclose(fout) != 0) {
+    free(result->code);
+    result->code = NULL;
+    result->code_length = 0;
+    set_error(result, "cannot write the generated code");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Builds the minimal DFA of the pattern (or rule set) of {@code length} chars
+ * at {@code pattern} into {@code m_automaton}. Returns 0 and stores the error
+ * into {@code result} on failure, or if the DFA budget is exceeded.
+ */
+static bool_t build_minimal_dfa(const char *pattern, size_t length,
+                                const regex2c_options_t *options,
+                                regex2c_result_t *result,
+                                automaton_t *m_automaton) {
+  if (options->rules) {
+    ast_list_t *rules;
+    if (!parse_rules(pattern, length, options, result, &rules)) {
+      return 0;
+    }
+    bool_t built = build_rule_dfa(rules, options, result, m_automaton);
+    delete_rules(rules);
+    return built;
+  }
+  ast_t ast;
+  if (!parse_pattern(pattern, length, options, result, &ast)) {
+    return 0;
+  }
+  automaton_t automaton;
+  automaton_t d_automaton;
+  bool_t built = build_dfa(&ast, options, result, &d_automaton, &automaton);
+  if (!built) {
+    if (automaton.nodes != NULL) {
+      set_error(result, "the DFA budget is exceeded, but the JIT needs a DFA");
+    }
+    delete_automaton(automaton);
+  } else {
+    *m_automaton = minimize_dfa(d_automaton, &result->stats);
+    if (options->verify && !verify_dfa(&ast, options, m_automaton, result)) {
+      delete_automaton(*m_automaton);
+      built = 0;
+    }
+  }
+  delete_ast(ast);
+  return built;
+}
+
+int regex2c_compile_jit(const char *pattern, size_t length,
+                        const regex2c_options_t *options,
+                        jit_matcher_t *matcher, regex2c_result_t *result) {
+  regex2c_options_t default_options;
+  options = begin_compile(options, &default_options, result);
+  memset(matcher, 0, sizeof(jit_matcher_t));
+  automaton_t m_automaton;
+  if (!check_options(options, result) ||
+      !build_minimal_dfa(pattern, length, options, result, &m_automaton)) {
+    return -1;
+  }
+  if (options->debug_file != NULL) {
+    fprintf(options->debug_file, "--- Minimal DFA:\n");
+    print_automaton(&m_automaton, options->debug_file);
+    fprintf(options->debug_file, "\n");
+  }
+  begin_phase(&result->stats, PHASE_CODEGEN);
+  bool_t compiled = compile_automaton_to_jit(&m_automaton, matcher);
+  end_phase(&result->stats, PHASE_CODEGEN);
+  delete_automaton(m_automaton);
+  if (!compiled) {
+    set_error(result, "cannot map executable memory for the JIT");
+    return -1;
+  }
+  return 0;
+}
+
+int regex2c_compile_table(const char *pattern, size_t length,
+                          const regex2c_options_t *options, FILE *ftable,
+                          dfa_table_stats_t *table_stats,
+                          regex2c_result_t *result) {
+  regex2c_options_t default_options;
+  options = begin_compile(options, &default_options, result);
+  compile_stats_t *stats = &result->stats;
+  if (options->construction == DIRECT_CONSTRUCTION || options->all_tags) {
+    set_error(result, "a DFA table needs an NFA construction and the lowest "
+                      "tags");
+    return -1;
+  }
+  automaton_t automaton;
+  if (options->rules) {
+    ast_list_t *rules;
+    if (!parse_rules(pattern, length, options, result, &rules)) {
+      return -1;
+    }
+    begin_phase(stats, PHASE_AST_TO_NFA);
+    automaton = options->construction == THOMPSON_CONSTRUCTION
+                    ? convert_ast_list_to_automaton(rules)
+                    : convert_ast_list_to_glushkov_automaton(rules);
+    end_phase(stats, PHASE_AST_TO_NFA);
+    delete_rules(rules);
+  } else {
+    ast_t ast;
+    if (!parse_pattern(pattern, length, options, result, &ast)) {
+      return -1;
+    }
+    if (ast_has_captures(&ast)) {
+      add_warning(result, "DFA tables do not record capture groups, ignoring "
+                          "them");
+    }
+    automaton = build_nfa(&ast, options, stats);
+    delete_ast(ast);
+  }
+  if (automaton.nodes == NULL) {
+    set_error(result, "the NFA has too many nodes");
+    return -1;
+  }
+
+  begin_phase(stats, PHASE_DETERMINIZE);
+  bool_t written = determinize_to_table_file(
+      &automaton, options->budget.max_memory, ftable, table_stats);
+  end_phase(stats, PHASE_DETERMINIZE);
+  int error = errno;
+  delete_automaton(automaton);
+  if (!written) {
+    set_detailed_error(result, "cannot write the DFA table: ",
+                       strerror(error));
+    return -1;
+  }
+  stats->dfa_states = table_stats->state_count;
+  stats->table_bytes = table_stats->table_bytes;
+  return 0;
+}
+
+void delete_regex2c_result(regex2c_result_t *result) {
+  free(result->code);
+  free(result->error);
+  free(result->blowup_subexpression);
+  free(result->warnings);
+  delete_tag_sets(result->tag_sets);
+  memset(result, 0, sizeof(regex2c_result_t));
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "ast.h"
+#include "automaton.h"
+#include "common.h"
+#include "dfa_table.h"
+#include "jit.h"
+#include "stats.h"
+#include "tag_sets.h"
+
+typedef enum construction {
+  THOMPSON_CONSTRUCTION,
+  GLUSHKOV_CONSTRUCTION,
+  DIRECT_CONSTRUCTION
+} construction_t;
+
+typedef enum backend {
+  DFA_BACKEND,
+  BITPARALLEL_BACKEND,
+  DENSE_TABLE_BACKEND, // see print_automaton_to_table_c_code
+  COMB_TABLE_BACKEND,
+  CPP_HEADER_BACKEND, // see print_automaton_to_cpp_header, needs a DFA
+  SIMD_BACKEND        // see print_automaton_to_simd_c_code, needs a DFA
+} backend_t;
+
+/**
+ * The options of {@code regex2c_compile}. Zero-initialized options compile a
+ * DFA parser (Thompson construction, no budget, no flags) of a single pattern
+ * with the default names {@code parse}, {@code consume_next}, {@code accept}
+ * and {@code reject}.
+ */
+typedef struct regex2c_options {
+  construction_t construction;
+  backend_t backend;
+  dfa_budget_t budget; // falls back to NFA simulation when exceeded
+  int flags;           // see print_automaton_to_c_code
+  char *parser_name;   // the names of the generated and called functions, or
+  char *next_name;     // NULL for the defaults
+  char *acc_name;
+  char *rej_name;
+  // Returns the AST of the given regular definition, or NULL; may be NULL.
+  // ASTs of definitions, which contain intersections, complements or UTF-8
+  // classes, must not be shared between concurrent compiles, since their DFAs
+  // are cached in them (see get_embedded_automaton).
+  ast_t *(*get_definition)(void *data, char *name);
+  void *definition_data;
+  // Whether whitespace ends the pattern (the rest is ignored), as in the
+  // files of the command line tool
+  bool_t whitespace_ends;
+  // Whether the pattern is a set of whitespace separated rules, which are
+  // tagged in order, instead of a single pattern (no budget is supported)
+  bool_t rules;
+  char *cache_dir; // keeps the DFAs of the rules (see compile_rule_set), or
+                   // NULL
+  // Whether accept gets the index of the set of all matching rules instead of
+  // the lowest tag (see determinize_tag_sets); needs rules and the Thompson
+  // construction
+  bool_t all_tags;
+  // Whether to check the minimal DFA against a DFA built by an independent
+  // construction
+  bool_t verify;
+  char *profile_file_name; // lays out the DFA parser by this profile (see
+                           // print_profiled_automaton_to_c_code), or NULL
+  FILE *debug_file; // receives the ASTs and automata of all phases, or NULL
+} regex2c_options_t;
+
+typedef struct regex2c_result {
+  char *code; // the generated c code, NULL on error
+  size_t code_length;
+  char *error;           // the error message, NULL on success
+  bool_t syntax_error;   // whether the pattern itself cannot be parsed, ...
+  size_t error_position; // ... after this number of chars
+  // The subexpression causing the blowup in regex syntax, if the DFA budget
+  // was exceeded (the parser simulates the NFA then), NULL otherwise
+  char *blowup_subexpression;
+  // Options, which were ignored or replaced, one line each, or NULL
+  char *warnings;
+  // The sets of matching rules with all_tags (see print_tag_sets_to_c_code,
+  // whose code is appended to the parser), empty otherwise
+  tag_sets_t tag_sets;
+  compile_stats_t stats;
+} regex2c_result_t;
+
+/**
+ * Compiles the regular expression of {@code length} chars at {@code pattern}
+ * (see {@code consume_regex_expr}; whitespace does not end it) into c code
+ * according to the given {@code options} (which may be {@code NULL} for the
+ * defaults). The result is stored into {@code result}, which must be deleted
+ * with {@code delete_regex2c_result} afterwards.
+ *
+ * Patterns with capture groups are compiled to a tagged DFA (see {@code
+ * print_tagged_dfa_to_c_code}), which needs the DFA backend and does not fall
+ * back to NFA simulation, when the budget is exceeded. With REGEX2C_SEARCH in
+ * the flags, a search is generated (see {@code
+ * print_search_automata_to_c_code}), which needs the DFA backend and DFAs
+ * within the budget; for rule sets, it passes the matching rule to accept
+ * (REGEX2C_SEARCH_TAGS is added to the flags). Its matches are
+ * leftmost-longest, or end as early as possible with REGEX2C_SEARCH_EARLIEST.
+ *
+ * Returns 0 on success and -1 if the pattern cannot be parsed or the code
+ * cannot be generated; {@code result->error} describes the error then. The
+ * function neither exits the process nor uses global state, so it can be
+ * called on several threads at once.
+ *
+ * The command line tool is a wrapper of this function, {@code
+ * regex2c_compile_jit} and {@code regex2c_compile_table}.
+ */
+int regex2c_compile(const char *pattern, size_t length,
+                    const regex2c_options_t *options,
+                    regex2c_result_t *result);
+
+/**
+ * Same as {@code regex2c_compile}, but compiles the minimal DFA of the pattern
+ * into machine code of the running process (see {@code
+ * compile_automaton_to_jit}) instead of c code, and stores it into {@code
+ * matcher}, which must be deleted with {@code delete_jit_matcher}. The
+ * backend, flags, names and profile of the {@code options} and capture groups
+ * are ignored. Exceeding the DFA budget is an error, since there is no NFA
+ * simulation in machine code. {@code result->code} stays {@code NULL}, but
+ * the result must be deleted nevertheless.
+ */
+int regex2c_compile_jit(const char *pattern, size_t length,
+                        const regex2c_options_t *options,
+                        jit_matcher_t *matcher, regex2c_result_t *result);
+
+/**
+ * Same as {@code regex2c_compile}, but determinizes the NFA of the pattern out
+ * of core into the DFA table file {@code ftable} (see {@code
+ * determinize_to_table_file}, whose buffer of node sets is bounded by {@code
+ * options->budget.max_memory}) instead of generating c code. The table
+ * statistics are stored into {@code table_stats}. Needs an NFA construction
+ * and the lowest tags; the backend, flags, names, profile and number of states
+ * of the budget of the {@code options} and capture groups are ignored.
+ */
+int regex2c_compile_table(const char *pattern, size_t length,
+                          const regex2c_options_t *options, FILE *ftable,
+                          dfa_table_stats_t *table_stats,
+                          regex2c_result_t *result);
+
+/**
+ * Frees all memory of the given {@code result}.
+ */
+void delete_regex2c_result(regex2c_result_t *result);
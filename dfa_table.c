@@ -0,0 +1,309 @@
+#include "dfa_table.h"
+#include "automaton.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_SET_BUFFER_SIZE (64L << 20)
+
+/**
+ * The node sets of the states of a DFA under construction. Each set is stored
+ * as its size followed by its sorted nodes, at an offset (in ints) of the
+ * concatenation of the temporary file and the buffer. The states are looked up
+ * by the hashes of their sets via an open addressing hash table.
+ */
+typedef struct spilled_sets {
+  FILE *file;
+  long file_length; // in ints
+  int *buffer;      // the sets after the file
+  long buffer_length;
+  long buffer_capacity;
+  long *offsets;
+  unsigned long *hashes;
+  int count;
+  int capacity;
+  int *buckets; // bucket_count entries, -1 for empty
+  int bucket_count;
+  bool_t failed; // whether reading or writing the file failed
+  dfa_table_stats_t *stats;
+} spilled_sets_t;
+
+static void insert_spilled_set_bucket(spilled_sets_t *sets, int state) {
+  int mask = sets->bucket_count - 1;
+  int bucket = sets->hashes[state] & mask;
+  while (sets->buckets[bucket] != -1) {
+    bucket = (bucket + 1) & mask;
+  }
+  sets->buckets[bucket] = state;
+}
+
+static void grow_spilled_sets(spilled_sets_t *sets) {
+  sets->capacity *= 2;
+  sets->offsets = realloc(sets->offsets, sets->capacity * sizeof(long));
+  sets->hashes =
+      realloc(sets->hashes, sets->capacity * sizeof(unsigned long));
+  // Keep the load factor of the hash table at most one half
+  free(sets->buckets);
+  sets->bucket_count = sets->capacity * 2;
+  sets->buckets = malloc(sets->bucket_count * sizeof(int));
+  memset(sets->buckets, 0xff, sets->bucket_count * sizeof(int));
+  for (int state = 0; state < sets->count; state++) {
+    insert_spilled_set_bucket(sets, state);
+  }
+}
+
+/**
+ * Appends {@code length} ints at {@code data} to the temporary file.
+ */
+static void write_spilled_ints(spilled_sets_t *sets, int *data, long length) {
+  if (fseek(sets->file, 0, SEEK_END) != 0 ||
+      fwrite(data, sizeof(int), length, sets->file) != (size_t)length) {
+    sets->failed = 1;
+  }
+  sets->file_length += length;
+  sets->stats->spilled_bytes += length * sizeof(int);
+}
+
+/**
+ * Appends the given set of {@code size} {@code nodes} to the buffer, which is
+ * written to the temporary file first, if the set does not fit into it
+ * anymore. Returns the offset of the set.
+ */
+static long append_spilled_set(spilled_sets_t *sets, int *nodes, int size) {
+  if (sets->buffer_length + size + 1 > sets->buffer_capacity) {
+    write_spilled_ints(sets, sets->buffer, sets->buffer_length);
+    sets->buffer_length = 0;
+  }
+  long offset = sets->file_length + sets->buffer_length;
+  if (size + 1 > sets->buffer_capacity) {
+    // Sets larger than the whole buffer go to the file directly
+    write_spilled_ints(sets, &size, 1);
+    write_spilled_ints(sets, nodes, size);
+    return offset;
+  }
+  sets->buffer[sets->buffer_length++] = size;
+  memcpy(&sets->buffer[sets->buffer_length], nodes, size * sizeof(int));
+  sets->buffer_length += size;
+  return offset;
+}
+
+/**
+ * Returns the size of the set of the given {@code state} and a pointer to its
+ * nodes, which are read into {@code nodes}, unless they are in the buffer.
+ */
+static int get_spilled_set(spilled_sets_t *sets, int state, int *nodes,
+                           int **result) {
+  long offset = sets->offsets[state];
+  if (offset >= sets->file_length) {
+    int *set = &sets->buffer[offset - sets->file_length];
+    *result = set + 1;
+    return set[0];
+  }
+  sets->stats->set_reads++;
+  int size = 0;
+  if (fseek(sets->file, offset * sizeof(int), SEEK_SET) != 0 ||
+      fread(&size, sizeof(int), 1, sets->file) != 1 ||
+      fread(nodes, sizeof(int), size, sets->file) != (size_t)size) {
+    sets->failed = 1;
+    size = 0;
+  }
+  *result = nodes;
+  return size;
+}
+
+/**
+ * Returns the state with the given sorted set of {@code nodes}, using {@code
+ * scratch} to read back sets with the same hash. The state is created, if it
+ * does not exist yet, and its end tag is appended to {@code end_tags}.
+ */
+static int find_or_add_spilled_set(spilled_sets_t *sets,
+                                   automaton_t *automaton, int *nodes,
+                                   int size, int *scratch, FILE *end_tags) {
+  unsigned long hash = hash_bytes(nodes, size * sizeof(int), HASH_SEED);
+  int mask = sets->bucket_count - 1;
+  int bucket = hash & mask;
+  while (sets->buckets[bucket] != -1) {
+    int state = sets->buckets[bucket];
+    if (sets->hashes[state] == hash) {
+      int *set;
+      int set_size = get_spilled_set(sets, state, scratch, &set);
+      if (set_size == size &&
+          memcmp(set, nodes, size * sizeof(int)) == 0) {
+        return state;
+      }
+    }
+    bucket = (bucket + 1) & mask;
+  }
+  if (sets->count == sets->capacity) {
+    grow_spilled_sets(sets);
+  }
+  int state = sets->count++;
+  sets->offsets[state] = append_spilled_set(sets, nodes, size);
+  sets->hashes[state] = hash;
+  insert_spilled_set_bucket(sets, state);
+  int32_t end_tag = -1;
+  for (int i = 0; i < size; i++) {
+    int tag = automaton->nodes[nodes[i]].end_tag;
+    if (tag != -1 && (end_tag == -1 || tag < end_tag)) {
+      end_tag = tag;
+    }
+  }
+  if (fwrite(&end_tag, sizeof(end_tag), 1, end_tags) != 1) {
+    sets->failed = 1;
+  }
+  return state;
+}
+
+static int compare_spilled_nodes(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * Stores all nodes, which can be reached from the {@code size} given {@code
+ * nodes} via a transition of {@code terminal}, into {@code result} (see
+ * {@code move} of {@code determinize}). Returns the number of nodes.
+ */
+static int move_nodes(automaton_t *automaton, int *nodes, int size,
+                      int terminal, int *result, int *mark, int stamp) {
+  int count = 0;
+  for (int i = 0; i < size; i++) {
+    node_t *node = &automaton->nodes[nodes[i]];
+    for (int e = 0; e < node->edge_count; e++) {
+      int target = node->edges[e].target;
+      if (node->edges[e].transitions[terminal] && mark[target] != stamp) {
+        mark[target] = stamp;
+        result[count++] = target;
+      }
+    }
+  }
+  return count;
+}
+
+/**
+ * Appends the end tags of all states from {@code end_tags} to {@code fout}.
+ */
+static bool_t copy_end_tags(FILE *end_tags, FILE *fout) {
+  rewind(end_tags);
+  int32_t buffer[4096];
+  size_t count;
+  while ((count = fread(buffer, sizeof(int32_t), 4096, end_tags)) > 0) {
+    if (fwrite(buffer, sizeof(int32_t), count, fout) != count) {
+      return 0;
+    }
+  }
+  return !ferror(end_tags);
+}
+
+bool_t determinize_to_table_file(automaton_t *automaton, size_t max_memory,
+                                 FILE *fout, dfa_table_stats_t *stats) {
+  dfa_table_stats_t ignored_stats;
+  stats = stats != NULL ? stats : &ignored_stats;
+  memset(stats, 0, sizeof(*stats));
+  int N = automaton->max_node_count;
+  int class_of[256];
+  int representatives[256];
+  int class_count = compute_terminal_classes(automaton, class_of);
+  get_class_representatives(class_of, class_count, representatives);
+
+  dfa_table_header_t header = {.version = DFA_TABLE_VERSION,
+                               .class_count = class_count,
+                               .state_count = 0,
+                               .start_index = 0};
+  memcpy(header.magic, DFA_TABLE_MAGIC, sizeof(header.magic));
+  int32_t classes[256];
+  for (int t = 0; t < 256; t++) {
+    classes[t] = class_of[t];
+  }
+  if (fwrite(&header, sizeof(header), 1, fout) != 1 ||
+      fwrite(classes, sizeof(int32_t), 256, fout) != 256) {
+    return 0;
+  }
+
+  FILE *end_tags = tmpfile();
+  FILE *file = end_tags != NULL ? tmpfile() : NULL;
+  if (file == NULL) {
+    if (end_tags != NULL) {
+      fclose(end_tags);
+    }
+    return 0;
+  }
+  spilled_sets_t sets = {.file = file, .capacity = 8, .stats = stats};
+  sets.buffer_capacity = (max_memory > 0 ? (long)max_memory
+                                         : DEFAULT_SET_BUFFER_SIZE) /
+                         sizeof(int);
+  sets.buffer = malloc(sets.buffer_capacity * sizeof(int));
+  sets.offsets = malloc(sets.capacity * sizeof(long));
+  sets.hashes = malloc(sets.capacity * sizeof(unsigned long));
+  sets.bucket_count = sets.capacity * 2;
+  sets.buckets = malloc(sets.bucket_count * sizeof(int));
+  memset(sets.buckets, 0xff, sets.bucket_count * sizeof(int));
+
+  bool_t needs_closure = count_epsilon_edges(automaton) > 0;
+  int *current = malloc(N * sizeof(int));
+  int *nodes = malloc(N * sizeof(int));
+  int *scratch = malloc(N * sizeof(int));
+  int *mark = malloc(N * sizeof(int));
+  memset(mark, 0xff, N * sizeof(int));
+  int stamp = 0;
+  int32_t *row = malloc(class_count * sizeof(int32_t));
+
+  nodes[0] = automaton->start_index;
+  mark[nodes[0]] = stamp;
+  int size = make_epsclosure(automaton, nodes, 1, mark, stamp++);
+  qsort(nodes, size, sizeof(int), compare_spilled_nodes);
+  find_or_add_spilled_set(&sets, automaton, nodes, size, scratch, end_tags);
+
+  for (int state = 0; state < sets.count && !sets.failed; state++) {
+    int *set;
+    int set_size = get_spilled_set(&sets, state, current, &set);
+    // Adding states may flush the buffer, which the set may point into
+    if (set != current) {
+      memcpy(current, set, set_size * sizeof(int));
+    }
+    for (int k = 0; k < class_count; k++) {
+      size = move_nodes(automaton, current, set_size, representatives[k],
+                        nodes, mark, stamp);
+      if (needs_closure) {
+        size = make_epsclosure(automaton, nodes, size, mark, stamp);
+      }
+      stamp++;
+      row[k] = -1;
+      if (size > 0) {
+        qsort(nodes, size, sizeof(int), compare_spilled_nodes);
+        row[k] = find_or_add_spilled_set(&sets, automaton, nodes, size,
+                                         scratch, end_tags);
+      }
+    }
+    if (fwrite(row, sizeof(int32_t), class_count, fout) !=
+        (size_t)class_count) {
+      sets.failed = 1;
+    }
+  }
+
+  bool_t success = !sets.failed && copy_end_tags(end_tags, fout);
+  header.state_count = sets.count;
+  success = success && fseek(fout, 0, SEEK_SET) == 0 &&
+            fwrite(&header, sizeof(header), 1, fout) == 1 &&
+            fseek(fout, 0, SEEK_END) == 0;
+  stats->state_count = sets.count;
+  // The index and the buffer only grow
+  stats->peak_memory =
+      sets.capacity * (sizeof(long) + sizeof(unsigned long)) +
+      sets.bucket_count * sizeof(int) + sets.buffer_capacity * sizeof(int);
+  stats->table_bytes = success ? ftell(fout) : 0;
+
+  free(current);
+  free(nodes);
+  free(scratch);
+  free(mark);
+  free(row);
+  free(sets.buffer);
+  free(sets.offsets);
+  free(sets.hashes);
+  free(sets.buckets);
+  fclose(file);
+  fclose(end_tags);
+  return success;
+}
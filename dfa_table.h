@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "automaton.h"
+#include "common.h"
+
+#define DFA_TABLE_MAGIC "r2ctable"
+#define DFA_TABLE_VERSION 1
+
+/**
+ * The header of a DFA table file. It is followed by arrays of int32_t: the
+ * byte class of every byte (256 entries), the target state of every state and
+ * class ({@code state_count * class_count} entries, row by row, -1 for no
+ * transition) and the end tag of every state ({@code state_count} entries, -1
+ * if the state does not accept). All numbers are in the byte order of the
+ * host, so the file can be mapped into memory and used in place.
+ */
+typedef struct dfa_table_header {
+  char magic[8]; // DFA_TABLE_MAGIC, without the terminating '\0'
+  int32_t version;
+  int32_t class_count;
+  int32_t state_count;
+  int32_t start_index;
+} dfa_table_header_t;
+
+typedef struct dfa_table_stats {
+  int state_count;
+  long table_bytes;   // of the whole table file
+  long spilled_bytes; // of the node sets written to the temporary file
+  long set_reads;     // node sets read back from the temporary file
+  long peak_memory;   // bytes of the hash index and the buffer of node sets
+} dfa_table_stats_t;
+
+/**
+ * Determinizes the given {@code automaton} like {@code determinize}, but out
+ * of core: the DFA is streamed into the table file {@code fout} (see {@code
+ * dfa_table_header_t}; it must be seekable, since the header is completed at
+ * the end), one row of transitions per state as soon as the state is done,
+ * instead of being built as an {@code automaton_t}. The DFA is not minimized.
+ *
+ * The sorted NFA node sets of the DFA states, which take most of the memory of
+ * {@code determinize} for large NFAs, are appended to a buffer of at most
+ * {@code max_memory} bytes (a default of 64M if it is 0), which is written to
+ * a temporary file when it is full. Only a hash index of the states stays in
+ * memory (24 bytes per state); a set is read back from the file to confirm a
+ * hash match, and once more, when the transitions of its state are computed.
+ *
+ * Statistics are stored into {@code stats} (if it is not {@code NULL}).
+ * Returns 0 if a file cannot be written or read; {@code errno} describes the
+ * error then.
+ */
+bool_t determinize_to_table_file(automaton_t *automaton, size_t max_memory,
+                                 FILE *fout, dfa_table_stats_t *stats);
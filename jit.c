@@ -0,0 +1,408 @@
+#include "jit.h"
+#include "common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Estimated branches per byte of a bitmap test, which is only used if all
+// byte ranges of a state lead to the same state
+#define JIT_BITMAP_COST 2
+// ... and of a jump table, whose indirect jump is harder to predict
+#define JIT_TABLE_COST 4
+
+/*
+ * Registers of the generated code (System V calling convention):
+ *
+ * rdi  the next input byte
+ * rsi  the end of the input
+ * rdx  where to store the end tag
+ * rcx  the start of the input
+ * r8   the position after the longest accepted prefix so far, or 0
+ * r9d  its end tag
+ * eax  the byte read last (then its class), r10 and r11 are scratch
+ */
+
+typedef struct code_buffer {
+  unsigned char *bytes;
+  size_t size;
+  size_t capacity;
+} code_buffer_t;
+
+typedef struct jit_fixup {
+  size_t offset; // of a rel32 field, which ends its instruction
+  int label;
+} jit_fixup_t;
+
+typedef struct jit_compiler {
+  code_buffer_t code;
+  jit_fixup_t *fixups;
+  int fixup_count;
+  int fixup_capacity;
+  // The offset of every label: the blocks of the N states, then the exit, the
+  // byte classes, and the jump table or bitmap of every state
+  size_t *labels;
+  int N;
+} jit_compiler_t;
+
+typedef struct jit_arm {
+  int first;
+  int last;
+  int target;
+} jit_arm_t;
+
+static void emit_bytes(code_buffer_t *code, const unsigned char *bytes,
+                       size_t count) {
+  if (code->size + count > code->capacity) {
+    code->capacity = (code->size + count) * 2;
+    code->bytes = realloc(code->bytes, code->capacity);
+  }
+  memcpy(code->bytes + code->size, bytes, count);
+  code->size += count;
+}
+
+static void emit_int32(code_buffer_t *code, int32_t value) {
+  unsigned char bytes[4];
+  for (int i = 0; i < 4; i++) {
+    bytes[i] = (uint32_t)value >> (8 * i);
+  }
+  emit_bytes(code, bytes, 4);
+}
+
+/**
+ * Emits the given {@code opcode} bytes followed by a rel32 field, which is
+ * resolved to {@code label} once all labels are known.
+ */
+static void emit_rel32(jit_compiler_t *jit, const unsigned char *opcode,
+                       size_t count, int label) {
+  emit_bytes(&jit->code, opcode, count);
+  if (jit->fixup_count == jit->fixup_capacity) {
+    jit->fixup_capacity = jit->fixup_capacity * 2 + 16;
+    jit->fixups =
+        realloc(jit->fixups, jit->fixup_capacity * sizeof(jit_fixup_t));
+  }
+  jit->fixups[jit->fixup_count++] =
+      (jit_fixup_t){.offset = jit->code.size, .label = label};
+  emit_int32(&jit->code, 0);
+}
+
+static void emit_jmp(jit_compiler_t *jit, int label) {
+  emit_rel32(jit, (unsigned char[]){0xe9}, 1, label);
+}
+
+static int exit_label(jit_compiler_t *jit) { return jit->N; }
+
+static int class_label(jit_compiler_t *jit) { return jit->N + 1; }
+
+static int data_label(jit_compiler_t *jit, int state) {
+  return jit->N + 2 + state;
+}
+
+/**
+ * Collects the ranges of consecutive bytes, which lead from {@code state} to
+ * the same state, into {@code arms}. Returns their number.
+ */
+static int collect_jit_arms(int *stm, int state, jit_arm_t *arms) {
+  int arm_count = 0;
+  int *row = &stm[state * 256];
+  for (int c = 0; c < 256; c++) {
+    if (row[c] == -1) {
+      continue;
+    }
+    if (arm_count > 0 && arms[arm_count - 1].last == c - 1 &&
+        arms[arm_count - 1].target == row[c]) {
+      arms[arm_count - 1].last = c;
+    } else {
+      arms[arm_count++] = (jit_arm_t){.first = c, .last = c, .target = row[c]};
+    }
+  }
+  return arm_count;
+}
+
+static void emit_compare_dispatch(jit_compiler_t *jit, jit_arm_t *arms,
+                                  int arm_count) {
+  code_buffer_t *code = &jit->code;
+  for (int i = 0; i < arm_count; i++) {
+    if (arms[i].first == arms[i].last) {
+      if (arms[i].first <= INT8_MAX) {
+        // cmp eax, imm8
+        emit_bytes(code, (unsigned char[]){0x83, 0xf8, arms[i].first}, 3);
+      } else {
+        // cmp eax, imm32
+        emit_bytes(code, (unsigned char[]){0x3d}, 1);
+        emit_int32(code, arms[i].first);
+      }
+      // je target
+      emit_rel32(jit, (unsigned char[]){0x0f, 0x84}, 2, arms[i].target);
+      continue;
+    }
+    // lea r10d, [rax - first]
+    emit_bytes(code, (unsigned char[]){0x44, 0x8d, 0x90}, 3);
+    emit_int32(code, -arms[i].first);
+    int width = arms[i].last - arms[i].first;
+    if (width <= INT8_MAX) {
+      // cmp r10d, imm8
+      emit_bytes(code, (unsigned char[]){0x41, 0x83, 0xfa, width}, 4);
+    } else {
+      // cmp r10d, imm32
+      emit_bytes(code, (unsigned char[]){0x41, 0x81, 0xfa}, 3);
+      emit_int32(code, width);
+    }
+    // jbe target
+    emit_rel32(jit, (unsigned char[]){0x0f, 0x86}, 2, arms[i].target);
+  }
+  emit_jmp(jit, exit_label(jit));
+}
+
+static void emit_bitmap_dispatch(jit_compiler_t *jit, int state, int target) {
+  code_buffer_t *code = &jit->code;
+  // lea r11, [rip + bitmap]
+  emit_rel32(jit, (unsigned char[]){0x4c, 0x8d, 0x1d}, 3,
+             data_label(jit, state));
+  // mov r10d, eax; shr r10d, 5; mov r10d, [r11 + r10 * 4]; bt r10d, eax
+  emit_bytes(code,
+             (unsigned char[]){0x41, 0x89, 0xc2, 0x41, 0xc1, 0xea, 0x05, 0x47,
+                               0x8b, 0x14, 0x93, 0x41, 0x0f, 0xa3, 0xc2},
+             15);
+  // jc target
+  emit_rel32(jit, (unsigned char[]){0x0f, 0x82}, 2, target);
+  emit_jmp(jit, exit_label(jit));
+}
+
+static void emit_table_dispatch(jit_compiler_t *jit, int state) {
+  code_buffer_t *code = &jit->code;
+  // lea r11, [rip + classes]; movzx eax, byte [r11 + rax]
+  emit_rel32(jit, (unsigned char[]){0x4c, 0x8d, 0x1d}, 3, class_label(jit));
+  emit_bytes(code, (unsigned char[]){0x41, 0x0f, 0xb6, 0x04, 0x03}, 5);
+  // lea r11, [rip + table]
+  emit_rel32(jit, (unsigned char[]){0x4c, 0x8d, 0x1d}, 3,
+             data_label(jit, state));
+  // movsxd r10, dword [r11 + rax * 4]; add r10, r11; jmp r10
+  emit_bytes(code,
+             (unsigned char[]){0x4d, 0x63, 0x14, 0x83, 0x4d, 0x01, 0xda, 0x41,
+                               0xff, 0xe2},
+             10);
+}
+
+typedef enum jit_dispatch {
+  JIT_NO_DISPATCH,
+  JIT_COMPARE_DISPATCH,
+  JIT_BITMAP_DISPATCH,
+  JIT_TABLE_DISPATCH
+} jit_dispatch_t;
+
+static jit_dispatch_t choose_jit_dispatch(jit_arm_t *arms, int arm_count) {
+  if (arm_count == 0) {
+    return JIT_NO_DISPATCH;
+  }
+  int compare_cost = 0;
+  bool_t single_target = 1;
+  for (int i = 0; i < arm_count; i++) {
+    compare_cost += arms[i].first == arms[i].last ? 1 : 2;
+    single_target &= arms[i].target == arms[0].target;
+  }
+  if (single_target && compare_cost > JIT_BITMAP_COST) {
+    return JIT_BITMAP_DISPATCH;
+  }
+  return compare_cost > JIT_TABLE_COST ? JIT_TABLE_DISPATCH
+                                       : JIT_COMPARE_DISPATCH;
+}
+
+static void emit_state(jit_compiler_t *jit, automaton_t *automaton, int *stm,
+                       int state, jit_dispatch_t dispatch) {
+  code_buffer_t *code = &jit->code;
+  jit->labels[state] = code->size;
+  int end_tag = automaton->nodes[state].end_tag;
+  if (end_tag != -1) {
+    // mov r8, rdi; mov r9d, end_tag
+    emit_bytes(code, (unsigned char[]){0x49, 0x89, 0xf8, 0x41, 0xb9}, 5);
+    emit_int32(code, end_tag);
+  }
+  if (dispatch == JIT_NO_DISPATCH) {
+    emit_jmp(jit, exit_label(jit));
+    return;
+  }
+  // cmp rdi, rsi; jae exit
+  emit_bytes(code, (unsigned char[]){0x48, 0x39, 0xf7}, 3);
+  emit_rel32(jit, (unsigned char[]){0x0f, 0x83}, 2, exit_label(jit));
+  // movzx eax, byte [rdi]; inc rdi
+  emit_bytes(code, (unsigned char[]){0x0f, 0xb6, 0x07, 0x48, 0xff, 0xc7}, 6);
+
+  jit_arm_t arms[256];
+  int arm_count = collect_jit_arms(stm, state, arms);
+  if (dispatch == JIT_COMPARE_DISPATCH) {
+    emit_compare_dispatch(jit, arms, arm_count);
+  } else if (dispatch == JIT_BITMAP_DISPATCH) {
+    emit_bitmap_dispatch(jit, state, arms[0].target);
+  } else {
+    emit_table_dispatch(jit, state);
+  }
+}
+
+static void emit_exit(jit_compiler_t *jit) {
+  jit->labels[exit_label(jit)] = jit->code.size;
+  // test r8, r8; jz none; mov [rdx], r9d; mov rax, r8; sub rax, rcx; ret
+  // none: mov rax, -1; ret
+  emit_bytes(&jit->code,
+             (unsigned char[]){0x4d, 0x85, 0xc0, 0x74, 0x0a, 0x44, 0x89, 0x0a,
+                               0x4c, 0x89, 0xc0, 0x48, 0x29, 0xc8, 0xc3, 0x48,
+                               0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff, 0xc3},
+             23);
+}
+
+static void align_code(code_buffer_t *code, size_t alignment) {
+  while (code->size % alignment != 0) {
+    // int3
+    emit_bytes(code, (unsigned char[]){0xcc}, 1);
+  }
+}
+
+/**
+ * Computes the classes of bytes, which lead to the same state from every
+ * state, from the columns of the state transition matrix {@code stm} (which is
+ * faster than refining the classes edge by edge). Classes are numbered in the
+ * order of their lowest byte. Returns the number of classes.
+ */
+static int compute_byte_classes(int *stm, int N, int *class_of) {
+  unsigned long hashes[256];
+  int representatives[256];
+  int class_count = 0;
+  for (int c = 0; c < 256; c++) {
+    hashes[c] = HASH_SEED;
+    for (int state = 0; state < N; state++) {
+      hashes[c] = hashes[c] * 31 + stm[state * 256 + c];
+    }
+    class_of[c] = -1;
+    for (int k = 0; k < class_count && class_of[c] == -1; k++) {
+      int r = representatives[k];
+      bool_t equal = hashes[r] == hashes[c];
+      for (int state = 0; state < N && equal; state++) {
+        equal = stm[state * 256 + r] == stm[state * 256 + c];
+      }
+      if (equal) {
+        class_of[c] = k;
+      }
+    }
+    if (class_of[c] == -1) {
+      representatives[class_count] = c;
+      class_of[c] = class_count++;
+    }
+  }
+  return class_count;
+}
+
+/**
+ * Emits the byte classes, and the jump tables and bitmaps of all states after
+ * the code. Jump table entries are relative to the start of their table.
+ */
+static void emit_data(jit_compiler_t *jit, int *stm, jit_dispatch_t *dispatch,
+                      int *class_of, int class_count) {
+  code_buffer_t *code = &jit->code;
+  int *representatives = malloc(class_count * sizeof(int));
+  get_class_representatives(class_of, class_count, representatives);
+  for (int state = 0; state < jit->N; state++) {
+    int *row = &stm[state * 256];
+    if (dispatch[state] == JIT_TABLE_DISPATCH) {
+      align_code(code, 4);
+      size_t table = code->size;
+      jit->labels[data_label(jit, state)] = table;
+      for (int k = 0; k < class_count; k++) {
+        int target = row[representatives[k]];
+        size_t address = jit->labels[target == -1 ? exit_label(jit) : target];
+        emit_int32(code, (int32_t)((long)address - (long)table));
+      }
+    } else if (dispatch[state] == JIT_BITMAP_DISPATCH) {
+      align_code(code, 4);
+      jit->labels[data_label(jit, state)] = code->size;
+      for (int w = 0; w < 8; w++) {
+        uint32_t word = 0;
+        for (int bit = 0; bit < 32; bit++) {
+          word |= (uint32_t)(row[w * 32 + bit] != -1) << bit;
+        }
+        emit_int32(code, word);
+      }
+    }
+  }
+  free(representatives);
+  jit->labels[class_label(jit)] = code->size;
+  for (int c = 0; c < 256; c++) {
+    emit_bytes(code, (unsigned char[]){class_of[c]}, 1);
+  }
+}
+
+bool_t compile_automaton_to_jit(automaton_t *automaton,
+                                jit_matcher_t *matcher) {
+  memset(matcher, 0, sizeof(jit_matcher_t));
+#if !defined(__x86_64__)
+  return 0;
+#else
+  int N = automaton->max_node_count;
+  jit_compiler_t jit = {.code = {.bytes = NULL, .size = 0, .capacity = 0},
+                        .fixups = NULL,
+                        .fixup_count = 0,
+                        .fixup_capacity = 0,
+                        .labels = calloc(2 * N + 2, sizeof(size_t)),
+                        .N = N};
+  int *stm = create_state_transition_matrix(automaton);
+  jit_dispatch_t *dispatch = malloc(N * sizeof(jit_dispatch_t));
+  bool_t has_table = 0;
+  jit_arm_t arms[256];
+  for (int state = 0; state < N; state++) {
+    int arm_count = collect_jit_arms(stm, state, arms);
+    dispatch[state] = choose_jit_dispatch(arms, arm_count);
+    has_table |= dispatch[state] == JIT_TABLE_DISPATCH;
+  }
+  int class_of[256] = {0};
+  int class_count = has_table ? compute_byte_classes(stm, N, class_of) : 1;
+
+  // mov rcx, rdi; xor r8d, r8d
+  emit_bytes(&jit.code, (unsigned char[]){0x48, 0x89, 0xf9, 0x45, 0x31, 0xc0},
+             6);
+  emit_jmp(&jit, automaton->start_index);
+  for (int state = 0; state < N; state++) {
+    emit_state(&jit, automaton, stm, state, dispatch[state]);
+  }
+  emit_exit(&jit);
+  emit_data(&jit, stm, dispatch, class_of, class_count);
+  for (int i = 0; i < jit.fixup_count; i++) {
+    jit_fixup_t *fixup = &jit.fixups[i];
+    long rel = (long)jit.labels[fixup->label] - (long)(fixup->offset + 4);
+    for (int b = 0; b < 4; b++) {
+      jit.code.bytes[fixup->offset + b] = (uint32_t)rel >> (8 * b);
+    }
+  }
+  free(stm);
+  free(dispatch);
+  free(jit.fixups);
+  free(jit.labels);
+
+  // Map the code writable first, then executable, never both
+  long page_size = sysconf(_SC_PAGESIZE);
+  size_t size = (jit.code.size + page_size - 1) / page_size * page_size;
+  void *code = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+    free(jit.code.bytes);
+    return 0;
+  }
+  memcpy(code, jit.code.bytes, jit.code.size);
+  free(jit.code.bytes);
+  if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(code, size);
+    return 0;
+  }
+  matcher->code = code;
+  matcher->code_size = size;
+  matcher->match = (jit_match_t)code;
+  return 1;
+#endif
+}
+
+void delete_jit_matcher(jit_matcher_t *matcher) {
+  if (matcher->code != NULL) {
+    munmap(matcher->code, matcher->code_size);
+  }
+  memset(matcher, 0, sizeof(jit_matcher_t));
+}
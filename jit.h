@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "automaton.h"
+#include "common.h"
+
+/**
+ * Returns the length of the longest prefix of the input from {@code input} to
+ * {@code end}, which the automaton accepts, and stores its end tag into {@code
+ * tag}; or returns -1 (without storing a tag) if no prefix is accepted.
+ */
+typedef long (*jit_match_t)(const unsigned char *input,
+                            const unsigned char *end, int *tag);
+
+typedef struct jit_matcher {
+  jit_match_t match; // points into code
+  void *code;        // executable, mapped pages
+  size_t code_size;  // of the mapping, including the tables after the code
+} jit_matcher_t;
+
+/**
+ * Compiles the given deterministic {@code automaton} into x86-64 machine code
+ * of the running process, without an external compiler, and stores the
+ * matcher into {@code matcher}. Returns 1 on success and 0 if the machine is
+ * not x86-64 or no executable memory can be mapped.
+ *
+ * Every state is one block of code, which records the position and end tag if
+ * the state accepts, reads the next byte and jumps to the block of the next
+ * state: by a chain of compares for a few byte ranges, by a bit test against a
+ * 256-bit bitmap if all ranges lead to the same state, or by a jump table
+ * indexed by the byte class of the automaton otherwise. The code is written
+ * into anonymous pages, which are made executable (and read-only) afterwards.
+ */
+bool_t compile_automaton_to_jit(automaton_t *automaton, jit_matcher_t *matcher);
+
+/**
+ * Unmaps the code of the given {@code matcher}.
+ */
+void delete_jit_matcher(jit_matcher_t *matcher);
@@ -0,0 +1,305 @@
+#include "nfa2c.h"
+#include "automaton2c.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BITSET_WORD_BITS 64
+
+/**
+ * Prints the epsilon edges of all nodes in compressed rows: the targets of the
+ * epsilon edges of node {@code n} are {@code epsilon_target[epsilon_start[n]]}
+ * up to (excluding) {@code epsilon_target[epsilon_start[n + 1]]}. Returns the
+ * number of epsilon edges.
+ */
+static int print_epsilon_tables(automaton_t *automaton, char *parser_name,
+                                FILE *fout) {
+  int N = automaton->max_node_count;
+  int epsilon_count = 0;
+  for (int node = 0; node < N; node++) {
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[node].edges[e];
+      epsilon_count += edge->transitions[EPSILON_EDGE];
+    }
+  }
+  if (epsilon_count == 0) {
+    return 0;
+  }
+  fprintf(fout, "static const int %s_epsilon_start[%d] = {", parser_name,
+          N + 1);
+  int start = 0;
+  for (int node = 0; node < N; node++) {
+    fprintf(fout, " %d,", start);
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[node].edges[e];
+      start += edge->transitions[EPSILON_EDGE];
+    }
+  }
+  fprintf(fout, " %d};\n", start);
+  fprintf(fout, "static const int %s_epsilon_target[%d] = {", parser_name,
+          epsilon_count);
+  for (int node = 0; node < N; node++) {
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[node].edges[e];
+      if (edge->transitions[EPSILON_EDGE]) {
+        fprintf(fout, " %d,", edge->target);
+      }
+    }
+  }
+  fprintf(fout, "};\n");
+  return epsilon_count;
+}
+
+/**
+ * Prints a function, which adds a node and its epsilon-closure to a bitset of
+ * active nodes. The closure is followed at runtime, using a stack of one entry
+ * per node (each node is pushed at most once, when it becomes active), so the
+ * tables stay linear in the size of the NFA.
+ */
+static void print_closure_function(char *parser_name, bool_t has_epsilons,
+                                   FILE *fout) {
+  fprintf(fout,
+          "static void %s_add_closure(uint64_t *set, int node, int *stack) "
+          "{\n",
+          parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "if (set[node >> 6] >> (node & 63) & 1) { return; }\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "set[node >> 6] |= 1ULL << (node & 63);\n");
+  if (has_epsilons) {
+    fprint_indent(2, fout);
+    fprintf(fout, "int size = 0;\n");
+    fprint_indent(2, fout);
+    fprintf(fout, "stack[size++] = node;\n");
+    fprint_indent(2, fout);
+    fprintf(fout, "while (size > 0) {\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "int source = stack[--size];\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "for (int e = %s_epsilon_start[source];\n", parser_name);
+    fprint_indent(9, fout);
+    fprintf(fout, "e < %s_epsilon_start[source + 1]; e++) {\n", parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout, "int target = %s_epsilon_target[e];\n", parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout, "if (!(set[target >> 6] >> (target & 63) & 1)) {\n");
+    fprint_indent(8, fout);
+    fprintf(fout, "set[target >> 6] |= 1ULL << (target & 63);\n");
+    fprint_indent(8, fout);
+    fprintf(fout, "stack[size++] = target;\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "}\n");
+    fprint_indent(2, fout);
+    fprintf(fout, "}\n");
+  }
+  fprintf(fout, "}\n");
+}
+
+/**
+ * Prints the tables of all non-epsilon edges. Returns the number of edges.
+ */
+static int print_edge_tables(automaton_t *automaton, char *parser_name,
+                             FILE *fout) {
+  int N = automaton->max_node_count;
+  int edge_count = 0;
+  for (int node0 = 0; node0 < N; node0++) {
+    for (int e = 0; e < automaton->nodes[node0].edge_count; e++) {
+      for (int t = 0; t < 256; t++) {
+        if (automaton->nodes[node0].edges[e].transitions[t]) {
+          edge_count++;
+          break;
+        }
+      }
+    }
+  }
+  if (edge_count == 0) {
+    return 0;
+  }
+
+  string_t sources = create_string(NULL);
+  string_t targets = create_string(NULL);
+  fprintf(fout, "static const uint32_t %s_edge_terminals[%d][8] = {\n",
+          parser_name, edge_count);
+  for (int node0 = 0; node0 < N; node0++) {
+    for (int e = 0; e < automaton->nodes[node0].edge_count; e++) {
+      edge_t *edge = &automaton->nodes[node0].edges[e];
+      int node1 = edge->target;
+      unsigned int words[8] = {0};
+      bool_t connected = 0;
+      for (int t = 0; t < 256; t++) {
+        if (edge->transitions[t]) {
+          words[t / 32] |= 1U << (t % 32);
+          connected = 1;
+        }
+      }
+      if (!connected) {
+        continue;
+      }
+      char *index = NULL;
+      asprintf(&index, " %d,", node0);
+      append_str_to_str(&sources, index);
+      free(index);
+      asprintf(&index, " %d,", node1);
+      append_str_to_str(&targets, index);
+      free(index);
+      fprint_indent(2, fout);
+      fprintf(fout, "{");
+      for (int w = 0; w < 8; w++) {
+        fprintf(fout, "%s0x%x", w > 0 ? ", " : "", words[w]);
+      }
+      fprintf(fout, "},\n");
+    }
+  }
+  fprintf(fout, "};\n");
+  fprintf(fout, "static const int %s_edge_source[%d] = {%s};\n", parser_name,
+          edge_count, sources.data);
+  fprintf(fout, "static const int %s_edge_target[%d] = {%s};\n", parser_name,
+          edge_count, targets.data);
+  free(sources.data);
+  free(targets.data);
+  return edge_count;
+}
+
+static int compare_end_nodes(const void *a, const void *b, void *arg) {
+  automaton_t *automaton = arg;
+  int tag0 = automaton->nodes[*(const int *)a].end_tag;
+  int tag1 = automaton->nodes[*(const int *)b].end_tag;
+  return tag0 != tag1 ? tag0 - tag1 : *(const int *)a - *(const int *)b;
+}
+
+/**
+ * Prints the tables of all end nodes, ordered by their end tag, so the first
+ * active end node has the lowest tag. Returns the number of end nodes.
+ */
+static int print_end_node_tables(automaton_t *automaton, char *parser_name,
+                                 FILE *fout) {
+  int N = automaton->max_node_count;
+  int *end_nodes = malloc(N * sizeof(int));
+  int end_count = 0;
+  for (int node = 0; node < N; node++) {
+    if (automaton->nodes[node].end_tag != -1) {
+      end_nodes[end_count++] = node;
+    }
+  }
+  qsort_r(end_nodes, end_count, sizeof(int), compare_end_nodes, automaton);
+  if (end_count > 0) {
+    fprintf(fout, "static const int %s_end_nodes[%d] = {", parser_name,
+            end_count);
+    for (int i = 0; i < end_count; i++) {
+      fprintf(fout, " %d,", end_nodes[i]);
+    }
+    fprintf(fout, "};\n");
+    fprintf(fout, "static const int %s_end_tags[%d] = {", parser_name,
+            end_count);
+    for (int i = 0; i < end_count; i++) {
+      fprintf(fout, " %d,", automaton->nodes[end_nodes[i]].end_tag);
+    }
+    fprintf(fout, "};\n");
+  }
+  free(end_nodes);
+  return end_count;
+}
+
+void print_nfa_simulation_to_c_code(automaton_t automaton, char *parser_name,
+                                    char *next_name, char *acc_name,
+                                    char *rej_name, int flags, FILE *fout) {
+  int words = (automaton.max_node_count + BITSET_WORD_BITS - 1) /
+              BITSET_WORD_BITS;
+  if (words == 0) {
+    words = 1;
+  }
+  fprintf(fout, "#include <stdint.h>\n");
+  fprintf(fout, "#include <string.h>\n");
+  print_helper_declarations(next_name, acc_name, rej_name, flags, fout);
+  int epsilon_count = print_epsilon_tables(&automaton, parser_name, fout);
+  print_closure_function(parser_name, epsilon_count > 0, fout);
+  int edge_count = print_edge_tables(&automaton, parser_name, fout);
+  int end_count = print_end_node_tables(&automaton, parser_name, fout);
+
+  fprintf(fout, "%svoid %s() {\n",
+          get_parser_storage(flags), parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "uint64_t sets[2][%d];\n", words);
+  fprint_indent(2, fout);
+  fprintf(fout, "int stack[%d];\n", automaton.max_node_count);
+  fprint_indent(2, fout);
+  fprintf(fout, "uint64_t *current = sets[0], *following = sets[1];\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "memset(current, 0, sizeof(sets[0]));\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "%s_add_closure(current, %d, stack);\n", parser_name,
+          automaton.start_index);
+  fprint_indent(2, fout);
+  fprintf(fout, "while (1) {\n");
+
+  if (end_count > 0) {
+    // Accept with the lowest tag of all active end nodes
+    fprint_indent(4, fout);
+    fprintf(fout, "for (int i = 0; i < %d; i++) {\n", end_count);
+    fprint_indent(6, fout);
+    fprintf(fout, "int node = %s_end_nodes[i];\n", parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout, "if (current[node >> 6] >> (node & 63) & 1) {\n");
+    fprint_indent(8, fout);
+    fprintf(fout, "if (%s(%s_end_tags[i])) { return; }\n", acc_name,
+            parser_name);
+    fprint_indent(8, fout);
+    fprintf(fout, "break;\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "}\n");
+  }
+
+  fprint_indent(4, fout);
+  fprintf(fout, "int c = %s();\n", next_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "int active = 0;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "memset(following, 0, sizeof(sets[0]));\n");
+  if (edge_count > 0) {
+    fprint_indent(4, fout);
+    fprintf(fout, "for (int e = 0; c >= 0 && c < 256 && e < %d; e++) {\n",
+            edge_count);
+    fprint_indent(6, fout);
+    fprintf(fout, "int source = %s_edge_source[e];\n", parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout,
+            "if ((current[source >> 6] >> (source & 63) & 1) &&\n");
+    fprint_indent(10, fout);
+    fprintf(fout, "(%s_edge_terminals[e][c >> 5] >> (c & 31) & 1)) {\n",
+            parser_name);
+    fprint_indent(8, fout);
+    fprintf(fout, "%s_add_closure(following, %s_edge_target[e], stack);\n",
+            parser_name, parser_name);
+    fprint_indent(8, fout);
+    fprintf(fout, "active = 1;\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "}\n");
+  }
+
+  // Reject if no node is active anymore
+  fprint_indent(4, fout);
+  fprintf(fout, "if (!active) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "%s();\n", rej_name);
+  fprint_indent(6, fout);
+  fprintf(fout, "return;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "uint64_t *tmp = current;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "current = following;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "following = tmp;\n");
+
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "}\n");
+}
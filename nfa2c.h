@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "automaton.h"
+#include "common.h"
+
+/*
+ * Generates c code from the given (nondeterministic) {@code automaton}, which
+ * simulates the automaton directly instead of converting it to a DFA first.
+ *
+ * The generated parser has the same interface and behaviour as the parser of
+ * {@code print_automaton_to_c_code} (including the meaning of {@code flags}),
+ * but keeps the set of active nodes in a bitset, which is advanced through
+ * constant tables (the epsilon edges and the non-epsilon edges of each node).
+ * Epsilon-closures are followed at runtime. Its memory usage (including a
+ * stack of one int per node) and the size of the generated code are linear in
+ * the size of the NFA, at the cost of a slower step per input char.
+ */
+void print_nfa_simulation_to_c_code(automaton_t automaton, char *parser_name,
+                                    char *next_name, char *acc_name,
+                                    char *rej_name, int flags, FILE *fout);
@@ -0,0 +1,375 @@
+#include "positions.h"
+#include "ast.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct position_list {
+  int *items;
+  int size;
+} position_list_t;
+
+/**
+ * The nullable, firstpos and lastpos of a subexpression.
+ */
+typedef struct position_fragment {
+  bool_t nullable;
+  position_list_t first;
+  position_list_t last;
+} position_fragment_t;
+
+void append_position(position_list_t *list, int position) {
+  list->items = realloc(list->items, (list->size + 1) * sizeof(int));
+  list->items[list->size++] = position;
+}
+
+void append_position_list(position_list_t *list, position_list_t *other) {
+  if (other->size == 0) {
+    return;
+  }
+  list->items = realloc(list->items, (list->size + other->size) * sizeof(int));
+  memcpy(&list->items[list->size], other->items, other->size * sizeof(int));
+  list->size += other->size;
+}
+
+void delete_position_fragment(position_fragment_t fragment) {
+  free(fragment.first.items);
+  free(fragment.last.items);
+}
+
+/**
+ * Returns the number of positions of the given {@code ast}. The number
+ * saturates at {@code SIZE_MAX} (see {@code add_sizes}).
+ */
+size_t count_positions(ast_t *ast) {
+  switch (ast->type) {
+  case OR_EXPR:
+  case AND_EXPR:
+  case STAR_MODIFIER:
+  case PLUS_MODIFIER:
+  case OPT_MODIFIER:
+  case CAPTURE_GROUP: {
+    size_t count = 0;
+    for (ast_child_list_t *list = ast->children; list != NULL;
+         list = list->next) {
+      count = add_sizes(count, count_positions(&list->child));
+    }
+    return count;
+  }
+  case CHAR:
+  case CLASS:
+  case INV_CLASS:
+  case WILDCARD:
+    return 1;
+  case REFERENCE:
+    return count_positions(ast->reference);
+  case REPEAT_MODIFIER:
+    return multiply_sizes(get_repeat_copies(ast),
+                          count_positions(&ast->children->child));
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
+  case UTF8_CLASS:
+    return count_edges(get_embedded_automaton(ast));
+  }
+  return 0;
+}
+
+/**
+ * Adds all positions of {@code to} to the follow set of all positions of
+ * {@code from}.
+ */
+void connect_positions(positions_t *positions, position_list_t *from,
+                       position_list_t *to) {
+  for (int i = 0; i < from->size; i++) {
+    for (int j = 0; j < to->size; j++) {
+      get_follow_set(positions, from->items[i])[to->items[j]] = 1;
+    }
+  }
+}
+
+position_fragment_t compute_positions(positions_t *positions, int *next,
+                                      ast_t *ast);
+
+position_fragment_t compute_or_positions(positions_t *positions, int *next,
+                                         ast_t *ast) {
+  position_fragment_t fragment = {.nullable = 0};
+  int count;
+  ast_t **children = get_children_in_order(ast, &count);
+  for (int i = 0; i < count; i++) {
+    position_fragment_t inner = compute_positions(positions, next, children[i]);
+    fragment.nullable |= inner.nullable;
+    append_position_list(&fragment.first, &inner.first);
+    append_position_list(&fragment.last, &inner.last);
+    delete_position_fragment(inner);
+  }
+  free(children);
+  return fragment;
+}
+
+position_fragment_t compute_and_positions(positions_t *positions, int *next,
+                                          ast_t *ast) {
+  int count;
+  ast_t **children = get_children_in_order(ast, &count);
+  position_fragment_t fragment =
+      compute_positions(positions, next, children[0]);
+  for (int i = 1; i < count; i++) {
+    position_fragment_t inner = compute_positions(positions, next, children[i]);
+    connect_positions(positions, &fragment.last, &inner.first);
+    if (fragment.nullable) {
+      append_position_list(&fragment.first, &inner.first);
+    }
+    if (inner.nullable) {
+      append_position_list(&inner.last, &fragment.last);
+    }
+    free(fragment.last.items);
+    fragment.last = inner.last;
+    fragment.nullable &= inner.nullable;
+    free(inner.first.items);
+  }
+  free(children);
+  return fragment;
+}
+
+position_fragment_t compute_modifier_positions(positions_t *positions,
+                                               int *next, ast_t *ast) {
+  position_fragment_t fragment =
+      compute_positions(positions, next, &ast->children->child);
+  if (ast->type != OPT_MODIFIER) {
+    // Repetitions can continue with the first positions after the last ones
+    connect_positions(positions, &fragment.last, &fragment.first);
+  }
+  if (ast->type != PLUS_MODIFIER) {
+    fragment.nullable = 1;
+  }
+  return fragment;
+}
+
+/**
+ * Computes the positions of a repetition from copies of its child. The copies
+ * after the minimum are optional, but each one can only follow the copy before
+ * it (x{1,3} is computed like x(x(x)?)?), so the follow sets stay small.
+ */
+position_fragment_t compute_repeat_positions(positions_t *positions, int *next,
+                                             ast_t *ast) {
+  position_fragment_t fragment = {.nullable = 1};
+  // The positions, which the next copy can follow
+  position_list_t previous = {.items = NULL, .size = 0};
+  bool_t first_open = 1;
+  int copies = get_repeat_copies(ast);
+  for (int i = 0; i < copies; i++) {
+    position_fragment_t inner =
+        compute_positions(positions, next, &ast->children->child);
+    if (ast->repeat_max == -1 && i == copies - 1) {
+      // The last copy of an unbounded repetition can repeat itself
+      connect_positions(positions, &inner.last, &inner.first);
+    }
+    connect_positions(positions, &previous, &inner.first);
+    if (first_open) {
+      append_position_list(&fragment.first, &inner.first);
+    }
+    first_open &= inner.nullable;
+    if (inner.nullable) {
+      append_position_list(&inner.last, &previous);
+    }
+    free(previous.items);
+    previous = inner.last;
+    if (i < ast->repeat_min) {
+      // The repetition cannot end before the required copies
+      free(fragment.last.items);
+      fragment.last.items = NULL;
+      fragment.last.size = 0;
+      fragment.nullable &= inner.nullable;
+    }
+    append_position_list(&fragment.last, &inner.last);
+    free(inner.first.items);
+  }
+  free(previous.items);
+  return fragment;
+}
+
+/**
+ * Computes the positions of an intersection, complement or UTF-8 class from
+ * its DFA. Every edge of the DFA is a position, which matches the terminals of
+ * the edge, and can be followed by the edges leaving its target node.
+ */
+position_fragment_t compute_embedded_positions(positions_t *positions,
+                                              int *next, ast_t *ast) {
+  automaton_t *dfa = get_embedded_automaton(ast);
+  int N = dfa->max_node_count;
+  // The positions of the edges of node u start at first_edge[u]
+  int *first_edge = malloc((N + 1) * sizeof(int));
+  first_edge[0] = *next;
+  for (int node = 0; node < N; node++) {
+    first_edge[node + 1] = first_edge[node] + dfa->nodes[node].edge_count;
+  }
+  *next = first_edge[N];
+
+  position_fragment_t fragment = {
+      .nullable = dfa->nodes[dfa->start_index].end_tag != -1};
+  for (int node = 0; node < N; node++) {
+    for (int e = 0; e < dfa->nodes[node].edge_count; e++) {
+      edge_t *edge = &dfa->nodes[node].edges[e];
+      int p = first_edge[node] + e;
+      position_t *position = &positions->positions[p];
+      position->end_tag = -1;
+      for (int t = 0; t < 256; t++) {
+        position->terminals[t] = edge->transitions[t];
+      }
+      for (int q = first_edge[edge->target]; q < first_edge[edge->target + 1];
+           q++) {
+        get_follow_set(positions, p)[q] = 1;
+      }
+      if (node == dfa->start_index) {
+        append_position(&fragment.first, p);
+      }
+      if (dfa->nodes[edge->target].end_tag != -1) {
+        append_position(&fragment.last, p);
+      }
+    }
+  }
+  free(first_edge);
+  return fragment;
+}
+
+position_fragment_t compute_terminal_positions(positions_t *positions,
+                                               int *next, ast_t *ast) {
+  position_t *position = &positions->positions[*next];
+  position->end_tag = -1;
+  for (int t = 0; t < 256; t++) {
+    switch (ast->type) {
+    case CHAR:
+      position->terminals[t] = t == ast->terminal;
+      break;
+    case CLASS:
+      position->terminals[t] = ast->terminals[t] != 0;
+      break;
+    case INV_CLASS:
+      position->terminals[t] = ast->terminals[t] == 0;
+      break;
+    default:
+      position->terminals[t] = 1;
+    }
+  }
+  position_fragment_t fragment = {.nullable = 0};
+  append_position(&fragment.first, *next);
+  append_position(&fragment.last, *next);
+  (*next)++;
+  return fragment;
+}
+
+position_fragment_t compute_positions(positions_t *positions, int *next,
+                                      ast_t *ast) {
+  switch (ast->type) {
+  case OR_EXPR:
+    return compute_or_positions(positions, next, ast);
+  case AND_EXPR:
+    return compute_and_positions(positions, next, ast);
+  case STAR_MODIFIER:
+  case PLUS_MODIFIER:
+  case OPT_MODIFIER:
+    return compute_modifier_positions(positions, next, ast);
+  case CHAR:
+  case CLASS:
+  case INV_CLASS:
+  case WILDCARD:
+    return compute_terminal_positions(positions, next, ast);
+  case REFERENCE:
+    return compute_positions(positions, next, ast->reference);
+  case CAPTURE_GROUP:
+    return compute_positions(positions, next, &ast->children->child);
+  case REPEAT_MODIFIER:
+    return compute_repeat_positions(positions, next, ast);
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
+  case UTF8_CLASS:
+    return compute_embedded_positions(positions, next, ast);
+  }
+  position_fragment_t empty = {.nullable = 1};
+  return empty;
+}
+
+positions_t create_positions_from_ast_list(ast_list_t *ast_list) {
+  size_t count = 0;
+  for (ast_list_t *list = ast_list; list != NULL; list = list->next) {
+    // Every ast gets an additional end marker
+    count = add_sizes(count, add_sizes(count_positions(list->ast), 1));
+  }
+  positions_t positions = {
+      .positions = calloc(count, sizeof(position_t)),
+      .count = count,
+      .first = calloc(count, sizeof(bool_t)),
+      .follow = calloc(multiply_sizes(count, count), sizeof(bool_t))};
+  int next = 0;
+  int tag = 0;
+  for (ast_list_t *list = ast_list; list != NULL; list = list->next) {
+    position_fragment_t fragment =
+        compute_positions(&positions, &next, list->ast);
+    int marker = next++;
+    positions.positions[marker].end_tag = tag++;
+    position_list_t markers = {.items = &marker, .size = 1};
+    connect_positions(&positions, &fragment.last, &markers);
+    if (fragment.nullable) {
+      append_position(&fragment.first, marker);
+    }
+    for (int i = 0; i < fragment.first.size; i++) {
+      positions.first[fragment.first.items[i]] = 1;
+    }
+    delete_position_fragment(fragment);
+  }
+  return positions;
+}
+
+positions_t create_positions_from_ast(ast_t *ast) {
+  ast_list_t list = {.next = NULL, .ast = ast};
+  return create_positions_from_ast_list(&list);
+}
+
+bool_t *get_follow_set(positions_t *positions, int p) {
+  return &positions->follow[(size_t)p * positions->count];
+}
+
+int lowest_end_tag(positions_t *positions, bool_t *set) {
+  int end_tag = -1;
+  for (int p = 0; p < positions->count; p++) {
+    int tag = positions->positions[p].end_tag;
+    if (set[p] && tag != -1 && (end_tag == -1 || tag < end_tag)) {
+      end_tag = tag;
+    }
+  }
+  return end_tag;
+}
+
+void print_positions(positions_t *positions, FILE *fout) {
+  fprintf(fout, "Positions (count = %d)\n", positions->count);
+  fprintf(fout, "> first, # end marker with tag, position: terminals -> "
+                "follow\n");
+  for (int p = 0; p < positions->count; p++) {
+    position_t *position = &positions->positions[p];
+    fprintf(fout, "%c", positions->first[p] ? '>' : ' ');
+    if (position->end_tag != -1) {
+      fprintf(fout, "#%3d %d\n", position->end_tag, p);
+      continue;
+    }
+    fprintf(fout, "     %d:", p);
+    for (int t = 0; t < 256; t++) {
+      if (position->terminals[t]) {
+        char buffer[CHAR_BUFFER_SIZE];
+        fprintf(fout, " %s", sprint_char(t, buffer));
+      }
+    }
+    fprintf(fout, " ->");
+    for (int q = 0; q < positions->count; q++) {
+      if (get_follow_set(positions, p)[q]) {
+        fprintf(fout, " %d", q);
+      }
+    }
+    fprintf(fout, "\n");
+  }
+}
+
+void delete_positions(positions_t positions) {
+  free(positions.positions);
+  free(positions.first);
+  free(positions.follow);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "ast2automaton.h"
+#include "common.h"
+
+typedef struct position {
+  bool_t terminals[256];
+  int end_tag; // -1 for char positions, the tag of the rule for end markers
+} position_t;
+
+/**
+ * The positions of a regular expression (Glushkov / followpos construction).
+ *
+ * Every char, class and wildcard of the expression is a position, numbered in
+ * the order of their appearance. Each expression of an ast list additionally
+ * gets an end marker position, which matches no char and carries the end tag
+ * of the expression. {@code first} holds the positions, which can match the
+ * first char of a string, and {@code follow} holds the positions, which can
+ * follow each position.
+ */
+typedef struct positions {
+  position_t *positions;
+  int count;
+  bool_t *first;  // count entries
+  bool_t *follow; // count * count entries, position q can follow position p
+                  // if follow[p * count + q] != 0
+} positions_t;
+
+/**
+ * Computes the positions of the given {@code ast}. The end marker is tagged
+ * with {@code 0}.
+ */
+positions_t create_positions_from_ast(ast_t *ast);
+
+/**
+ * Computes the positions of the or-construct of all asts in the given {@code
+ * ast_list}. Each ast gets an end marker with a different end tag, starting
+ * with {@code 0} and incrementing.
+ */
+positions_t create_positions_from_ast_list(ast_list_t *ast_list);
+
+/**
+ * Returns the follow set of position {@code p}, with {@code positions->count}
+ * entries.
+ */
+bool_t *get_follow_set(positions_t *positions, int p);
+
+/**
+ * Returns the lowest end tag of all end markers in the given {@code set} of
+ * positions (with {@code positions->count} entries), or {@code -1} if there is
+ * none.
+ */
+int lowest_end_tag(positions_t *positions, bool_t *set);
+
+/**
+ * Prints the given {@code positions}.
+ */
+void print_positions(positions_t *positions, FILE *fout);
+
+/**
+ * Deletes the given {@code positions} and frees all their related memory.
+ */
+void delete_positions(positions_t positions);
@@ -0,0 +1,152 @@
+#include "profile.h"
+#include "automaton2c.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool_t allocate_profile_counts(profile_t *profile, int state_count) {
+  if (profile->state_visits != NULL) {
+    // Concatenated profiles must belong to the same parser
+    return profile->state_count == state_count;
+  }
+  if (state_count <= 0) {
+    return 0;
+  }
+  profile->state_count = state_count;
+  profile->state_visits = calloc(state_count, sizeof(unsigned long));
+  profile->transition_hits = calloc(state_count * 256, sizeof(unsigned long));
+  return 1;
+}
+
+static bool_t read_profile_line(FILE *fin, profile_t *profile,
+                                bool_t *has_fingerprint) {
+  char keyword[16];
+  if (fscanf(fin, "%15s", keyword) != 1) {
+    return 0;
+  }
+  if (strcmp(keyword, "regex2c-profile") == 0) {
+    int version;
+    return fscanf(fin, "%d", &version) == 1 &&
+           version == REGEX2C_PROFILE_VERSION;
+  }
+  if (strcmp(keyword, "fingerprint") == 0) {
+    unsigned long fingerprint;
+    if (fscanf(fin, "%lx", &fingerprint) != 1) {
+      return 0;
+    }
+    if (*has_fingerprint && profile->fingerprint != fingerprint) {
+      return 0;
+    }
+    profile->fingerprint = fingerprint;
+    *has_fingerprint = 1;
+    return 1;
+  }
+  if (strcmp(keyword, "states") == 0) {
+    int state_count;
+    return fscanf(fin, "%d", &state_count) == 1 &&
+           allocate_profile_counts(profile, state_count);
+  }
+  if (profile->state_visits == NULL) {
+    // Counts before the state count
+    return 0;
+  }
+  if (strcmp(keyword, "state") == 0) {
+    int state;
+    unsigned long visits;
+    if (fscanf(fin, "%d %lu", &state, &visits) != 2 || state < 0 ||
+        state >= profile->state_count) {
+      return 0;
+    }
+    profile->state_visits[state] += visits;
+    return 1;
+  }
+  if (strcmp(keyword, "transition") == 0) {
+    int state, c;
+    unsigned long hits;
+    if (fscanf(fin, "%d %d %lu", &state, &c, &hits) != 3 || state < 0 ||
+        state >= profile->state_count || c < 0 || c >= 256) {
+      return 0;
+    }
+    profile->transition_hits[state * 256 + c] += hits;
+    return 1;
+  }
+  return 0;
+}
+
+bool_t read_profile(char *path, profile_t *profile) {
+  memset(profile, 0, sizeof(profile_t));
+  FILE *fin = fopen(path, "r");
+  if (fin == NULL) {
+    return 0;
+  }
+  bool_t has_fingerprint = 0;
+  bool_t success = 1;
+  int c;
+  while (success && (c = getc(fin)) != EOF) {
+    if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+      continue;
+    }
+    ungetc(c, fin);
+    success = read_profile_line(fin, profile, &has_fingerprint);
+  }
+  fclose(fin);
+  if (!success || !has_fingerprint || profile->state_visits == NULL) {
+    delete_profile(*profile);
+    memset(profile, 0, sizeof(profile_t));
+    return 0;
+  }
+  return 1;
+}
+
+bool_t profile_matches_automaton(profile_t *profile, automaton_t *automaton) {
+  return profile->state_count == automaton->max_node_count &&
+         profile->fingerprint == automaton_fingerprint(automaton);
+}
+
+static int compare_state_hotness(const void *a, const void *b, void *arg) {
+  profile_t *profile = arg;
+  int s0 = *(const int *)a;
+  int s1 = *(const int *)b;
+  unsigned long v0 = profile->state_visits[s0];
+  unsigned long v1 = profile->state_visits[s1];
+  if (v0 != v1) {
+    return v0 > v1 ? -1 : 1;
+  }
+  // Keep the original order for equally hot states
+  return s0 - s1;
+}
+
+void order_states_by_hotness(profile_t *profile, int *new_index) {
+  int N = profile->state_count;
+  int *order = malloc(N * sizeof(int));
+  for (int i = 0; i < N; i++) {
+    order[i] = i;
+  }
+  qsort_r(order, N, sizeof(int), compare_state_hotness, profile);
+  for (int i = 0; i < N; i++) {
+    new_index[order[i]] = i;
+  }
+  free(order);
+}
+
+void renumber_profile(profile_t *profile, int *new_index) {
+  int N = profile->state_count;
+  unsigned long *visits = malloc(N * sizeof(unsigned long));
+  unsigned long *hits = malloc(N * 256 * sizeof(unsigned long));
+  for (int i = 0; i < N; i++) {
+    visits[new_index[i]] = profile->state_visits[i];
+    memcpy(&hits[new_index[i] * 256], &profile->transition_hits[i * 256],
+           256 * sizeof(unsigned long));
+  }
+  free(profile->state_visits);
+  free(profile->transition_hits);
+  profile->state_visits = visits;
+  profile->transition_hits = hits;
+}
+
+void delete_profile(profile_t profile) {
+  free(profile.state_visits);
+  free(profile.transition_hits);
+}
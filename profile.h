@@ -0,0 +1,43 @@
+#pragma once
+
+#include "automaton.h"
+#include "common.h"
+
+typedef struct profile {
+  int state_count;
+  unsigned long fingerprint;
+  unsigned long *state_visits;    // state_count entries
+  unsigned long *transition_hits; // state_count * 256 entries
+} profile_t;
+
+/**
+ * Reads the profile file at {@code path} (as written by a parser generated
+ * with {@code REGEX2C_PROFILE}) into {@code profile}. Counts of repeated
+ * entries are summed up. Returns 1 on success and 0 if the file cannot be
+ * read, is malformed or contains profiles of different parsers.
+ */
+bool_t read_profile(char *path, profile_t *profile);
+
+/**
+ * Returns whether the given {@code profile} was recorded with a parser
+ * generated from the given {@code automaton}.
+ */
+bool_t profile_matches_automaton(profile_t *profile, automaton_t *automaton);
+
+/**
+ * Computes a renumbering of the states of the given {@code profile}, which
+ * orders them by descending visit count. {@code new_index} must hold {@code
+ * state_count} entries and receives the new index of each state.
+ */
+void order_states_by_hotness(profile_t *profile, int *new_index);
+
+/**
+ * Moves the counts of state {@code i} in the given {@code profile} to state
+ * {@code new_index[i]}.
+ */
+void renumber_profile(profile_t *profile, int *new_index);
+
+/**
+ * Deletes the given {@code profile} and frees all its related memory.
+ */
+void delete_profile(profile_t profile);
@@ -49,28 +49,25 @@
  * @author Florian Malicky
  */
 
-#include "ast2automaton.h"
 #include "automaton2c.h"
+#include "batch.h"
 #include "common.h"
+#include "compiler.h"
+#include "jit.h"
 #include "not_enough_cli/not_enough_cli.h"
-#include "regex_parser.h"
+#include "stats.h"
 
 #include <err.h>
 #include <getopt.h>
-#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-static int next_char = EOF;
-static int char_pos = 0;
+#include <unistd.h>
 
 static char **in_files = NULL;
 static int fin_idx = 0;
 static FILE *fin = NULL;
 
-int peek_next() { return next_char; }
-
 static void open_next_in_file() {
   if (fin != NULL) {
     fclose(fin);
@@ -106,44 +103,47 @@ static int get_next_input_char() {
   }
 }
 
-int consume_next() {
-  int c = peek_next();
-  next_char = get_next_input_char();
-  char_pos++;
-  return c;
-}
-
-_Noreturn int reject(char *err, ...) {
-  va_list args;
-  va_start(args, err);
-  char *errf = NULL;
-  if (vasprintf(&errf, err, args) == -1) {
-    errx(EXIT_FAILURE, "Failed to print error message");
+/**
+ * Reads all input files (or the standard input) into one string, and stores
+ * its length into {@code length}.
+ */
+static char *read_input(size_t *length) {
+  char *input = NULL;
+  FILE *finput = open_memstream(&input, length);
+  if (finput == NULL) {
+    err(EXIT_FAILURE, "Cannot read the input");
   }
-  va_end(args);
-  errx(EXIT_FAILURE, "Rejected at char %d: %s", char_pos, errf);
-}
-
-ast_t *get_definition(char *name) { return NULL; }
-
-bool_t is_end(int c) {
-  switch (c) {
-  case EOF:
-  case '\n':
-  case '\r':
-  case '\t':
-  case '\0':
-  case ' ':
-    return 1;
-  default:
-    return 0;
+  int c;
+  while ((c = get_next_input_char()) != EOF) {
+    fputc(c, finput);
   }
+  if (fclose(finput) != 0) {
+    err(EXIT_FAILURE, "Cannot read the input");
+  }
+  return input;
 }
 
 struct option OPTIONS_LONG[] = {{"help", no_argument, NULL, 'h'},
                                 {"version", no_argument, NULL, 'v'},
                                 {"debug", no_argument, NULL, 'd'},
                                 {"output", required_argument, NULL, 'o'},
+                                {"stats", required_argument, NULL, 's'},
+                                {"instrument", no_argument, NULL, 'i'},
+                                {"profile", required_argument, NULL, 'p'},
+                                {"max-states", required_argument, NULL, 'S'},
+                                {"max-memory", required_argument, NULL, 'M'},
+                                {"backend", required_argument, NULL, 'b'},
+                                {"construction", required_argument, NULL, 'c'},
+                                {"verify", no_argument, NULL, 'V'},
+                                {"rules", no_argument, NULL, 'r'},
+                                {"cache", required_argument, NULL, 'C'},
+                                {"batch", required_argument, NULL, 'B'},
+                                {"jobs", required_argument, NULL, 'j'},
+                                {"match", required_argument, NULL, 'm'},
+                                {"search", no_argument, NULL, 'f'},
+                                {"earliest", no_argument, NULL, 'e'},
+                                {"table-file", required_argument, NULL, 'T'},
+                                {"all-tags", no_argument, NULL, 'A'},
                                 {NULL, 0, NULL, 0}};
 
 static char *OPTIONS_HELP[] = {
@@ -151,11 +151,65 @@ static char *OPTIONS_HELP[] = {
     ['v'] = "print program version",
     ['d'] = "output debug information",
     ['o'] = "set output file name",
+    ['s'] = "write compile statistics as JSON to the given file",
+    ['i'] = "instrument the parser with state and transition counters",
+    ['p'] = "lay out the parser using the given profile of an instrumented "
+            "parser",
+    ['S'] = "limit the number of DFA states, fall back to NFA simulation "
+            "when exceeded",
+    ['M'] = "limit the memory of determinization (in bytes, K, M or G "
+            "suffixes allowed), fall back to NFA simulation when exceeded",
+    ['b'] = "select the generated parser: dfa (default), bitparallel (for "
+            "patterns with less than 128 positions), table (dense transition "
+            "table), comb (compressed transition table), cpp (header-only "
+            "C++ matcher with constexpr tables) or simd (matches many "
+            "records at once in AVX2/AVX-512 lanes)",
+    ['c'] = "select the DFA construction: thompson (default) or glushkov "
+            "NFA and determinization, or direct (followpos, without NFA)",
+    ['V'] = "verify the minimal DFA against a DFA built with an "
+            "independent construction",
+    ['r'] = "read a set of whitespace separated rules (tagged in order) "
+            "instead of a single pattern",
+    ['C'] = "keep the DFAs of rules in the given directory and only rebuild "
+            "those of changed rules (implies --rules)",
+    ['B'] = "compile every \"name pattern\" or \"name @file\" line of the "
+            "given manifest into a parser of that name, all in one output",
+    ['j'] = "compile a batch on the given number of threads (default: "
+            "number of processors)",
+    ['m'] = "compile the DFA to machine code in-process and print the length "
+            "and end tag of the longest accepted prefix of every line of the "
+            "given file (-1 -1 if there is none) instead of c code",
+    ['f'] = "generate a search for all matches in a buffer, which reports "
+            "the start and end (and rule, with --rules) of each match, "
+            "instead of a parser",
+    ['e'] = "end each match of a search as early as possible instead of "
+            "at the longest match from its start (implies --search)",
+    ['T'] = "determinize out of core into a binary DFA table in the given "
+            "file (not minimized) instead of generating c code; "
+            "--max-memory limits the buffer of NFA node sets",
+    ['A'] = "report the set of all matching rules instead of the lowest "
+            "tag: accept gets the index of the set, whose tags "
+            "parse_tags(set, &tags) returns (implies --rules)",
 };
 
 static char *out_file_name = NULL;
 static FILE *out_file = NULL;
 static bool_t output_debug_info = 0;
+static char *stats_file_name = NULL;
+static int codegen_flags = 0;
+static char *profile_file_name = NULL;
+static dfa_budget_t budget = {.max_states = 0, .max_memory = 0};
+
+static backend_t backend = DFA_BACKEND;
+static construction_t construction = THOMPSON_CONSTRUCTION;
+static bool_t verify = 0;
+static bool_t read_rules = 0;
+static char *cache_dir_name = NULL;
+static char *manifest_file_name = NULL;
+static int jobs = 0;
+static char *match_file_name = NULL;
+static char *table_file_name = NULL;
+static bool_t all_tags = 0;
 
 _Noreturn static void version() {
   printf("regex2c 1.0\n");
@@ -171,6 +225,34 @@ _Noreturn static void usage(int status) {
   exit(status);
 }
 
+/**
+ * Parses the argument of the option {@code opt} as a positive size with an
+ * optional K, M or G suffix.
+ */
+static size_t parse_size_arg(char opt, bool_t allow_suffix) {
+  char *arg = nac_optarg_trimmed();
+  char *end = NULL;
+  unsigned long long size = strtoull(arg, &end, 10);
+  if (end == arg) {
+    nac_missing_arg(opt);
+  }
+  if (allow_suffix) {
+    switch (*end) {
+    case 'G':
+      size *= 1024;
+    case 'M':
+      size *= 1024;
+    case 'K':
+      size *= 1024;
+      end++;
+    }
+  }
+  if (*end != '\0' || size == 0) {
+    errx(EXIT_FAILURE, "Invalid argument for option '%c': \"%s\"\n", opt, arg);
+  }
+  return size;
+}
+
 static void handle_option(char opt) {
   switch (opt) {
   case 'o':
@@ -179,9 +261,106 @@ static void handle_option(char opt) {
       nac_missing_arg('o');
     }
     break;
+  case 'f':
+    codegen_flags |= REGEX2C_SEARCH;
+    break;
+  case 'e':
+    codegen_flags |= REGEX2C_SEARCH | REGEX2C_SEARCH_EARLIEST;
+    break;
   case 'd':
     output_debug_info = 1;
     break;
+  case 'V':
+    verify = 1;
+    break;
+  case 'r':
+    read_rules = 1;
+    break;
+  case 'C':
+    cache_dir_name = nac_optarg_trimmed();
+    if (cache_dir_name[0] == '\0') {
+      nac_missing_arg('C');
+    }
+    read_rules = 1;
+    break;
+  case 'B':
+    manifest_file_name = nac_optarg_trimmed();
+    if (manifest_file_name[0] == '\0') {
+      nac_missing_arg('B');
+    }
+    break;
+  case 'j':
+    jobs = parse_size_arg('j', 0);
+    break;
+  case 'm':
+    match_file_name = nac_optarg_trimmed();
+    if (match_file_name[0] == '\0') {
+      nac_missing_arg('m');
+    }
+    break;
+  case 'A':
+    all_tags = 1;
+    read_rules = 1;
+    break;
+  case 'T':
+    table_file_name = nac_optarg_trimmed();
+    if (table_file_name[0] == '\0') {
+      nac_missing_arg('T');
+    }
+    break;
+  case 'i':
+    codegen_flags |= REGEX2C_PROFILE;
+    break;
+  case 'p':
+    profile_file_name = nac_optarg_trimmed();
+    if (profile_file_name[0] == '\0') {
+      nac_missing_arg('p');
+    }
+    break;
+  case 'S':
+    budget.max_states = parse_size_arg('S', 0);
+    break;
+  case 'M':
+    budget.max_memory = parse_size_arg('M', 1);
+    break;
+  case 'b': {
+    char *name = nac_optarg_trimmed();
+    if (strcmp(name, "dfa") == 0) {
+      backend = DFA_BACKEND;
+    } else if (strcmp(name, "bitparallel") == 0) {
+      backend = BITPARALLEL_BACKEND;
+    } else if (strcmp(name, "table") == 0) {
+      backend = DENSE_TABLE_BACKEND;
+    } else if (strcmp(name, "comb") == 0) {
+      backend = COMB_TABLE_BACKEND;
+    } else if (strcmp(name, "cpp") == 0) {
+      backend = CPP_HEADER_BACKEND;
+    } else if (strcmp(name, "simd") == 0) {
+      backend = SIMD_BACKEND;
+    } else {
+      errx(EXIT_FAILURE, "Unknown backend \"%s\"\n", name);
+    }
+    break;
+  }
+  case 'c': {
+    char *name = nac_optarg_trimmed();
+    if (strcmp(name, "thompson") == 0) {
+      construction = THOMPSON_CONSTRUCTION;
+    } else if (strcmp(name, "glushkov") == 0) {
+      construction = GLUSHKOV_CONSTRUCTION;
+    } else if (strcmp(name, "direct") == 0) {
+      construction = DIRECT_CONSTRUCTION;
+    } else {
+      errx(EXIT_FAILURE, "Unknown DFA construction \"%s\"\n", name);
+    }
+    break;
+  }
+  case 's':
+    stats_file_name = nac_optarg_trimmed();
+    if (stats_file_name[0] == '\0') {
+      nac_missing_arg('s');
+    }
+    break;
   }
 }
 
@@ -190,7 +369,12 @@ static void parse_args(int *argc, char ***argv) {
   nac_simple_parse_args(argc, argv, handle_option);
 
   nac_opt_check_excl("hv");
-  nac_opt_check_max_once("hvo");
+  nac_opt_check_excl("ip");
+  nac_opt_check_excl("mb");
+  nac_opt_check_excl("mi");
+  nac_opt_check_excl("mp");
+  nac_opt_check_excl("mB");
+  nac_opt_check_max_once("hvospSMbcVrCBjm");
 
   if (nac_get_opt('h')) {
     usage(*argc > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
@@ -202,6 +386,47 @@ static void parse_args(int *argc, char ***argv) {
     version();
   }
 
+  if (table_file_name != NULL &&
+      (backend != DFA_BACKEND || construction == DIRECT_CONSTRUCTION ||
+       codegen_flags & (REGEX2C_SEARCH | REGEX2C_PROFILE) ||
+       match_file_name != NULL || manifest_file_name != NULL ||
+       cache_dir_name != NULL || profile_file_name != NULL || verify ||
+       nac_get_opt('S'))) {
+    errx(EXIT_FAILURE, "A DFA table needs the dfa backend, an NFA "
+                       "construction and none of the options f, i, m, B, C, "
+                       "p, V and S\n");
+  }
+  if (all_tags &&
+      (backend == CPP_HEADER_BACKEND ||
+       construction != THOMPSON_CONSTRUCTION ||
+       codegen_flags & REGEX2C_SEARCH || cache_dir_name != NULL ||
+       table_file_name != NULL || verify)) {
+    // Glushkov automata share one start node, which has only one end tag
+    errx(EXIT_FAILURE, "Tag sets need the thompson construction and none of "
+                       "the options f, C, T and V, or the cpp backend\n");
+  }
+  if (read_rules && table_file_name == NULL &&
+      (nac_get_opt('S') || nac_get_opt('M'))) {
+    errx(EXIT_FAILURE, "The DFA budget is not supported with rule sets\n");
+  }
+  if (codegen_flags & REGEX2C_SEARCH &&
+      (backend != DFA_BACKEND || match_file_name != NULL)) {
+    errx(EXIT_FAILURE, "A search needs the dfa backend\n");
+  }
+
+  if (manifest_file_name != NULL) {
+    if (read_rules || verify || output_debug_info || stats_file_name != NULL ||
+        profile_file_name != NULL) {
+      errx(EXIT_FAILURE, "The options r, C, V, d, s and p are not supported "
+                         "with batches\n");
+    }
+    if (*argc > 0) {
+      usage(EXIT_FAILURE);
+    }
+  } else if (jobs > 0) {
+    errx(EXIT_FAILURE, "The option 'j' requires a batch\n");
+  }
+
   if (out_file_name == NULL) {
     out_file = stdout;
   } else {
@@ -224,42 +449,234 @@ static void parse_args(int *argc, char ***argv) {
   nac_cleanup();
 }
 
-int main(int argc, char **argv) {
-  parse_args(&argc, &argv);
-  consume_next();
-  ast_t ast = consume_regex_expr();
-  if (output_debug_info) {
-    fprintf(out_file, "--- Abstract syntax tree:\n");
-    print_ast(&ast, out_file);
-    fprintf(out_file, "\n");
+static void write_stats(compile_stats_t *stats) {
+  if (stats_file_name == NULL) {
+    return;
+  }
+  FILE *stats_file = fopen(stats_file_name, "w");
+  if (stats_file == NULL) {
+    errx(EXIT_FAILURE, "Failed to open specified stats file \"%s\"\n",
+         stats_file_name);
+  }
+  print_stats_json(stats, stats_file);
+  fclose(stats_file);
+}
+
+/**
+ * Reports the size of the generated transition tables compared to a dense
+ * table.
+ */
+static void print_table_size(long bytes, long dense_bytes) {
+  fprintf(stderr,
+          "regex2c: transition tables of %ld bytes, %ld bytes dense "
+          "(compression ratio %.2f)\n",
+          bytes, dense_bytes, (double)dense_bytes / bytes);
+}
+
+/**
+ * Prints every line of the given {@code warnings} (if any), after the given
+ * {@code name} of a batch entry (if any).
+ */
+static void print_warnings(char *name, char *warnings) {
+  while (warnings != NULL && *warnings != '\0') {
+    char *end = strchr(warnings, '\n');
+    int length = end != NULL ? end - warnings : strlen(warnings);
+    if (name != NULL) {
+      warnx("\"%s\": %.*s", name, length, warnings);
+    } else {
+      warnx("%.*s", length, warnings);
+    }
+    warnings += end != NULL ? length + 1 : length;
+  }
+}
+
+/**
+ * Reports the warnings of the given {@code result}, and exits with its error,
+ * if there is one.
+ */
+static void check_result(regex2c_result_t *result) {
+  if (result->blowup_subexpression != NULL) {
+    if (result->error == NULL) {
+      warnx("DFA budget exceeded, falling back to NFA simulation");
+    }
+    warnx("subexpression causing the blowup: %s",
+          result->blowup_subexpression);
+  }
+  print_warnings(NULL, result->warnings);
+  if (result->syntax_error) {
+    // The offending char, counted from 1
+    errx(EXIT_FAILURE, "Rejected at char %zu: %s", result->error_position + 1,
+         result->error);
+  }
+  if (result->error != NULL) {
+    errx(EXIT_FAILURE, "%s", result->error);
+  }
+}
+
+/**
+ * Determinizes the given pattern out of core into the DFA table file (see
+ * {@code regex2c_compile_table}).
+ */
+static void write_table_file(char *pattern, size_t length,
+                             regex2c_options_t *options,
+                             regex2c_result_t *result) {
+  FILE *ftable = fopen(table_file_name, "w");
+  if (ftable == NULL) {
+    errx(EXIT_FAILURE, "Cannot open file \"%s\"\n", table_file_name);
   }
+  dfa_table_stats_t table_stats;
+  regex2c_compile_table(pattern, length, options, ftable, &table_stats,
+                        result);
+  if (fclose(ftable) != 0 && result->error == NULL) {
+    err(EXIT_FAILURE, "Cannot write the DFA table \"%s\"", table_file_name);
+  }
+  check_result(result);
+  fprintf(stderr,
+          "regex2c: DFA table of %d states and %ld bytes, %ld bytes of node "
+          "sets spilled and read back %ld times, %ld bytes of index and "
+          "buffer\n",
+          table_stats.state_count, table_stats.table_bytes,
+          table_stats.spilled_bytes, table_stats.set_reads,
+          table_stats.peak_memory);
+}
 
-  automaton_t automaton = convert_ast_to_automaton(&ast);
-  delete_ast(ast);
-  if (output_debug_info) {
-    fprintf(out_file, "--- NFA:\n");
-    print_automaton(&automaton, out_file);
-    fprintf(out_file, "\n");
+/**
+ * Compiles the given pattern to machine code (see {@code
+ * regex2c_compile_jit}), and prints the length and end tag of the longest
+ * accepted prefix of every line of the match file.
+ */
+static void match_lines(char *pattern, size_t length,
+                        regex2c_options_t *options, regex2c_result_t *result) {
+  FILE *fmatch = fopen(match_file_name, "r");
+  if (fmatch == NULL) {
+    errx(EXIT_FAILURE, "Cannot open file \"%s\"\n", match_file_name);
   }
+  jit_matcher_t matcher;
+  regex2c_compile_jit(pattern, length, options, &matcher, result);
+  check_result(result);
 
-  automaton_t d_automaton = determinize(&automaton);
-  delete_automaton(automaton);
-  if (output_debug_info) {
-    fprintf(out_file, "--- DFA:\n");
-    print_automaton(&d_automaton, out_file);
-    fprintf(out_file, "\n");
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t line_length;
+  while ((line_length = getline(&line, &capacity, fmatch)) != -1) {
+    if (line_length > 0 && line[line_length - 1] == '\n') {
+      line_length--;
+    }
+    unsigned char *input = (unsigned char *)line;
+    int tag = -1;
+    long matched = matcher.match(input, input + line_length, &tag);
+    if (all_tags && tag != -1) {
+      // Print the tags of the set, separated by commas
+      const int *tags;
+      int count = get_tag_set(&result->tag_sets, tag, &tags);
+      fprintf(out_file, "%ld ", matched);
+      for (int i = 0; i < count; i++) {
+        fprintf(out_file, "%d%s", tags[i], i + 1 < count ? "," : "\n");
+      }
+    } else {
+      fprintf(out_file, "%ld %d\n", matched, tag);
+    }
   }
+  free(line);
+  fclose(fmatch);
+  delete_jit_matcher(&matcher);
+}
 
-  automaton_t m_automaton = minimize(&d_automaton);
-  delete_automaton(d_automaton);
-  if (output_debug_info) {
-    fprintf(out_file, "--- Minimal DFA:\n");
-    print_automaton(&m_automaton, out_file);
-    fprintf(out_file, "\n--- C code:\n");
+/**
+ * Compiles the batch of the manifest into one translation unit, or into a
+ * header with static inline parsers if the output file name ends with ".h".
+ */
+static void compile_manifest() {
+  regex2c_options_t options = {.construction = construction,
+                               .backend = backend,
+                               .budget = budget,
+                               .flags = codegen_flags};
+  batch_t batch;
+  char *error;
+  if (!read_batch_manifest(manifest_file_name, &options, &batch, &error)) {
+    errx(EXIT_FAILURE, "Invalid batch: %s", error);
+  }
+  size_t name_length = out_file_name != NULL ? strlen(out_file_name) : 0;
+  bool_t header =
+      name_length > 2 && strcmp(out_file_name + name_length - 2, ".h") == 0;
+  if (header) {
+    options.flags |= REGEX2C_PARSER_DECL_STATIC | REGEX2C_PARSER_DECL_INLINE;
+  }
+  if (jobs == 0) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = processors > 0 ? processors : 1;
   }
 
-  print_automaton_to_c_code(m_automaton, "parse", "consume_next", "accept",
-                            "reject", 0, out_file);
+  int failed = compile_batch(&batch, &options, jobs);
+  if (failed != -1) {
+    batch_entry_t *entry = &batch.entries[failed];
+    errx(EXIT_FAILURE, "Rejected \"%s\" (line %d) at char %d: %s",
+         entry->name, entry->line, (int)entry->result.error_position,
+         entry->result.error);
+  }
+  for (int i = 0; i < batch.entry_count; i++) {
+    if (batch.entries[i].result.blowup_subexpression != NULL) {
+      warnx("DFA budget exceeded by \"%s\", falling back to NFA simulation "
+            "(subexpression causing the blowup: %s)",
+            batch.entries[i].name,
+            batch.entries[i].result.blowup_subexpression);
+    }
+    print_warnings(batch.entries[i].name, batch.entries[i].result.warnings);
+  }
+  long table_bytes = 0;
+  long dense_table_bytes = 0;
+  for (int i = 0; i < batch.entry_count; i++) {
+    if (batch.entries[i].result.stats.table_bytes != -1) {
+      table_bytes += batch.entries[i].result.stats.table_bytes;
+      dense_table_bytes += batch.entries[i].result.stats.dense_table_bytes;
+    }
+  }
+  if (table_bytes > 0) {
+    print_table_size(table_bytes, dense_table_bytes);
+  }
+  if (header && backend != CPP_HEADER_BACKEND) {
+    fprintf(out_file, "#pragma once\n\n");
+  }
+  print_batch(&batch, &options, out_file);
+  delete_batch(&batch);
+}
 
-  delete_automaton(m_automaton);
+int main(int argc, char **argv) {
+  parse_args(&argc, &argv);
+  if (manifest_file_name != NULL) {
+    compile_manifest();
+    return EXIT_SUCCESS;
+  }
+  size_t length;
+  char *pattern = read_input(&length);
+  regex2c_options_t options = {.construction = construction,
+                               .backend = backend,
+                               .budget = budget,
+                               .flags = codegen_flags,
+                               .whitespace_ends = 1,
+                               .rules = read_rules,
+                               .cache_dir = cache_dir_name,
+                               .all_tags = all_tags,
+                               .verify = verify,
+                               .profile_file_name = profile_file_name,
+                               .debug_file =
+                                   output_debug_info ? out_file : NULL};
+  regex2c_result_t result;
+  if (table_file_name != NULL) {
+    write_table_file(pattern, length, &options, &result);
+  } else if (match_file_name != NULL) {
+    match_lines(pattern, length, &options, &result);
+  } else {
+    regex2c_compile(pattern, length, &options, &result);
+    check_result(&result);
+    if (result.stats.table_bytes != -1) {
+      print_table_size(result.stats.table_bytes,
+                       result.stats.dense_table_bytes);
+    }
+    fwrite(result.code, 1, result.code_length, out_file);
+  }
+  write_stats(&result.stats);
+  delete_regex2c_result(&result);
+  free(pattern);
+  return EXIT_SUCCESS;
 }
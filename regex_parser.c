@@ -2,37 +2,215 @@
 
 #include "ast.h"
 #include "common.h"
+#include "utf8.h"
 
-#include <err.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-extern int peek_next();
-extern int consume_next();
-extern int reject(char *err, ...);
-extern bool_t is_end(int c);
-extern ast_t *get_definition(char *name);
+typedef enum char_kind {
+  BYTE_CHAR,      // a byte: an ASCII char or a \x escape
+  CODEPOINT_CHAR, // a codepoint: a \u escape or a UTF-8 encoded char
+  CATEGORY_CHAR,  // a set of codepoints: a \p or \P escape
+} char_kind_t;
 
-int consume_hex_char() {
-  int c = consume_next();
+// After an error, the parser sees EOF, so it finishes the (incomplete) ast
+// without reading further
+
+int peek(regex_parser_t *parser) {
+  return parser->error != NULL ? EOF : parser->peek_next(parser->data);
+}
+
+int consume(regex_parser_t *parser) {
+  if (parser->error != NULL) {
+    return EOF;
+  }
+  parser->position++;
+  return parser->consume_next(parser->data);
+}
+
+static void reject(regex_parser_t *parser, char *err, ...) {
+  if (parser->error != NULL) {
+    // Only the first error is kept, the others follow from it
+    return;
+  }
+  va_list args;
+  va_start(args, err);
+  if (vasprintf(&parser->error, err, args) == -1) {
+    parser->error = NULL;
+  }
+  va_end(args);
+  if (parser->error == NULL) {
+    parser->error = create_string("out of memory").data;
+  }
+}
+
+/**
+ * Rejects with the given {@code err}, whose only conversion is a {@code %s}
+ * of the char {@code c} (see {@code print_char}).
+ */
+static void reject_char(regex_parser_t *parser, char *err, int c) {
+  char buffer[CHAR_BUFFER_SIZE];
+  reject(parser, err, sprint_char(c, buffer));
+}
+
+bool_t is_end(regex_parser_t *parser, int c) {
+  return c == EOF ||
+         (parser->is_end != NULL && parser->is_end(parser->data, c));
+}
+
+ast_t *get_definition(regex_parser_t *parser, char *name) {
+  if (parser->get_definition == NULL) {
+    return NULL;
+  }
+  return parser->get_definition(parser->data, name);
+}
+
+// Bounds of repetitions may not be larger than this
+#define MAX_REPEAT_BOUND 65535
+// Repetitions may not expand to more terminals than this (nested repetitions
+// multiply, so the bounds alone do not limit the size of the automata)
+#define MAX_REPEAT_TERMINALS (1 << 17)
+
+int consume_hex_char(regex_parser_t *parser) {
+  int c = consume(parser);
   if (c >= '0' && c <= '9') {
     return c - '0' + 0x0;
   }
-  if (c >= 'a' && c <= 'z') {
+  if (c >= 'a' && c <= 'f') {
     return c - 'a' + 0xa;
   }
-  if (c >= 'A' && c <= 'Z') {
+  if (c >= 'A' && c <= 'F') {
     return c - 'A' + 0xA;
   }
-  reject("escaped hex char: unexpected char: '%s'", print_char(c));
+  reject_char(parser, "escaped hex char: unexpected char: '%s'", c);
   return 0;
 }
 
-int consume_char_() {
-  if (peek_next() == '\\') {
-    consume_next();
-    switch (peek_next()) {
+/**
+ * Consumes the hex digits and the closing '}' of a codepoint escape
+ * (\u{...}), or exactly 4 hex digits (\uHHHH). The 'u' must have been
+ * consumed already.
+ */
+int consume_codepoint_escape(regex_parser_t *parser) {
+  int codepoint = 0;
+  if (peek(parser) != '{') {
+    for (int i = 0; i < 4; i++) {
+      codepoint = codepoint * 0x10 + consume_hex_char(parser);
+    }
+  } else {
+    consume(parser);
+    int digits = 0;
+    while (peek(parser) != '}' && peek(parser) != EOF) {
+      codepoint = codepoint * 0x10 + consume_hex_char(parser);
+      if (++digits > 6) {
+        reject(parser, "codepoint escape: more than 6 hex digits");
+      }
+    }
+    if (digits == 0) {
+      reject(parser, "codepoint escape: missing hex digits");
+    }
+    if (peek(parser) != '}') {
+      reject(parser, "codepoint escape: missing closing '}'");
+    }
+    consume(parser);
+  }
+  if (codepoint > MAX_CODEPOINT ||
+      (codepoint >= FIRST_SURROGATE && codepoint <= LAST_SURROGATE)) {
+    reject(parser, "codepoint escape: U+%X is not a unicode scalar value",
+           codepoint);
+  }
+  return codepoint;
+}
+
+/**
+ * Consumes the name of a general category and the closing '}' of a category
+ * escape (\p{...} or \P{...}), and adds its codepoints (or all others, if
+ * {@code inverted}) to {@code codepoints}. The 'p' or 'P' must have been
+ * consumed already.
+ */
+void consume_category_escape(regex_parser_t *parser, bool_t inverted,
+                             codepoint_set_t *codepoints) {
+  if (peek(parser) != '{') {
+    reject(parser, "category escape: missing opening '{'");
+    return;
+  }
+  consume(parser);
+  string_t name = create_string(NULL);
+  while (peek(parser) != '}' && !is_end(parser, peek(parser))) {
+    append_char_to_str(&name, consume(parser));
+  }
+  if (peek(parser) != '}') {
+    reject(parser, "category escape: missing closing '}'");
+  }
+  consume(parser);
+  codepoint_set_t category = create_codepoint_set();
+  if (parser->error == NULL &&
+      !add_unicode_category(&category, name.data != NULL ? name.data : "")) {
+    reject(parser, "category escape: unknown general category: '%s'",
+           name.data != NULL ? name.data : "");
+  }
+  normalize_codepoint_set(&category);
+  if (inverted) {
+    invert_codepoint_set(&category);
+  }
+  for (int i = 0; i < category.range_count; i++) {
+    add_codepoint_range(codepoints, category.ranges[i].first,
+                        category.ranges[i].last);
+  }
+  delete_codepoint_set(&category);
+  free(name.data);
+}
+
+/**
+ * Consumes a UTF-8 encoded char (which is not ASCII) and returns its
+ * codepoint. Overlong encodings and surrogates are rejected.
+ */
+int consume_utf8_char(regex_parser_t *parser) {
+  int c = consume(parser);
+  int length;
+  int codepoint;
+  if (c >= 0xc2 && c <= 0xdf) {
+    length = 2;
+    codepoint = c & 0x1f;
+  } else if (c >= 0xe0 && c <= 0xef) {
+    length = 3;
+    codepoint = c & 0x0f;
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    length = 4;
+    codepoint = c & 0x07;
+  } else {
+    reject_char(parser, "UTF-8 char: unexpected byte: '%s'", c);
+    return 0;
+  }
+  for (int i = 1; i < length; i++) {
+    if (peek(parser) < 0x80 || peek(parser) > 0xbf) {
+      reject_char(parser, "UTF-8 char: unexpected continuation byte: '%s'",
+                  peek(parser));
+      return 0;
+    }
+    codepoint = (codepoint << 6) | (consume(parser) & 0x3f);
+  }
+  static const int FIRST_OF_LENGTH[] = {0, 0, 0x80, 0x800, 0x10000};
+  if (codepoint < FIRST_OF_LENGTH[length] || codepoint > MAX_CODEPOINT ||
+      (codepoint >= FIRST_SURROGATE && codepoint <= LAST_SURROGATE)) {
+    reject(parser, "UTF-8 char: invalid encoding of U+%X", codepoint);
+  }
+  return codepoint;
+}
+
+/**
+ * Consumes a single char, an escaped char or a UTF-8 encoded char and returns
+ * it; its kind is stored into {@code kind}. Category escapes add their
+ * codepoints to {@code codepoints} instead (and return 0).
+ */
+int consume_char_(regex_parser_t *parser, char_kind_t *kind,
+                  codepoint_set_t *codepoints) {
+  *kind = BYTE_CHAR;
+  if (peek(parser) == '\\') {
+    consume(parser);
+    switch (peek(parser)) {
     case '[':
     case ']':
     case '(':
@@ -46,36 +224,48 @@ int consume_char_() {
     case '*':
     case '+':
     case '?':
+    case '&':
+    case '~':
     case '\\':
-      return consume_next();
+      return consume(parser);
     case '0':
-      consume_next();
+      consume(parser);
       return 0;
     case 't':
-      consume_next();
+      consume(parser);
       return 9;
     case 'n':
-      consume_next();
+      consume(parser);
       return 10;
     case 's':
-      consume_next();
+      consume(parser);
       return 32;
     case 'r':
-      consume_next();
+      consume(parser);
       return 13;
     case 'x':
-      consume_next();
-      int c = consume_hex_char();
-      c += consume_hex_char() * 0x10;
-      printf("Consumed char: %d\n", c);
+      consume(parser);
+      int c = consume_hex_char(parser) * 0x10;
+      c += consume_hex_char(parser);
       return c;
+    case 'u':
+      consume(parser);
+      *kind = CODEPOINT_CHAR;
+      return consume_codepoint_escape(parser);
+    case 'p':
+    case 'P': {
+      bool_t inverted = consume(parser) == 'P';
+      *kind = CATEGORY_CHAR;
+      consume_category_escape(parser, inverted, codepoints);
+      return 0;
+    }
     default:
       // EOF and non-special chars cannot be escaped
-      reject("escaped char: unexpected char after '\\': '%s'",
-             print_char(peek_next()));
+      reject_char(parser, "escaped char: unexpected char after '\\': '%s'",
+                  peek(parser));
     }
   }
-  switch (peek_next()) {
+  switch (peek(parser)) {
   case '[':
   case ']':
   case '(':
@@ -89,72 +279,146 @@ int consume_char_() {
   case '*':
   case '+':
   case '?':
+  case '&':
+  case '~':
   case '\\':
     // If these characters appear unescaped, it's an error
-    reject("unescaped char: unexpected (unescaped) char: '%s'",
-           print_char(peek_next()));
+    reject_char(parser, "unescaped char: unexpected (unescaped) char: '%s'",
+                peek(parser));
   }
-  switch (peek_next()) {
+  switch (peek(parser)) {
   case 0x21 ... 0x7e:
     // Includes alphanumerics and (some) special (printable) chars.
     // Special chars which are related to the regex syntax have been caughed
     // before.
-    return consume_next();
+    return consume(parser);
+  case 0x80 ... 0xff:
+    *kind = CODEPOINT_CHAR;
+    return consume_utf8_char(parser);
   default:
-    reject("unescaped char: unexpected char: '%s'", print_char(peek_next()));
+    reject_char(parser, "unescaped char: unexpected char: '%s'", peek(parser));
     return 0;
   }
 }
 
-ast_t consume_char() {
-  ast_t ast = {.type = CHAR, .terminal = consume_char_()};
+/**
+ * Creates a UTF-8 class of the given {@code codepoints}, which are normalized
+ * and (if {@code inverted}) inverted. The class owns the codepoints.
+ */
+ast_t create_utf8_class(codepoint_set_t *codepoints, bool_t inverted) {
+  normalize_codepoint_set(codepoints);
+  if (inverted) {
+    invert_codepoint_set(codepoints);
+  }
+  ast_t ast = {.type = UTF8_CLASS,
+               .codepoints = malloc(sizeof(codepoint_set_t)),
+               .automaton = NULL};
+  *ast.codepoints = *codepoints;
+  return ast;
+}
+
+ast_t consume_char(regex_parser_t *parser) {
+  char_kind_t kind;
+  codepoint_set_t codepoints = create_codepoint_set();
+  int c = consume_char_(parser, &kind, &codepoints);
+  if (kind == CATEGORY_CHAR) {
+    return create_utf8_class(&codepoints, 0);
+  }
+  delete_codepoint_set(&codepoints);
+  if (kind == BYTE_CHAR || c < 0x80) {
+    ast_t ast = {.type = CHAR, .terminal = c};
+    return ast;
+  }
+  // The bytes of the encoding
+  unsigned char bytes[4];
+  int length = encode_utf8(c, bytes);
+  ast_t ast = {.type = AND_EXPR, .children = NULL};
+  for (int i = 0; i < length; i++) {
+    ast_t byte = {.type = CHAR, .terminal = bytes[i]};
+    add_child(&ast, byte);
+  }
   return ast;
 }
 
-ast_t consume_wildcard() {
-  consume_next(); // consume '.'
+ast_t consume_wildcard(regex_parser_t *parser) {
+  consume(parser); // consume '.'
   ast_t ast = {.type = WILDCARD};
   return ast;
 }
 
-void consume_char_or_range(unsigned char *terminals) {
-  int c0 = consume_char_();
-  if (peek_next() == '-') {
-    consume_next();
-    int c1 = consume_char_();
+/**
+ * Consumes a char, a range or a category of a class. Bytes are stored into
+ * {@code terminals}, codepoints are added to {@code codepoints}, and {@code
+ * utf8} is set, if the class contains any codepoint.
+ */
+void consume_char_or_range(regex_parser_t *parser, unsigned char *terminals,
+                           codepoint_set_t *codepoints, bool_t *utf8) {
+  char_kind_t kind0;
+  int c0 = consume_char_(parser, &kind0, codepoints);
+  if (kind0 == CATEGORY_CHAR) {
+    *utf8 = 1;
+    if (peek(parser) == '-') {
+      reject(parser, "char range: a category cannot bound a range");
+    }
+    return;
+  }
+  if (peek(parser) == '-') {
+    consume(parser);
+    char_kind_t kind1;
+    int c1 = consume_char_(parser, &kind1, codepoints);
+    if (kind1 == CATEGORY_CHAR) {
+      reject(parser, "char range: a category cannot bound a range");
+    }
     if (c1 <= c0) {
       // start must be smaller than end
-      reject("char range: start is not lower than end");
+      reject(parser, "char range: start is not lower than end");
+    }
+    if (kind0 == CODEPOINT_CHAR || kind1 == CODEPOINT_CHAR) {
+      if ((kind0 == BYTE_CHAR && c0 > 0x7f) ||
+          (kind1 == BYTE_CHAR && c1 > 0x7f)) {
+        reject(parser, "char range: bytes above \\x7f cannot bound a range "
+                       "of codepoints");
+      }
+      *utf8 = 1;
+      add_codepoint_range(codepoints, c0, c1);
+      return;
     }
     for (int c = c0; c < c1 + 1; c++) {
       if (c < 0 || c >= 256) {
         // this may be unnecessary, but better be safe
-        reject("char range: invalid char encountered");
+        reject(parser, "char range: invalid char encountered");
       }
       terminals[c] = 1;
     }
+  } else if (kind0 == CODEPOINT_CHAR) {
+    *utf8 = 1;
+    add_codepoint_range(codepoints, c0, c0);
   } else {
     terminals[c0] = 1;
   }
 }
 
-ast_t consume_reference() {
-  consume_next(); // consume '{'
+/**
+ * Consumes the name of a reference and the closing '}'. The opening '{' must
+ * have been consumed already.
+ */
+ast_t consume_reference_name(regex_parser_t *parser) {
   ast_t ast = {.type = REFERENCE, .reference = NULL};
   string_t name = create_string(NULL);
   while (1) {
-    switch (peek_next()) {
+    switch (peek(parser)) {
     case 'a' ... 'z':
     case 'A' ... 'Z':
     case '0' ... '9':
     case '_':
-      append_char_to_str(&name, consume_next());
+      append_char_to_str(&name, consume(parser));
       break;
     case '}':
-      consume_next();
-      ast_t *ref = get_definition(name.data);
+      consume(parser);
+      ast_t *ref = get_definition(parser, name.data);
       if (ref == NULL) {
-        reject("regular definition reference: regular definition with name "
+        reject(parser,
+               "regular definition reference: regular definition with name "
                "does not exist: '%s'",
                name.data);
       }
@@ -162,22 +426,51 @@ ast_t consume_reference() {
       free(name.data);
       return ast;
     default:
-      reject("regular definition reference: unexpected char: '%s'",
-             print_char(peek_next()));
+      reject_char(parser, "regular definition reference: unexpected char: '%s'",
+                  peek(parser));
+      free(name.data);
+      return ast;
+    }
+  }
+}
+
+ast_t consume_reference(regex_parser_t *parser) {
+  consume(parser); // consume '{'
+  return consume_reference_name(parser);
+}
+
+/**
+ * Converts the given byte class {@code ast} into a UTF-8 class, which also
+ * contains the given {@code codepoints}. The bytes must be ASCII.
+ */
+ast_t convert_class_to_utf8_class(regex_parser_t *parser, ast_t ast,
+                                  codepoint_set_t *codepoints) {
+  for (int c = 0; c < 256; c++) {
+    if (!ast.terminals[c]) {
+      continue;
+    }
+    if (c > 0x7f) {
+      reject(parser, "class: bytes above \\x7f cannot be mixed with "
+                     "codepoints");
     }
+    add_codepoint_range(codepoints, c, c);
   }
+  free(ast.terminals);
+  return create_utf8_class(codepoints, ast.type == INV_CLASS);
 }
 
-ast_t consume_class() {
-  consume_next(); // consume '['
+ast_t consume_class(regex_parser_t *parser) {
+  consume(parser); // consume '['
   ast_t ast = {.type = CLASS, .terminals = calloc(256, sizeof(unsigned char))};
-  if (peek_next() == '^') {
-    consume_next();
+  if (peek(parser) == '^') {
+    consume(parser);
     ast.type = INV_CLASS;
   }
+  codepoint_set_t codepoints = create_codepoint_set();
+  bool_t utf8 = 0;
   while (1) {
-    consume_char_or_range(ast.terminals);
-    switch (peek_next()) {
+    consume_char_or_range(parser, ast.terminals, &codepoints, &utf8);
+    switch (peek(parser)) {
     case '[':
     case '(':
     case ')':
@@ -190,39 +483,107 @@ ast_t consume_class() {
     case '*':
     case '+':
     case '?':
+    case '&':
+    case '~':
     case EOF:
       // these special chars can never be inside a class at this points
-      reject("class: unexpected char: '%s'", print_char(peek_next()));
+      reject_char(parser, "class: unexpected char: '%s'", peek(parser));
     case ']':
-      consume_next();
-      return ast;
+      consume(parser);
+      if (!utf8) {
+        delete_codepoint_set(&codepoints);
+        return ast;
+      }
+      return convert_class_to_utf8_class(parser, ast, &codepoints);
+    }
+  }
+}
+
+ast_t consume_or_expr(regex_parser_t *parser);
+
+/**
+ * Returns 1 if a capture group named {@code name} was already parsed, 0
+ * otherwise.
+ */
+static bool_t has_capture_name(regex_parser_t *parser, char *name) {
+  for (int k = 0; k < parser->capture_count; k++) {
+    if (strcmp(parser->capture_names[k], name) == 0) {
+      return 1;
     }
   }
+  return 0;
 }
 
-ast_t consume_or_expr();
+/**
+ * Consumes the name of a capture group, a c identifier, and the closing '>'.
+ * The "(?<" must have been consumed already. A name used before and the name
+ * of the enumerator of the capture count are rejected.
+ */
+char *consume_capture_name(regex_parser_t *parser) {
+  string_t name = create_string(NULL);
+  while ((peek(parser) >= 'a' && peek(parser) <= 'z') ||
+         (peek(parser) >= 'A' && peek(parser) <= 'Z') || peek(parser) == '_' ||
+         (name.length > 0 && peek(parser) >= '0' && peek(parser) <= '9')) {
+    append_char_to_str(&name, consume(parser));
+  }
+  if (name.length == 0) {
+    reject_char(parser, "capture group: unexpected char: '%s' (expected name)",
+                peek(parser));
+  } else if (peek(parser) != '>') {
+    reject_char(parser, "capture group: unexpected char: '%s' (expected '>')",
+                peek(parser));
+  } else if (strcmp(name.data, "capture_count") == 0) {
+    reject(parser, "capture group: the name 'capture_count' is reserved");
+  } else if (has_capture_name(parser, name.data)) {
+    reject(parser, "capture group: the name '%s' is already used", name.data);
+  } else {
+    parser->capture_names =
+        realloc(parser->capture_names,
+                (parser->capture_count + 1) * sizeof(char *));
+    parser->capture_names[parser->capture_count++] = name.data;
+  }
+  consume(parser);
+  return name.data;
+}
 
-ast_t consume_parentheses() {
-  consume_next(); // consume ')'
-  ast_t ast = consume_or_expr();
-  if (peek_next() != ')') {
+ast_t consume_parentheses(regex_parser_t *parser) {
+  consume(parser); // consume '('
+  char *capture_name = NULL;
+  if (peek(parser) == '?') {
+    consume(parser);
+    if (peek(parser) != '<') {
+      reject_char(parser, "capture group: unexpected char: '%s' (expected '<')",
+                  peek(parser));
+    }
+    consume(parser);
+    capture_name = consume_capture_name(parser);
+  }
+  ast_t ast = consume_or_expr(parser);
+  if (peek(parser) != ')') {
     // missing closing ')'
-    reject("parentheses: missing closing ')'");
+    reject(parser, "parentheses: missing closing ')'");
   }
-  consume_next();
-  return ast;
+  consume(parser);
+  if (capture_name == NULL) {
+    return ast;
+  }
+  ast_t capture = {.type = CAPTURE_GROUP,
+                   .children = NULL,
+                   .capture_name = capture_name};
+  add_child(&capture, ast);
+  return capture;
 }
 
-ast_t consume_single() {
-  switch (peek_next()) {
+ast_t consume_single(regex_parser_t *parser) {
+  switch (peek(parser)) {
   case '{':
-    return consume_reference();
+    return consume_reference(parser);
   case '[':
-    return consume_class();
+    return consume_class(parser);
   case '(':
-    return consume_parentheses();
+    return consume_parentheses(parser);
   case '.':
-    return consume_wildcard();
+    return consume_wildcard(parser);
   case ']':
   case ')':
   case '}':
@@ -232,15 +593,18 @@ ast_t consume_single() {
   case '*':
   case '+':
   case '?':
+  case '&':
+  case '~':
   case EOF:
-    reject("single: unexpected char: '%s'", print_char(peek_next()));
+    reject_char(parser, "single: unexpected char: '%s'", peek(parser));
   default:
-    return consume_char();
+    return consume_char(parser);
   }
 }
 
-ast_t make_modifier(ast_type_t modifier_type, ast_t child) {
-  consume_next(); // consume the modifier char
+ast_t make_modifier(regex_parser_t *parser, ast_type_t modifier_type,
+                    ast_t child) {
+  consume(parser); // consume the modifier char
   ast_t ast = {.type = modifier_type,
                .children = malloc(sizeof(ast_child_list_t))};
   ast.children->next = NULL;
@@ -248,27 +612,88 @@ ast_t make_modifier(ast_type_t modifier_type, ast_t child) {
   return ast;
 }
 
-ast_t consume_modifier() {
-  ast_t ast = consume_single();
-  switch (peek_next()) {
+int consume_repeat_bound(regex_parser_t *parser) {
+  if (peek(parser) < '0' || peek(parser) > '9') {
+    reject_char(parser, "repetition: unexpected char: '%s' (expected digit)",
+                peek(parser));
+  }
+  int bound = 0;
+  while (peek(parser) >= '0' && peek(parser) <= '9') {
+    bound = bound * 10 + consume(parser) - '0';
+    if (bound > MAX_REPEAT_BOUND) {
+      reject(parser, "repetition: bound is larger than %d", MAX_REPEAT_BOUND);
+    }
+  }
+  return bound;
+}
+
+/**
+ * Consumes the bounds of a repetition ({n}, {n,} or {n,m}) of the given
+ * {@code child}. The opening '{' must have been consumed already.
+ */
+ast_t make_repeat_modifier(regex_parser_t *parser, ast_t child) {
+  ast_t ast = {.type = REPEAT_MODIFIER,
+               .children = malloc(sizeof(ast_child_list_t))};
+  ast.children->next = NULL;
+  ast.children->child = child;
+  ast.repeat_min = consume_repeat_bound(parser);
+  ast.repeat_max = ast.repeat_min;
+  if (peek(parser) == ',') {
+    consume(parser);
+    ast.repeat_max = peek(parser) == '}' ? -1 : consume_repeat_bound(parser);
+  }
+  if (peek(parser) != '}') {
+    reject(parser, "repetition: missing closing '}'");
+  }
+  consume(parser);
+  if (ast.repeat_max != -1 && ast.repeat_max < ast.repeat_min) {
+    reject(parser, "repetition: upper bound is lower than lower bound");
+  }
+  // The child is incomplete after an error, so it is not measured then
+  if (parser->error == NULL &&
+      get_expanded_terminal_count(&ast) > MAX_REPEAT_TERMINALS) {
+    reject(parser, "repetition: expands to more than %d terminals",
+           MAX_REPEAT_TERMINALS);
+  }
+  return ast;
+}
+
+ast_t consume_modifier_of(regex_parser_t *parser, ast_t ast) {
+  switch (peek(parser)) {
   case '*':
-    return make_modifier(STAR_MODIFIER, ast);
+    return make_modifier(parser, STAR_MODIFIER, ast);
   case '+':
-    return make_modifier(PLUS_MODIFIER, ast);
+    return make_modifier(parser, PLUS_MODIFIER, ast);
   case '?':
-    return make_modifier(OPT_MODIFIER, ast);
+    return make_modifier(parser, OPT_MODIFIER, ast);
+  case '{':
+    consume(parser);
+    if (peek(parser) >= '0' && peek(parser) <= '9') {
+      return make_repeat_modifier(parser, ast);
+    }
+    // Not a repetition, but a reference following the single. The reference
+    // may have a modifier itself.
+    ast_t and = {.type = AND_EXPR, .children = NULL};
+    add_child(&and, ast);
+    add_child(&and,
+              consume_modifier_of(parser, consume_reference_name(parser)));
+    return and;
   default:
     return ast;
   }
 }
 
-ast_t consume_and_expr() {
+ast_t consume_modifier(regex_parser_t *parser) {
+  return consume_modifier_of(parser, consume_single(parser));
+}
+
+ast_t consume_and_expr(regex_parser_t *parser) {
   ast_t ast = {.type = AND_EXPR, .children = NULL};
   int c = 0;
   while (1) {
-    ast_t inner = consume_modifier();
+    ast_t inner = consume_modifier(parser);
     c++;
-    switch (peek_next()) {
+    switch (peek(parser)) {
     case ']':
     case '}':
     case '-':
@@ -276,17 +701,19 @@ ast_t consume_and_expr() {
     case '*':
     case '+':
     case '?':
+    case '~':
       // this token can never come after a single
-      reject("and expr: unexpected char: '%s'", print_char(peek_next()));
+      reject_char(parser, "and expr: unexpected char: '%s'", peek(parser));
     case ')':
     case '|':
+    case '&':
       if (c == 1) {
         return inner;
       }
       add_child(&ast, inner);
       return ast;
     default:
-      if (is_end(peek_next())) {
+      if (is_end(parser, peek(parser))) {
         if (c == 1) {
           return inner;
         }
@@ -298,13 +725,41 @@ ast_t consume_and_expr() {
   }
 }
 
-ast_t consume_or_expr() {
+ast_t consume_complement_expr(regex_parser_t *parser) {
+  if (peek(parser) != '~') {
+    return consume_and_expr(parser);
+  }
+  consume(parser);
+  ast_t ast = {.type = COMPLEMENT_EXPR, .children = NULL};
+  add_child(&ast, consume_complement_expr(parser));
+  return ast;
+}
+
+ast_t consume_intersection_expr(regex_parser_t *parser) {
+  ast_t ast = {.type = INTERSECTION_EXPR, .children = NULL};
+  int c = 0;
+  while (1) {
+    ast_t inner = consume_complement_expr(parser);
+    c++;
+    if (peek(parser) != '&') {
+      if (c == 1) {
+        return inner;
+      }
+      add_child(&ast, inner);
+      return ast;
+    }
+    add_child(&ast, inner);
+    consume(parser);
+  }
+}
+
+ast_t consume_or_expr(regex_parser_t *parser) {
   ast_t ast = {.type = OR_EXPR, .children = NULL};
   int c = 0;
   while (1) {
-    ast_t inner = consume_and_expr();
+    ast_t inner = consume_intersection_expr(parser);
     c++;
-    if (peek_next() != '|') {
+    if (peek(parser) != '|') {
       if (c == 1) {
         return inner;
       }
@@ -312,16 +767,21 @@ ast_t consume_or_expr() {
       return ast;
     }
     add_child(&ast, inner);
-    consume_next();
+    consume(parser);
   }
 }
 
-ast_t consume_regex_expr() {
-  ast_t ast = consume_or_expr();
-  if (!is_end(peek_next())) {
-    reject("regex ex: unexpected char after expression: '%s' (expected ending "
-           "character)",
-           print_char(peek_next()));
+ast_t consume_regex_expr(regex_parser_t *parser) {
+  ast_t ast = consume_or_expr(parser);
+  if (!is_end(parser, peek(parser))) {
+    reject_char(parser,
+                "regex ex: unexpected char after expression: '%s' (expected "
+                "ending character)",
+                peek(parser));
   }
+  // The names belong to the AST
+  free(parser->capture_names);
+  parser->capture_names = NULL;
+  parser->capture_count = 0;
   return ast;
 }
@@ -1,39 +1,77 @@
 #pragma once
 
 #include "ast.h"
+#include "common.h"
+
+#include <stddef.h>
 
 /**
- * Consumes all chars (using the functions {@code peek_next} and {@code
- * consume_next}) until EOF is reached. Tries to parse the consumed chars as a
- * regex string. Returns the AST of the parsed regular expression if successful.
- * If not, the function {@code reject} is called.
+ * The input and the state of a regex parser. There is no global state, so
+ * several parsers can run at once (e.g. on different threads).
  *
- * This function expects the following functions to be implemented:
+ * peek_next      returns the next char, without consuming it, or EOF
+ * consume_next   returns and consumes the next char
+ * is_end         returns 1, when the given char ends the expression, or 0 (EOF
+ *                always ends the expression; may be NULL)
+ * get_definition returns the AST of the given regular definition, or NULL (may
+ *                be NULL, if there are no definitions)
  *
- * int peek_next();
- * int consume_next();
- * int reject(char *err, ...);
- * bool_t is_end(int c);
- * ast_t *get_definition(char *name);
+ * All functions get {@code data} as first argument. {@code error}, {@code
+ * position}, {@code capture_names} and {@code capture_count} must be
+ * initialized with {@code NULL} and {@code 0}.
+ */
+typedef struct regex_parser {
+  int (*peek_next)(void *data);
+  int (*consume_next)(void *data);
+  bool_t (*is_end)(void *data, int c);
+  ast_t *(*get_definition)(void *data, char *name);
+  void *data;
+  char *error;     // the message of the first error, NULL if there is none
+  size_t position; // the number of consumed chars
+  char **capture_names; // of the groups parsed so far, owned by their ASTs
+  int capture_count;
+} regex_parser_t;
+
+/**
+ * Consumes chars from the given {@code parser} until the end of the expression
+ * is reached and parses them as a regex string. Returns the AST of the parsed
+ * regular expression.
  *
- * peek_next      returns the next char, without consuming it
- * consume_next   returns and consumes the next char
- * reject         is called, when the given input sequence cannot be parsed
- * is_end         returns 1, when the given char ends the expression, or 0
- * get_definition returns the AST of the given regular definition, or NULL
+ * If the chars cannot be parsed, the message of the first error is stored into
+ * {@code parser->error} (which must be freed by the caller) and nothing more is
+ * consumed. The returned AST is incomplete in that case, but can be deleted as
+ * usual.
  *
  * The regex syntax mostly follows today's conventions, with a few exceptions:
  *
- * There are no backreferences or capture groups.
+ * There are no backreferences. {@code (?<name>a)} is a capture group named
+ * {@code name} (a c identifier), which is otherwise the same as {@code (a)};
+ * only tagged DFAs (see {@code tagged_dfa.h}) record its submatch. The names
+ * of the groups must differ and must not be {@code capture_count}, since they
+ * are declared along with it as enumerators (see {@code tagged_dfa2c.h}).
  * The syntax for including a regular definitions is:
  * {@code ...{NAME_OF_THE_DEFINITION}...}
  * The names of definitions may contain alphanumerical letters and '_'
  *
+ * Bounded repetitions are written as {@code a{n}} (exactly n times), {@code
+ * a{n,}} (at least n times) and {@code a{n,m}} (n to m times), with bounds up
+ * to 65535. A repetition, expanded into copies of its child (with nested
+ * repetitions expanded as well), may have at most 131072 terminals. A '{'
+ * directly after a single followed by a digit always starts a repetition, so
+ * names of definitions used there must not start with a digit.
+ *
+ * {@code a&b} matches the strings matched by both {@code a} and {@code b},
+ * and {@code ~a} matches all strings not matched by {@code a}. '|' binds
+ * weakest, then '&', then '~', then concatenation, so {@code ~ab&c|d} is
+ * {@code ((~(ab))&c)|d}. Both are built as product automata of the DFAs of
+ * their operands, so a filter like {@code [a-z]+&~(.*bad.*)} is matched in a
+ * single pass.
+ *
  * The following special chars must be (always!) escaped in the regex:
- * ()[]{}+*?\.|^
+ * ()[]{}+*?\.|^&~
  *
  * The following chars do not need to be escaped
- * 0-9a-zA-Z!"#$%&',/:;<=>@_`~
+ * 0-9a-zA-Z!"#$%',/:;<=>@_`
  *
  * The following escape codes exist:
  * \0 for null character
@@ -42,8 +80,17 @@
  * \t for tab
  * \s for space
  * \x__ for specifying the char hex code
+ * \u{_} for specifying a codepoint by 1 to 6 hex digits (or \u____)
+ * \p{_} for the codepoints of a general category (e.g. L, Lu, Letter, Any)
+ * \P{_} for all other codepoints
+ *
+ * Chars above 0x7f must be valid UTF-8 and match the bytes of their encoding.
+ * A class containing codepoints (UTF-8 chars, \u or \p escapes), e.g. {@code
+ * [Ѐ-ӿ]}, matches the UTF-8 encodings of its codepoints, and its inverse all
+ * other codepoints; such classes cannot contain bytes above \x7f. Other
+ * classes and '.' match single bytes.
  *
  * All other characters are rejected!
  *
  */
-ast_t consume_regex_expr();
+ast_t consume_regex_expr(regex_parser_t *parser);
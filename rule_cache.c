@@ -0,0 +1,361 @@
+#include "rule_cache.h"
+#include "ast.h"
+#include "common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A range of rules ends after a subrange, whose key (hashed with the level)
+// is 0 modulo this, so ranges have about this many subranges
+#define RANGE_FANOUT 4
+// The most subranges of a range, which bounds the products of a rebuild
+#define MAX_RANGE_CHILDREN 16
+
+/**
+ * A range of rules in the tree of ranges. Its DFA is the DFA of a single rule,
+ * or the product of the DFAs of its subranges.
+ */
+typedef struct rule_range {
+  int lo;            // the first rule of the range
+  int hi;            // the rule after the last rule of the range
+  unsigned long key; // the hash of the rule, or of the keys of the subranges
+  int first_child;   // the index of the first subrange, -1 for a single rule
+  int child_count;   // the number of subranges
+} rule_range_t;
+
+typedef struct rule_cache {
+  ast_t **rules;
+  rule_range_t *ranges; // the ranges of single rules first, the root last
+  char *directory;
+  rule_cache_stats_t *stats;
+  int error; // errno of the first cache file, which could not be written
+} rule_cache_t;
+
+static void print_edge_ranges(int node, edge_t *edge, FILE *fout) {
+  for (int t = 0; t < 256; t++) {
+    if (!edge->transitions[t]) {
+      continue;
+    }
+    int last = t;
+    while (last < 255 && edge->transitions[last + 1]) {
+      last++;
+    }
+    fprintf(fout, "edge %d %d %d %d\n", node, edge->target, t, last);
+    t = last;
+  }
+}
+
+bool_t write_automaton_file(char *path, unsigned long key,
+                            automaton_t *automaton) {
+  // Write to a temporary file first, so readers never see a partial file
+  char *tmp_path = NULL;
+  if (asprintf(&tmp_path, "%s.%d.tmp", path, (int)getpid()) == -1) {
+    return 0;
+  }
+  FILE *fout = fopen(tmp_path, "w");
+  if (fout == NULL) {
+    free(tmp_path);
+    return 0;
+  }
+  int N = automaton->max_node_count;
+  fprintf(fout, "regex2c-dfa %d\n", REGEX2C_RULE_CACHE_VERSION);
+  fprintf(fout, "key %lx\n", key);
+  fprintf(fout, "states %d\n", N);
+  fprintf(fout, "start %d\n", automaton->start_index);
+  for (int node = 0; node < N; node++) {
+    if (automaton->nodes[node].end_tag != -1) {
+      fprintf(fout, "node %d %d\n", node, automaton->nodes[node].end_tag);
+    }
+    for (int e = 0; e < automaton->nodes[node].edge_count; e++) {
+      print_edge_ranges(node, &automaton->nodes[node].edges[e], fout);
+    }
+  }
+  bool_t success = !ferror(fout);
+  success &= fclose(fout) == 0;
+  success = success && rename(tmp_path, path) == 0;
+  if (!success) {
+    int error = errno;
+    remove(tmp_path);
+    errno = error;
+  }
+  free(tmp_path);
+  return success;
+}
+
+static bool_t read_automaton_line(FILE *fin, unsigned long key,
+                                  automaton_t *automaton, bool_t *has_key) {
+  char keyword[16];
+  if (fscanf(fin, "%15s", keyword) != 1) {
+    return 0;
+  }
+  if (strcmp(keyword, "regex2c-dfa") == 0) {
+    int version;
+    return fscanf(fin, "%d", &version) == 1 &&
+           version == REGEX2C_RULE_CACHE_VERSION;
+  }
+  if (strcmp(keyword, "key") == 0) {
+    unsigned long file_key;
+    *has_key = fscanf(fin, "%lx", &file_key) == 1 && file_key == key;
+    return *has_key;
+  }
+  if (strcmp(keyword, "states") == 0) {
+    int state_count;
+    if (automaton->nodes != NULL || fscanf(fin, "%d", &state_count) != 1 ||
+        state_count <= 0) {
+      return 0;
+    }
+    *automaton = create_automaton(state_count);
+    automaton->next_node_index = state_count;
+    return 1;
+  }
+  if (automaton->nodes == NULL) {
+    // Nodes before the state count
+    return 0;
+  }
+  int N = automaton->max_node_count;
+  if (strcmp(keyword, "start") == 0) {
+    return fscanf(fin, "%d", &automaton->start_index) == 1 &&
+           automaton->start_index >= 0 && automaton->start_index < N;
+  }
+  if (strcmp(keyword, "node") == 0) {
+    int node, end_tag;
+    if (fscanf(fin, "%d %d", &node, &end_tag) != 2 || node < 0 || node >= N ||
+        end_tag < 0) {
+      return 0;
+    }
+    automaton->nodes[node].end_tag = end_tag;
+    return 1;
+  }
+  if (strcmp(keyword, "edge") == 0) {
+    int node, target, first, last;
+    if (fscanf(fin, "%d %d %d %d", &node, &target, &first, &last) != 4 ||
+        node < 0 || node >= N || target < 0 || target >= N || first < 0 ||
+        first > last || last > 255) {
+      return 0;
+    }
+    for (int t = first; t <= last; t++) {
+      connect_nodes(automaton, node, target, t, 0);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+bool_t read_automaton_file(char *path, unsigned long key,
+                           automaton_t *automaton) {
+  memset(automaton, 0, sizeof(automaton_t));
+  FILE *fin = fopen(path, "r");
+  if (fin == NULL) {
+    return 0;
+  }
+  bool_t has_key = 0;
+  bool_t success = 1;
+  int c;
+  while (success && (c = getc(fin)) != EOF) {
+    if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+      continue;
+    }
+    ungetc(c, fin);
+    success = read_automaton_line(fin, key, automaton, &has_key);
+  }
+  fclose(fin);
+  if (!success || !has_key || automaton->nodes == NULL) {
+    if (automaton->nodes != NULL) {
+      delete_automaton(*automaton);
+    }
+    memset(automaton, 0, sizeof(automaton_t));
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Returns whether a range of the given {@code level} ends after the subrange
+ * with the given {@code key}.
+ */
+static bool_t is_range_end(unsigned long key, int level) {
+  return hash_bytes(&level, sizeof(int), key) % RANGE_FANOUT == 0;
+}
+
+/**
+ * Builds the tree of ranges above the {@code count} ranges of single rules at
+ * the start of {@code cache->ranges}, and returns the index of its root. The
+ * ranges of every level are grouped into the ranges of the next level, which
+ * end after the ranges, whose key is a range end (see {@code is_range_end}),
+ * but have at least 2 (except for the last range of a level) and at most
+ * MAX_RANGE_CHILDREN subranges. Since the bounds of a range only depend on the
+ * keys of the rules around them, adding or removing a rule only changes the
+ * ranges next to it, and all other ranges keep their keys (bounds chosen by
+ * index would move behind every added or removed rule).
+ */
+static int build_range_tree(rule_cache_t *cache, int count) {
+  int level_start = 0;
+  int level_end = count;
+  for (int level = 1; level_end - level_start > 1; level++) {
+    int next = level_end;
+    int first = level_start;
+    while (first < level_end) {
+      int last = first;
+      while (last + 1 < level_end &&
+             (last == first || (last - first + 1 < MAX_RANGE_CHILDREN &&
+                                !is_range_end(cache->ranges[last].key,
+                                              level)))) {
+        last++;
+      }
+      rule_range_t *range = &cache->ranges[next++];
+      range->lo = cache->ranges[first].lo;
+      range->hi = cache->ranges[last].hi;
+      range->first_child = first;
+      range->child_count = last - first + 1;
+      // A range of a single subrange has the same DFA, and so the same key
+      range->key = cache->ranges[first].key;
+      for (int child = first + 1; child <= last; child++) {
+        range->key = hash_bytes(&cache->ranges[child].key,
+                                sizeof(unsigned long), range->key);
+      }
+      first = last + 1;
+    }
+    level_start = level_end;
+    level_end = next;
+  }
+  return level_start;
+}
+
+/**
+ * Returns the minimal DFA of the rule range at {@code index} of {@code
+ * cache->ranges}, tagged relative to its first rule.
+ */
+static automaton_t compile_rule_range(rule_cache_t *cache, int index) {
+  rule_range_t *range = &cache->ranges[index];
+  if (range->child_count == 1) {
+    return compile_rule_range(cache, range->first_child);
+  }
+  unsigned long key = range->key;
+  char *path = NULL;
+  automaton_t result;
+  if (cache->directory != NULL) {
+    if (asprintf(&path, "%s/%016lx.dfa", cache->directory, key) == -1) {
+      path = NULL;
+    } else if (read_automaton_file(path, key, &result)) {
+      cache->stats->loaded_dfas++;
+      free(path);
+      return result;
+    }
+  }
+
+  if (range->first_child == -1) {
+    automaton_t automaton = convert_ast_to_dfa(cache->rules[range->lo]);
+    result = minimize(&automaton);
+    delete_automaton(automaton);
+  } else {
+    // Minimal DFAs of the first subranges keep the next products small
+    result = compile_rule_range(cache, range->first_child);
+    for (int c = 1; c < range->child_count && result.nodes != NULL; c++) {
+      rule_range_t *child = &cache->ranges[range->first_child + c];
+      automaton_t right = compile_rule_range(cache, range->first_child + c);
+      automaton_t product = {.nodes = NULL};
+      if (right.nodes != NULL) {
+        product = union_automata(&result, &right, child->lo - range->lo);
+      }
+      delete_automaton(result);
+      delete_automaton(right);
+      result = product.nodes != NULL ? minimize(&product) : product;
+      delete_automaton(product);
+    }
+  }
+  if (result.nodes == NULL) {
+    // The product has too many states, the failure is passed up
+    free(path);
+    return result;
+  }
+  cache->stats->built_dfas++;
+  if (path != NULL) {
+    if (!write_automaton_file(path, key, &result) && cache->error == 0) {
+      cache->error = errno;
+    }
+    free(path);
+  } else if (cache->directory != NULL && cache->error == 0) {
+    cache->error = ENOMEM;
+  }
+  return result;
+}
+
+/**
+ * Creates the directory at {@code path} and its missing parents, like {@code
+ * mkdir -p}. Returns 0 if it cannot be created; {@code errno} describes the
+ * error then.
+ */
+static bool_t make_directories(char *path) {
+  char *prefix = create_string(path).data;
+  size_t length = strlen(prefix);
+  bool_t success = 1;
+  for (size_t i = 1; success && i <= length; i++) {
+    if (prefix[i] == '/' || prefix[i] == '\0') {
+      prefix[i] = '\0';
+      // An existing file instead of a directory fails below
+      success = mkdir(prefix, 0777) == 0 || errno == EEXIST;
+      prefix[i] = path[i];
+    }
+  }
+  free(prefix);
+  struct stat status;
+  if (!success || stat(path, &status) != 0) {
+    return 0;
+  }
+  if (!S_ISDIR(status.st_mode)) {
+    errno = ENOTDIR;
+    return 0;
+  }
+  return 1;
+}
+
+bool_t compile_rule_set(ast_list_t *ast_list, char *cache_dir,
+                        automaton_t *automaton, rule_cache_stats_t *stats) {
+  rule_cache_stats_t local_stats;
+  rule_cache_t cache = {.directory = cache_dir,
+                        .stats = stats != NULL ? stats : &local_stats};
+  memset(cache.stats, 0, sizeof(rule_cache_stats_t));
+  if (cache_dir != NULL && !make_directories(cache_dir)) {
+    // Build without the cache, but report the error
+    cache.error = errno;
+    cache.directory = NULL;
+  }
+  int count = 0;
+  for (ast_list_t *list = ast_list; list != NULL; list = list->next) {
+    count++;
+  }
+  cache.rules = malloc(count * sizeof(ast_t *));
+  // Every level has at most half (rounded up) as many ranges as the one below
+  cache.ranges = malloc((2 * (size_t)count + 32) * sizeof(rule_range_t));
+  int i = 0;
+  for (ast_list_t *list = ast_list; list != NULL; list = list->next, i++) {
+    int version = REGEX2C_RULE_CACHE_VERSION;
+    cache.rules[i] = list->ast;
+    rule_range_t rule = {.lo = i,
+                         .hi = i + 1,
+                         .key = hash_ast(list->ast,
+                                         hash_bytes(&version, sizeof(int),
+                                                    HASH_SEED)),
+                         .first_child = -1,
+                         .child_count = 0};
+    cache.ranges[i] = rule;
+  }
+
+  automaton_t m_automaton =
+      compile_rule_range(&cache, build_range_tree(&cache, count));
+  free(cache.rules);
+  free(cache.ranges);
+  if (m_automaton.nodes == NULL) {
+    *automaton = m_automaton;
+    errno = EOVERFLOW;
+    return 0;
+  }
+  *automaton = canonicalize_automaton(&m_automaton);
+  delete_automaton(m_automaton);
+  errno = cache.error;
+  return cache.error == 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ast2automaton.h"
+#include "automaton.h"
+#include "common.h"
+
+#define REGEX2C_RULE_CACHE_VERSION 1
+
+typedef struct rule_cache_stats {
+  int loaded_dfas; // DFAs read from the cache directory
+  int built_dfas;  // DFAs of rules or merged rules built and stored
+} rule_cache_stats_t;
+
+/**
+ * Compiles the minimal DFA of the or-construct of all asts of the given
+ * (non-empty) {@code ast_list}. End tags are assigned as in {@code
+ * convert_ast_list_to_automaton}. The result is canonicalized (see {@code
+ * canonicalize_automaton}), so it is equal to the canonicalized minimal DFA of
+ * a full rebuild.
+ *
+ * The rules are split into a tree of ranges, whose bounds are chosen by the
+ * hashes of the rules (about 4 subranges per range). The minimal DFA of a
+ * single rule is built by the followpos construction, the minimal DFA of a
+ * range of rules by the products of the DFAs of its subranges. If {@code
+ * cache_dir} is not {@code NULL}, the DFA of every range is stored in that
+ * directory under a hash of its rules, and read again instead of being rebuilt
+ * as long as the rules of the range do not change. Editing, adding or removing
+ * a rule therefore only rebuilds that rule and the ranges around it on the way
+ * to the root, wherever the rule is. Files of ranges, which are no longer
+ * used, are not removed.
+ *
+ * The cache directory and its parents are created if they do not exist. The
+ * DFA is stored into {@code automaton} and the numbers of read and built DFAs
+ * into {@code stats} (if it is not {@code NULL}). A missing or malformed cache
+ * file is rebuilt. Returns 0 if the cache directory cannot be created or a
+ * cache file cannot be written; {@code errno} describes the first error then,
+ * and the DFA is still complete. Returns 0 with {@code errno} set to {@code
+ * EOVERFLOW} if a product of DFAs has too many states (see {@code
+ * combine_automata}); the DFA has no nodes then.
+ */
+bool_t compile_rule_set(ast_list_t *ast_list, char *cache_dir,
+                        automaton_t *automaton, rule_cache_stats_t *stats);
+
+/**
+ * Writes the given deterministic {@code automaton}, identified by {@code key},
+ * to the file at {@code path}. Returns 1 on success, 0 otherwise; {@code
+ * errno} describes the error then.
+ */
+bool_t write_automaton_file(char *path, unsigned long key,
+                            automaton_t *automaton);
+
+/**
+ * Reads the automaton written by {@code write_automaton_file} with the same
+ * {@code key} from the file at {@code path} into {@code automaton}. Returns 1
+ * on success and 0 if the file cannot be read, is malformed or belongs to a
+ * different key.
+ */
+bool_t read_automaton_file(char *path, unsigned long key,
+                           automaton_t *automaton);
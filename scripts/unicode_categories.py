@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Generates unicode_categories.c from UnicodeData.txt of the Unicode
+Character Database.
+
+Usage: unicode_categories.py VERSION UnicodeData.txt > unicode_categories.c
+
+Every codepoint, which UnicodeData.txt does not list (individually or in a
+"<..., First>" / "<..., Last>" range), is unassigned (Cn). Surrogates (Cs) are
+left out, since they cannot be encoded in UTF-8.
+"""
+
+import sys
+
+CATEGORIES = [
+    ("Lu", "Uppercase_Letter"),
+    ("Ll", "Lowercase_Letter"),
+    ("Lt", "Titlecase_Letter"),
+    ("Lm", "Modifier_Letter"),
+    ("Lo", "Other_Letter"),
+    ("Mn", "Nonspacing_Mark"),
+    ("Mc", "Spacing_Mark"),
+    ("Me", "Enclosing_Mark"),
+    ("Nd", "Decimal_Number"),
+    ("Nl", "Letter_Number"),
+    ("No", "Other_Number"),
+    ("Pc", "Connector_Punctuation"),
+    ("Pd", "Dash_Punctuation"),
+    ("Ps", "Open_Punctuation"),
+    ("Pe", "Close_Punctuation"),
+    ("Pi", "Initial_Punctuation"),
+    ("Pf", "Final_Punctuation"),
+    ("Po", "Other_Punctuation"),
+    ("Sm", "Math_Symbol"),
+    ("Sc", "Currency_Symbol"),
+    ("Sk", "Modifier_Symbol"),
+    ("So", "Other_Symbol"),
+    ("Zs", "Space_Separator"),
+    ("Zl", "Line_Separator"),
+    ("Zp", "Paragraph_Separator"),
+    ("Cc", "Control"),
+    ("Cf", "Format"),
+    ("Co", "Private_Use"),
+    ("Cn", "Unassigned"),
+]
+
+MAX_CODEPOINT = 0x10FFFF
+
+
+def read_categories(path):
+    """Returns the general category of every codepoint."""
+    categories = ["Cn"] * (MAX_CODEPOINT + 1)
+    first = None
+    with open(path, encoding="utf-8") as fin:
+        for line in fin:
+            fields = line.rstrip("\n").split(";")
+            if len(fields) < 3:
+                continue
+            codepoint = int(fields[0], 16)
+            name, category = fields[1], fields[2]
+            if name.endswith(", First>"):
+                first = codepoint
+                continue
+            start = codepoint
+            if name.endswith(", Last>"):
+                if first is None:
+                    sys.exit("%s: range end without start: %s" % (path, line))
+                start, first = first, None
+            for c in range(start, codepoint + 1):
+                categories[c] = category
+    return categories
+
+
+def collect_ranges(categories):
+    """Returns the sorted, merged codepoint ranges of every category."""
+    ranges = {short: [] for short, _ in CATEGORIES}
+    for codepoint, category in enumerate(categories):
+        if category == "Cs":
+            continue
+        category_ranges = ranges[category]
+        if category_ranges and category_ranges[-1][1] == codepoint - 1:
+            category_ranges[-1][1] = codepoint
+        else:
+            category_ranges.append([codepoint, codepoint])
+    return ranges
+
+
+def print_tables(version, ranges, fout):
+    fout.write("// Generated from the Unicode Character Database %s. "
+               "Do not edit.\n" % version)
+    fout.write("// Surrogates (Cs) are left out, since they cannot be "
+               "encoded in UTF-8.\n\n")
+    fout.write('#include "utf8.h"\n\n')
+    for short, _ in CATEGORIES:
+        fout.write("static const codepoint_range_t %s_RANGES[] = {\n"
+                   % short.upper())
+        # Fill the lines up to 80 columns, like clang-format
+        line = "   "
+        for first, last in ranges[short]:
+            item = " {0x%x, 0x%x}," % (first, last)
+            if len(line) + len(item) > 80:
+                fout.write(line + "\n")
+                line = "   "
+            line += item
+        fout.write(line + "\n};\n\n")
+    fout.write("const unicode_category_t UNICODE_CATEGORIES[] = {\n")
+    for short, name in CATEGORIES:
+        fout.write('    {"%s", "%s", %s_RANGES,\n' % (short, name,
+                                                       short.upper()))
+        fout.write("     sizeof(%s_RANGES) / sizeof(codepoint_range_t)},\n"
+                   % short.upper())
+    fout.write("};\n\n")
+    fout.write("const int UNICODE_CATEGORY_COUNT =\n")
+    fout.write("    sizeof(UNICODE_CATEGORIES) / sizeof(unicode_category_t);\n")
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: %s VERSION UnicodeData.txt" % sys.argv[0])
+    ranges = collect_ranges(read_categories(sys.argv[2]))
+    print_tables(sys.argv[1], ranges, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,492 @@
+#include "search2c.h"
+#include "automaton2c.h"
+#include "common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Determinizes and minimizes the given {@code automaton} within the {@code
+ * budget}. Returns 0 if the budget is exceeded.
+ */
+static bool_t build_minimal_dfa(automaton_t *automaton, dfa_budget_t *budget,
+                                automaton_t *result) {
+  automaton_t d_automaton;
+  if (!determinize_bounded(automaton, budget, &d_automaton)) {
+    return 0;
+  }
+  automaton_t m_automaton = minimize(&d_automaton);
+  delete_automaton(d_automaton);
+  // Without a sink state, the backward runs stop as early as possible
+  *result = trim_automaton(&m_automaton);
+  delete_automaton(m_automaton);
+  return 1;
+}
+
+bool_t build_search_automata(automaton_t *automaton, dfa_budget_t *budget,
+                             automaton_t *forward, automaton_t *reverse,
+                             automaton_t *anchored) {
+  automaton_t unanchored = unanchor_automaton(automaton);
+  bool_t built = build_minimal_dfa(&unanchored, budget, forward);
+  delete_automaton(unanchored);
+  if (!built) {
+    return 0;
+  }
+  automaton_t reversed = reverse_automaton(automaton);
+  built = build_minimal_dfa(&reversed, budget, reverse);
+  delete_automaton(reversed);
+  if (!built) {
+    delete_automaton(*forward);
+    return 0;
+  }
+  *anchored = trim_automaton(automaton);
+  return 1;
+}
+
+/**
+ * Adds the {@code bytes} to the given {@code bucket} at {@code offset} of the
+ * {@code prefilter}.
+ */
+static void add_prefilter_bytes(prefilter_t *prefilter, int offset,
+                                int bucket, const bool_t *bytes) {
+  for (int c = 0; c < 256; c++) {
+    if (bytes[c]) {
+      prefilter->low[offset][c & 15] |= 1 << bucket;
+      prefilter->high[offset][c >> 4] |= 1 << bucket;
+    }
+  }
+}
+
+void build_prefilter(automaton_t *automaton, prefilter_t *result) {
+  memset(result, 0, sizeof(*result));
+  int N = automaton->max_node_count;
+  int start = automaton->start_index;
+  if (automaton->nodes[start].end_tag != -1) {
+    return;
+  }
+  int *stm = create_state_transition_matrix(automaton);
+  int first_bytes = 0;
+  for (int c = 0; c < 256; c++) {
+    first_bytes += stm[start * 256 + c] != -1;
+  }
+  if (first_bytes > 128) {
+    free(stm);
+    return;
+  }
+
+  // The targets of the first transitions are distributed round robin
+  int *bucket_of = malloc(N * sizeof(int));
+  for (int s = 0; s < N; s++) {
+    bucket_of[s] = -1;
+  }
+  int target_count = 0;
+  for (int c = 0; c < 256; c++) {
+    int target = stm[start * 256 + c];
+    if (target != -1 && bucket_of[target] == -1) {
+      bucket_of[target] = target_count++ % PREFILTER_BUCKETS;
+    }
+  }
+  int bucket_count =
+      target_count < PREFILTER_BUCKETS ? target_count : PREFILTER_BUCKETS;
+  int used = (1 << bucket_count) - 1;
+
+  bool_t *frontier = malloc(N * sizeof(bool_t));
+  bool_t *next_frontier = malloc(N * sizeof(bool_t));
+  for (int bucket = 0; bucket < PREFILTER_BUCKETS; bucket++) {
+    bool_t bytes[256] = {0};
+    memset(frontier, 0, N * sizeof(bool_t));
+    for (int c = 0; c < 256; c++) {
+      int target = stm[start * 256 + c];
+      if (target != -1 && bucket_of[target] == bucket) {
+        bytes[c] = 1;
+        frontier[target] = 1;
+      }
+    }
+    add_prefilter_bytes(result, 0, bucket, bytes);
+    bool_t ended = 0;
+    for (int offset = 1; offset < PREFILTER_MAX_LENGTH; offset++) {
+      memset(bytes, 0, sizeof(bytes));
+      memset(next_frontier, 0, N * sizeof(bool_t));
+      for (int s = 0; s < N; s++) {
+        if (!frontier[s]) {
+          continue;
+        }
+        ended |= automaton->nodes[s].end_tag != -1;
+        for (int c = 0; c < 256; c++) {
+          int target = stm[s * 256 + c];
+          if (target != -1) {
+            bytes[c] = 1;
+            next_frontier[target] = 1;
+          }
+        }
+      }
+      // After a match end, the next bytes can be anything
+      if (ended) {
+        for (int c = 0; c < 256; c++) {
+          bytes[c] = 1;
+        }
+      }
+      add_prefilter_bytes(result, offset, bucket, bytes);
+      bool_t *swap = frontier;
+      frontier = next_frontier;
+      next_frontier = swap;
+    }
+  }
+  free(stm);
+  free(bucket_of);
+  free(frontier);
+  free(next_frontier);
+
+  // Offsets, at which all bytes are possible in all buckets, are not checked
+  result->length = PREFILTER_MAX_LENGTH;
+  while (result->length > 1) {
+    bool_t useful = 0;
+    for (int i = 0; i < 16; i++) {
+      useful |= (result->low[result->length - 1][i] & used) != used ||
+                (result->high[result->length - 1][i] & used) != used;
+    }
+    if (useful) {
+      break;
+    }
+    result->length--;
+  }
+}
+
+/**
+ * Prints the array {@code <parser_name>_<name>} of {@code count} {@code
+ * values}, which are at most {@code max_value}.
+ */
+static void print_search_array(char *parser_name, char *name, int *values,
+                               int count, int max_value, FILE *fout) {
+  fprintf(fout, "static const %s %s_%s[%d] = {",
+          max_value <= UINT8_MAX    ? "uint8_t"
+          : max_value <= UINT16_MAX ? "uint16_t"
+                                    : "int32_t",
+          parser_name, name, count);
+  for (int i = 0; i < count; i++) {
+    if (i % 16 == 0) {
+      fprintf(fout, "\n");
+      fprint_indent(2, fout);
+    }
+    fprintf(fout, "%d,", values[i]);
+  }
+  fprintf(fout, "\n};\n");
+}
+
+/**
+ * Prints the tables {@code <parser_name>_<name>_class} (the byte class of
+ * every byte), {@code <parser_name>_<name>_next} (the target state + 1 of
+ * every state and class, 0 if there is none) and {@code
+ * <parser_name>_<name>_accept} (the end tag + 1 of every state, 0 if it does
+ * not accept) of the given deterministic {@code automaton}. Returns the number
+ * of byte classes.
+ */
+static int print_search_tables(automaton_t *automaton, char *parser_name,
+                               char *name, FILE *fout) {
+  int N = automaton->max_node_count;
+  int class_of[256];
+  int class_count = compute_terminal_classes(automaton, class_of);
+  int representatives[256];
+  get_class_representatives(class_of, class_count, representatives);
+  int *stm = create_state_transition_matrix(automaton);
+  int *next = malloc(N * class_count * sizeof(int));
+  int *accept = malloc(N * sizeof(int));
+  int max_accept = 0;
+  for (int s = 0; s < N; s++) {
+    for (int c = 0; c < class_count; c++) {
+      next[s * class_count + c] = stm[s * 256 + representatives[c]] + 1;
+    }
+    accept[s] = automaton->nodes[s].end_tag + 1;
+    max_accept = accept[s] > max_accept ? accept[s] : max_accept;
+  }
+
+  char array_name[64];
+  snprintf(array_name, sizeof(array_name), "%s_class", name);
+  print_search_array(parser_name, array_name, class_of, 256, class_count - 1,
+                     fout);
+  snprintf(array_name, sizeof(array_name), "%s_next", name);
+  print_search_array(parser_name, array_name, next, N * class_count, N, fout);
+  snprintf(array_name, sizeof(array_name), "%s_accept", name);
+  print_search_array(parser_name, array_name, accept, N, max_accept, fout);
+  free(stm);
+  free(next);
+  free(accept);
+  return class_count;
+}
+
+/**
+ * Prints {@code <parser_name>_prefilter_masks(input)}, which returns the
+ * buckets possible at {@code input} for the bytes of an AVX2 vector (see
+ * {@code print_prefilter}).
+ */
+static void print_prefilter_masks(prefilter_t *prefilter, char *parser_name,
+                                  FILE *fout) {
+  fprintf(fout,
+          "__attribute__((target(\"avx2\"))) static inline __m256i "
+          "%s_prefilter_masks(const unsigned char *input) {\n",
+          parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "__m256i nibble = _mm256_set1_epi8(15);\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "__m256i masks = _mm256_set1_epi8(-1);\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "for (int j = 0; j < %d; j++) {\n", prefilter->length);
+  fprint_indent(4, fout);
+  fprintf(fout,
+          "__m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const "
+          "__m128i *)%s_prefilter_low[j]));\n",
+          parser_name);
+  fprint_indent(4, fout);
+  fprintf(fout,
+          "__m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const "
+          "__m128i *)%s_prefilter_high[j]));\n",
+          parser_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "__m256i bytes = _mm256_loadu_si256((const __m256i *)(input "
+                "+ j));\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "__m256i low_bucket = _mm256_shuffle_epi8(low, "
+                "_mm256_and_si256(bytes, nibble));\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "__m256i high_bucket = _mm256_shuffle_epi8(high, "
+                "_mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "masks = _mm256_and_si256(masks, "
+                "_mm256_and_si256(low_bucket, high_bucket));\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return masks;\n");
+  fprintf(fout, "}\n");
+}
+
+/**
+ * Prints the nibble masks of the {@code prefilter} and {@code long
+ * <parser_name>_prefilter(input, offset, length)}, which returns the first
+ * offset from {@code offset} on, at which a match may start. Offsets, whose
+ * bytes do not fill a vector, are returned as they are (the DFA is as fast as
+ * a check of single bytes).
+ */
+static void print_prefilter(prefilter_t *prefilter, char *parser_name,
+                            FILE *fout) {
+  char *names[] = {"low", "high"};
+  for (int i = 0; i < 2; i++) {
+    fprintf(fout, "static const uint8_t %s_prefilter_%s[%d][16] = {\n",
+            parser_name, names[i], prefilter->length);
+    for (int j = 0; j < prefilter->length; j++) {
+      fprint_indent(2, fout);
+      fprintf(fout, "{");
+      for (int k = 0; k < 16; k++) {
+        unsigned char *masks = i == 0 ? prefilter->low[j] : prefilter->high[j];
+        fprintf(fout, "%d%s", masks[k], k < 15 ? "," : "},\n");
+      }
+    }
+    fprintf(fout, "};\n");
+  }
+
+  fprintf(fout, "#if defined(__x86_64__) && defined(__GNUC__)\n");
+  fprintf(fout, "#include <immintrin.h>\n");
+  print_prefilter_masks(prefilter, parser_name, fout);
+  fprintf(fout,
+          "__attribute__((target(\"avx2\"))) static long "
+          "%s_prefilter_avx2(const unsigned char *input, long offset, long "
+          "length) {\n",
+          parser_name);
+  // The loads of the last offset of a vector must stay in the input
+  fprint_indent(2, fout);
+  fprintf(fout, "for (; offset + %d <= length; offset += 32) {\n",
+          32 + prefilter->length - 1);
+  fprint_indent(4, fout);
+  fprintf(fout, "__m256i masks = %s_prefilter_masks(input + offset);\n",
+          parser_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "unsigned candidates = ~(unsigned)_mm256_movemask_epi8("
+                "_mm256_cmpeq_epi8(masks, _mm256_setzero_si256()));\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "if (candidates != 0) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "return offset + __builtin_ctz(candidates);\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return offset;\n");
+  fprintf(fout, "}\n");
+  fprintf(fout, "#endif\n");
+
+  fprintf(fout,
+          "static long %s_prefilter(const unsigned char *input, long offset, "
+          "long length) {\n",
+          parser_name);
+  fprintf(fout, "#if defined(__x86_64__) && defined(__GNUC__)\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "if (__builtin_cpu_supports(\"avx2\")) {\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "return %s_prefilter_avx2(input, offset, length);\n",
+          parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "#endif\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return offset;\n");
+  fprintf(fout, "}\n");
+}
+
+void print_search_automata_to_c_code(automaton_t *forward,
+                                     automaton_t *reverse,
+                                     automaton_t *anchored,
+                                     prefilter_t *prefilter, char *parser_name,
+                                     char *acc_name, int flags, FILE *fout) {
+  fprintf(fout, "#include <stdint.h>\n");
+  print_helper_declarations(NULL, acc_name, NULL, flags | REGEX2C_SEARCH,
+                            fout);
+  int forward_classes =
+      print_search_tables(forward, parser_name, "forward", fout);
+  int reverse_classes =
+      print_search_tables(reverse, parser_name, "reverse", fout);
+  bool_t tagged = flags & REGEX2C_SEARCH_TAGS;
+  int match_classes =
+      tagged || !(flags & REGEX2C_SEARCH_EARLIEST)
+          ? print_search_tables(anchored, parser_name, "match", fout)
+          : 0;
+  bool_t prefiltered = prefilter != NULL && prefilter->length > 0;
+  if (prefiltered) {
+    print_prefilter(prefilter, parser_name, fout);
+  }
+
+  fprintf(fout, "%svoid %s(const unsigned char *input, long length) {\n",
+          get_parser_storage(flags), parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "int state = %d;\n", forward->start_index);
+  fprint_indent(2, fout);
+  fprintf(fout, "long end = 0;\n");
+  // No match starts before the end of the last one
+  fprint_indent(2, fout);
+  fprintf(fout, "long from = 0;\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "while (1) {\n");
+  // An empty match right at the end of the last match is not reported
+  fprint_indent(4, fout);
+  fprintf(fout,
+          "if (%s_forward_accept[state] && (end > from || end == 0)) {\n",
+          parser_name);
+  // Run the reverse DFA back from the end, the last acceptance is leftmost
+  fprint_indent(6, fout);
+  fprintf(fout, "long start = end;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "int back = %d;\n", reverse->start_index);
+  fprint_indent(6, fout);
+  fprintf(fout, "for (long i = end; i > from; i--) {\n");
+  fprint_indent(8, fout);
+  fprintf(fout, "back = %s_reverse_next[back * %d + %s_reverse_class[input[i "
+                "- 1]]] - 1;\n",
+          parser_name, reverse_classes, parser_name);
+  fprint_indent(8, fout);
+  fprintf(fout, "if (back < 0) {\n");
+  fprint_indent(10, fout);
+  fprintf(fout, "break;\n");
+  fprint_indent(8, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(8, fout);
+  fprintf(fout, "if (%s_reverse_accept[back]) {\n", parser_name);
+  fprint_indent(10, fout);
+  fprintf(fout, "start = i - 1;\n");
+  fprint_indent(8, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+  if (flags & REGEX2C_SEARCH_EARLIEST) {
+    if (tagged) {
+      // The match is accepted, so the DFA never runs into a missing transition
+      fprint_indent(6, fout);
+      fprintf(fout, "int rule = %d;\n", anchored->start_index);
+      fprint_indent(6, fout);
+      fprintf(fout, "for (long i = start; i < end; i++) {\n");
+      fprint_indent(8, fout);
+      fprintf(fout,
+              "rule = %s_match_next[rule * %d + %s_match_class[input[i]]] - "
+              "1;\n",
+              parser_name, match_classes, parser_name);
+      fprint_indent(6, fout);
+      fprintf(fout, "}\n");
+      fprint_indent(6, fout);
+      fprintf(fout, "rule = %s_match_accept[rule] - 1;\n", parser_name);
+    }
+  } else {
+    // Run the DFA forward from the start, the last acceptance is the longest
+    // match (no match from the start ends before the earliest end)
+    fprint_indent(6, fout);
+    fprintf(fout, "int match = %d;\n", anchored->start_index);
+    if (tagged) {
+      fprint_indent(6, fout);
+      fprintf(fout, "int rule = %s_match_accept[match] - 1;\n", parser_name);
+    }
+    fprint_indent(6, fout);
+    fprintf(fout, "for (long i = start; i < length; i++) {\n");
+    fprint_indent(8, fout);
+    fprintf(fout,
+            "match = %s_match_next[match * %d + %s_match_class[input[i]]] - "
+            "1;\n",
+            parser_name, match_classes, parser_name);
+    fprint_indent(8, fout);
+    fprintf(fout, "if (match < 0) {\n");
+    fprint_indent(10, fout);
+    fprintf(fout, "break;\n");
+    fprint_indent(8, fout);
+    fprintf(fout, "}\n");
+    fprint_indent(8, fout);
+    fprintf(fout, "if (%s_match_accept[match]) {\n", parser_name);
+    fprint_indent(10, fout);
+    fprintf(fout, "end = i + 1;\n");
+    if (tagged) {
+      fprint_indent(10, fout);
+      fprintf(fout, "rule = %s_match_accept[match] - 1;\n", parser_name);
+    }
+    fprint_indent(8, fout);
+    fprintf(fout, "}\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+  }
+  fprint_indent(6, fout);
+  if (tagged) {
+    fprintf(fout, "if (%s(start, end, rule)) {\n", acc_name);
+  } else {
+    fprintf(fout, "if (%s(start, end)) {\n", acc_name);
+  }
+  fprint_indent(8, fout);
+  fprintf(fout, "return;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+  // Restart the forward DFA, so that it only finds matches after this one
+  fprint_indent(6, fout);
+  fprintf(fout, "from = end;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "state = %d;\n", forward->start_index);
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  if (prefiltered) {
+    fprint_indent(4, fout);
+    fprintf(fout, "if (state == %d) {\n", forward->start_index);
+    fprint_indent(6, fout);
+    fprintf(fout, "end = %s_prefilter(input, end, length);\n", parser_name);
+    fprint_indent(4, fout);
+    fprintf(fout, "}\n");
+  }
+  fprint_indent(4, fout);
+  fprintf(fout, "if (end == length) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "return;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  // The forward DFA never rejects, since it looks for matches at every offset
+  fprint_indent(4, fout);
+  fprintf(fout,
+          "state = %s_forward_next[state * %d + "
+          "%s_forward_class[input[end++]]] - 1;\n",
+          parser_name, forward_classes, parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "}\n");
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "automaton.h"
+#include "common.h"
+
+// The most bytes of the match starts checked by a prefilter
+#define PREFILTER_MAX_LENGTH 3
+// The number of groups of prefixes told apart by a prefilter (bits of a byte)
+#define PREFILTER_BUCKETS 8
+
+/**
+ * Nibble masks of the prefixes of all matches (as in Teddy of Hyperscan). The
+ * bytes of the prefixes are grouped into buckets by the first transition of
+ * the DFA they take. A byte {@code c} at offset {@code j} of a prefix may be
+ * in bucket {@code b}, if bit {@code b} is set in both {@code
+ * low[j][c & 15]} and {@code high[j][c >> 4]}; a match may start at an offset,
+ * if a bucket is possible for all of the next {@code length} bytes.
+ */
+typedef struct prefilter {
+  int length; // 0 if every offset may start a match
+  unsigned char low[PREFILTER_MAX_LENGTH][16];
+  unsigned char high[PREFILTER_MAX_LENGTH][16];
+} prefilter_t;
+
+/**
+ * Builds the prefilter of the given deterministic {@code automaton} from the
+ * bytes of the first {@code PREFILTER_MAX_LENGTH} transitions of its paths.
+ * A path stops adding bytes at an accepting state, since a match can end
+ * there. There is no prefilter, if the start state accepts or more than half
+ * of all bytes can start a match, since it would rarely skip anything then.
+ */
+void build_prefilter(automaton_t *automaton, prefilter_t *result);
+
+/**
+ * Builds the DFAs of a search for the given minimal DFA {@code automaton} (of
+ * a pattern, or of a rule set whose rules are searched at once): {@code
+ * forward} finds the ends of all matches (see {@code unanchor_automaton}),
+ * {@code reverse} accepts the reversed matches (see {@code
+ * reverse_automaton}) and {@code anchored} is the trimmed {@code automaton}
+ * (see {@code trim_automaton}), which extends a match from its start. Returns
+ * 0 if one of the determinizations exceeds the {@code budget} (which may be
+ * {@code NULL}), all DFAs are deleted then.
+ */
+bool_t build_search_automata(automaton_t *automaton, dfa_budget_t *budget,
+                             automaton_t *forward, automaton_t *reverse,
+                             automaton_t *anchored);
+
+/**
+ * Generates a search in a buffer from the DFAs of {@code
+ * build_search_automata}. Unlike {@code print_automaton_to_c_code}, the
+ * generated function is declared as {@code void <parser_name>(const unsigned
+ * char *input, long length)} and calls {@code int <acc_name>(long start, long
+ * end)} for the non-overlapping matches in the input, in increasing order:
+ * {@code end} is the offset after the match, {@code start} its offset. With
+ * REGEX2C_SEARCH_TAGS in the {@code flags}, accept is declared as {@code int
+ * <acc_name>(long start, long end, int tag)} instead, and {@code tag} is the
+ * end tag of {@code anchored} for the match, i.e. the lowest rule of a rule
+ * set matching exactly the bytes from {@code start} to {@code end}. Each match
+ * starts at the leftmost start of the matches with the earliest end among
+ * those starting at or after the end of the previous match, and is the
+ * longest match from there (leftmost-longest, as in POSIX, unless a match
+ * starting further left ends later). With REGEX2C_SEARCH_EARLIEST, each match
+ * keeps the earliest end instead. An empty match right at the end of the
+ * previous match is not reported. If accept returns 1, the search stops.
+ *
+ * The forward DFA runs once over the input, and restarts after every match.
+ * At the earliest match end, the reverse DFA runs backwards from the end until
+ * it cannot accept anymore or reaches the end of the previous match, and the
+ * last offset it accepted at is the leftmost start (the two-pass search of
+ * RE2). Then {@code anchored} runs from the start until it cannot accept
+ * anymore, and the last offset it accepted at is the end of the match, where
+ * the search resumes; it also tells the tag of the match (the reverse DFA only
+ * accepts, it does not tell which rule matched). Matches are exact without
+ * simulating the NFA. With REGEX2C_SEARCH_EARLIEST, the backward runs never
+ * cross the previous match, so every byte is scanned at most twice (plus once
+ * more for the tag). The longest match may have to look past its end, until
+ * {@code anchored} fails, so e.g. a|a*b searched in a run of a scans the rest
+ * of the run at every match.
+ *
+ * With a {@code prefilter} (see {@code build_prefilter}; may be {@code NULL}),
+ * the forward DFA skips the bytes, which cannot start a match, whenever it is
+ * in its start state (i.e. no match is in progress): the offsets are checked
+ * 32 at a time with the nibble masks and PSHUFB on CPUs with AVX2 (chosen at
+ * runtime). Without AVX2, and for the last bytes of the input, the forward DFA
+ * runs over every byte.
+ *
+ * The DFAs are compiled into a byte class table and a dense transition table
+ * per DFA. Of the {@code flags} of {@code print_automaton_to_c_code}, only
+ * REGEX2C_ACCEPT_DECL_STATIC, REGEX2C_PARSER_DECL_STATIC,
+ * REGEX2C_OMIT_HELPER_DECLS, REGEX2C_SEARCH_TAGS and REGEX2C_SEARCH_EARLIEST
+ * are supported.
+ */
+void print_search_automata_to_c_code(automaton_t *forward,
+                                     automaton_t *reverse,
+                                     automaton_t *anchored,
+                                     prefilter_t *prefilter, char *parser_name,
+                                     char *acc_name, int flags, FILE *fout);
@@ -0,0 +1,322 @@
+#include "simd2c.h"
+#include "automaton2c.h"
+#include "common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Prints the array {@code <parser_name>_<name>} of {@code count} {@code
+ * values} of the given c {@code type}.
+ */
+static void print_simd_array(char *parser_name, char *name, char *type,
+                             int *values, int count, FILE *fout) {
+  fprintf(fout, "static const %s %s_%s[%d] = {", type, parser_name, name,
+          count);
+  for (int i = 0; i < count; i++) {
+    if (i % 16 == 0) {
+      fprintf(fout, "\n");
+      fprint_indent(2, fout);
+    }
+    fprintf(fout, "%d,", values[i]);
+  }
+  fprintf(fout, "\n};\n");
+}
+
+/**
+ * Prints the signature of the matcher {@code <parser_name><suffix>}.
+ */
+static void print_simd_signature(char *parser_name, char *suffix,
+                                 FILE *fout) {
+  fprintf(fout,
+          "void %s%s(const unsigned char *const *inputs, const long *lengths,"
+          " long count, int *tags)",
+          parser_name, suffix);
+}
+
+/**
+ * Prints the matcher {@code <parser_name>_<isa>}, which keeps {@code lanes}
+ * records in the lanes of {@code bits}-bit vectors (see {@code
+ * print_automaton_to_simd_c_code}).
+ */
+static void print_simd_matcher(char *parser_name, char *isa, int lanes,
+                               int bits, int start, int sink, int class_count,
+                               FILE *fout) {
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "_%s", isa);
+  // AVX2 loads and stores take vector pointers
+  char *load_cast = bits == 512 ? "" : "(const __m256i *)";
+  char *store_cast = bits == 512 ? "" : "(__m256i *)";
+  fprintf(fout, "__attribute__((target(\"%s\"))) static ",
+          bits == 512 ? "avx512f" : "avx2");
+  print_simd_signature(parser_name, suffix, fout);
+  fprintf(fout, " {\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "const unsigned char *cursor[%d];\n", lanes);
+  fprint_indent(2, fout);
+  fprintf(fout, "long record[%d];\n", lanes);
+  fprint_indent(2, fout);
+  fprintf(fout, "int32_t states[%d];\n", lanes);
+  fprint_indent(2, fout);
+  fprintf(fout, "int32_t remaining[%d];\n", lanes);
+  fprint_indent(2, fout);
+  fprintf(fout, "for (int l = 0; l < %d; l++) {\n", lanes);
+  fprint_indent(4, fout);
+  fprintf(fout, "record[l] = -1;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "remaining[l] = 0;\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "long next = 0;\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "while (1) {\n");
+
+  // Replace the finished records by the next ones
+  fprint_indent(4, fout);
+  fprintf(fout, "for (int l = 0; l < %d; l++) {\n", lanes);
+  fprint_indent(6, fout);
+  fprintf(fout, "if (remaining[l] > 0 && states[l] != %d) {\n",
+          sink * class_count);
+  fprint_indent(8, fout);
+  fprintf(fout, "continue;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "if (record[l] != -1) {\n");
+  fprint_indent(8, fout);
+  fprintf(fout, "tags[record[l]] = %s_accept[states[l] / %d];\n", parser_name,
+          class_count);
+  fprint_indent(8, fout);
+  fprintf(fout, "record[l] = -1;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+  // Empty records and those without 32-bit lengths are matched one by one
+  fprint_indent(6, fout);
+  fprintf(fout,
+          "while (next < count && (lengths[next] == 0 || lengths[next] > "
+          "INT32_MAX)) {\n");
+  fprint_indent(8, fout);
+  fprintf(fout, "tags[next] = %s_run(inputs[next], lengths[next]);\n",
+          parser_name);
+  fprint_indent(8, fout);
+  fprintf(fout, "next++;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "if (next == count) {\n");
+  fprint_indent(8, fout);
+  fprintf(fout, "break;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "record[l] = next;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "cursor[l] = inputs[next];\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "remaining[l] = (int32_t)lengths[next];\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "states[l] = %d;\n", start * class_count);
+  fprint_indent(6, fout);
+  fprintf(fout, "next++;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  // Without records for all lanes, the unfinished ones are matched on
+  fprint_indent(4, fout);
+  fprintf(fout, "if (next == count) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "break;\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+
+  // Step all lanes until one of them finishes its record or rejects
+  fprint_indent(4, fout);
+  fprintf(fout, "__m%di state = _mm%d_loadu_si%d(%sstates);\n", bits, bits,
+          bits, load_cast);
+  fprint_indent(4, fout);
+  fprintf(fout, "__m%di left = _mm%d_loadu_si%d(%sremaining);\n", bits, bits,
+          bits, load_cast);
+  fprint_indent(4, fout);
+  fprintf(fout, "__m%di sink = _mm%d_set1_epi32(%d);\n", bits, bits,
+          sink * class_count);
+  fprint_indent(4, fout);
+  fprintf(fout, "__m%di one = _mm%d_set1_epi32(1);\n", bits, bits);
+  fprint_indent(4, fout);
+  fprintf(fout, "__m%di zero = _mm%d_setzero_si%d();\n", bits, bits, bits);
+  fprint_indent(4, fout);
+  fprintf(fout, "while (1) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "__m%di bytes = _mm%d_setr_epi32(", bits, bits);
+  for (int l = 0; l < lanes; l++) {
+    if (l % 4 == 0) {
+      fprintf(fout, "\n");
+      fprint_indent(10, fout);
+    }
+    fprintf(fout, "*cursor[%d]++%s", l, l + 1 < lanes ? ", " : ");\n");
+  }
+  fprint_indent(6, fout);
+  if (bits == 512) {
+    fprintf(fout,
+            "__m512i classes = _mm512_i32gather_epi32(bytes, %s_class, "
+            "4);\n",
+            parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout,
+            "state = _mm512_i32gather_epi32(_mm512_add_epi32(state, "
+            "classes), %s_next, 4);\n",
+            parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout, "left = _mm512_sub_epi32(left, one);\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "if (_mm512_cmpeq_epi32_mask(left, zero) | "
+                  "_mm512_cmpeq_epi32_mask(state, sink)) {\n");
+  } else {
+    fprintf(fout,
+            "__m256i classes = _mm256_i32gather_epi32(%s_class, bytes, "
+            "4);\n",
+            parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout,
+            "state = _mm256_i32gather_epi32(%s_next, "
+            "_mm256_add_epi32(state, classes), 4);\n",
+            parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout, "left = _mm256_sub_epi32(left, one);\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "__m256i finished = _mm256_or_si256(_mm256_cmpeq_epi32("
+                  "left, zero), _mm256_cmpeq_epi32(state, sink));\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "if (!_mm256_testz_si256(finished, finished)) {\n");
+  }
+  fprint_indent(8, fout);
+  fprintf(fout, "break;\n");
+  fprint_indent(6, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "_mm%d_storeu_si%d(%sstates, state);\n", bits, bits,
+          store_cast);
+  fprint_indent(4, fout);
+  fprintf(fout, "_mm%d_storeu_si%d(%sremaining, left);\n", bits, bits,
+          store_cast);
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+
+  fprint_indent(2, fout);
+  fprintf(fout, "for (int l = 0; l < %d; l++) {\n", lanes);
+  fprint_indent(4, fout);
+  fprintf(fout, "if (record[l] != -1) {\n");
+  fprint_indent(6, fout);
+  fprintf(fout,
+          "tags[record[l]] = %s_accept[%s_step(states[l], cursor[l], "
+          "remaining[l]) / %d];\n",
+          parser_name, parser_name, class_count);
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "}\n");
+}
+
+void print_automaton_to_simd_c_code(automaton_t automaton, char *parser_name,
+                                    int flags, FILE *fout) {
+  // State N is a sink, which replaces missing transitions, so that gathers
+  // never need a check
+  int N = automaton.max_node_count;
+  int class_of[256];
+  int class_count = compute_terminal_classes(&automaton, class_of);
+  int representatives[256];
+  get_class_representatives(class_of, class_count, representatives);
+  int *stm = create_state_transition_matrix(&automaton);
+  int *next = malloc((N + 1) * class_count * sizeof(int));
+  int *accept = malloc((N + 1) * sizeof(int));
+  for (int s = 0; s <= N; s++) {
+    for (int c = 0; c < class_count; c++) {
+      int target = s == N ? -1 : stm[s * 256 + representatives[c]];
+      next[s * class_count + c] = (target == -1 ? N : target) * class_count;
+    }
+    accept[s] = s == N ? -1 : automaton.nodes[s].end_tag;
+  }
+  free(stm);
+
+  char *storage = get_parser_storage(flags);
+  fprintf(fout, "#include <stdint.h>\n");
+  // The classes are gathered, so they have 32 bits
+  print_simd_array(parser_name, "class", "int32_t", class_of, 256, fout);
+  // The target state times the class count of every state and class
+  print_simd_array(parser_name, "next", "int32_t", next,
+                   (N + 1) * class_count, fout);
+  print_simd_array(parser_name, "accept", "int32_t", accept, N + 1, fout);
+  free(next);
+  free(accept);
+
+  // Steps from the state (times the class count) through the input
+  fprintf(fout,
+          "static int32_t %s_step(int32_t state, const unsigned char *input, "
+          "long length) {\n",
+          parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "for (long i = 0; i < length && state != %d; i++) {\n",
+          N * class_count);
+  fprint_indent(4, fout);
+  fprintf(fout, "state = %s_next[state + %s_class[input[i]]];\n",
+          parser_name, parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "return state;\n");
+  fprintf(fout, "}\n");
+  fprintf(fout,
+          "static int %s_run(const unsigned char *input, long length) {\n",
+          parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "return %s_accept[%s_step(%d, input, length) / %d];\n",
+          parser_name, parser_name, automaton.start_index * class_count,
+          class_count);
+  fprintf(fout, "}\n");
+
+  fprintf(fout, "%s", storage);
+  print_simd_signature(parser_name, "_scalar", fout);
+  fprintf(fout, " {\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "for (long r = 0; r < count; r++) {\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "tags[r] = %s_run(inputs[r], lengths[r]);\n", parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "}\n");
+
+  fprintf(fout, "#if defined(__x86_64__) && defined(__GNUC__)\n");
+  fprintf(fout, "#include <immintrin.h>\n");
+  print_simd_matcher(parser_name, "avx2", SIMD_AVX2_LANES, 256,
+                     automaton.start_index, N, class_count, fout);
+  print_simd_matcher(parser_name, "avx512", SIMD_AVX512_LANES, 512,
+                     automaton.start_index, N, class_count, fout);
+  fprintf(fout, "#endif\n");
+
+  fprintf(fout, "%s", storage);
+  print_simd_signature(parser_name, "", fout);
+  fprintf(fout, " {\n");
+  fprintf(fout, "#if defined(__x86_64__) && defined(__GNUC__)\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "if (__builtin_cpu_supports(\"avx512f\")) {\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "%s_avx512(inputs, lengths, count, tags);\n", parser_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "return;\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "if (__builtin_cpu_supports(\"avx2\")) {\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "%s_avx2(inputs, lengths, count, tags);\n", parser_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "return;\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "#endif\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "%s_scalar(inputs, lengths, count, tags);\n", parser_name);
+  fprintf(fout, "}\n");
+}
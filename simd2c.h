@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "automaton.h"
+#include "common.h"
+
+// The number of records matched at once with AVX2 and AVX-512
+#define SIMD_AVX2_LANES 8
+#define SIMD_AVX512_LANES 16
+
+/*
+ * Generates a matcher for many independent records from the given
+ * deterministic {@code automaton}. Unlike {@code print_automaton_to_c_code},
+ * the generated function is declared as
+ *
+ * {@code void <parser_name>(const unsigned char *const *inputs,
+ *                           const long *lengths, long count, int *tags)}
+ *
+ * and stores the end tag of the automaton for the whole record {@code
+ * inputs[i]} of {@code lengths[i]} bytes into {@code tags[i]}, or -1 if the
+ * record is not accepted. It calls no other functions.
+ *
+ * On x86-64 (with GCC or Clang), the records are matched in the lanes of
+ * SIMD registers: 16 at once with AVX-512, or 8 with AVX2, chosen at runtime
+ * by the features of the CPU. Every step gathers the byte classes of the next
+ * bytes of all lanes and then their next states from a transition table,
+ * which is indexed by the state times the number of byte classes plus the
+ * byte class. A lane, whose record has ended or was rejected, gets the next
+ * record, so short and long records do not wait for each other; the records
+ * left, when there are no more to refill the lanes with, and all records on
+ * other CPUs are finished one by one. {@code <parser_name>_scalar}, which has
+ * the same signature and is always generated, matches all records one by one,
+ * so results can be compared on any machine.
+ *
+ * Of the {@code flags} of {@code print_automaton_to_c_code}, only
+ * REGEX2C_PARSER_DECL_STATIC is supported.
+ */
+void print_automaton_to_simd_c_code(automaton_t automaton, char *parser_name,
+                                    int flags, FILE *fout);
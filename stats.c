@@ -0,0 +1,113 @@
+#include "stats.h"
+
+#include <limits.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define HAS_MALLINFO2
+#endif
+
+static const char *PHASE_NAMES[PHASE_COUNT] = {
+    [PHASE_PARSE] = "parse",
+    [PHASE_AST_TO_NFA] = "ast_to_nfa",
+    [PHASE_DETERMINIZE] = "determinize",
+    [PHASE_MINIMIZE] = "minimize",
+    [PHASE_CODEGEN] = "codegen",
+};
+
+/**
+ * Returns the number of bytes allocated on the heap of the process, or -1 if
+ * it is unknown.
+ */
+static long get_heap_bytes() {
+#ifdef HAS_MALLINFO2
+  struct mallinfo2 info = mallinfo2();
+  // Large blocks are mapped separately from the arenas
+  return (long)(info.uordblks + info.hblkhd);
+#else
+  return -1;
+#endif
+}
+
+compile_stats_t create_compile_stats() {
+  compile_stats_t stats;
+  memset(&stats, 0, sizeof(compile_stats_t));
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    stats.phases[phase].wall_ms = -1;
+    stats.phases[phase].process_max_rss_kb = -1;
+    stats.phases[phase].heap_growth_kb = LONG_MIN;
+  }
+  stats.nfa_nodes = -1;
+  stats.nfa_edges = -1;
+  stats.nfa_epsilon_edges = -1;
+  stats.dfa_states = -1;
+  stats.minimized_dfa_states = -1;
+  stats.minimization_rounds = -1;
+  stats.rules = -1;
+  stats.loaded_rule_dfas = -1;
+  stats.built_rule_dfas = -1;
+  stats.table_bytes = -1;
+  stats.dense_table_bytes = -1;
+  return stats;
+}
+
+void begin_phase(compile_stats_t *stats, compile_phase_t phase) {
+  stats->phase_start_heap_bytes = get_heap_bytes();
+  clock_gettime(CLOCK_MONOTONIC, &stats->phase_start);
+}
+
+void end_phase(compile_stats_t *stats, compile_phase_t phase) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  stats->phases[phase].wall_ms =
+      (now.tv_sec - stats->phase_start.tv_sec) * 1e3 +
+      (now.tv_nsec - stats->phase_start.tv_nsec) / 1e6;
+
+  // ru_maxrss is the peak resident set size of the process in kilobytes
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  stats->phases[phase].process_max_rss_kb = usage.ru_maxrss;
+
+  long heap_bytes = get_heap_bytes();
+  if (heap_bytes != -1 && stats->phase_start_heap_bytes != -1) {
+    stats->phases[phase].heap_growth_kb =
+        (heap_bytes - stats->phase_start_heap_bytes) / 1024;
+  }
+}
+
+void print_stats_json(compile_stats_t *stats, FILE *fout) {
+  fprintf(fout, "{\n  \"phases\": {\n");
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    phase_stats_t *phase_stats = &stats->phases[phase];
+    fprintf(fout,
+            "    \"%s\": {\"wall_ms\": %.3f, \"process_max_rss_kb\": %ld, "
+            "\"heap_growth_kb\": ",
+            PHASE_NAMES[phase], phase_stats->wall_ms,
+            phase_stats->process_max_rss_kb);
+    if (phase_stats->heap_growth_kb == LONG_MIN) {
+      fprintf(fout, "null");
+    } else {
+      fprintf(fout, "%ld", phase_stats->heap_growth_kb);
+    }
+    fprintf(fout, "}%s\n", phase + 1 < PHASE_COUNT ? "," : "");
+  }
+  fprintf(fout, "  },\n");
+  fprintf(fout,
+          "  \"nfa\": {\"nodes\": %d, \"edges\": %d, \"epsilon_edges\": %d},\n",
+          stats->nfa_nodes, stats->nfa_edges, stats->nfa_epsilon_edges);
+  fprintf(fout,
+          "  \"dfa\": {\"states\": %d, \"minimized_states\": %d, "
+          "\"minimization_rounds\": %d, \"nfa_simulation\": %s},\n",
+          stats->dfa_states, stats->minimized_dfa_states,
+          stats->minimization_rounds,
+          stats->nfa_simulation ? "true" : "false");
+  fprintf(fout,
+          "  \"rules\": {\"count\": %d, \"loaded_dfas\": %d, "
+          "\"built_dfas\": %d},\n",
+          stats->rules, stats->loaded_rule_dfas, stats->built_rule_dfas);
+  fprintf(fout, "  \"table\": {\"bytes\": %ld, \"dense_bytes\": %ld}\n",
+          stats->table_bytes, stats->dense_table_bytes);
+  fprintf(fout, "}\n");
+}
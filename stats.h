@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdio.h>
+#include <time.h>
+
+typedef enum compile_phase {
+  PHASE_PARSE,
+  PHASE_AST_TO_NFA,
+  PHASE_DETERMINIZE,
+  PHASE_MINIMIZE,
+  PHASE_CODEGEN,
+  PHASE_COUNT,
+} compile_phase_t;
+
+typedef struct phase_stats {
+  double wall_ms;
+  // The maximum resident set size of the whole process up to the end of the
+  // phase, not of the phase alone (the RSS of concurrent compiles cannot be
+  // told apart)
+  long process_max_rss_kb;
+  // The growth of the allocated heap during the phase alone (negative if the
+  // phase freed more than it allocated), LONG_MIN if unknown. Other threads
+  // allocating at the same time are counted as well
+  long heap_growth_kb;
+} phase_stats_t;
+
+typedef struct compile_stats {
+  phase_stats_t phases[PHASE_COUNT];
+  struct timespec phase_start;
+  long phase_start_heap_bytes;
+  int nfa_nodes;
+  int nfa_edges;
+  int nfa_epsilon_edges;
+  int dfa_states;
+  int minimized_dfa_states;
+  int minimization_rounds;
+  char nfa_simulation; // whether the DFA budget forced an NFA simulation
+  int rules;
+  int loaded_rule_dfas;   // DFAs read from the rule cache
+  int built_rule_dfas;    // DFAs built for the rule cache
+  long table_bytes;       // of the transition tables of table backends
+  long dense_table_bytes; // ... and of a dense table instead
+} compile_stats_t;
+
+/**
+ * Creates empty statistics. All counters are set to {@code -1} (unknown).
+ */
+compile_stats_t create_compile_stats();
+
+/**
+ * Starts the wall clock for the given {@code phase} and records the allocated
+ * heap of the process.
+ */
+void begin_phase(compile_stats_t *stats, compile_phase_t phase);
+
+/**
+ * Stops the wall clock for the given {@code phase} and records the maximum
+ * resident memory of the process so far, which includes all earlier phases
+ * and other threads, as well as the growth of the allocated heap since {@code
+ * begin_phase} (with glibc 2.33 or later, see {@code mallinfo2}).
+ */
+void end_phase(compile_stats_t *stats, compile_phase_t phase);
+
+/**
+ * Prints the given {@code stats} as a single JSON object.
+ */
+void print_stats_json(compile_stats_t *stats, FILE *fout);
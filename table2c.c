@@ -0,0 +1,330 @@
+#include "table2c.h"
+#include "automaton2c.h"
+#include "common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The rows used most recently are tried as defaults of the following rows
+#define MAX_DEFAULT_CANDIDATES 64
+// Rows with fewer entries would save too little as defaults to be tried
+#define MIN_CANDIDATE_ENTRIES 8
+
+typedef struct comb_table {
+  int *base;          // per state, the offset of its row in next and check
+  int *default_state; // per state, the state + 1 to continue with, or 0
+  int *next;          // per slot, the target state + 1, or 0 to reject
+  int *check;         // per slot, the state it belongs to, or N if it is free
+  int size;           // of next and check
+  int capacity;
+} comb_table_t;
+
+static char *get_entry_type(long max_entry) {
+  return max_entry <= UINT8_MAX    ? "uint8_t"
+         : max_entry <= UINT16_MAX ? "uint16_t"
+                                   : "int32_t";
+}
+
+static size_t get_entry_size(long max_entry) {
+  return max_entry <= UINT8_MAX ? 1 : max_entry <= UINT16_MAX ? 2 : 4;
+}
+
+/**
+ * Prints the array {@code <parser_name>_<name>} of {@code count} {@code
+ * values} with the smallest type, which holds values up to {@code max_entry}.
+ * Returns the size of the array in bytes.
+ */
+static size_t print_table_array(char *parser_name, char *name, int *values,
+                                int count, long max_entry, FILE *fout) {
+  fprintf(fout, "static const %s %s_%s[%d] = {", get_entry_type(max_entry),
+          parser_name, name, count);
+  for (int i = 0; i < count; i++) {
+    if (i % 16 == 0) {
+      fprintf(fout, "\n");
+      fprint_indent(2, fout);
+    }
+    fprintf(fout, "%d,", values[i]);
+  }
+  fprintf(fout, "\n};\n");
+  return count * get_entry_size(max_entry);
+}
+
+/**
+ * Returns the number of bytes, for which the states {@code s0} and {@code s1}
+ * lead to different states (or only one of them rejects), but stops counting
+ * at {@code limit}.
+ */
+static int count_row_differences(int *stm, int s0, int s1, int limit) {
+  int *row0 = &stm[s0 * 256];
+  int *row1 = &stm[s1 * 256];
+  int count = 0;
+  for (int c = 0; c < 256 && count < limit; c++) {
+    count += row0[c] != row1[c];
+  }
+  return count;
+}
+
+/**
+ * Chooses the default state of every state: the candidate, whose row differs
+ * from the row of the state in the fewest bytes, if that are fewer bytes than
+ * the state has transitions. The candidates are the most recently used rows
+ * (similar states tend to be numbered closely), which are not close to
+ * another candidate themselves. Stores the number of entries, which every
+ * state has to store, into {@code entry_count}.
+ */
+static void choose_default_states(int *stm, int N, int *default_state,
+                                  int *entry_count) {
+  int *chain_length = calloc(N, sizeof(int));
+  int candidates[MAX_DEFAULT_CANDIDATES];
+  int candidate_count = 0;
+  for (int s = 0; s < N; s++) {
+    int transition_count = 0;
+    for (int c = 0; c < 256; c++) {
+      transition_count += stm[s * 256 + c] != -1;
+    }
+    int best = -1;
+    int best_count = transition_count;
+    for (int i = 0; i < candidate_count; i++) {
+      if (chain_length[candidates[i]] == MAX_DEFAULT_CHAIN) {
+        continue;
+      }
+      int count = count_row_differences(stm, s, candidates[i], best_count);
+      if (count < best_count) {
+        best = i;
+        best_count = count;
+      }
+    }
+    entry_count[s] = best_count;
+    default_state[s] = 0;
+    if (best != -1) {
+      int t = candidates[best];
+      default_state[s] = t + 1;
+      chain_length[s] = chain_length[t] + 1;
+      memmove(&candidates[1], &candidates[0], best * sizeof(int));
+      candidates[0] = t;
+    }
+    if (transition_count >= MIN_CANDIDATE_ENTRIES &&
+        best_count * 2 > transition_count) {
+      if (candidate_count < MAX_DEFAULT_CANDIDATES) {
+        candidate_count++;
+      }
+      memmove(&candidates[1], &candidates[0],
+              (candidate_count - 1) * sizeof(int));
+      candidates[0] = s;
+    }
+  }
+  free(chain_length);
+}
+
+static int compare_entry_counts(const void *a, const void *b, void *arg) {
+  int *entry_count = arg;
+  int s0 = *(const int *)a;
+  int s1 = *(const int *)b;
+  return entry_count[s0] != entry_count[s1] ? entry_count[s1] - entry_count[s0]
+                                            : s0 - s1;
+}
+
+/**
+ * Grows the slots of the given {@code table} to at least {@code capacity}.
+ */
+static void reserve_comb_slots(comb_table_t *table, int capacity, int N) {
+  if (capacity <= table->capacity) {
+    return;
+  }
+  int new_capacity = table->capacity * 2;
+  if (new_capacity < capacity) {
+    new_capacity = capacity;
+  }
+  table->next = realloc(table->next, new_capacity * sizeof(int));
+  table->check = realloc(table->check, new_capacity * sizeof(int));
+  for (int i = table->capacity; i < new_capacity; i++) {
+    table->next[i] = 0;
+    table->check[i] = N;
+  }
+  table->capacity = new_capacity;
+}
+
+/**
+ * Compresses the state transition matrix {@code stm} of {@code N} states. The
+ * rows are placed by first fit, those with the most entries first.
+ */
+static comb_table_t create_comb_table(int *stm, int N) {
+  comb_table_t table = {.base = calloc(N, sizeof(int)),
+                        .default_state = malloc(N * sizeof(int)),
+                        .next = NULL,
+                        .check = NULL,
+                        .size = 256,
+                        .capacity = 0};
+  reserve_comb_slots(&table, 1024, N);
+  int *entry_count = malloc(N * sizeof(int));
+  choose_default_states(stm, N, table.default_state, entry_count);
+  int *order = malloc(N * sizeof(int));
+  for (int s = 0; s < N; s++) {
+    order[s] = s;
+  }
+  qsort_r(order, N, sizeof(int), compare_entry_counts, entry_count);
+
+  int first_free = 0;
+  int entries[256];
+  for (int i = 0; i < N && entry_count[order[i]] > 0; i++) {
+    int s = order[i];
+    int *row = &stm[s * 256];
+    int d = table.default_state[s] - 1;
+    int stored = 0;
+    for (int c = 0; c < 256; c++) {
+      if (row[c] != (d == -1 ? -1 : stm[d * 256 + c])) {
+        entries[stored++] = c;
+      }
+    }
+    int base = first_free > entries[0] ? first_free - entries[0] : 0;
+    while (1) {
+      reserve_comb_slots(&table, base + 256, N);
+      bool_t fits = 1;
+      for (int j = 0; j < stored && fits; j++) {
+        fits = table.check[base + entries[j]] == N;
+      }
+      if (fits) {
+        break;
+      }
+      base++;
+    }
+    table.base[s] = base;
+    for (int j = 0; j < stored; j++) {
+      table.check[base + entries[j]] = s;
+      table.next[base + entries[j]] = row[entries[j]] + 1;
+    }
+    if (base + 256 > table.size) {
+      table.size = base + 256;
+    }
+    while (first_free < table.capacity && table.check[first_free] != N) {
+      first_free++;
+    }
+  }
+  free(order);
+  free(entry_count);
+  return table;
+}
+
+static void delete_comb_table(comb_table_t table) {
+  free(table.base);
+  free(table.default_state);
+  free(table.next);
+  free(table.check);
+}
+
+static void print_reject(char *rej_name, int indent, FILE *fout) {
+  fprint_indent(indent, fout);
+  fprintf(fout, "%s();\n", rej_name);
+  fprint_indent(indent, fout);
+  fprintf(fout, "return;\n");
+}
+
+table_size_t print_automaton_to_table_c_code(automaton_t automaton,
+                                             bool_t compress,
+                                             char *parser_name,
+                                             char *next_name, char *acc_name,
+                                             char *rej_name, int flags,
+                                             FILE *fout) {
+  int N = automaton.max_node_count;
+  int *stm = create_state_transition_matrix(&automaton);
+  table_size_t size = {.bytes = 0,
+                       .dense_bytes = (size_t)N * 256 * get_entry_size(N)};
+
+  fprintf(fout, "#include <stdint.h>\n");
+  print_helper_declarations(next_name, acc_name, rej_name, flags, fout);
+  // The end tag + 1 of every state, 0 if it does not accept
+  int *accept = malloc(N * sizeof(int));
+  int max_accept = 0;
+  for (int s = 0; s < N; s++) {
+    accept[s] = automaton.nodes[s].end_tag + 1;
+    if (accept[s] > max_accept) {
+      max_accept = accept[s];
+    }
+  }
+  if (max_accept > 0) {
+    print_table_array(parser_name, "accept", accept, N, max_accept, fout);
+  }
+  free(accept);
+  if (compress) {
+    comb_table_t table = create_comb_table(stm, N);
+    int max_base = 0;
+    for (int s = 0; s < N; s++) {
+      if (table.base[s] > max_base) {
+        max_base = table.base[s];
+      }
+    }
+    size.bytes += print_table_array(parser_name, "base", table.base, N,
+                                    max_base, fout);
+    size.bytes += print_table_array(parser_name, "default",
+                                    table.default_state, N, N, fout);
+    size.bytes += print_table_array(parser_name, "next", table.next,
+                                    table.size, N, fout);
+    size.bytes += print_table_array(parser_name, "check", table.check,
+                                    table.size, N, fout);
+    delete_comb_table(table);
+  } else {
+    for (int i = 0; i < N * 256; i++) {
+      stm[i]++;
+    }
+    size.bytes += print_table_array(parser_name, "next", stm, N * 256, N, fout);
+  }
+  free(stm);
+
+  fprintf(fout, "%svoid %s() {\n",
+          get_parser_storage(flags), parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "int state = %d;\n", automaton.start_index);
+  fprint_indent(2, fout);
+  fprintf(fout, "while (1) {\n");
+  if (max_accept > 0) {
+    fprint_indent(4, fout);
+    fprintf(fout, "if (%s_accept[state] && %s(%s_accept[state] - 1)) {\n",
+            parser_name, acc_name, parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout, "return;\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "}\n");
+  }
+  fprint_indent(4, fout);
+  fprintf(fout, "int c = %s();\n", next_name);
+  fprint_indent(4, fout);
+  fprintf(fout, "if ((unsigned)c >= 256) {\n");
+  print_reject(rej_name, 6, fout);
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+
+  if (compress) {
+    // Follow the defaults until a row stores an entry for c
+    fprint_indent(4, fout);
+    fprintf(fout, "int s = state;\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "while (%s_check[%s_base[s] + c] != s) {\n", parser_name,
+            parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout, "s = %s_default[s] - 1;\n", parser_name);
+    fprint_indent(6, fout);
+    fprintf(fout, "if (s < 0) {\n");
+    print_reject(rej_name, 8, fout);
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "}\n");
+    fprint_indent(4, fout);
+    fprintf(fout, "state = %s_next[%s_base[s] + c] - 1;\n", parser_name,
+            parser_name);
+  } else {
+    fprint_indent(4, fout);
+    fprintf(fout, "state = %s_next[state * 256 + c] - 1;\n", parser_name);
+  }
+  fprint_indent(4, fout);
+  fprintf(fout, "if (state < 0) {\n");
+  print_reject(rej_name, 6, fout);
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "}\n");
+  return size;
+}
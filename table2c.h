@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "automaton.h"
+#include "common.h"
+
+// A lookup in a compressed table follows at most this many default states
+#define MAX_DEFAULT_CHAIN 4
+
+typedef struct table_size {
+  size_t bytes;       // of the generated transition tables
+  size_t dense_bytes; // of a dense table (256 entries per state) instead
+} table_size_t;
+
+/*
+ * Generates a table-driven parser from the given deterministic {@code
+ * automaton}. The parser has the same interface and behaviour as the parser of
+ * {@code print_automaton_to_c_code} (including the meaning of {@code flags},
+ * except for REGEX2C_PROFILE, which is ignored), but is a single loop, which
+ * looks up the next state in constant tables instead of branching on the
+ * state.
+ *
+ * Without {@code compress}, the transitions are a dense table of 256 entries
+ * per state. With {@code compress}, they are compressed by row displacement
+ * (a comb vector, as in flex): every state may use another state with a
+ * similar row as its default, and only stores the entries, which differ from
+ * the default. The stored entries of all states are overlaid into one vector,
+ * each row at an offset (its base), where none of its entries collide with
+ * those of other rows. A lookup checks whether the entry at the base of the
+ * state belongs to it, and follows the chain of defaults otherwise. Default
+ * chains have at most {@code MAX_DEFAULT_CHAIN} states.
+ *
+ * Returns the sizes of the generated and of the dense transition tables.
+ */
+table_size_t print_automaton_to_table_c_code(automaton_t automaton,
+                                             bool_t compress,
+                                             char *parser_name,
+                                             char *next_name, char *acc_name,
+                                             char *rej_name, int flags,
+                                             FILE *fout);
@@ -0,0 +1,83 @@
+#include "tag_sets.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+tag_sets_t create_tag_sets() {
+  tag_sets_t sets = {.capacity = 8, .member_capacity = 16};
+  sets.offsets = malloc((sets.capacity + 1) * sizeof(int));
+  sets.offsets[0] = 0;
+  sets.members = malloc(sets.member_capacity * sizeof(int));
+  sets.bucket_count = sets.capacity * 2;
+  sets.buckets = malloc(sets.bucket_count * sizeof(int));
+  memset(sets.buckets, 0xff, sets.bucket_count * sizeof(int));
+  return sets;
+}
+
+static unsigned long hash_tag_set(const int *tags, int size) {
+  return hash_bytes(tags, size * sizeof(int), HASH_SEED);
+}
+
+static void insert_tag_set_bucket(tag_sets_t *sets, int index) {
+  int mask = sets->bucket_count - 1;
+  const int *tags;
+  int size = get_tag_set(sets, index, &tags);
+  int bucket = hash_tag_set(tags, size) & mask;
+  while (sets->buckets[bucket] != -1) {
+    bucket = (bucket + 1) & mask;
+  }
+  sets->buckets[bucket] = index;
+}
+
+static void grow_tag_sets(tag_sets_t *sets) {
+  sets->capacity *= 2;
+  sets->offsets = realloc(sets->offsets, (sets->capacity + 1) * sizeof(int));
+  // Keep the load factor of the hash table at most one half
+  free(sets->buckets);
+  sets->bucket_count = sets->capacity * 2;
+  sets->buckets = malloc(sets->bucket_count * sizeof(int));
+  memset(sets->buckets, 0xff, sets->bucket_count * sizeof(int));
+  for (int index = 0; index < sets->count; index++) {
+    insert_tag_set_bucket(sets, index);
+  }
+}
+
+int intern_tag_set(tag_sets_t *sets, int *tags, int size) {
+  int mask = sets->bucket_count - 1;
+  int bucket = hash_tag_set(tags, size) & mask;
+  while (sets->buckets[bucket] != -1) {
+    int index = sets->buckets[bucket];
+    const int *members;
+    if (get_tag_set(sets, index, &members) == size &&
+        memcmp(members, tags, size * sizeof(int)) == 0) {
+      return index;
+    }
+    bucket = (bucket + 1) & mask;
+  }
+  if (sets->count == sets->capacity) {
+    grow_tag_sets(sets);
+  }
+  int offset = sets->offsets[sets->count];
+  while (offset + size > sets->member_capacity) {
+    sets->member_capacity *= 2;
+    sets->members =
+        realloc(sets->members, sets->member_capacity * sizeof(int));
+  }
+  memcpy(&sets->members[offset], tags, size * sizeof(int));
+  int index = sets->count++;
+  sets->offsets[sets->count] = offset + size;
+  insert_tag_set_bucket(sets, index);
+  return index;
+}
+
+int get_tag_set(tag_sets_t *sets, int index, const int **tags) {
+  *tags = &sets->members[sets->offsets[index]];
+  return sets->offsets[index + 1] - sets->offsets[index];
+}
+
+void delete_tag_sets(tag_sets_t sets) {
+  free(sets.offsets);
+  free(sets.members);
+  free(sets.buckets);
+}
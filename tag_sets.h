@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common.h"
+
+/**
+ * Interned sets of end tags. Every distinct set is stored once and identified
+ * by its index: the tags of set {@code k} are {@code members[offsets[k]]} to
+ * {@code members[offsets[k + 1] - 1]}, in increasing order. Equal sets get
+ * equal indices, so automata can use the index as end tag.
+ */
+typedef struct tag_sets {
+  int *offsets; // count + 1 entries
+  int *members;
+  int count;
+  int capacity;
+  int member_capacity;
+  int *buckets; // bucket_count entries, -1 for empty
+  int bucket_count;
+} tag_sets_t;
+
+/**
+ * Creates an empty collection of tag sets.
+ */
+tag_sets_t create_tag_sets();
+
+/**
+ * Returns the index of the set of the {@code size} given {@code tags}, which
+ * must be sorted and distinct. The set is added, if it does not exist yet.
+ */
+int intern_tag_set(tag_sets_t *sets, int *tags, int size);
+
+/**
+ * Returns the number of tags of set {@code index} and stores a pointer to them
+ * into {@code tags}.
+ */
+int get_tag_set(tag_sets_t *sets, int index, const int **tags);
+
+/**
+ * Frees all memory of the given {@code sets}.
+ */
+void delete_tag_sets(tag_sets_t sets);
@@ -0,0 +1,734 @@
+#include "tagged_dfa.h"
+#include "ast.h"
+#include "ast2automaton.h"
+#include "automaton.h"
+#include "common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The tagged NFA: like a Thompson NFA, but the edges of every node are kept in
+ * the order of their priority, and epsilon edges may set a tag. Tag 2 * k is
+ * the start and tag 2 * k + 1 the end of capture k.
+ */
+
+typedef struct tnfa_edge {
+  int target;
+  int tag;       // set when an epsilon edge is passed, or -1
+  bool_t *bytes; // 256 flags, NULL for epsilon edges
+} tnfa_edge_t;
+
+typedef struct tnfa_node {
+  tnfa_edge_t *edges; // in the order of their priority
+  int edge_count;
+  int edge_capacity;
+  bool_t consumes; // whether the node has an edge, which consumes a byte
+} tnfa_node_t;
+
+typedef struct tnfa {
+  tnfa_node_t *nodes;
+  int node_count;
+  int node_capacity;
+  char **capture_names; // of the result, at most MAX_CAPTURES are stored
+  int capture_count;    // may exceed MAX_CAPTURES
+} tnfa_t;
+
+static int create_tnfa_node(tnfa_t *tnfa) {
+  if (tnfa->node_count == tnfa->node_capacity) {
+    tnfa->node_capacity = tnfa->node_capacity * 2 + 16;
+    tnfa->nodes =
+        realloc(tnfa->nodes, tnfa->node_capacity * sizeof(tnfa_node_t));
+  }
+  tnfa->nodes[tnfa->node_count] = (tnfa_node_t){.edges = NULL,
+                                                .edge_count = 0,
+                                                .edge_capacity = 0,
+                                                .consumes = 0};
+  return tnfa->node_count++;
+}
+
+static void add_tnfa_edge(tnfa_t *tnfa, int node0, int node1, int tag,
+                          bool_t *bytes) {
+  tnfa_node_t *node = &tnfa->nodes[node0];
+  if (node->edge_count == node->edge_capacity) {
+    node->edge_capacity = node->edge_capacity * 2 + 2;
+    node->edges =
+        realloc(node->edges, node->edge_capacity * sizeof(tnfa_edge_t));
+  }
+  node->edges[node->edge_count++] =
+      (tnfa_edge_t){.target = node1, .tag = tag, .bytes = bytes};
+  node->consumes |= bytes != NULL;
+}
+
+static void add_epsilon_edge(tnfa_t *tnfa, int node0, int node1) {
+  add_tnfa_edge(tnfa, node0, node1, -1, NULL);
+}
+
+/**
+ * Returns the index of the capture with the given {@code name}, which is
+ * added if it is new.
+ */
+static int get_capture_index(tnfa_t *tnfa, char *name) {
+  for (int k = 0; k < tnfa->capture_count && k < MAX_CAPTURES; k++) {
+    if (strcmp(tnfa->capture_names[k], name) == 0) {
+      return k;
+    }
+  }
+  if (tnfa->capture_count < MAX_CAPTURES) {
+    tnfa->capture_names[tnfa->capture_count] = strdup(name);
+  }
+  return tnfa->capture_count++;
+}
+
+static void build_tnfa(tnfa_t *tnfa, ast_t *ast, int *start, int *end);
+
+static void build_terminal_tnfa(tnfa_t *tnfa, ast_t *ast, int *start,
+                                int *end) {
+  bool_t *bytes = malloc(256 * sizeof(bool_t));
+  for (int t = 0; t < 256; t++) {
+    switch (ast->type) {
+    case CHAR:
+      bytes[t] = t == ast->terminal;
+      break;
+    case CLASS:
+      bytes[t] = ast->terminals[t] != 0;
+      break;
+    case INV_CLASS:
+      bytes[t] = ast->terminals[t] == 0;
+      break;
+    default:
+      bytes[t] = 1;
+    }
+  }
+  *start = create_tnfa_node(tnfa);
+  *end = create_tnfa_node(tnfa);
+  add_tnfa_edge(tnfa, *start, *end, -1, bytes);
+}
+
+/**
+ * Builds the children of the given {@code ast} in source order, one after the
+ * other (for and-expressions) or as alternatives (for or-expressions).
+ */
+static void build_children_tnfa(tnfa_t *tnfa, ast_t *ast, int *start,
+                                int *end) {
+  int count;
+  ast_t **children = get_children_in_order(ast, &count);
+  *start = create_tnfa_node(tnfa);
+  *end = ast->type == OR_EXPR ? create_tnfa_node(tnfa) : *start;
+  for (int i = 0; i < count; i++) {
+    int inner_start, inner_end;
+    build_tnfa(tnfa, children[i], &inner_start, &inner_end);
+    if (ast->type == OR_EXPR) {
+      add_epsilon_edge(tnfa, *start, inner_start);
+      add_epsilon_edge(tnfa, inner_end, *end);
+    } else {
+      add_epsilon_edge(tnfa, *end, inner_start);
+      *end = inner_end;
+    }
+  }
+  free(children);
+}
+
+/**
+ * Builds a greedy loop around {@code child}: the loop node prefers another
+ * repetition over leaving it. Stores the loop node into {@code loop}.
+ */
+static void build_loop_tnfa(tnfa_t *tnfa, ast_t *child, int *loop, int *end) {
+  *loop = create_tnfa_node(tnfa);
+  *end = create_tnfa_node(tnfa);
+  int inner_start, inner_end;
+  build_tnfa(tnfa, child, &inner_start, &inner_end);
+  add_epsilon_edge(tnfa, *loop, inner_start);
+  add_epsilon_edge(tnfa, *loop, *end);
+  add_epsilon_edge(tnfa, inner_end, *loop);
+}
+
+/**
+ * Builds the given repetition {@code ast} from copies of its child: the
+ * required copies, followed by a loop (if unbounded) or by nested optional
+ * copies, which prefer to match.
+ */
+static void build_repeat_tnfa(tnfa_t *tnfa, ast_t *ast, int *start,
+                              int *end) {
+  ast_t *child = &ast->children->child;
+  *start = create_tnfa_node(tnfa);
+  *end = *start;
+  for (int i = 0; i < ast->repeat_min; i++) {
+    int inner_start, inner_end;
+    build_tnfa(tnfa, child, &inner_start, &inner_end);
+    add_epsilon_edge(tnfa, *end, inner_start);
+    *end = inner_end;
+  }
+  if (ast->repeat_max == -1) {
+    int loop, loop_end;
+    build_loop_tnfa(tnfa, child, &loop, &loop_end);
+    add_epsilon_edge(tnfa, *end, loop);
+    *end = loop_end;
+    return;
+  }
+  int optional_end = create_tnfa_node(tnfa);
+  for (int i = ast->repeat_min; i < ast->repeat_max; i++) {
+    int inner_start, inner_end;
+    build_tnfa(tnfa, child, &inner_start, &inner_end);
+    add_epsilon_edge(tnfa, *end, inner_start);
+    add_epsilon_edge(tnfa, *end, optional_end);
+    *end = inner_end;
+  }
+  add_epsilon_edge(tnfa, *end, optional_end);
+  *end = optional_end;
+}
+
+/**
+ * Copies the DFA of the intersection, complement or UTF-8 class {@code ast}
+ * (see {@code get_embedded_automaton}) into the tagged NFA.
+ */
+static void build_embedded_tnfa(tnfa_t *tnfa, ast_t *ast, int *start,
+                                int *end) {
+  automaton_t *dfa = get_embedded_automaton(ast);
+  *start = create_tnfa_node(tnfa);
+  *end = create_tnfa_node(tnfa);
+  int offset = tnfa->node_count;
+  for (int node = 0; node < dfa->next_node_index; node++) {
+    create_tnfa_node(tnfa);
+  }
+  for (int node = 0; node < dfa->next_node_index; node++) {
+    for (int e = 0; e < dfa->nodes[node].edge_count; e++) {
+      edge_t *edge = &dfa->nodes[node].edges[e];
+      bool_t *bytes = malloc(256 * sizeof(bool_t));
+      memcpy(bytes, edge->transitions, 256 * sizeof(bool_t));
+      add_tnfa_edge(tnfa, offset + node, offset + edge->target, -1, bytes);
+    }
+    if (dfa->nodes[node].end_tag != -1) {
+      add_epsilon_edge(tnfa, offset + node, *end);
+    }
+  }
+  add_epsilon_edge(tnfa, *start, offset + dfa->start_index);
+}
+
+static void build_tnfa(tnfa_t *tnfa, ast_t *ast, int *start, int *end) {
+  ast = resolve_references(ast);
+  int inner_start, inner_end;
+  switch (ast->type) {
+  case OR_EXPR:
+  case AND_EXPR:
+    build_children_tnfa(tnfa, ast, start, end);
+    return;
+  case CHAR:
+  case CLASS:
+  case INV_CLASS:
+  case WILDCARD:
+    build_terminal_tnfa(tnfa, ast, start, end);
+    return;
+  case STAR_MODIFIER:
+    build_loop_tnfa(tnfa, &ast->children->child, start, end);
+    return;
+  case PLUS_MODIFIER:
+    build_tnfa(tnfa, &ast->children->child, start, &inner_end);
+    *end = create_tnfa_node(tnfa);
+    add_epsilon_edge(tnfa, inner_end, *start);
+    add_epsilon_edge(tnfa, inner_end, *end);
+    return;
+  case OPT_MODIFIER:
+    *start = create_tnfa_node(tnfa);
+    *end = create_tnfa_node(tnfa);
+    build_tnfa(tnfa, &ast->children->child, &inner_start, &inner_end);
+    add_epsilon_edge(tnfa, *start, inner_start);
+    add_epsilon_edge(tnfa, *start, *end);
+    add_epsilon_edge(tnfa, inner_end, *end);
+    return;
+  case REPEAT_MODIFIER:
+    build_repeat_tnfa(tnfa, ast, start, end);
+    return;
+  case CAPTURE_GROUP: {
+    int capture = get_capture_index(tnfa, ast->capture_name);
+    *start = create_tnfa_node(tnfa);
+    *end = create_tnfa_node(tnfa);
+    build_tnfa(tnfa, &ast->children->child, &inner_start, &inner_end);
+    add_tnfa_edge(tnfa, *start, inner_start, 2 * capture, NULL);
+    add_tnfa_edge(tnfa, inner_end, *end, 2 * capture + 1, NULL);
+    return;
+  }
+  case INTERSECTION_EXPR:
+  case COMPLEMENT_EXPR:
+  case UTF8_CLASS:
+    build_embedded_tnfa(tnfa, ast, start, end);
+    return;
+  case REFERENCE:
+    // References have been resolved above
+    return;
+  }
+}
+
+static void delete_tnfa(tnfa_t tnfa) {
+  for (int node = 0; node < tnfa.node_count; node++) {
+    for (int e = 0; e < tnfa.nodes[node].edge_count; e++) {
+      free(tnfa.nodes[node].edges[e].bytes);
+    }
+    free(tnfa.nodes[node].edges);
+  }
+  free(tnfa.nodes);
+}
+
+/*
+ * The determinization.
+ */
+
+// The register, which breaks cycles of copies, until the number of registers
+// is known
+#define TEMP_REGISTER -3
+
+typedef struct tagged_item {
+  int node;
+  int origin;        // the node of the previous state, the path came from
+  uint64_t set_tags; // the tags passed in the closure
+} tagged_item_t;
+
+typedef struct tagged_builder {
+  tnfa_t *tnfa;
+  int end_node;
+  int tag_count;
+  int *register_base; // of every node, or -1 if not yet assigned
+  int register_count;
+  // The closure being computed: nodes are visited in the current generation
+  int *visited;
+  int generation;
+  tagged_item_t *items;
+  int item_count;
+  // The ordered nodes of every state, and a hash table of them
+  int **state_nodes;
+  int *state_sizes;
+  int state_count;
+  int state_capacity;
+  int *table; // state indices, -1 for empty slots
+  int table_size;
+  // Scratch arrays of the sequentialization of copies, per register
+  int *readers;
+  int *writer;
+} tagged_builder_t;
+
+/**
+ * Adds the nodes reachable from {@code node} by epsilon edges to the closure
+ * in the order of their priority. Only nodes, which consume bytes, and the end
+ * node are kept.
+ */
+static void add_to_closure(tagged_builder_t *builder, int node, int origin,
+                           uint64_t set_tags) {
+  if (builder->visited[node] == builder->generation) {
+    return;
+  }
+  builder->visited[node] = builder->generation;
+  tnfa_node_t *tnfa_node = &builder->tnfa->nodes[node];
+  if (tnfa_node->consumes || node == builder->end_node) {
+    builder->items[builder->item_count++] = (tagged_item_t){
+        .node = node, .origin = origin, .set_tags = set_tags};
+  }
+  for (int e = 0; e < tnfa_node->edge_count; e++) {
+    tnfa_edge_t *edge = &tnfa_node->edges[e];
+    if (edge->bytes == NULL) {
+      uint64_t tags = set_tags;
+      if (edge->tag != -1) {
+        tags |= (uint64_t)1 << edge->tag;
+      }
+      add_to_closure(builder, edge->target, origin, tags);
+    }
+  }
+}
+
+static unsigned long hash_state_nodes(int *nodes, int count) {
+  return hash_bytes(nodes, count * sizeof(int), HASH_SEED);
+}
+
+static void grow_state_table(tagged_builder_t *builder) {
+  int old_size = builder->table_size;
+  int *old_table = builder->table;
+  builder->table_size = old_size * 2;
+  builder->table = malloc(builder->table_size * sizeof(int));
+  memset(builder->table, 0xff, builder->table_size * sizeof(int));
+  for (int i = 0; i < old_size; i++) {
+    int state = old_table[i];
+    if (state == -1) {
+      continue;
+    }
+    unsigned long slot = hash_state_nodes(builder->state_nodes[state],
+                                          builder->state_sizes[state]);
+    while (builder->table[slot & (builder->table_size - 1)] != -1) {
+      slot++;
+    }
+    builder->table[slot & (builder->table_size - 1)] = state;
+  }
+  free(old_table);
+}
+
+/**
+ * Returns the state of the nodes of the current closure, which is added if it
+ * is new. Stores whether it is new into {@code added}.
+ */
+static int find_or_add_state(tagged_builder_t *builder, bool_t *added) {
+  int count = builder->item_count;
+  int *nodes = malloc(count * sizeof(int));
+  for (int i = 0; i < count; i++) {
+    nodes[i] = builder->items[i].node;
+  }
+  unsigned long slot = hash_state_nodes(nodes, count);
+  while (1) {
+    int state = builder->table[slot & (builder->table_size - 1)];
+    if (state == -1) {
+      break;
+    }
+    if (builder->state_sizes[state] == count &&
+        memcmp(builder->state_nodes[state], nodes, count * sizeof(int)) ==
+            0) {
+      free(nodes);
+      *added = 0;
+      return state;
+    }
+    slot++;
+  }
+  if (builder->state_count == builder->state_capacity) {
+    builder->state_capacity = builder->state_capacity * 2 + 16;
+    builder->state_nodes =
+        realloc(builder->state_nodes, builder->state_capacity * sizeof(int *));
+    builder->state_sizes =
+        realloc(builder->state_sizes, builder->state_capacity * sizeof(int));
+  }
+  int state = builder->state_count++;
+  builder->state_nodes[state] = nodes;
+  builder->state_sizes[state] = count;
+  builder->table[slot & (builder->table_size - 1)] = state;
+  for (int i = 0; i < count; i++) {
+    if (builder->register_base[nodes[i]] == -1) {
+      builder->register_base[nodes[i]] = builder->register_count;
+      builder->register_count += builder->tag_count;
+    }
+  }
+  if (2 * builder->state_count > builder->table_size) {
+    grow_state_table(builder);
+  }
+  *added = 1;
+  return state;
+}
+
+/**
+ * Orders the parallel copies {@code moves} (all targets are distinct), such
+ * that no register is overwritten before it has been read, and stores them
+ * into {@code ops}. A cycle of copies is broken by saving one register into
+ * {@code temp}. Returns the number of operations.
+ */
+static int sequentialize_moves(tagged_builder_t *builder,
+                               register_op_t *moves, int count, int temp,
+                               register_op_t *ops) {
+  int *readers = builder->readers;
+  int *writer = builder->writer;
+  int *ready = malloc(count * sizeof(int));
+  bool_t *done = calloc(count, sizeof(bool_t));
+  int ready_count = 0;
+  for (int i = 0; i < count; i++) {
+    writer[moves[i].target] = i;
+    if (moves[i].source >= 0) {
+      readers[moves[i].source]++;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (readers[moves[i].target] == 0) {
+      ready[ready_count++] = i;
+    }
+  }
+  int op_count = 0;
+  int remaining = count;
+  int next_cycle = 0;
+  while (remaining > 0) {
+    while (ready_count > 0) {
+      int i = ready[--ready_count];
+      ops[op_count++] = moves[i];
+      done[i] = 1;
+      remaining--;
+      int source = moves[i].source;
+      if (source >= 0 && --readers[source] == 0 && writer[source] != -1 &&
+          !done[writer[source]]) {
+        ready[ready_count++] = writer[source];
+      }
+    }
+    if (remaining == 0) {
+      break;
+    }
+    // All remaining copies are in cycles: save the target of one of them
+    while (done[next_cycle]) {
+      next_cycle++;
+    }
+    int target = moves[next_cycle].target;
+    ops[op_count++] = (register_op_t){.target = temp, .source = target};
+    for (int i = 0; i < count; i++) {
+      if (!done[i] && moves[i].source == target) {
+        moves[i].source = temp;
+      }
+    }
+    readers[target] = 0;
+    ready[ready_count++] = next_cycle;
+  }
+  for (int i = 0; i < count; i++) {
+    writer[moves[i].target] = -1;
+    if (moves[i].source >= 0) {
+      readers[moves[i].source] = 0;
+    }
+  }
+  free(ready);
+  free(done);
+  return op_count;
+}
+
+/**
+ * Returns the register operations, which set the registers of the items of
+ * the current closure, and stores their number into {@code op_count}. Tags
+ * passed in the closure are set to the position, the others are copied from
+ * the origin of the item (or unset, if {@code origin_registers} is 0).
+ */
+static register_op_t *create_closure_ops(tagged_builder_t *builder,
+                                         bool_t origin_registers,
+                                         int *op_count) {
+  int T = builder->tag_count;
+  register_op_t *moves = malloc((builder->item_count * T + 1) *
+                                sizeof(register_op_t));
+  int move_count = 0;
+  for (int i = 0; i < builder->item_count; i++) {
+    tagged_item_t *item = &builder->items[i];
+    int base = builder->register_base[item->node];
+    for (int t = 0; t < T; t++) {
+      int source;
+      if (item->set_tags & ((uint64_t)1 << t)) {
+        source = REGISTER_POSITION;
+      } else if (origin_registers) {
+        source = builder->register_base[item->origin] + t;
+      } else {
+        source = REGISTER_UNSET;
+      }
+      if (source != base + t) {
+        moves[move_count++] =
+            (register_op_t){.target = base + t, .source = source};
+      }
+    }
+  }
+  register_op_t *ops = malloc((2 * move_count + 1) * sizeof(register_op_t));
+  *op_count =
+      sequentialize_moves(builder, moves, move_count, TEMP_REGISTER, ops);
+  free(moves);
+  return ops;
+}
+
+static void replace_temp_register_in_ops(register_op_t *ops, int op_count,
+                                         int temp) {
+  for (int i = 0; i < op_count; i++) {
+    if (ops[i].target == TEMP_REGISTER) {
+      ops[i].target = temp;
+    }
+    if (ops[i].source == TEMP_REGISTER) {
+      ops[i].source = temp;
+    }
+  }
+}
+
+/**
+ * Replaces {@code TEMP_REGISTER} by the register after the last one.
+ */
+static void replace_temp_register(tagged_dfa_t *dfa) {
+  replace_temp_register_in_ops(dfa->start_ops, dfa->start_op_count,
+                               dfa->register_count);
+  for (int state = 0; state < dfa->state_count; state++) {
+    for (int c = 0; c < dfa->class_count; c++) {
+      tagged_transition_t *transition = &dfa->states[state].transitions[c];
+      replace_temp_register_in_ops(transition->ops, transition->op_count,
+                                   dfa->register_count);
+    }
+  }
+}
+
+bool_t convert_ast_to_tagged_dfa(ast_t *ast, dfa_budget_t *budget,
+                                 tagged_dfa_t *result, char **error) {
+  memset(result, 0, sizeof(tagged_dfa_t));
+  tnfa_t tnfa = {.nodes = NULL,
+                 .node_count = 0,
+                 .node_capacity = 0,
+                 .capture_names = result->capture_names,
+                 .capture_count = 0};
+  int start, end;
+  build_tnfa(&tnfa, ast, &start, &end);
+  if (tnfa.capture_count > MAX_CAPTURES) {
+    asprintf(error, "more than %d capture groups", MAX_CAPTURES);
+    result->capture_count = MAX_CAPTURES;
+    delete_tnfa(tnfa);
+    delete_tagged_dfa(*result);
+    return 0;
+  }
+  result->capture_count = tnfa.capture_count;
+
+  memset(result->class_of, 0, sizeof(result->class_of));
+  result->class_count = 1;
+  for (int node = 0; node < tnfa.node_count; node++) {
+    for (int e = 0; e < tnfa.nodes[node].edge_count; e++) {
+      if (tnfa.nodes[node].edges[e].bytes != NULL) {
+        result->class_count = refine_terminal_classes(
+            result->class_of, tnfa.nodes[node].edges[e].bytes);
+      }
+    }
+  }
+  int representatives[256];
+  get_class_representatives(result->class_of, result->class_count,
+                            representatives);
+
+  tagged_builder_t builder = {
+      .tnfa = &tnfa,
+      .end_node = end,
+      .tag_count = 2 * tnfa.capture_count,
+      .register_base = malloc(tnfa.node_count * sizeof(int)),
+      .register_count = 0,
+      .visited = calloc(tnfa.node_count, sizeof(int)),
+      .generation = 0,
+      .items = malloc(tnfa.node_count * sizeof(tagged_item_t)),
+      .state_nodes = NULL,
+      .state_sizes = NULL,
+      .state_count = 0,
+      .state_capacity = 0,
+      .table = malloc(64 * sizeof(int)),
+      .table_size = 64};
+  memset(builder.register_base, 0xff, tnfa.node_count * sizeof(int));
+  memset(builder.table, 0xff, 64 * sizeof(int));
+  // The end node gets the first registers, which hold the captures
+  builder.register_base[end] = 0;
+  builder.register_count = builder.tag_count;
+  result->final_register = 0;
+
+  builder.generation++;
+  builder.item_count = 0;
+  add_to_closure(&builder, start, start, 0);
+  bool_t added;
+  result->start_index = find_or_add_state(&builder, &added);
+  // The scratch arrays must cover all registers, so they are allocated once
+  // every node may own registers (the temp register included)
+  int max_registers = (tnfa.node_count + 1) * builder.tag_count + 1;
+  builder.readers = calloc(max_registers, sizeof(int));
+  builder.writer = malloc(max_registers * sizeof(int));
+  memset(builder.writer, 0xff, max_registers * sizeof(int));
+  result->start_ops =
+      create_closure_ops(&builder, 0, &result->start_op_count);
+
+  int max_states = budget != NULL ? budget->max_states : 0;
+  bool_t exceeded = 0;
+  int states_capacity = 0;
+  int state = 0;
+  for (; state < builder.state_count && !exceeded; state++) {
+    if (state == states_capacity) {
+      states_capacity = states_capacity * 2 + 16;
+      result->states =
+          realloc(result->states, states_capacity * sizeof(tagged_state_t));
+    }
+    tagged_state_t *tagged_state = &result->states[state];
+    int *nodes = builder.state_nodes[state];
+    int size = builder.state_sizes[state];
+    tagged_state->end_tag = -1;
+    for (int i = 0; i < size; i++) {
+      if (nodes[i] == end) {
+        tagged_state->end_tag = 0;
+      }
+    }
+    tagged_state->transitions =
+        calloc(result->class_count, sizeof(tagged_transition_t));
+    for (int c = 0; c < result->class_count; c++) {
+      int byte = representatives[c];
+      builder.generation++;
+      builder.item_count = 0;
+      for (int i = 0; i < size; i++) {
+        tnfa_node_t *node = &tnfa.nodes[nodes[i]];
+        for (int e = 0; e < node->edge_count; e++) {
+          if (node->edges[e].bytes != NULL && node->edges[e].bytes[byte]) {
+            add_to_closure(&builder, node->edges[e].target, nodes[i], 0);
+          }
+        }
+      }
+      tagged_transition_t *transition = &tagged_state->transitions[c];
+      if (builder.item_count == 0) {
+        transition->target = -1;
+        continue;
+      }
+      transition->target = find_or_add_state(&builder, &added);
+      transition->ops =
+          create_closure_ops(&builder, 1, &transition->op_count);
+      if (added && max_states > 0 && builder.state_count > max_states) {
+        exceeded = 1;
+      }
+    }
+  }
+  // Only the processed states have transitions
+  result->state_count = state;
+  result->register_count = builder.register_count;
+  replace_temp_register(result);
+
+  for (int i = 0; i < builder.state_count; i++) {
+    free(builder.state_nodes[i]);
+  }
+  free(builder.state_nodes);
+  free(builder.state_sizes);
+  free(builder.table);
+  free(builder.register_base);
+  free(builder.visited);
+  free(builder.items);
+  free(builder.readers);
+  free(builder.writer);
+  delete_tnfa(tnfa);
+  if (exceeded) {
+    asprintf(error, "the tagged DFA has more than %d states", max_states);
+    delete_tagged_dfa(*result);
+    return 0;
+  }
+  return 1;
+}
+
+void delete_tagged_dfa(tagged_dfa_t dfa) {
+  for (int state = 0; state < dfa.state_count; state++) {
+    for (int c = 0; c < dfa.class_count; c++) {
+      free(dfa.states[state].transitions[c].ops);
+    }
+    free(dfa.states[state].transitions);
+  }
+  free(dfa.states);
+  free(dfa.start_ops);
+  for (int k = 0; k < dfa.capture_count; k++) {
+    free(dfa.capture_names[k]);
+  }
+}
+
+static void print_register_ops(register_op_t *ops, int op_count, FILE *fout) {
+  for (int i = 0; i < op_count; i++) {
+    fprintf(fout, " r%d=", ops[i].target);
+    if (ops[i].source == REGISTER_POSITION) {
+      fprintf(fout, "pos");
+    } else if (ops[i].source == REGISTER_UNSET) {
+      fprintf(fout, "-1");
+    } else {
+      fprintf(fout, "r%d", ops[i].source);
+    }
+  }
+}
+
+void print_tagged_dfa(tagged_dfa_t *dfa, FILE *fout) {
+  fprintf(fout, "captures:");
+  for (int k = 0; k < dfa->capture_count; k++) {
+    fprintf(fout, " %s (r%d, r%d)", dfa->capture_names[k],
+            dfa->final_register + 2 * k, dfa->final_register + 2 * k + 1);
+  }
+  fprintf(fout, "\nstart %d:", dfa->start_index);
+  print_register_ops(dfa->start_ops, dfa->start_op_count, fout);
+  fprintf(fout, "\n");
+  for (int state = 0; state < dfa->state_count; state++) {
+    fprintf(fout, "%d%s\n", state,
+            dfa->states[state].end_tag != -1 ? " (end)" : "");
+    for (int c = 0; c < dfa->class_count; c++) {
+      tagged_transition_t *transition = &dfa->states[state].transitions[c];
+      if (transition->target == -1) {
+        continue;
+      }
+      fprintf(fout, "  class %d -> %d:", c, transition->target);
+      print_register_ops(transition->ops, transition->op_count, fout);
+      fprintf(fout, "\n");
+    }
+  }
+}
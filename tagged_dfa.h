@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "automaton.h"
+#include "common.h"
+
+// The most capture groups (with distinct names) of a pattern
+#define MAX_CAPTURES 32
+
+// Sources of register operations, which are not registers
+#define REGISTER_POSITION -1 // the number of bytes consumed so far
+#define REGISTER_UNSET -2    // -1, for captures which did not participate
+
+typedef struct register_op {
+  int target; // a register
+  int source; // a register, REGISTER_POSITION or REGISTER_UNSET
+} register_op_t;
+
+typedef struct tagged_transition {
+  int target;          // the next state, or -1 if there is no transition
+  register_op_t *ops;  // executed in order, after the byte was consumed
+  int op_count;
+} tagged_transition_t;
+
+typedef struct tagged_state {
+  int end_tag;                      // -1 if the state does not accept
+  tagged_transition_t *transitions; // one per byte class
+} tagged_state_t;
+
+typedef struct tagged_dfa {
+  tagged_state_t *states;
+  int state_count;
+  int start_index;
+  register_op_t *start_ops; // executed before the first byte is consumed
+  int start_op_count;
+  int class_of[256]; // see compute_terminal_classes
+  int class_count;
+  // Registers 0 to register_count - 1 hold the tags of the NFA nodes; an
+  // additional register at register_count is used to break cycles of copies
+  int register_count;
+  // The registers of the start and end offset of every capture at accepting
+  // states: final_register + 2 * k and final_register + 2 * k + 1
+  int final_register;
+  char *capture_names[MAX_CAPTURES]; // in the order of their first '('
+  int capture_count;
+} tagged_dfa_t;
+
+/**
+ * Converts the given {@code ast} to a tagged DFA (Laurikari), which records
+ * the submatches of the capture groups of the {@code ast} in registers while
+ * it consumes the input, in a single forward pass.
+ *
+ * The {@code ast} is converted to an NFA (as in Thompson's construction),
+ * whose epsilon transitions are ordered by priority (left alternatives and
+ * more repetitions first) and tagged at the start and end of every capture
+ * group. Every DFA state is an ordered list of NFA nodes; the epsilon closure
+ * keeps only the first path to every node, so each accepting state reports the
+ * submatches of the highest priority match ending there (leftmost greedy, as
+ * in Perl, except that a loop never records an iteration matching the empty
+ * string, where Perl performs one before it leaves the loop). Every NFA node
+ * owns one register per tag; the operations on a transition set the tags
+ * passed in the closure to the current position, and copy the other tags from
+ * the node the path came from.
+ *
+ * Capture groups with the same name share their registers (the last submatch
+ * wins); groups inside '&' and '~' are not recorded. The automaton is not
+ * minimized.
+ *
+ * Returns 1 on success. Returns 0 if the {@code ast} has more than {@code
+ * MAX_CAPTURES} capture groups, or the automaton would get more states than
+ * {@code budget->max_states} (unless {@code budget} is {@code NULL} or its
+ * {@code max_states} is 0), and stores a description of the error into {@code
+ * error} (to be freed by the caller).
+ */
+bool_t convert_ast_to_tagged_dfa(ast_t *ast, dfa_budget_t *budget,
+                                 tagged_dfa_t *result, char **error);
+
+/**
+ * Deletes the given {@code dfa} and frees all its related memory.
+ */
+void delete_tagged_dfa(tagged_dfa_t dfa);
+
+/**
+ * Prints the given tagged {@code dfa} (states, transitions and register
+ * operations) for debugging.
+ */
+void print_tagged_dfa(tagged_dfa_t *dfa, FILE *fout);
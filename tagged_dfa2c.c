@@ -0,0 +1,112 @@
+#include "tagged_dfa2c.h"
+#include "automaton2c.h"
+#include "common.h"
+
+static void print_register_ops(register_op_t *ops, int op_count, int indent,
+                               FILE *fout) {
+  for (int i = 0; i < op_count; i++) {
+    fprint_indent(indent, fout);
+    fprintf(fout, "registers[%d] = ", ops[i].target);
+    if (ops[i].source == REGISTER_POSITION) {
+      fprintf(fout, "position;\n");
+    } else if (ops[i].source == REGISTER_UNSET) {
+      fprintf(fout, "-1;\n");
+    } else {
+      fprintf(fout, "registers[%d];\n", ops[i].source);
+    }
+  }
+}
+
+static void print_transition(tagged_dfa_t *dfa, int state, int class,
+                             FILE *fout) {
+  // Print the byte ranges of the class as case labels
+  for (int first = 0; first < 256; first++) {
+    if (dfa->class_of[first] != class) {
+      continue;
+    }
+    int last = first;
+    while (last < 255 && dfa->class_of[last + 1] == class) {
+      last++;
+    }
+    fprint_indent(6, fout);
+    if (first == last) {
+      fprintf(fout, "case %d:\n", first);
+    } else {
+      fprintf(fout, "case %d ... %d:\n", first, last);
+    }
+    first = last;
+  }
+  tagged_transition_t *transition = &dfa->states[state].transitions[class];
+  fprint_indent(8, fout);
+  fprintf(fout, "position++;\n");
+  print_register_ops(transition->ops, transition->op_count, 8, fout);
+  fprint_indent(8, fout);
+  fprintf(fout, "state = %d;\n", transition->target);
+  fprint_indent(8, fout);
+  fprintf(fout, "continue;\n");
+}
+
+void print_tagged_dfa_to_c_code(tagged_dfa_t *dfa, char *parser_name,
+                                char *next_name, char *acc_name,
+                                char *rej_name, int flags, FILE *fout) {
+  fprintf(fout, "enum {\n");
+  for (int k = 0; k < dfa->capture_count; k++) {
+    fprint_indent(2, fout);
+    fprintf(fout, "%s_%s = %d,\n", parser_name, dfa->capture_names[k], k);
+  }
+  fprint_indent(2, fout);
+  fprintf(fout, "%s_capture_count = %d\n", parser_name, dfa->capture_count);
+  fprintf(fout, "};\n");
+  print_helper_declarations(next_name, acc_name, rej_name, flags, fout);
+  fprintf(fout, "%svoid %s(long *captures) {\n",
+          get_parser_storage(flags), parser_name);
+  fprint_indent(2, fout);
+  fprintf(fout, "long registers[%d];\n", dfa->register_count + 1);
+  fprint_indent(2, fout);
+  fprintf(fout, "long position = 0;\n");
+  print_register_ops(dfa->start_ops, dfa->start_op_count, 2, fout);
+  fprint_indent(2, fout);
+  fprintf(fout, "int state = %d;\n", dfa->start_index);
+  fprint_indent(2, fout);
+  fprintf(fout, "while (1) {\n");
+  fprint_indent(4, fout);
+  fprintf(fout, "switch (state) {\n");
+
+  for (int state = 0; state < dfa->state_count; state++) {
+    fprint_indent(4, fout);
+    fprintf(fout, "case %d:\n", state);
+    int end_tag = dfa->states[state].end_tag;
+    if (end_tag != -1) {
+      // Report the submatches of the match ending here
+      for (int t = 0; t < 2 * dfa->capture_count; t++) {
+        fprint_indent(6, fout);
+        fprintf(fout, "captures[%d] = registers[%d];\n", t,
+                dfa->final_register + t);
+      }
+      fprint_indent(6, fout);
+      fprintf(fout, "if (%s(%d)) { return; }\n", acc_name, end_tag);
+    }
+    fprint_indent(6, fout);
+    fprintf(fout, "switch (%s()) {\n", next_name);
+    for (int c = 0; c < dfa->class_count; c++) {
+      if (dfa->states[state].transitions[c].target != -1) {
+        print_transition(dfa, state, c, fout);
+      }
+    }
+    // Reject if there is no transition for that terminal-state combo
+    fprint_indent(6, fout);
+    fprintf(fout, "default:\n");
+    fprint_indent(8, fout);
+    fprintf(fout, "%s();\n", rej_name);
+    fprint_indent(8, fout);
+    fprintf(fout, "return;\n");
+    fprint_indent(6, fout);
+    fprintf(fout, "}\n");
+  }
+
+  fprint_indent(4, fout);
+  fprintf(fout, "}\n");
+  fprint_indent(2, fout);
+  fprintf(fout, "}\n");
+  fprintf(fout, "}\n");
+}
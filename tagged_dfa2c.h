@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "tagged_dfa.h"
+
+/**
+ * Generates c code from the given tagged {@code dfa} (see {@code
+ * convert_ast_to_tagged_dfa}), like {@code print_automaton_to_c_code}.
+ *
+ * The generated parser is declared as {@code void <parser_name>(long
+ * *captures)}; {@code captures} must hold two offsets per capture group. Before
+ * each call of accept, the parser stores the start and end offset (the number
+ * of bytes consumed before the submatch starts and ends) of capture group k
+ * into {@code captures[2 * k]} and {@code captures[2 * k + 1]}, or -1 for
+ * groups, which did not participate in the match. The indices are declared as
+ * {@code <parser_name>_<name>} in an enum, followed by {@code
+ * <parser_name>_capture_count}.
+ *
+ * Of the {@code flags} of {@code print_automaton_to_c_code}, only the static
+ * flags and REGEX2C_OMIT_HELPER_DECLS are supported.
+ */
+void print_tagged_dfa_to_c_code(tagged_dfa_t *dfa, char *parser_name,
+                                char *next_name, char *acc_name,
+                                char *rej_name, int flags, FILE *fout);
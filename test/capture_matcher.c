@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The parsers of captures.txt
+extern void alternation(long *captures);
+extern void optional(long *captures);
+extern void nested(long *captures);
+extern void star(long *captures);
+extern void repeat(long *captures);
+
+typedef struct parser {
+  char *name;
+  void (*parse)(long *captures);
+} parser_t;
+
+parser_t parsers[] = {{"alternation", alternation},
+                      {"optional", optional},
+                      {"nested", nested},
+                      {"star", star},
+                      {"repeat", repeat}};
+
+int next_char = EOF;
+long captures[16];
+// The expected start and end offsets of all capture groups
+char **expected;
+int expected_count;
+
+int peek_next() { return next_char; }
+
+int consume_next() {
+  int c = peek_next();
+  next_char = getc(stdin);
+  return c;
+}
+
+int accept(int tag) {
+  if (peek_next() != EOF) {
+    // Only check the submatches of the whole string
+    return 0;
+  }
+  int failed = 0;
+  for (int i = 0; i < expected_count; i++) {
+    printf("%ld ", captures[i]);
+    failed |= captures[i] != atol(expected[i]);
+  }
+  printf("\n");
+  if (failed) {
+    printf("Wrong submatches!\n");
+    exit(EXIT_FAILURE);
+  }
+  exit(EXIT_SUCCESS);
+}
+
+void reject() {
+  printf("Reject!\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc - 2 > 16) {
+    printf("Usage: %s PARSER [START END]...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  expected = argv + 2;
+  expected_count = argc - 2;
+  consume_next();
+  for (size_t p = 0; p < sizeof(parsers) / sizeof(parser_t); p++) {
+    if (strcmp(parsers[p].name, argv[1]) == 0) {
+      parsers[p].parse(captures);
+      reject();
+    }
+  }
+  printf("Unknown parser %s\n", argv[1]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern void parse(const unsigned char *input, long length);
+
+long match_count = 0;
+long last_end = 0;
+// The first matches as "start-end," for comparison
+char spans[1024] = "";
+
+int accept(long start, long end) {
+  if (start < last_end || end < start) {
+    printf("Overlapping match [%ld, %ld)!\n", start, end);
+    exit(EXIT_FAILURE);
+  }
+  match_count++;
+  last_end = end;
+  size_t used = strlen(spans);
+  snprintf(spans + used, sizeof(spans) - used, "%ld-%ld,", start, end);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  long capacity = 1 << 16;
+  long length = 0;
+  unsigned char *input = malloc(capacity);
+  size_t count;
+  while ((count = fread(input + length, 1, capacity - length, stdin)) > 0) {
+    length += count;
+    if (length == capacity) {
+      capacity *= 2;
+      input = realloc(input, capacity);
+    }
+  }
+  parse(input, length);
+  printf("%ld matches\n", match_count);
+  free(input);
+  if (argc > 2 && strcmp(spans, argv[2]) != 0) {
+    printf("Expected the matches %s, but found %s\n", argv[2], spans);
+    return EXIT_FAILURE;
+  }
+  // Fails, unless the expected number of matches is given and found
+  return argc > 1 && match_count != atol(argv[1]) ? EXIT_FAILURE
+                                                  : EXIT_SUCCESS;
+}
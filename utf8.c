@@ -0,0 +1,436 @@
+#include "utf8.h"
+#include "automaton.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The longest UTF-8 encoding
+#define MAX_UTF8_LENGTH 4
+
+typedef struct byte_range {
+  unsigned char first;
+  unsigned char last;
+} byte_range_t;
+
+typedef struct utf8_sequences {
+  byte_range_t (*sequences)[MAX_UTF8_LENGTH];
+  int *lengths;
+  int count;
+  int capacity;
+} utf8_sequences_t;
+
+typedef struct utf8_transition {
+  byte_range_t range;
+  int target; // the built target node, -1 while it is not built yet
+} utf8_transition_t;
+
+typedef struct utf8_trie_node {
+  utf8_transition_t *transitions;
+  int count;
+  int capacity;
+} utf8_trie_node_t;
+
+typedef struct built_node {
+  unsigned long hash;
+  utf8_transition_t *transitions; // NULL if the slot is empty
+  int count;
+  int node;
+} built_node_t;
+
+typedef struct utf8_compiler {
+  automaton_t automaton;
+  int final_node;
+  // The nodes of the path of the last added sequence, which are not built
+  // yet. The last transition of each node leads to the next one.
+  utf8_trie_node_t path[MAX_UTF8_LENGTH + 1];
+  int depth;
+  // Built nodes by their transitions, for suffix sharing (open addressing)
+  built_node_t *built;
+  int built_capacity;
+} utf8_compiler_t;
+
+typedef struct category_group {
+  char *name;
+  char *long_name;
+  char *members; // the first letters of the member categories, or the names
+} category_group_t;
+
+static const category_group_t CATEGORY_GROUPS[] = {
+    {"L", "Letter", "L"},      {"LC", "Cased_Letter", "Lu Ll Lt"},
+    {"M", "Mark", "M"},        {"N", "Number", "N"},
+    {"P", "Punctuation", "P"}, {"S", "Symbol", "S"},
+    {"Z", "Separator", "Z"},   {"C", "Other", "C"},
+};
+
+codepoint_set_t create_codepoint_set() {
+  codepoint_set_t set = {.ranges = NULL, .range_count = 0,
+                         .range_capacity = 0};
+  return set;
+}
+
+void add_codepoint_range(codepoint_set_t *set, int first, int last) {
+  if (set->range_count == set->range_capacity) {
+    set->range_capacity =
+        set->range_capacity == 0 ? 8 : 2 * set->range_capacity;
+    set->ranges =
+        realloc(set->ranges, set->range_capacity * sizeof(codepoint_range_t));
+  }
+  codepoint_range_t range = {.first = first, .last = last};
+  set->ranges[set->range_count++] = range;
+}
+
+static void add_category_ranges(codepoint_set_t *set,
+                                const unicode_category_t *category) {
+  for (int i = 0; i < category->range_count; i++) {
+    add_codepoint_range(set, category->ranges[i].first,
+                        category->ranges[i].last);
+  }
+}
+
+/**
+ * Adds the categories of the given group to the given {@code set}. Members of
+ * one letter select all categories starting with it.
+ */
+static void add_category_group(codepoint_set_t *set,
+                               const category_group_t *group) {
+  for (int c = 0; c < UNICODE_CATEGORY_COUNT; c++) {
+    const char *name = UNICODE_CATEGORIES[c].name;
+    bool_t member = strlen(group->members) == 1
+                        ? name[0] == group->members[0]
+                        : strstr(group->members, name) != NULL;
+    if (member) {
+      add_category_ranges(set, &UNICODE_CATEGORIES[c]);
+    }
+  }
+}
+
+bool_t add_unicode_category(codepoint_set_t *set, char *name) {
+  if (strcmp(name, "Any") == 0) {
+    add_codepoint_range(set, 0, MAX_CODEPOINT);
+    return 1;
+  }
+  for (int c = 0; c < UNICODE_CATEGORY_COUNT; c++) {
+    if (strcmp(name, UNICODE_CATEGORIES[c].name) == 0 ||
+        strcmp(name, UNICODE_CATEGORIES[c].long_name) == 0) {
+      add_category_ranges(set, &UNICODE_CATEGORIES[c]);
+      return 1;
+    }
+  }
+  int group_count = sizeof(CATEGORY_GROUPS) / sizeof(category_group_t);
+  for (int g = 0; g < group_count; g++) {
+    if (strcmp(name, CATEGORY_GROUPS[g].name) == 0 ||
+        strcmp(name, CATEGORY_GROUPS[g].long_name) == 0) {
+      add_category_group(set, &CATEGORY_GROUPS[g]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int compare_codepoint_ranges(const void *a, const void *b) {
+  const codepoint_range_t *range_a = a;
+  const codepoint_range_t *range_b = b;
+  return range_a->first - range_b->first;
+}
+
+void normalize_codepoint_set(codepoint_set_t *set) {
+  if (set->range_count == 0) {
+    return;
+  }
+  qsort(set->ranges, set->range_count, sizeof(codepoint_range_t),
+        compare_codepoint_ranges);
+  int count = 0;
+  for (int i = 0; i < set->range_count; i++) {
+    codepoint_range_t range = set->ranges[i];
+    if (count > 0 && range.first <= set->ranges[count - 1].last + 1) {
+      if (range.last > set->ranges[count - 1].last) {
+        set->ranges[count - 1].last = range.last;
+      }
+    } else {
+      set->ranges[count++] = range;
+    }
+  }
+  set->range_count = count;
+
+  // Cut the surrogates out of the ranges
+  for (int i = 0; i < set->range_count; i++) {
+    codepoint_range_t range = set->ranges[i];
+    if (range.last < FIRST_SURROGATE || range.first > LAST_SURROGATE) {
+      continue;
+    }
+    if (range.first < FIRST_SURROGATE && range.last > LAST_SURROGATE) {
+      set->ranges[i].last = FIRST_SURROGATE - 1;
+      add_codepoint_range(set, LAST_SURROGATE + 1, range.last);
+      memmove(&set->ranges[i + 2], &set->ranges[i + 1],
+              (set->range_count - i - 2) * sizeof(codepoint_range_t));
+      set->ranges[i + 1].first = LAST_SURROGATE + 1;
+      set->ranges[i + 1].last = range.last;
+      i++;
+    } else if (range.first < FIRST_SURROGATE) {
+      set->ranges[i].last = FIRST_SURROGATE - 1;
+    } else if (range.last > LAST_SURROGATE) {
+      set->ranges[i].first = LAST_SURROGATE + 1;
+    } else {
+      memmove(&set->ranges[i], &set->ranges[i + 1],
+              (set->range_count - i - 1) * sizeof(codepoint_range_t));
+      set->range_count--;
+      i--;
+    }
+  }
+}
+
+void invert_codepoint_set(codepoint_set_t *set) {
+  codepoint_set_t inverse = create_codepoint_set();
+  int next = 0;
+  for (int i = 0; i < set->range_count; i++) {
+    if (set->ranges[i].first > next) {
+      add_codepoint_range(&inverse, next, set->ranges[i].first - 1);
+    }
+    next = set->ranges[i].last + 1;
+  }
+  if (next <= MAX_CODEPOINT) {
+    add_codepoint_range(&inverse, next, MAX_CODEPOINT);
+  }
+  normalize_codepoint_set(&inverse);
+  delete_codepoint_set(set);
+  *set = inverse;
+}
+
+void delete_codepoint_set(codepoint_set_t *set) {
+  free(set->ranges);
+  *set = create_codepoint_set();
+}
+
+int encode_utf8(int codepoint, unsigned char *bytes) {
+  if (codepoint < 0x80) {
+    bytes[0] = codepoint;
+    return 1;
+  }
+  if (codepoint < 0x800) {
+    bytes[0] = 0xc0 | (codepoint >> 6);
+    bytes[1] = 0x80 | (codepoint & 0x3f);
+    return 2;
+  }
+  if (codepoint < 0x10000) {
+    bytes[0] = 0xe0 | (codepoint >> 12);
+    bytes[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+    bytes[2] = 0x80 | (codepoint & 0x3f);
+    return 3;
+  }
+  bytes[0] = 0xf0 | (codepoint >> 18);
+  bytes[1] = 0x80 | ((codepoint >> 12) & 0x3f);
+  bytes[2] = 0x80 | ((codepoint >> 6) & 0x3f);
+  bytes[3] = 0x80 | (codepoint & 0x3f);
+  return 4;
+}
+
+static void add_utf8_sequence(utf8_sequences_t *sequences,
+                              unsigned char *first, unsigned char *last,
+                              int length) {
+  if (sequences->count == sequences->capacity) {
+    sequences->capacity =
+        sequences->capacity == 0 ? 16 : 2 * sequences->capacity;
+    sequences->sequences =
+        realloc(sequences->sequences,
+                sequences->capacity * sizeof(*sequences->sequences));
+    sequences->lengths =
+        realloc(sequences->lengths, sequences->capacity * sizeof(int));
+  }
+  for (int i = 0; i < length; i++) {
+    sequences->sequences[sequences->count][i].first = first[i];
+    sequences->sequences[sequences->count][i].last = last[i];
+  }
+  sequences->lengths[sequences->count++] = length;
+}
+
+/**
+ * Splits the codepoints from {@code first} to {@code last} into sequences of
+ * byte ranges, such that the encodings of the codepoints are exactly the
+ * byte strings matching one of the sequences. The sequences are added in
+ * order.
+ */
+static void split_utf8_range(int first, int last,
+                             utf8_sequences_t *sequences) {
+  // Split at the bounds of the encoding lengths
+  static const int LAST_OF_LENGTH[] = {0x7f, 0x7ff, 0xffff};
+  for (int n = 0; n < 3; n++) {
+    if (first <= LAST_OF_LENGTH[n] && last > LAST_OF_LENGTH[n]) {
+      split_utf8_range(first, LAST_OF_LENGTH[n], sequences);
+      split_utf8_range(LAST_OF_LENGTH[n] + 1, last, sequences);
+      return;
+    }
+  }
+  // Split, until every continuation byte either is fixed or covers the whole
+  // continuation range, once the bytes before it differ
+  for (int i = 1; i < MAX_UTF8_LENGTH; i++) {
+    int mask = (1 << (6 * i)) - 1;
+    if ((first & ~mask) == (last & ~mask)) {
+      continue;
+    }
+    if ((first & mask) != 0) {
+      split_utf8_range(first, first | mask, sequences);
+      split_utf8_range((first | mask) + 1, last, sequences);
+      return;
+    }
+    if ((last & mask) != mask) {
+      split_utf8_range(first, (last & ~mask) - 1, sequences);
+      split_utf8_range(last & ~mask, last, sequences);
+      return;
+    }
+  }
+  unsigned char first_bytes[MAX_UTF8_LENGTH];
+  unsigned char last_bytes[MAX_UTF8_LENGTH];
+  int length = encode_utf8(first, first_bytes);
+  encode_utf8(last, last_bytes);
+  add_utf8_sequence(sequences, first_bytes, last_bytes, length);
+}
+
+static unsigned long hash_transitions(utf8_trie_node_t *node) {
+  return hash_bytes(node->transitions,
+                    node->count * sizeof(utf8_transition_t), HASH_SEED);
+}
+
+/**
+ * Builds the given finished trie {@code node}, or returns an equal node which
+ * has been built before. Returns the index of the node in the automaton.
+ */
+static int build_trie_node(utf8_compiler_t *compiler, utf8_trie_node_t *node) {
+  unsigned long hash = hash_transitions(node);
+  int slot = hash & (compiler->built_capacity - 1);
+  while (compiler->built[slot].transitions != NULL) {
+    built_node_t *built = &compiler->built[slot];
+    if (built->hash == hash && built->count == node->count &&
+        memcmp(built->transitions, node->transitions,
+               node->count * sizeof(utf8_transition_t)) == 0) {
+      node->count = 0;
+      return built->node;
+    }
+    slot = (slot + 1) & (compiler->built_capacity - 1);
+  }
+
+  automaton_t *automaton = &compiler->automaton;
+  int index = create_node(automaton);
+  for (int i = 0; i < node->count; i++) {
+    utf8_transition_t *transition = &node->transitions[i];
+    for (int t = transition->range.first; t <= transition->range.last; t++) {
+      connect_nodes(automaton, index, transition->target, t, 0);
+    }
+  }
+  built_node_t *built = &compiler->built[slot];
+  built->hash = hash;
+  built->count = node->count;
+  built->node = index;
+  built->transitions = malloc(node->count * sizeof(utf8_transition_t));
+  memcpy(built->transitions, node->transitions,
+         node->count * sizeof(utf8_transition_t));
+  node->count = 0;
+  return index;
+}
+
+static void add_trie_transition(utf8_trie_node_t *node, byte_range_t range,
+                                int target) {
+  if (node->count == node->capacity) {
+    node->capacity = node->capacity == 0 ? 4 : 2 * node->capacity;
+    node->transitions =
+        realloc(node->transitions, node->capacity * sizeof(utf8_transition_t));
+  }
+  // Zero the padding, since transitions are hashed and compared bytewise
+  memset(&node->transitions[node->count], 0, sizeof(utf8_transition_t));
+  node->transitions[node->count].range = range;
+  node->transitions[node->count++].target = target;
+}
+
+/**
+ * Builds the nodes of the path below {@code depth}, which are finished.
+ */
+static void build_path_below(utf8_compiler_t *compiler, int depth) {
+  while (compiler->depth > depth + 1) {
+    compiler->depth--;
+    int node = build_trie_node(compiler, &compiler->path[compiler->depth]);
+    utf8_trie_node_t *parent = &compiler->path[compiler->depth - 1];
+    parent->transitions[parent->count - 1].target = node;
+  }
+}
+
+static void add_sequence_to_trie(utf8_compiler_t *compiler,
+                                 byte_range_t *sequence, int length) {
+  // Follow the common prefix with the path of the last sequence
+  int prefix = 0;
+  while (prefix < compiler->depth - 1 && prefix < length) {
+    utf8_trie_node_t *node = &compiler->path[prefix];
+    byte_range_t range = node->transitions[node->count - 1].range;
+    if (range.first != sequence[prefix].first ||
+        range.last != sequence[prefix].last) {
+      break;
+    }
+    prefix++;
+  }
+  build_path_below(compiler, prefix);
+  for (int i = prefix; i < length; i++) {
+    if (i == length - 1) {
+      add_trie_transition(&compiler->path[i], sequence[i],
+                          compiler->final_node);
+    } else {
+      add_trie_transition(&compiler->path[i], sequence[i], -1);
+      compiler->depth++;
+    }
+  }
+}
+
+automaton_t convert_codepoint_set_to_automaton(codepoint_set_t *set) {
+  utf8_sequences_t sequences = {.sequences = NULL, .lengths = NULL,
+                                .count = 0, .capacity = 0};
+  for (int i = 0; i < set->range_count; i++) {
+    split_utf8_range(set->ranges[i].first, set->ranges[i].last, &sequences);
+  }
+
+  // Every trie node is built at most once; the final node and the root
+  int node_count = 2;
+  for (int i = 0; i < sequences.count; i++) {
+    node_count += sequences.lengths[i];
+  }
+  utf8_compiler_t compiler = {.automaton = create_automaton(node_count),
+                              .depth = 1};
+  memset(compiler.path, 0, sizeof(compiler.path));
+  compiler.built_capacity = 16;
+  while (compiler.built_capacity < 2 * node_count) {
+    compiler.built_capacity *= 2;
+  }
+  compiler.built = calloc(compiler.built_capacity, sizeof(built_node_t));
+  compiler.final_node = create_node(&compiler.automaton);
+  compiler.automaton.nodes[compiler.final_node].end_tag = 0;
+
+  for (int i = 0; i < sequences.count; i++) {
+    add_sequence_to_trie(&compiler, sequences.sequences[i],
+                         sequences.lengths[i]);
+  }
+  build_path_below(&compiler, 0);
+  // The root is never shared, it may be entered by no transition
+  compiler.automaton.start_index = create_node(&compiler.automaton);
+  utf8_trie_node_t *root = &compiler.path[0];
+  for (int i = 0; i < root->count; i++) {
+    for (int t = root->transitions[i].range.first;
+         t <= root->transitions[i].range.last; t++) {
+      connect_nodes(&compiler.automaton, compiler.automaton.start_index,
+                    root->transitions[i].target, t, 0);
+    }
+  }
+
+  for (int i = 0; i <= MAX_UTF8_LENGTH; i++) {
+    free(compiler.path[i].transitions);
+  }
+  for (int slot = 0; slot < compiler.built_capacity; slot++) {
+    free(compiler.built[slot].transitions);
+  }
+  free(compiler.built);
+  free(sequences.sequences);
+  free(sequences.lengths);
+
+  // Drop the unused nodes and make sure the result is minimal
+  automaton_t trimmed = trim_automaton(&compiler.automaton);
+  delete_automaton(compiler.automaton);
+  automaton_t result = minimize(&trimmed);
+  delete_automaton(trimmed);
+  return result;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "automaton.h"
+#include "common.h"
+
+#define MAX_CODEPOINT 0x10ffff
+#define FIRST_SURROGATE 0xd800
+#define LAST_SURROGATE 0xdfff
+
+typedef struct codepoint_range {
+  int first;
+  int last; // inclusive
+} codepoint_range_t;
+
+/**
+ * A set of unicode codepoints as a list of ranges. Once normalized (see
+ * {@code normalize_codepoint_set}), the ranges are sorted, disjoint and not
+ * adjacent, and contain no surrogates.
+ */
+typedef struct codepoint_set {
+  codepoint_range_t *ranges;
+  int range_count;
+  int range_capacity;
+} codepoint_set_t;
+
+typedef struct unicode_category {
+  const char *name;      // e.g. Lu
+  const char *long_name; // e.g. Uppercase_Letter
+  const codepoint_range_t *ranges;
+  int range_count;
+} unicode_category_t;
+
+/**
+ * The general categories of the unicode character database (see
+ * unicode_categories.c), except for surrogates.
+ */
+extern const unicode_category_t UNICODE_CATEGORIES[];
+extern const int UNICODE_CATEGORY_COUNT;
+
+codepoint_set_t create_codepoint_set();
+
+/**
+ * Adds the codepoints from {@code first} to {@code last} (inclusive) to the
+ * given {@code set}. The set is not normalized afterwards.
+ */
+void add_codepoint_range(codepoint_set_t *set, int first, int last);
+
+/**
+ * Adds the codepoints of the general category or group of categories with the
+ * given {@code name} to the given {@code set}. Categories are named by their
+ * short (Lu) or long (Uppercase_Letter) names, groups by their first letter
+ * (L) or long names (Letter), and {@code Any} names all codepoints. Returns 1
+ * on success, 0 if there is no such category.
+ */
+bool_t add_unicode_category(codepoint_set_t *set, char *name);
+
+/**
+ * Sorts and merges the ranges of the given {@code set}, and removes
+ * surrogates.
+ */
+void normalize_codepoint_set(codepoint_set_t *set);
+
+/**
+ * Replaces the given normalized {@code set} by all codepoints (except
+ * surrogates), which are not in the set.
+ */
+void invert_codepoint_set(codepoint_set_t *set);
+
+void delete_codepoint_set(codepoint_set_t *set);
+
+/**
+ * Stores the UTF-8 encoding of the given {@code codepoint} into {@code bytes}
+ * and returns its length (1 to 4).
+ */
+int encode_utf8(int codepoint, unsigned char *bytes);
+
+/**
+ * Creates the minimal DFA over bytes, which accepts the UTF-8 encodings of the
+ * codepoints of the given normalized {@code set} (tagged with {@code 0}).
+ *
+ * The ranges are split into sequences of byte ranges (e.g. [Ѐ-ӿ] into
+ * [\xd0-\xd3][\x80-\xbf]), which are added in order to a trie, whose finished
+ * nodes are shared with equal nodes already built (suffix sharing). So the
+ * automaton stays small for large sets, and needs no decoding at match time.
+ */
+automaton_t convert_codepoint_set_to_automaton(codepoint_set_t *set);